@@ -223,6 +223,20 @@ bool EState<PT>::equivNdx(unsigned int i, unsigned int j) const {
 }
 
 
+template <class PT>
+tuple<VUI, VUI> EState<PT>::uniqueEquivNdx() const {
+  auto ns = vector<int>(pstns.size());
+  for (unsigned int i = 0; i < pstns.size(); i++) {
+    auto pi = (const EPosition<PT>*) (pstns[i]);
+    if (nullptr == pi) {
+      throw KException("EState<PT>::uniqueEquivNdx: pi is a null pointer");
+    }
+    ns[i] = pi->getIndex();
+  }
+  return KBase::ueIndicesByKey<int>(ns);
+}
+
+
 template <class PT>
 unsigned int EState<PT>::posNdx(const unsigned int i) const {
   if (i >= pstns.size()) {
@@ -414,14 +428,11 @@ EState<PT>* EState<PT>::doSUSN(ReportingLevel rl) const {
     // the stored pointers.
     // Cannot use State::equivNdx because the comparisons for index 'h'
     // use the hypothetical mph, not pstns[h]
-    auto equivHNdx = [this, h, eph](const unsigned int i, const unsigned int j) {
-      int ni = (i == h) ? eph.getIndex() : posNdx(i);
-      int nj = (j == h) ? eph.getIndex() : posNdx(j);
-      return (ni == nj);
-    };
-
-    auto ns = KBase::uiSeq(0, model->numAct - 1);
-    const VUI uNdx = get<0>(KBase::ueIndices<unsigned int>(ns, equivHNdx));
+    auto ns = vector<int>(model->numAct);
+    for (unsigned int i = 0; i < model->numAct; i++) {
+      ns[i] = (i == h) ? eph.getIndex() : posNdx(i);
+    }
+    const VUI uNdx = get<0>(KBase::ueIndicesByKey<int>(ns));
     const unsigned int numU = uNdx.size();
     auto hypUtil = KMatrix(eMod->numAct, numU);
     // we need now to go through 'uh', copying column J the first time
@@ -771,12 +782,6 @@ EState<PT>* EState<PT>::doMCN(ReportingLevel rl) const {
   const auto w = eMod->actorWeights(); // a row vector
   const unsigned int numNghbrs = neighbors.size();
 
-  // these two variables collect the results of a parallel search
-  // for the neighbor with highest Zeta
-  double bestZeta = 0.0; // all real zetas are positive
-  unsigned int bestNghbr = 0;
-  std::mutex nsEvalMutex;
-
   // somewhat more explicit than "auto"
   function < EState<PT>* (const VUI& , bool)>
       stateFromVUI = [this, numA, clearPstns] (const VUI& ni, bool autilP) {
@@ -799,49 +804,42 @@ EState<PT>* EState<PT>::doMCN(ReportingLevel rl) const {
     return ns;
   };
 
+  // due to round-off error, we must have a tolerance factor
+  auto assertUnitRange = [](const KMatrix & m) {
+    const double tol = 1E-10;
+    for (auto mij : m) {
+      if (!(0.0 <= mij + tol)) {
+        throw KException("EState<PT>::expUtilMat: lower limit crossed");
+      }
+      if (!(mij <= 1.0 + tol)) {
+        throw KException("EState<PT>::expUtilMat: upper limit crossed");
+      }
+    }
+    return;
+  };
 
-  function<void(unsigned int)> testNghbr =
-      [&neighbors, &w, &nsEvalMutex, &bestZeta, &bestNghbr, rl, numA, numP, this, stateFromVUI]
-      (unsigned int i) {
-    const auto rlNewEU = ReportingLevel::Silent;
-    const VUI ni = neighbors[i];
-    auto ns = stateFromVUI(ni, true);
+  // Build each neighboring state just long enough to get its matrix of
+  // utilities for unique positions. Their expected utilities are then those
+  // of expUtilMat, but with all the scalarPCEs done in one batch.
+  vector<KMatrix> uNghbr(numNghbrs);
+  function<void(unsigned int)> nghbrUtil =
+      [&neighbors, &uNghbr, numA, numP, stateFromVUI, assertUnitRange] (unsigned int i) {
+    auto ns = stateFromVUI(neighbors[i], true);
     const unsigned int numUi = ns->uIndices.size();
-
     auto uMati = ns->uMatH(0);
+    delete ns;
+    ns = nullptr;
     if (numA != uMati.numR()) {
       throw KException("EState<PT>::doMCN: uMati matrix doesn't have rows for each actor");
     }
     if (numUi != uMati.numC()) {
       throw KException("EState<PT>::doMCN: uMati matrix has wrong number of columns");
     }
-    auto eui = ns->expUtilMat(rlNewEU, numA, numP, eMod->vpm, uMati); // col-vec
-    double zi = dot(trans(w), eui);
-
-    // fast, critical section
-    nsEvalMutex.lock();
-    if (0.0 > bestZeta) {
-      throw KException("EState<PT>::doMCN: bestZeta must be non-negative");
-    }
-    if (0.0 >= zi) {
-      throw KException("EState<PT>::doMCN: zi must be positive");
-    }
-    double delta = (zi - bestZeta)/(zi + bestZeta);
-    // Empirically, delta seems to be either at least E-4, or at most 1E-13.
-    // So I put the cut-off two orders below "significant".
-    const double sigDelta = 1E-6;
-    if ((bestZeta < zi) && (delta > sigDelta)) {
-      bestZeta = zi;
-      bestNghbr = i;
-      if (ReportingLevel::Low < rl) {
-        LOG(INFO) << KBase::getFormattedString("New best neighbor is %u with z=%.4f (delta=%.2E)\n",
-               i, zi, delta);
-        KBase::printVUI(ni);
-      }
+    if (uMati.numC() > numP) { // might have dropped some duplicates
+      throw KException("EState<PT>::expUtilMat: column count of uMat must not be greater than numP");
     }
-    nsEvalMutex.unlock();
-    delete ns;
-    ns = nullptr;
+    assertUnitRange(uMati);
+    uNghbr[i] = std::move(uMati);
     return;
   };
   bool parP = KBase::testMultiThreadSQLite(false, rl);
@@ -860,11 +858,49 @@ EState<PT>* EState<PT>::doMCN(ReportingLevel rl) const {
   }
 
   if (parP) {
-    KBase::groupThreads(testNghbr, 0, numNghbrs-1);
+    KBase::groupThreads(nghbrUtil, 0, numNghbrs-1);
   }
   else {
     for (unsigned int i=0; i<numNghbrs; i++) {
-      testNghbr(i);
+      nghbrUtil(i);
+    }
+  }
+
+  auto uStack = KBase::UtilStack(numA);
+  for (auto & ui : uNghbr) {
+    uStack.add(ui);
+  }
+  uNghbr = {};
+  auto vr = vector<VotingRule>(numA);
+  for (unsigned int k = 0; k < numA; k++) {
+    vr[k] = ((const EActor<PT>*)(eMod->actrs[k]))->vr;
+  }
+  const auto pNghbr = Model::scalarPCEBatch(uStack, w, vr, vpm, eMod->pcem, nullptr, nullptr, eMod->pceSolver);
+
+  // the neighbor with highest Zeta, taken in order so the choice does not
+  // depend on the threads
+  double bestZeta = 0.0; // all real zetas are positive
+  unsigned int bestNghbr = 0;
+  for (unsigned int i = 0; i < numNghbrs; i++) {
+    const auto eui = uStack.matrix(i) * pNghbr[i]; // col-vec
+    assertUnitRange(eui);
+    double zi = dot(trans(w), eui);
+
+    if (0.0 >= zi) {
+      throw KException("EState<PT>::doMCN: zi must be positive");
+    }
+    double delta = (zi - bestZeta)/(zi + bestZeta);
+    // Empirically, delta seems to be either at least E-4, or at most 1E-13.
+    // So I put the cut-off two orders below "significant".
+    const double sigDelta = 1E-6;
+    if ((bestZeta < zi) && (delta > sigDelta)) {
+      bestZeta = zi;
+      bestNghbr = i;
+      if (ReportingLevel::Low < rl) {
+        LOG(INFO) << KBase::getFormattedString("New best neighbor is %u with z=%.4f (delta=%.2E)\n",
+               i, zi, delta);
+        KBase::printVUI(neighbors[i]);
+      }
     }
   }
 
@@ -975,16 +1011,18 @@ tuple <KMatrix, VUI> EState<PT>::pDist(int persp) const {
   // cout << "uMatH passed" << endl << flush;
 
   // vote_k ( i : j )
-  auto vkij = [this, uMat](unsigned int k, unsigned int i, unsigned int j) {
+  auto vr = vector<VotingRule>(uMat.numR());
+  auto w = KMatrix(1, uMat.numR());
+  for (unsigned int k = 0; k < uMat.numR(); k++) {
     auto ak = (EActor<PT>*)(eMod->actrs[k]);
-    auto v_kij = Model::vote(ak->vr, ak->sCap, uMat(k, i), uMat(k, j));
-    return v_kij;
-  };
+    vr[k] = ak->vr;
+    w(0, k) = ak->sCap;
+  }
 
   // the following uses exactly the values in the given expected
   // utility matrix, which is usually NOT square
-  const auto c = Model::coalitions(vkij, uMat.numR(), uMat.numC());
-  const auto ppv = Model::probCE2(eMod->pcem, eMod->vpm, c);
+  const auto c = Model::coalitions(vr, w, uMat);
+  const auto ppv = Model::probCE2(eMod->pcem, eMod->vpm, c, KMatrix(), eMod->pceSolver);
   const auto p = get<0>(ppv); // column
   //const auto pv = get<1>(ppv); // square
   const auto eu = uMat*p; // column
@@ -1045,17 +1083,19 @@ KMatrix EState<PT>::expUtilMat  (KBase::ReportingLevel rl,
   KMatrix::mapV(uRng, uMat.numR(), uMat.numC());
 
   // vote_k(i:j)
-  auto vkij = [this, uMat](unsigned int k, unsigned int i, unsigned int j) {
+  auto vr = vector<VotingRule>(uMat.numR());
+  auto w = KMatrix(1, uMat.numR());
+  for (unsigned int k = 0; k < uMat.numR(); k++) {
     auto ak = (const EActor<PT>*)(eMod->actrs[k]);
-    auto v_kij = Model::vote(ak->vr, ak->sCap, uMat(k, i), uMat(k, j));
-    return v_kij;
-  };
+    vr[k] = ak->vr;
+    w(0, k) = ak->sCap;
+  }
 
   // the following uses exactly the values in the given expected
   // utility matrix, which is usually NOT square
-  const auto c = Model::coalitions(vkij, uMat.numR(), uMat.numC());
+  const auto c = Model::coalitions(vr, w, uMat);
   // use whatever 'vpm' was supplied
-  const auto ppv = Model::probCE2(eMod->pcem, vpm, c);
+  const auto ppv = Model::probCE2(eMod->pcem, vpm, c, KMatrix(), eMod->pceSolver);
   const auto p = get<0>(ppv); // column
   const auto pv = get<1>(ppv); // square
   const auto eu = uMat*p; // column
@@ -177,6 +177,9 @@ protected:
   virtual EState<PT>* makeNewEState() const = 0;
   virtual void setAllAUtil(ReportingLevel rl) = 0;
 
+  // positions are equivalent when they have the same index into Theta, so look them up by index
+  virtual tuple<VUI, VUI> uniqueEquivNdx() const;
+
   // Calculate the values to the actors of the tj-th option, theta[j].
   // This needs to be done for any possible position, not just those
   // currently advocated.
@@ -0,0 +1,188 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "kutils.h"
+#include "kcheckpoint.h"
+
+namespace KBase {
+
+namespace {
+const char magic[8] = { 'K', 'T', 'A', 'B', 'C', 'K', 'P', '1' };
+
+void putLE(string & buf, uint64_t v, unsigned int n) {
+  for (unsigned int k = 0; k < n; k++) {
+    buf += (char)((v >> (8 * k)) & 0xFF);
+  }
+}
+
+uint64_t getLE(const unsigned char * p, unsigned int n) {
+  uint64_t v = 0;
+  for (unsigned int k = 0; k < n; k++) {
+    v |= ((uint64_t)p[k]) << (8 * k);
+  }
+  return v;
+}
+
+uint64_t fnv1a(const string & s) {
+  uint64_t h = 0xCBF29CE484222325;
+  for (const char c : s) {
+    h = (h ^ (unsigned char)c) * 0x100000001B3;
+  }
+  return h;
+}
+}
+
+void CheckpointWriter::u32(uint32_t v) {
+  putLE(buf, v, 4);
+}
+
+void CheckpointWriter::u64(uint64_t v) {
+  putLE(buf, v, 8);
+}
+
+void CheckpointWriter::f64(double v) {
+  uint64_t b = 0;
+  std::memcpy(&b, &v, sizeof(b));
+  putLE(buf, b, 8);
+}
+
+void CheckpointWriter::str(const string & s) {
+  u32(s.size());
+  buf += s;
+}
+
+void CheckpointWriter::matrix(const KMatrix & m) {
+  u32(m.numR());
+  u32(m.numC());
+  for (unsigned int i = 0; i < m.numR(); i++) {
+    for (unsigned int j = 0; j < m.numC(); j++) {
+      f64(m(i, j));
+    }
+  }
+}
+
+void CheckpointWriter::save(const string & path) const {
+  string hdr(magic, sizeof(magic));
+  putLE(hdr, buf.size(), 8);
+  string tail = "";
+  putLE(tail, fnv1a(buf), 8);
+
+  const string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(hdr.data(), hdr.size());
+    out.write(buf.data(), buf.size());
+    out.write(tail.data(), tail.size());
+    out.close();
+    if (!out.good()) {
+      std::remove(tmp.c_str());
+      throw KException("CheckpointWriter::save: could not write " + tmp);
+    }
+  }
+  // rename replaces the old checkpoint at once where it can (POSIX), but not on Windows
+  if (0 != std::rename(tmp.c_str(), path.c_str())) {
+    std::remove(path.c_str());
+    if (0 != std::rename(tmp.c_str(), path.c_str())) {
+      throw KException("CheckpointWriter::save: could not rename " + tmp + " to " + path);
+    }
+  }
+  return;
+}
+
+
+CheckpointReader::CheckpointReader(const string & p) : path(p) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.good()) {
+    throw KException("CheckpointReader: could not open " + path);
+  }
+  const string all((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  const size_t hdrLen = sizeof(magic) + 8;
+  if ((all.size() < hdrLen + 8) || (0 != all.compare(0, sizeof(magic), magic, sizeof(magic)))) {
+    throw KException("CheckpointReader: " + path + " is not a checkpoint");
+  }
+  auto bytes = (const unsigned char *)all.data();
+  const uint64_t n = getLE(bytes + sizeof(magic), 8);
+  if (all.size() - hdrLen - 8 != n) {
+    throw KException("CheckpointReader: " + path + " is truncated or corrupt");
+  }
+  buf = all.substr(hdrLen, n);
+  if (fnv1a(buf) != getLE(bytes + hdrLen + n, 8)) {
+    throw KException("CheckpointReader: " + path + " is corrupt");
+  }
+}
+
+const unsigned char * CheckpointReader::take(size_t n) {
+  if (buf.size() - at < n) {
+    throw KException("CheckpointReader: " + path + " ends too soon");
+  }
+  auto p = ((const unsigned char *)buf.data()) + at;
+  at += n;
+  return p;
+}
+
+uint32_t CheckpointReader::u32() {
+  return (uint32_t)getLE(take(4), 4);
+}
+
+uint64_t CheckpointReader::u64() {
+  return getLE(take(8), 8);
+}
+
+double CheckpointReader::f64() {
+  const uint64_t b = u64();
+  double v = 0.0;
+  std::memcpy(&v, &b, sizeof(v));
+  return v;
+}
+
+string CheckpointReader::str() {
+  const uint32_t n = u32();
+  auto p = take(n);
+  return string((const char *)p, n);
+}
+
+KMatrix CheckpointReader::matrix() {
+  const unsigned int nr = u32();
+  const unsigned int nc = u32();
+  if ((buf.size() - at) / 8 < ((uint64_t)nr) * nc) {
+    throw KException("CheckpointReader: " + path + " ends too soon");
+  }
+  auto m = KMatrix(nr, nc);
+  for (unsigned int i = 0; i < nr; i++) {
+    for (unsigned int j = 0; j < nc; j++) {
+      m(i, j) = f64();
+    }
+  }
+  return m;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
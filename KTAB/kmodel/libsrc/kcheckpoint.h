@@ -0,0 +1,95 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// A checkpoint holds what a model needs to continue a run exactly where it
+// left off. The model decides what goes in it, and in what order; these
+// classes only store numbers, strings and matrices, one after another.
+//
+// Layout (little-endian):
+//
+//   "KTABCKP1", u64 payload bytes, payload, u64 FNV-1a hash of the payload
+//
+// Integers take 4 or 8 bytes, doubles their 8 bytes of IEEE bits (so they
+// come back exactly), strings a u32 length and then their bytes, and a
+// matrix its u32 rows and columns and then its values, row by row.
+//
+// The file is written under a temporary name and then renamed, so a run
+// interrupted while saving still has its previous checkpoint.
+// -------------------------------------------------
+#ifndef KTAB_CHECKPOINT_H
+#define KTAB_CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+
+#include "kmatrix.h"
+
+namespace KBase {
+using std::string;
+
+class CheckpointWriter {
+public:
+  CheckpointWriter() {};
+
+  void u32(uint32_t v);
+  void u64(uint64_t v);
+  void f64(double v);
+  void str(const string & s);
+  void matrix(const KMatrix & m);
+
+  // throws KException if the file cannot be written
+  void save(const string & path) const;
+
+protected:
+  string buf = "";
+};
+
+
+class CheckpointReader {
+public:
+  // reads the whole file, throwing KException if it is missing, truncated or corrupt
+  explicit CheckpointReader(const string & path);
+
+  // each throws KException if the payload ends first
+  uint32_t u32();
+  uint64_t u64();
+  double f64();
+  string str();
+  KMatrix matrix();
+
+  bool atEnd() const { return at == buf.size(); }
+
+protected:
+  const unsigned char * take(size_t n);
+
+  string path = "";
+  string buf = ""; // the payload
+  size_t at = 0;
+};
+
+} // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
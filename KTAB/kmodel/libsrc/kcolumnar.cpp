@@ -0,0 +1,525 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+
+#include <cstring>
+
+#include "kutils.h"
+#include "kcolumnar.h"
+
+#include <QFile>
+
+namespace KBase {
+
+namespace {
+const char magic[8] = { 'K', 'T', 'A', 'B', 'C', 'O', 'L', '1' };
+const uint32_t dictBlock = 1;
+const uint32_t rowsBlock = 2;
+
+enum class Enc : uint8_t { Plain = 0, Delta = 1, Code = 2 };
+
+void putLE(string & buf, uint64_t v, unsigned int n) {
+  for (unsigned int k = 0; k < n; k++) {
+    buf += (char)((v >> (8 * k)) & 0xFF);
+  }
+}
+
+uint64_t getLE(const unsigned char * p, unsigned int n) {
+  uint64_t v = 0;
+  for (unsigned int k = 0; k < n; k++) {
+    v |= ((uint64_t)p[k]) << (8 * k);
+  }
+  return v;
+}
+
+void pad8(string & buf) {
+  while (0 != (buf.size() % 8)) {
+    buf += '\0';
+  }
+}
+
+unsigned int bitWidth(uint64_t x) {
+  unsigned int w = 0;
+  while (0 != x) {
+    w++;
+    x >>= 1;
+  }
+  return w;
+}
+
+// w bits per value, filling u64 words from the least significant bit
+void putPacked(string & buf, const vector<uint64_t> & u, unsigned int w) {
+  if (0 == w) {
+    return;
+  }
+  vector<uint64_t> words(((uint64_t)u.size() * w + 63) / 64, 0);
+  for (size_t k = 0; k < u.size(); k++) {
+    const uint64_t pos = (uint64_t)k * w;
+    const unsigned int off = pos % 64;
+    words[pos / 64] |= u[k] << off;
+    if (64 < off + w) {
+      words[pos / 64 + 1] |= u[k] >> (64 - off);
+    }
+  }
+  for (const uint64_t x : words) {
+    putLE(buf, x, 8);
+  }
+}
+
+// Reads what the file holds, checking every length against its end.
+class Cursor {
+public:
+  Cursor(const unsigned char * b, size_t n, const string & f) : start(b), p(b), end(b + n), file(f) {};
+
+  const unsigned char * take(size_t n) {
+    if ((size_t)(end - p) < n) {
+      throw KException("ColumnarReader: " + file + " is truncated or corrupt");
+    }
+    const unsigned char * q = p;
+    p += n;
+    return q;
+  }
+  uint64_t le(unsigned int n) { return getLE(take(n), n); }
+  void align() { take((8 - (pos() % 8)) % 8); }
+  size_t pos() const { return (size_t)(p - start); }
+  bool done() const { return p == end; }
+
+protected:
+  const unsigned char * const start;
+  const unsigned char * p;
+  const unsigned char * const end;
+  const string file;
+};
+
+vector<uint64_t> getPacked(Cursor & c, size_t n, unsigned int w) {
+  vector<uint64_t> u(n, 0);
+  if (0 == w) {
+    return u;
+  }
+  if (64 < w) {
+    throw KException("ColumnarReader: bad bit width");
+  }
+  const size_t nw = ((uint64_t)n * w + 63) / 64;
+  const unsigned char * bytes = c.take(8 * nw);
+  vector<uint64_t> words(nw + 1, 0); // one spare, so a value may always read the next word
+  for (size_t k = 0; k < nw; k++) {
+    words[k] = getLE(bytes + 8 * k, 8);
+  }
+  const uint64_t mask = (64 == w) ? ~(uint64_t)0 : ((((uint64_t)1) << w) - 1);
+  for (size_t k = 0; k < n; k++) {
+    const uint64_t pos = (uint64_t)k * w;
+    const unsigned int off = pos % 64;
+    uint64_t v = words[pos / 64] >> off;
+    if (0 != off) {
+      v |= words[pos / 64 + 1] << (64 - off);
+    }
+    u[k] = v & mask;
+  }
+  return u;
+}
+}
+
+// --------------------------------------------
+
+void ColumnData::addNull() {
+  if (Kind::Real == kind) {
+    reals.push_back(0.0);
+  }
+  else {
+    ints.push_back(0);
+  }
+  null.push_back(1);
+}
+
+int64_t ColumnData::code(const string & v) {
+  if (codes.size() != dict.size()) {
+    codes.clear();
+    for (size_t n = 0; n < dict.size(); n++) {
+      codes[dict[n]] = n;
+    }
+  }
+  auto it = codes.find(v);
+  if (codes.end() == it) {
+    it = codes.insert({ v, (int64_t)dict.size() }).first;
+    dict.push_back(v);
+  }
+  return it->second;
+}
+
+// --------------------------------------------
+
+ColumnarWriter::ColumnarWriter(const string & p, const vector<string> & names,
+                               const vector<ColumnData::Kind> & ks) : path(p), kinds(ks) {
+  if (names.size() != kinds.size()) {
+    throw KException("ColumnarWriter: need one kind per column");
+  }
+  dicts.resize(kinds.size());
+
+  bool exists = false;
+  {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    exists = in.good() && (0 < in.tellg());
+  }
+  if (exists) {
+    ColumnarReader r(path);
+    if (r.names() != names) {
+      throw KException("ColumnarWriter: " + path + " holds different columns");
+    }
+    for (unsigned int k = 0; k < kinds.size(); k++) {
+      if (r.columns()[k].kind != kinds[k]) {
+        throw KException("ColumnarWriter: " + path + " holds different column types");
+      }
+      const auto & d = r.columns()[k].dict;
+      for (uint32_t c = 0; c < d.size(); c++) {
+        dicts[k][d[c]] = c;
+      }
+    }
+  }
+
+  out.open(path, std::ios::binary | std::ios::app);
+  if (!out.good()) {
+    throw KException("ColumnarWriter: could not open " + path);
+  }
+  if (!exists) {
+    string hdr(magic, sizeof(magic));
+    putLE(hdr, names.size(), 4);
+    putLE(hdr, 0, 4);
+    for (unsigned int k = 0; k < names.size(); k++) {
+      putLE(hdr, (uint8_t)kinds[k], 1);
+      putLE(hdr, 0, 1);
+      putLE(hdr, names[k].size(), 2);
+      hdr += names[k];
+    }
+    pad8(hdr);
+    out.write(hdr.data(), hdr.size());
+  }
+}
+
+ColumnarWriter::~ColumnarWriter() {
+}
+
+void ColumnarWriter::putBlock(uint32_t type, uint32_t count, const string & payload) {
+  string hdr = "";
+  putLE(hdr, type, 4);
+  putLE(hdr, count, 4);
+  putLE(hdr, payload.size(), 8);
+  out.write(hdr.data(), hdr.size());
+  out.write(payload.data(), payload.size());
+}
+
+void ColumnarWriter::append(const vector<ColumnData> & cols) {
+  if (cols.size() != kinds.size()) {
+    throw KException("ColumnarWriter::append: wrong number of columns for " + path);
+  }
+  const size_t n = cols.empty() ? 0 : cols[0].size();
+  if (0 == n) {
+    return;
+  }
+  if (0xFFFFFFFF < n) {
+    throw KException("ColumnarWriter::append: too many rows in one block");
+  }
+
+  string rows = "";
+  for (unsigned int k = 0; k < cols.size(); k++) {
+    const ColumnData & c = cols[k];
+    if ((c.kind != kinds[k]) || (c.size() != n)) {
+      throw KException("ColumnarWriter::append: column " + std::to_string(k) + " does not match for " + path);
+    }
+    bool hasNulls = false;
+    for (const uint8_t x : c.null) {
+      hasNulls = hasNulls || (0 != x);
+    }
+
+    Enc enc = Enc::Plain;
+    uint64_t first = 0;
+    uint64_t step = 0;
+    vector<uint64_t> u = {};
+    switch (c.kind) {
+    case ColumnData::Kind::Real:
+      break;
+
+    case ColumnData::Kind::Int: {
+      // a NULL repeats the row before it, so it costs nothing to pack
+      enc = Enc::Delta;
+      vector<uint64_t> e(n, 0);
+      size_t k0 = 0;
+      while ((k0 < n) && (0 != c.null[k0])) {
+        k0++;
+      }
+      uint64_t prev = (k0 < n) ? (uint64_t)c.ints[k0] : 0;
+      for (size_t r = 0; r < n; r++) {
+        e[r] = (0 != c.null[r]) ? prev : (uint64_t)c.ints[r];
+        prev = e[r];
+      }
+      first = e[0];
+      u.resize(n - 1);
+      int64_t minD = 0;
+      for (size_t r = 1; r < n; r++) {
+        u[r - 1] = e[r] - e[r - 1]; // wraps, as does decoding
+        minD = ((1 == r) || ((int64_t)u[r - 1] < minD)) ? (int64_t)u[r - 1] : minD;
+      }
+      step = (uint64_t)minD;
+      for (auto & x : u) {
+        x -= step;
+      }
+      break;
+    }
+
+    case ColumnData::Kind::Text: {
+      // the file's code for each of the column's own
+      enc = Enc::Code;
+      string newEntries = "";
+      uint32_t numNew = 0;
+      vector<uint64_t> fileCode(c.dict.size(), 0);
+      for (size_t d = 0; d < c.dict.size(); d++) {
+        auto it = dicts[k].find(c.dict[d]);
+        if (dicts[k].end() == it) {
+          if (0xFFFFFFFF < c.dict[d].size()) {
+            throw KException("ColumnarWriter::append: text too long");
+          }
+          it = dicts[k].insert({ c.dict[d], (uint32_t)dicts[k].size() }).first;
+          putLE(newEntries, c.dict[d].size(), 4);
+          newEntries += c.dict[d];
+          numNew++;
+        }
+        fileCode[d] = it->second;
+      }
+      if (0 < numNew) {
+        string payload = "";
+        putLE(payload, k, 4);
+        putLE(payload, 0, 4);
+        payload += newEntries;
+        pad8(payload);
+        putBlock(dictBlock, numNew, payload);
+      }
+      u.resize(n);
+      bool any = false;
+      for (size_t r = 0; r < n; r++) {
+        if (0 == c.null[r]) {
+          u[r] = fileCode.at(c.ints[r]);
+          step = (!any || (u[r] < step)) ? u[r] : step;
+          any = true;
+        }
+      }
+      for (size_t r = 0; r < n; r++) {
+        u[r] = (0 != c.null[r]) ? 0 : (u[r] - step);
+      }
+      break;
+    }
+    }
+
+    uint64_t maxU = 0;
+    for (const uint64_t x : u) {
+      maxU = (x > maxU) ? x : maxU;
+    }
+    const unsigned int w = bitWidth(maxU);
+
+    putLE(rows, (uint8_t)enc, 1);
+    putLE(rows, w, 1);
+    putLE(rows, hasNulls ? 1 : 0, 1);
+    putLE(rows, 0, 5);
+    putLE(rows, first, 8);
+    putLE(rows, step, 8);
+    if (hasNulls) {
+      vector<uint64_t> bits(n);
+      for (size_t r = 0; r < n; r++) {
+        bits[r] = c.null[r];
+      }
+      putPacked(rows, bits, 1);
+    }
+    if (Enc::Plain == enc) {
+      for (const double x : c.reals) {
+        uint64_t b = 0;
+        std::memcpy(&b, &x, sizeof(b));
+        putLE(rows, b, 8);
+      }
+    }
+    else {
+      putPacked(rows, u, w);
+    }
+  }
+  putBlock(rowsBlock, (uint32_t)n, rows);
+  out.flush();
+  if (!out.good()) {
+    throw KException("ColumnarWriter::append: could not write " + path);
+  }
+  return;
+}
+
+// --------------------------------------------
+
+ColumnarReader::ColumnarReader(const string & p) : path(p) {
+  QFile f(QString::fromStdString(path));
+  if (!f.open(QIODevice::ReadOnly)) {
+    throw KException("ColumnarReader: could not open " + path);
+  }
+  const qint64 n = f.size();
+  if (n < (qint64)sizeof(magic)) {
+    throw KException("ColumnarReader: " + path + " is not a columnar file");
+  }
+  // map it where possible; otherwise read it
+  const uchar * m = f.map(0, n);
+  if (nullptr != m) {
+    parse(m, (size_t)n);
+    f.unmap(const_cast<uchar *>(m));
+  }
+  else {
+    const QByteArray all = f.readAll();
+    parse((const unsigned char *)all.constData(), (size_t)all.size());
+  }
+  f.close();
+}
+
+void ColumnarReader::parse(const unsigned char * p, size_t n) {
+  Cursor c(p, n, path);
+  if (0 != std::memcmp(c.take(sizeof(magic)), magic, sizeof(magic))) {
+    throw KException("ColumnarReader: " + path + " is not a columnar file");
+  }
+  const uint64_t nc = c.le(4);
+  c.le(4);
+  for (uint64_t k = 0; k < nc; k++) {
+    const uint64_t kind = c.le(1);
+    c.le(1);
+    const uint64_t len = c.le(2);
+    if (2 < kind) {
+      throw KException("ColumnarReader: " + path + " has an unknown column type");
+    }
+    colNames.push_back(string((const char *)c.take(len), len));
+    cols.push_back(ColumnData((ColumnData::Kind)kind));
+  }
+  c.align();
+
+  // size the columns once, from the block headers
+  {
+    Cursor scan = c;
+    uint64_t total = 0;
+    while (!scan.done()) {
+      const uint64_t type = scan.le(4);
+      const uint64_t count = scan.le(4);
+      scan.take(scan.le(8));
+      total += (rowsBlock == type) ? count : 0;
+    }
+    for (auto & col : cols) {
+      col.null.reserve(total);
+      if (ColumnData::Kind::Real == col.kind) {
+        col.reals.reserve(total);
+      }
+      else {
+        col.ints.reserve(total);
+      }
+    }
+  }
+
+  while (!c.done()) {
+    const uint64_t type = c.le(4);
+    const uint64_t count = c.le(4);
+    const uint64_t size = c.le(8);
+    const size_t blockEnd = c.pos() + size;
+
+    if (dictBlock == type) {
+      const uint64_t k = c.le(4);
+      c.le(4);
+      if ((nc <= k) || (ColumnData::Kind::Text != cols[k].kind)) {
+        throw KException("ColumnarReader: " + path + " has a dictionary for a non-text column");
+      }
+      for (uint64_t e = 0; e < count; e++) {
+        const uint64_t len = c.le(4);
+        cols[k].dict.push_back(string((const char *)c.take(len), len));
+      }
+    }
+    else if (rowsBlock == type) {
+      for (uint64_t k = 0; k < nc; k++) {
+        ColumnData & col = cols[k];
+        const Enc enc = (Enc)c.le(1);
+        const unsigned int w = (unsigned int)c.le(1);
+        const bool hasNulls = (0 != c.le(1));
+        c.take(5);
+        const uint64_t first = c.le(8);
+        const uint64_t step = c.le(8);
+        vector<uint64_t> isNull(count, 0);
+        if (hasNulls) {
+          isNull = getPacked(c, count, 1);
+        }
+
+        if ((ColumnData::Kind::Real == col.kind) && (Enc::Plain == enc)) {
+          for (uint64_t r = 0; r < count; r++) {
+            const uint64_t b = c.le(8);
+            double x = 0.0;
+            std::memcpy(&x, &b, sizeof(x));
+            if (0 != isNull[r]) {
+              col.addNull();
+            }
+            else {
+              col.add(x);
+            }
+          }
+        }
+        else if ((ColumnData::Kind::Int == col.kind) && (Enc::Delta == enc)) {
+          const vector<uint64_t> u = getPacked(c, (0 < count) ? (count - 1) : 0, w);
+          uint64_t v = first;
+          for (uint64_t r = 0; r < count; r++) {
+            v = (0 == r) ? first : (v + step + u[r - 1]);
+            if (0 != isNull[r]) {
+              col.addNull();
+            }
+            else {
+              col.add((int64_t)v);
+            }
+          }
+        }
+        else if ((ColumnData::Kind::Text == col.kind) && (Enc::Code == enc)) {
+          const vector<uint64_t> u = getPacked(c, count, w);
+          for (uint64_t r = 0; r < count; r++) {
+            if (0 != isNull[r]) {
+              col.addNull();
+              continue;
+            }
+            const uint64_t code = u[r] + step;
+            if (col.dict.size() <= code) {
+              throw KException("ColumnarReader: " + path + " uses a code missing from its dictionary");
+            }
+            col.ints.push_back((int64_t)code);
+            col.null.push_back(0);
+          }
+        }
+        else {
+          throw KException("ColumnarReader: " + path + " has an unknown column encoding");
+        }
+      }
+    }
+    else {
+      throw KException("ColumnarReader: " + path + " has an unknown block type");
+    }
+
+    if (c.pos() > blockEnd) {
+      throw KException("ColumnarReader: " + path + " is truncated or corrupt");
+    }
+    c.take(blockEnd - c.pos());
+  }
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
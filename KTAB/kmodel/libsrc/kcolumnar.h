@@ -0,0 +1,138 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// A columnar file format for the append-only result tables, one file per
+// table and scenario, as an alternative to storing their rows in SQL.
+//
+// Layout (little-endian; every block starts on an 8-byte boundary, so a
+// file can be memory-mapped and read in place):
+//
+//   header:  "KTABCOL1", u32 number of columns, u32 0,
+//            then per column: u8 kind, u8 0, u16 name length, name;
+//            padded to 8 bytes
+//   blocks:  u32 type, u32 count, u64 payload bytes (a multiple of 8), payload
+//
+//   Dict block (type 1): new dictionary entries for one text column, whose
+//     codes continue from the previous Dict block of that column.
+//     Payload: u32 column, u32 0, then per entry: u32 length, bytes.
+//   Rows block (type 2): count rows, as one chunk per column.
+//     Chunk: u8 encoding, u8 bit width, u8 has-nulls, 5 zero bytes,
+//            i64 first, i64 step; then, with nulls, one bit per row (set
+//            for NULL) in u64 words; then the values.
+//     Reals are stored as they are. Integers are stored as the difference
+//     from the previous row, less the smallest such difference (step), in
+//     width bits each. Text is stored as dictionary codes, less the
+//     smallest code (step), in width bits each. Packing fills u64 words
+//     from the least significant bit. A column holding one value, such as
+//     ScenarioId, needs zero bits.
+//
+// A file is only ever appended to. Each Rows block is written after the
+// Dict blocks which its codes need.
+// -------------------------------------------------
+#ifndef KTAB_COLUMNAR_H
+#define KTAB_COLUMNAR_H
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace KBase {
+using std::string;
+using std::vector;
+
+// The values of one column, for a run of rows. Text is held as codes, in
+// ints, into the column's dictionary. A NULL row holds 0 there.
+class ColumnData {
+public:
+  enum class Kind : uint8_t { Int = 0, Real = 1, Text = 2 };
+
+  explicit ColumnData(Kind k = Kind::Int) : kind(k) {};
+
+  size_t size() const { return null.size(); }
+  void addNull();
+  void add(int64_t v) { ints.push_back(v); null.push_back(0); }
+  void add(double v) { reals.push_back(v); null.push_back(0); }
+  void add(const string & v) { ints.push_back(code(v)); null.push_back(0); }
+  const string & textAt(size_t r) const { return dict[ints[r]]; }
+
+  // v's index in dict, adding it if it is new
+  int64_t code(const string & v);
+
+  Kind kind = Kind::Int;
+  vector<int64_t> ints = {};
+  vector<double> reals = {};
+  vector<string> dict = {};
+  vector<uint8_t> null = {}; // 1 for NULL
+
+protected:
+  std::map<string, int64_t> codes = {};
+};
+
+
+// Appends blocks of rows to one file, creating it with the given columns
+// if it does not exist. An existing file must have the same columns;
+// its dictionaries are read back so that codes stay consistent.
+class ColumnarWriter {
+public:
+  ColumnarWriter(const string & path, const vector<string> & names,
+                 const vector<ColumnData::Kind> & kinds);
+  ~ColumnarWriter();
+
+  // one column per name, all of the same size; throws KException on failure
+  void append(const vector<ColumnData> & cols);
+
+protected:
+  void putBlock(uint32_t type, uint32_t count, const string & payload);
+
+  string path = "";
+  vector<ColumnData::Kind> kinds = {};
+  vector<std::map<string, uint32_t>> dicts = {}; // per column; empty unless Text
+  std::ofstream out;
+};
+
+
+// Reads a whole file, mapping it into memory where the platform allows.
+class ColumnarReader {
+public:
+  explicit ColumnarReader(const string & path); // throws KException if it is not a valid file
+
+  const vector<string> & names() const { return colNames; }
+  const vector<ColumnData> & columns() const { return cols; }
+  size_t numRows() const { return cols.empty() ? 0 : cols[0].size(); }
+
+protected:
+  void parse(const unsigned char * p, size_t n);
+
+  string path = "";
+  vector<string> colNames = {};
+  vector<ColumnData> cols = {};
+};
+
+} // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
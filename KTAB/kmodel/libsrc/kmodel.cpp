@@ -24,8 +24,10 @@
 //#include <assert.h>
 #include <easylogging++.h>
 
+#include <atomic>
 #include <time.h>
 #include "kmodel.h"
+#include "threadpool.h"
 
 namespace KBase {
 
@@ -56,12 +58,8 @@ Model::Model(string desc, uint64_t sd, vector<bool> f, string Name) {
   stop = nullptr;
   rng = nullptr;
 
-  sqlFlags = f; // JAH 20160730 save the vec of SQL flags
-  LOG(INFO) << "SQL Logging Flags ";
-  for (unsigned int i = 0; i < sqlFlags.size(); i++)
-  {
-    LOG(INFO) << "Grp" << i << "=" << (sqlFlags[i] ? 1 : 0); // "a<<b?c:d" was "suspicious code"
-  }
+  logPolicy = LogPolicy(f); // JAH 20160730 save the vec of SQL flags
+  // what is recorded of each table is logged by setLogPolicy, as --log clauses may override f
 
   // Record the UTC time so it can be used as the default scenario name
   std::chrono::time_point<std::chrono::system_clock> st;
@@ -100,7 +98,9 @@ Model::Model(string desc, uint64_t sd, vector<bool> f, string Name) {
     scenName = Name;
   }
 
-  sprintf(utcBuffId, "%s_%u", scenName.c_str(), microSeconds);
+  // models made at the same microsecond, e.g. by concurrent runs, still get distinct IDs
+  static std::atomic<unsigned int> modelCount(0);
+  sprintf(utcBuffId, "%s_%u_%u", scenName.c_str(), microSeconds, modelCount++);
 
   delete utcBuff;
   utcBuff = nullptr;
@@ -147,7 +147,9 @@ uint64_t Model::getSeed() const {
 Model::~Model() {
   while (0 < history.size()) {
     State* s = history[history.size() - 1];
-    delete s;
+    if (forkTurn < history.size()) { // the parent deletes the states it shares
+      delete s;
+    }
     history.pop_back();
   }
 
@@ -167,6 +169,10 @@ Model::~Model() {
     KTables.pop_back();
   }
 
+  // finish the writes before the connection goes away
+  delete sqlWriter;
+  sqlWriter = nullptr;
+
   if (nullptr != qtDB && qtDB->isValid()) {
     // Note: It is necessary to free the resources held by query object
     // Else the removeDatabase() method causes segmentation fault
@@ -183,12 +189,16 @@ Model::~Model() {
 
 
 void Model::run() {
-  if (1 != history.size()) {
-    throw KException("Model::run: History size should not be more than 1 at this stage.");
+  // a resumed run continues from the last state of its checkpoint
+  if (history.empty()) {
+    throw KException("Model::run: History must hold the initial state at this stage.");
   }
-  State* s0 = history[0];
+  State* s0 = history.back();
   bool done = false;
-  unsigned int iter = 0;
+  unsigned int iter = history.size() - 1;
+
+  // Store each turn's tables in the background while the next one is computed.
+  startSQLWriter();
 
   while (!done) {
     if (nullptr == s0) {
@@ -203,10 +213,40 @@ void Model::run() {
     addState(s1);
     done = stop(iter, s1);
     s0 = s1;
+
+    // Do not let the writer fall more than a turn behind.
+    if (nullptr != sqlWriter) {
+      sqlWriter->turnBarrier();
+    }
+
+    const bool due = (0 < checkpointEvery) && (0 == iter % checkpointEvery);
+    if (!done && !checkpointPath.empty() && (due || (0 != checkpointWanted))) {
+      checkpointWanted = 0;
+      // a checkpoint must not get ahead of the database
+      if (nullptr != sqlWriter) {
+        sqlWriter->flush();
+      }
+      saveCheckpoint(checkpointPath);
+      LOG(INFO) << "Saved checkpoint after iteration" << iter << "to" << checkpointPath;
+    }
   }
+
+  // The caller may use the database directly from here on.
+  stopSQLWriter();
+  return;
+}
+
+volatile std::sig_atomic_t Model::checkpointWanted = 0;
+
+void Model::requestCheckpoint(int) {
+  checkpointWanted = 1;
   return;
 }
 
+void Model::saveCheckpoint(const string &) {
+  throw KException("Model::saveCheckpoint: this model cannot be checkpointed");
+}
+
 unsigned int Model::addActor(Actor* a) {
   if (nullptr == a) {
     throw KException("Model::addActor Actor a is a null pointer");
@@ -335,6 +375,12 @@ ostream& operator<< (ostream& os, const PCEModel& pcm) {
   return os;
 }
 
+ostream& operator<< (ostream& os, const PCESolver& ps) {
+  string s = nameFromEnum<PCESolver>(ps, KBase::PCESolverNames);
+  os << s;
+  return os;
+}
+
 ostream& operator<< (ostream& os, const ThirdPartyCommit& tpc) {
   string s = nameFromEnum<ThirdPartyCommit>(tpc, KBase::ThirdPartyCommitNames);
   os << s;
@@ -414,12 +460,16 @@ double Model::vote(VotingRule vr, double wi, double uij, double uik) {
   return v;
 }
 
-tuple<double, double> Model::vProb(VPModel vpm, const double s1, const double s2) {
+namespace {
+// Model::vProb for a victory model fixed at compile time, so that the loop
+// over a coalition matrix need not switch on it for every pair.
+template <VPModel VPM>
+inline tuple<double, double> vProbAs(const double s1, const double s2) {
   const double tol = 1E-8;
   const double minX = 1E-6;
   double x1 = 0;
   double x2 = 0;
-  switch (vpm) {
+  switch (VPM) {
   case VPModel::Linear:
     x1 = s1;
     x2 = s2;
@@ -482,15 +532,9 @@ tuple<double, double> Model::vProb(VPModel vpm, const double s1, const double s2
   return tuple<double, double>(p1, p2);
 }
 
-// note that while the C_ij can be any arbitrary positive matrix
-// with C_kk = 0, the p_ij matrix has the symmetry pij + pji = 1
-// (and hence pkk = 1/2).
-KMatrix Model::vProb(VPModel vpm, const KMatrix & c) {
-  unsigned int numOpt = c.numR();
-  if (numOpt != c.numC()) {
-    throw KException("Model::vProb: coalitions matrix is not square");
-  }
-  auto p = KMatrix(numOpt, numOpt);
+template <VPModel VPM>
+void vProbInto(const KMatrix & c, KMatrix & p) {
+  const unsigned int numOpt = c.numR();
   for (unsigned int i = 0; i < numOpt; i++) {
     for (unsigned int j = 0; j < i; j++) {
       double cij = c(i, j);
@@ -504,12 +548,61 @@ KMatrix Model::vProb(VPModel vpm, const KMatrix & c) {
       if ((0 >= cij) && (0 >= cji)) {
         throw KException("Model::vProb: Either one of cij or cji must be positive");
       }
-      auto ppr = vProb(vpm, cij, cji);
+      auto ppr = vProbAs<VPM>(cij, cji);
       p(i, j) = get<0>(ppr); // set the lower left  probability: if Linear, cij / (cij + cji)
       p(j, i) = get<1>(ppr); // set the upper right probability: if Linear, cji / (cij + cji)
     }
     p(i, i) = 0.5; // set the diagonal probability
   }
+  return;
+}
+}
+
+tuple<double, double> Model::vProb(VPModel vpm, const double s1, const double s2) {
+  switch (vpm) {
+  case VPModel::Linear:
+    return vProbAs<VPModel::Linear>(s1, s2);
+  case VPModel::Square:
+    return vProbAs<VPModel::Square>(s1, s2);
+  case VPModel::Quartic:
+    return vProbAs<VPModel::Quartic>(s1, s2);
+  case VPModel::Octic:
+    return vProbAs<VPModel::Octic>(s1, s2);
+  case VPModel::Binary:
+    return vProbAs<VPModel::Binary>(s1, s2);
+  default:
+    throw KException("Model::vProb: unrecognized VPModel");
+  }
+}
+
+// note that while the C_ij can be any arbitrary positive matrix
+// with C_kk = 0, the p_ij matrix has the symmetry pij + pji = 1
+// (and hence pkk = 1/2).
+KMatrix Model::vProb(VPModel vpm, const KMatrix & c) {
+  unsigned int numOpt = c.numR();
+  if (numOpt != c.numC()) {
+    throw KException("Model::vProb: coalitions matrix is not square");
+  }
+  auto p = KMatrix(numOpt, numOpt);
+  switch (vpm) {
+  case VPModel::Linear:
+    vProbInto<VPModel::Linear>(c, p);
+    break;
+  case VPModel::Square:
+    vProbInto<VPModel::Square>(c, p);
+    break;
+  case VPModel::Quartic:
+    vProbInto<VPModel::Quartic>(c, p);
+    break;
+  case VPModel::Octic:
+    vProbInto<VPModel::Octic>(c, p);
+    break;
+  case VPModel::Binary:
+    vProbInto<VPModel::Binary>(c, p);
+    break;
+  default:
+    throw KException("Model::vProb: unrecognized VPModel");
+  }
   return p;
 }
 
@@ -542,13 +635,201 @@ KMatrix Model::coalitions(function<double(unsigned int ak, unsigned int pi, unsi
   return c;
 }
 
+namespace {
+// Model::vote for a rule fixed at compile time, given du = uij - uik.
+// Each case is the same arithmetic, in the same order, as in Model::vote.
+template <VotingRule VR>
+inline double voteAs(double wi, double du) {
+  const double sTol = 1E-8;
+  const double rbp = 0.2;
+  const double rpc = 0.5;
+  double rBin = du / sTol;
+  rBin = (rBin > +1) ? +1 : rBin;
+  rBin = (rBin < -1) ? -1 : rBin;
+  switch (VR) {
+  case VotingRule::Binary:
+    return wi * rBin;
+  case VotingRule::PropBin:
+    return wi * ((1 - rbp)*du + rbp*rBin);
+  case VotingRule::Proportional:
+    return wi * du;
+  case VotingRule::PropCbc:
+    return wi * ((1 - rpc)*du + rpc*(du * du * du));
+  case VotingRule::Cubic:
+    return wi * (du * du * du);
+  case VotingRule::ASymProsp:
+    return (du < 0.0) ? (wi * du) : ((0.0 < du) ? ((2.0 * wi * du) / 3.0) : 0.0);
+  }
+  return 0.0;
+}
+
+// Add the votes of an actor with strength wk and utilities uk over options
+// i:j, for each j < i, to the coalitions for i (ci[j]) and for j (cj[j]).
+// The loop over j has no branches or calls, so the compiler can vectorize it,
+// and each coalition still sums its votes in the order of the actors.
+template <VotingRule VR>
+void addVotes(double wk, const double * uk, unsigned int i, double * ci, double * cj) {
+  const double uki = uk[i];
+  for (unsigned int j = 0; j < i; j++) {
+    const double v = voteAs<VR>(wk, uki - uk[j]);
+    ci[j] = ci[j] + ((v > 0) ? v : 0.0);
+    cj[j] = cj[j] - ((v < 0) ? v : 0.0);
+  }
+  return;
+}
+
+// the coalitions of simple voting by numAct actors over numOpt options, with
+// utilities u (row-major), into c; ci and cj are scratch
+void coalitionsInto(const VotingRule * vr, const KMatrix & w, const double * u,
+                    unsigned int numAct, unsigned int numOpt,
+                    KMatrix & c, vector<double> & ci, vector<double> & cj) {
+  if ((1 != w.numR()) || (numAct != w.numC())) {
+    throw KException("Model::coalitions: need a weight and a voting rule for each actor");
+  }
+  if (1 < numOpt) {
+    for (unsigned int k = 0; k < numAct; k++) {
+      if (w(0, k) <= 0.0) {
+        throw KException("Model::vote - non-positive voting weight");
+      }
+    }
+  }
+
+  const double minC = 1E-8;
+  c.resize(numOpt, numOpt);
+  ci.resize(numOpt);
+  cj.resize(numOpt);
+  for (unsigned int i = 0; i < numOpt; i++) {
+    std::fill(ci.begin(), ci.begin() + i, minC);
+    std::fill(cj.begin(), cj.begin() + i, minC);
+    for (unsigned int k = 0; (0 < i) && (k < numAct); k++) {
+      const double wk = w(0, k);
+      const double * uk = u + k * numOpt;
+      switch (vr[k]) {
+      case VotingRule::Binary:
+        addVotes<VotingRule::Binary>(wk, uk, i, ci.data(), cj.data());
+        break;
+      case VotingRule::PropBin:
+        addVotes<VotingRule::PropBin>(wk, uk, i, ci.data(), cj.data());
+        break;
+      case VotingRule::Proportional:
+        addVotes<VotingRule::Proportional>(wk, uk, i, ci.data(), cj.data());
+        break;
+      case VotingRule::PropCbc:
+        addVotes<VotingRule::PropCbc>(wk, uk, i, ci.data(), cj.data());
+        break;
+      case VotingRule::Cubic:
+        addVotes<VotingRule::Cubic>(wk, uk, i, ci.data(), cj.data());
+        break;
+      case VotingRule::ASymProsp:
+        addVotes<VotingRule::ASymProsp>(wk, uk, i, ci.data(), cj.data());
+        break;
+      default:
+        throw KException("Model::vote - Unrecognized VotingRule");
+      }
+    }
+    for (unsigned int j = 0; j < i; j++) {
+      c(i, j) = ci[j];  // set the lower left coalition
+      c(j, i) = cj[j];  // set the upper right coalition
+    }
+    c(i, i) = minC; // set the diagonal coalition
+  }
+  return;
+}
+}
+
+KMatrix Model::coalitions(const vector<VotingRule> & vr, const KMatrix & w, const KMatrix & u) {
+  if (u.numR() != vr.size()) {
+    throw KException("Model::coalitions: need a weight and a voting rule for each actor");
+  }
+  auto c = KMatrix();
+  auto ci = vector<double>();
+  auto cj = vector<double>();
+  const double * u0 = (0 < u.numR() * u.numC()) ? &(*u.begin()) : nullptr;
+  coalitionsInto(vr.data(), w, u0, u.numR(), u.numC(), c, ci, cj);
+  return c;
+}
+
+KMatrix Model::coalitions(VotingRule vr, const KMatrix & w, const KMatrix & u) {
+  return coalitions(vector<VotingRule>(u.numR(), vr), w, u);
+}
+
+
+UtilStack::UtilStack(unsigned int numAct) : na(numAct) {}
+
+unsigned int UtilStack::add(unsigned int numOpt) {
+  offsets.push_back(vals.size());
+  numOpts.push_back(numOpt);
+  vals.resize(vals.size() + ((size_t)na) * numOpt, 0.0);
+  return numOpts.size() - 1;
+}
+
+unsigned int UtilStack::add(const KMatrix & u) {
+  if (na != u.numR()) {
+    throw KException("UtilStack::add: the matrix must have a row for each actor");
+  }
+  const unsigned int b = add(u.numC());
+  std::copy(u.begin(), u.end(), vals.begin() + offsets[b]);
+  return b;
+}
+
+KMatrix UtilStack::matrix(unsigned int b) const {
+  auto first = vals.begin() + offsets[b];
+  return KMatrix(na, numOpts[b], vector<double>(first, first + ((size_t)na) * numOpts[b]));
+}
+
+vector<KMatrix> Model::scalarPCEBatch(const UtilStack & u, const KMatrix & w,
+                                      const vector<VotingRule> & vr, VPModel vpm, PCEModel pcem,
+                                      vector<KMatrix> * c, vector<KMatrix> * pv, PCESolver s) {
+  const unsigned int nB = u.size();
+  if (u.numAct() != vr.size()) {
+    throw KException("Model::scalarPCEBatch: need a voting rule for each actor");
+  }
+  auto p = vector<KMatrix>(nB);
+  if (nullptr != c) {
+    *c = vector<KMatrix>(nB);
+  }
+  if (nullptr != pv) {
+    *pv = vector<KMatrix>(nB);
+  }
+  if (0 == nB) {
+    return p;
+  }
+
+  // Several matrices to a task, each task with its own scratch space; more
+  // tasks than threads, as the matrices can differ greatly in size.
+  const unsigned int nTask = std::min(nB, 4 * (ThreadPool::global().numThreads() + 1));
+  auto taskFn = [&](unsigned int t) {
+    auto cb = KMatrix();
+    auto ci = vector<double>();
+    auto cj = vector<double>();
+    for (unsigned int b = (t * nB) / nTask; b < ((t + 1) * nB) / nTask; b++) {
+      coalitionsInto(vr.data(), w, u.data(b), u.numAct(), u.numOpt(b), cb, ci, cj);
+      auto pv2 = probCE2(pcem, vpm, cb, KMatrix(), s);
+      p[b] = std::move(get<0>(pv2));
+      if (nullptr != pv) {
+        (*pv)[b] = std::move(get<1>(pv2));
+      }
+      if (nullptr != c) {
+        (*c)[b] = cb;
+      }
+    }
+  };
+  groupThreads(taskFn, 0, nTask - 1);
+  return p;
+}
+
+vector<KMatrix> Model::scalarPCEBatch(const UtilStack & u, const KMatrix & w,
+                                      VotingRule vr, VPModel vpm, PCEModel pcem,
+                                      vector<KMatrix> * c, vector<KMatrix> * pv, PCESolver s) {
+  return scalarPCEBatch(u, w, vector<VotingRule>(u.numAct(), vr), vpm, pcem, c, pv, s);
+}
+
 // returns a square matrix of prob(OptI > OptJ)
 // these are assumed to be unique options.
 // w is a [1,actor] row-vector of actor strengths, u is [act,option] utilities.
 KMatrix Model::vProb(VotingRule vr, VPModel vpm, const KMatrix & w, const KMatrix & u) {
   // u_ij is utility to actor i of the position advocated by actor j
   unsigned int numAct = u.numR();
-  unsigned int numOpt = u.numC();
   // w_j is row-vector of actor weights, for simple voting
   if (numAct != w.numC()) { // require 1-to-1 matching of actors and strengths
     throw KException("Model::vProb: weight matrix's column size must be equal to number of actors");
@@ -557,17 +838,13 @@ KMatrix Model::vProb(VotingRule vr, VPModel vpm, const KMatrix & w, const KMatri
     throw KException("Model::vProb: weights must be a row-vector");
   }
 
-  auto vfn = [vr, &w, &u](unsigned int k, unsigned int i, unsigned int j) {
-    double vkij = vote(vr, w(0, k), u(k, i), u(k, j));
-    return vkij;
-  };
-
-  auto c = coalitions(vfn, numAct, numOpt); // c(i,j) = strength of coaltion for i against j
+  auto c = coalitions(vr, w, u); // c(i,j) = strength of coaltion for i against j
   KMatrix p = vProb(vpm, c);  // p(i,j) = prob Ai defeats Aj
   return p;
 }
 
-tuple<KMatrix, KMatrix> Model::probCE2(PCEModel pcm, VPModel vpm, const KMatrix & cltnStrngth) {
+tuple<KMatrix, KMatrix> Model::probCE2(PCEModel pcm, VPModel vpm, const KMatrix & cltnStrngth,
+                                       const KMatrix & p0, PCESolver s) {
   const double pTol = 1E-8;
   unsigned int numOpt = cltnStrngth.numR();
   auto p = KMatrix(numOpt, 1);
@@ -577,10 +854,10 @@ tuple<KMatrix, KMatrix> Model::probCE2(PCEModel pcm, VPModel vpm, const KMatrix
     p = condPCE(victProb);
     break;
   case PCEModel::MarkovIPCM:
-    p = markovIncentivePCE(cltnStrngth, vpm);
+    p = markovIncentivePCE(cltnStrngth, vpm, p0, s);
     break;
   case PCEModel::MarkovUPCM:
-    p = markovUniformPCE(victProb);
+    p = markovUniformPCE(victProb, p0, s);
     break;
   default:
     throw KException("Model::probCE2: unrecognized PCEModel");
@@ -634,7 +911,8 @@ tuple<KMatrix, KMatrix> Model::probCE2(PCEModel pcm, VPModel vpm, const KMatrix
 // Given square matrix of strengths, Coalition[i over j] returns a column vector for Prob[i].
 // Uses Markov process, not 1-step conditional probability.
 // Challenge probabilities are proportional to influence promoting a challenge
-KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
+KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm, const KMatrix & p0,
+                                  PCESolver s) {
   using KBase::sqr;
   using KBase::qrtc;
   const bool printP = false;
@@ -644,7 +922,7 @@ KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
 
   // given coalitions, calculate the total incentive for i to challenge j
   // This is n[ i -> j] in the "Markov Voting with Incentives in KTAB" paper
-  auto iFn = [victProbMatrix, coalitions](unsigned int i, unsigned int j) {
+  auto iFn = [&victProbMatrix, &coalitions](unsigned int i, unsigned int j) {
     const double epsSupport = 1E-10;
     const double sij = coalitions(i, j);
     double inctv = sij * victProbMatrix(i,j);
@@ -665,7 +943,7 @@ KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
   // and it will correctly return that the only "challenger" is j itself,
   // with guaranteed success.
   //
-  auto cpFn = [inctvMatrix, numOpt](unsigned int i, unsigned int j) {
+  auto cpFn = [&inctvMatrix, numOpt](unsigned int i, unsigned int j) {
     double sum = 0.0;
     for (unsigned int k = 0; k < numOpt; k++) {
       sum = sum + inctvMatrix(k, j);
@@ -676,38 +954,33 @@ KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
 
   const auto chlgProbMatrix = KMatrix::map(cpFn, numOpt, numOpt);
 
+  if (PCESolver::Damped != s) {
+    return markovStationary(victProbMatrix, chlgProbMatrix, s, pTol, p0);
+  }
+
   // probability starts as uniform distribution (column vector)
-  auto p = KMatrix(numOpt, 1, 1.0) / numOpt;  // all 1/n
+  KMatrix p = KMatrix(numOpt, 1, 1.0) / numOpt;  // all 1/n
   auto q = p;
   unsigned int iMax = 1000;  // 10-30 is typical
   unsigned int iter = 0;
   double change = 1.0;
 
   // do the markov calculation
-  while (pTol < change)  { // && (iter < iMax)
+  while ((pTol < change) && (iter < iMax)) {
     if (printP) {
       LOG(INFO) << "Iteration" << iter << "/" << iMax;
       LOG(INFO) << "pDist:";
       trans(p).mPrintf(" %.4f");
       LOG(INFO) << KBase::getFormattedString("change: %.4e", change);
     }
-    auto ct = KMatrix(numOpt, numOpt);
-    for (unsigned int i = 0; i < numOpt; i++) {
-      for (unsigned int j = 0; j < numOpt; j++) {
-        // See "Markov Voting with Incentives in KTAB" paper
-        ct(i, j) = p(i, 0) * chlgProbMatrix(j, i);
-      }
-    }
-    if (printP) {
-      LOG(INFO) << "Ct:";
-      ct.mPrintf("  %.3f");
-    }
     change = 0.0;
     for (unsigned int i = 0; i < numOpt; i++) {
       double qi = 0.0;
       for (unsigned int j = 0; j < numOpt; j++) {
         double vij = victProbMatrix(i, j);
-        double cj = ct(i, j) + ct(j, i);
+        // ct(i,j) + ct(j,i) of the "Markov Voting with Incentives in KTAB" paper,
+        // where ct(i,j) = p(i) * chlgProb(j,i)
+        double cj = p(i, 0) * chlgProbMatrix(j, i) + p(j, 0) * chlgProbMatrix(i, j);
         qi = qi + vij* cj;
       }
       if (0 > qi) {
@@ -718,14 +991,15 @@ KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
       change = (c > change) ? c : change;
     }
     // Newton method improves convergence.
-    p = (p+q)/2.0;
+    p += q;
+    p /= 2.0;
     iter++;
     if (fabs(sum(p) - 1.0) >= pTol) {
       throw KException("Model::markovIncentivePCE: Sum total of prob p must be less than 1.0");
     }
   }
 
-  if (iter >= iMax) { // no way to recover
+  if (pTol < change) { // no way to recover
     throw KException("Model::markovIncentivePCE: Iteration exceeded upper limit");
   }
   return p;
@@ -737,7 +1011,7 @@ KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
 
     const double pTol = 1E-6;
     unsigned int numOpt = pv.numR();
-    auto p = KMatrix(numOpt, 1, 1.0) / numOpt;  // all 1/n
+    KMatrix p = KMatrix(numOpt, 1, 1.0) / numOpt;  // all 1/n
     auto q = p;
     unsigned int iMax = 1000;  // 10-30 is typical
     unsigned int iter = 0;
@@ -753,15 +1027,18 @@ KMatrix Model::markovIncentivePCE(const KMatrix & coalitions, VPModel vpm) {
 // Given square matrix of Prob[i>j] returns a column vector for Prob[i].
 // Uses Markov process, not 1-step conditional probability.
 // Challenges have uniform probability 1/N
-KMatrix Model::markovUniformPCE(const KMatrix & pv) {
+KMatrix Model::markovUniformPCE(const KMatrix & pv, const KMatrix & p0, PCESolver s) {
   const double pTol = 1E-6;
   unsigned int numOpt = pv.numR();
-  auto p = KMatrix(numOpt, 1, 1.0) / numOpt;  // all 1/n
+  if (PCESolver::Damped != s) {
+    return markovStationary(pv, KMatrix(numOpt, numOpt, 1.0 / numOpt), s, pTol, p0);
+  }
+  KMatrix p = KMatrix(numOpt, 1, 1.0) / numOpt;  // all 1/n
   auto q = p;
   unsigned int iMax = 1000;  // 10-30 is typical
   unsigned int iter = 0;
   double change = 1.0;
-  while (pTol < change) {
+  while ((pTol < change) && (iter < iMax)) {
     change = 0;
     for (unsigned int i = 0; i < numOpt; i++) {
       double pi = 0.0;
@@ -776,13 +1053,14 @@ KMatrix Model::markovUniformPCE(const KMatrix & pv) {
       change = (c > change) ? c : change;
     }
     // Newton method improves convergence.
-    p = (p + q) / 2.0;
+    p += q;
+    p /= 2.0;
     iter++;
     if (fabs(sum(p) - 1.0) >= pTol) { // double-check
       throw KException("Model::markovUniformPCE: Sum total of probabilities must be less than 1.0");
     }
   }
-  if (iter >= iMax) { // no way to recover
+  if (pTol < change) { // no way to recover
     throw KException("Model::markovUniformPCE: Iteration exceeded the upper limit");
   }
   return p;
@@ -818,45 +1096,64 @@ KMatrix Model::condPCE(const KMatrix & pv) {
 // is a direct function of difference in utilities.Therefore, we can use
 // Model::vProb(VotingRule vr, const KMatrix & w, const KMatrix & u)
 KMatrix Model::scalarPCE(unsigned int numAct, unsigned int numOpt, const KMatrix & w, const KMatrix & u,
-                         VotingRule vr, VPModel vpm, PCEModel pcem, ReportingLevel rl) {
+                         VotingRule vr, VPModel vpm, PCEModel pcem, ReportingLevel rl, PCESolver s) {
+  KMatrix c, pv;
+  const auto p = scalarPCE(numAct, numOpt, w, u, vr, vpm, pcem, c, pv, s);
+
+  if (ReportingLevel::Low < rl) {
+    mtx_spce_log.lock();
+    showScalarPCE(numAct, numOpt, w, u, vr, c, pv, p);
+    mtx_spce_log.unlock();
+  }
+  return p;
+}
+
+KMatrix Model::scalarPCE(unsigned int numAct, unsigned int numOpt, const KMatrix & w, const KMatrix & u,
+                         VotingRule vr, VPModel vpm, PCEModel pcem, KMatrix & c, KMatrix & pv,
+                         PCESolver s) {
 
   // auto pv = Model::vProb(vr, vpm, w, u);
   // auto p = Model::probCE(pcem, pv);
 
-  auto vfn = [vr, &w, &u](unsigned int k, unsigned int i, unsigned int j) {
-    double vkij = vote(vr, w(0, k), u(k, i), u(k, j));
-    return vkij;
-  };
-  const auto c = coalitions(vfn, numAct, numOpt); // c(i,j) = strength of coaltion for i against j
-  const auto pv2 = Model::probCE2(pcem, vpm, c);
-  const auto p = get<0>(pv2); //column
-  const auto pv = get<1>(pv2); // square
+  if ((numAct == u.numR()) && (numOpt == u.numC())) {
+    c = coalitions(vr, w, u); // c(i,j) = strength of coaltion for i against j
+  }
+  else { // the leading block of a larger u
+    auto vfn = [vr, &w, &u](unsigned int k, unsigned int i, unsigned int j) {
+      double vkij = vote(vr, w(0, k), u(k, i), u(k, j));
+      return vkij;
+    };
+    c = coalitions(vfn, numAct, numOpt);
+  }
+  auto pv2 = Model::probCE2(pcem, vpm, c, KMatrix(), s);
+  pv = std::move(get<1>(pv2)); // square
+  return std::move(get<0>(pv2)); //column
+}
 
-  mtx_spce_log.lock();
-  if (ReportingLevel::Low < rl) {
-    LOG(INFO) << "Num actors:" << numAct;
-    LOG(INFO) << "Num options:" << numOpt;
-
-    if ((numAct <= 20) && (numOpt <= 20)) {
-      LOG(INFO) << "Actor strengths:";
-      w.mPrintf(" %6.2f ");
-      LOG(INFO) << "Voting rule:" << vr;
-      // printf("         aka %s \n", KBase::vrName(vr).c_str());
-      LOG(INFO) << "Utility to actors of options:";
-      u.mPrintf(" %+8.3f ");
-
-      LOG(INFO) << "Coalition strengths of (i:j):";
-      c.mPrintf(" %8.3f ");
-
-      LOG(INFO) << "Probability Opt_i > Opt_j";
-      pv.mPrintf(" %.4f ");
-      LOG(INFO) << "Probability Opt_i";
-      p.mPrintf(" %.4f ");
-    }
-    LOG(INFO) << "Found stable PCE distribution";
+void Model::showScalarPCE(unsigned int numAct, unsigned int numOpt, const KMatrix & w,
+                          const KMatrix & u, VotingRule vr,
+                          const KMatrix & c, const KMatrix & pv, const KMatrix & p) {
+  LOG(INFO) << "Num actors:" << numAct;
+  LOG(INFO) << "Num options:" << numOpt;
+
+  if ((numAct <= 20) && (numOpt <= 20)) {
+    LOG(INFO) << "Actor strengths:";
+    w.mPrintf(" %6.2f ");
+    LOG(INFO) << "Voting rule:" << vr;
+    // printf("         aka %s \n", KBase::vrName(vr).c_str());
+    LOG(INFO) << "Utility to actors of options:";
+    u.mPrintf(" %+8.3f ");
+
+    LOG(INFO) << "Coalition strengths of (i:j):";
+    c.mPrintf(" %8.3f ");
+
+    LOG(INFO) << "Probability Opt_i > Opt_j";
+    pv.mPrintf(" %.4f ");
+    LOG(INFO) << "Probability Opt_i";
+    p.mPrintf(" %.4f ");
   }
-  mtx_spce_log.unlock();
-  return p;
+  LOG(INFO) << "Found stable PCE distribution";
+  return;
 }
 
 
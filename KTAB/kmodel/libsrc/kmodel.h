@@ -44,8 +44,12 @@
 #include "kutils.h"
 #include "kmatrix.h"
 #include "prng.h"
+#include "sqlwriter.h"
+#include "logpolicy.h"
+#include "kcheckpoint.h"
 #include <QSqlDatabase>
 #include <QSqlQuery>
+#include <csignal>
 #include <map>
 #include <memory>
 
@@ -143,6 +147,25 @@ const vector<string> PCEModelNames = {
   "Conditional", "MarkovIncentive", "MarkovUniform" };
 ostream& operator<< (ostream& os, const PCEModel& pcm);
 
+// How the Markov PCE models find their stationary distribution (see kpce.cpp):
+// by the damped iteration they always used, by solving the linear system
+// directly, or by Anderson-accelerated iteration.
+enum class PCESolver {
+  Damped=0, Direct, Anderson
+};
+const vector<string> PCESolverNames = {
+  "Damped", "Direct", "Anderson" };
+ostream& operator<< (ostream& os, const PCESolver& ps);
+
+// What one solve did.
+struct PCEDiagnostics {
+  PCESolver solver = PCESolver::Damped; // the one which produced the answer
+  unsigned int iterations = 0; // 0 for a direct solve
+  double residual = 0.0; // max |Mp - p| at the answer
+  bool warmStart = false;
+  bool fellBack = false; // the solver asked for failed, so Damped was used
+};
+
 
 
 // whether you consider the probability of a coalition winning to go up linearly
@@ -254,6 +277,9 @@ public:
   unsigned int numCat = 0;
   VUI match = {}; // must be of length numItm
 
+  // everything operator== compares, as one key for KBase::ueIndicesByKey
+  VUI eqvKey() const;
+
 protected:
   virtual void print(ostream& os) const;
 
@@ -284,6 +310,37 @@ protected:
 };
 
 
+// -------------------------------------------------
+// A stack of utility matrices for Model::scalarPCEBatch, each [numAct, numOpt]
+// with its own number of options, held row-major one after another in a
+// single buffer.
+class UtilStack {
+public:
+  explicit UtilStack(unsigned int numAct);
+
+  // append a zero-filled matrix with numOpt options, or a copy of u,
+  // returning its index in the stack
+  unsigned int add(unsigned int numOpt);
+  unsigned int add(const KMatrix & u);
+
+  unsigned int size() const { return numOpts.size(); }
+  unsigned int numAct() const { return na; }
+  unsigned int numOpt(unsigned int b) const { return numOpts[b]; }
+
+  // the values of matrix b, (i,j) at [i*numOpt(b) + j]; add() may move them,
+  // so fill the stack only once every matrix has been added
+  double * data(unsigned int b) { return vals.data() + offsets[b]; }
+  const double * data(unsigned int b) const { return vals.data() + offsets[b]; }
+  KMatrix matrix(unsigned int b) const;
+
+protected:
+  unsigned int na = 0;
+  vector<double> vals = {};
+  vector<size_t> offsets = {};
+  vector<unsigned int> numOpts = {};
+};
+
+
 // -------------------------------------------------
 class Model {
 public:
@@ -314,6 +371,10 @@ public:
   // default 'probabilistic Condorcet election' model for bargains and coalitions
   PCEModel pcem = PCEModel::ConditionalPCM;
 
+  // how the Markov PCE models find their stationary distribution; Damped gives
+  // the same bits as before
+  PCESolver pceSolver = PCESolver::Damped;
+
   // default state transition mode is deterministic, not stochastic
   StateTransMode stm = StateTransMode::DeterminsticSTM;
 
@@ -324,6 +385,21 @@ public:
   // significant is likely to happen if the run were to continue.
   void run();
 
+  // Checkpoints. Given a path, run() saves one there every checkpointEvery turns
+  // (none if 0), and after any turn during which requestCheckpoint was called.
+  // Only models which override saveCheckpoint can be checkpointed.
+  string checkpointPath = "";
+  unsigned int checkpointEvery = 0;
+  static void requestCheckpoint(int sig = 0); // safe to call from a signal handler
+  virtual void saveCheckpoint(const string & path);
+
+  // A fork of another scenario shares that scenario's first forkTurn states:
+  // history[0] to history[forkTurn-1] belong to the parent model, which must
+  // outlive this one, and the fork records only its own turns, from forkTurn on.
+  // ScenarioDesc links the two, so the earlier turns are read from the parent's rows.
+  string parentScenId = ""; // "" unless this is a fork
+  unsigned int forkTurn = 0;
+
   // simple voting based on the difference in utility.
   static double vote(VotingRule vr, double wi, double uij, double uik);
 
@@ -338,6 +414,13 @@ public:
   static KMatrix coalitions(function<double(unsigned int ak, unsigned int pi, unsigned int pj)> vfn,
                             unsigned int numAct, unsigned int numOpt);
 
+  // The same as coalitions(vfn, ...) for simple voting, i.e. with
+  // vfn(k,i,j) = vote(vr[k], w(0,k), u(k,i), u(k,j)), where w is a [1,actor]
+  // row-vector of strengths and u is [act,option] utilities, but much faster:
+  // each actor's rule is looked up once per option, not once per vote.
+  static KMatrix coalitions(const vector<VotingRule> & vr, const KMatrix & w, const KMatrix & u);
+  static KMatrix coalitions(VotingRule vr, const KMatrix & w, const KMatrix & u);
+
   // calculate pv[i>j] from coalitions
   // c[i,j] is the strength of coalition supporting OptI over OptJ
   static KMatrix vProb(VPModel vpm, const KMatrix & c);
@@ -354,15 +437,57 @@ public:
   // from square matrix coalition[i:j], return two matrices:
   // column vector P[i] of outcome probabilities
   // square matrix of P[ i > j] victory probabilities
-  static tuple<KMatrix, KMatrix> probCE2(PCEModel pcm, VPModel vpm, const KMatrix & cltnStrngth);
+  // A Markov model is solved with s, and may start from p0, e.g. the distribution
+  // over the same options in the previous turn, unless s is Damped (which always
+  // starts uniform).
+  static tuple<KMatrix, KMatrix> probCE2(PCEModel pcm, VPModel vpm, const KMatrix & cltnStrngth,
+                                         const KMatrix & p0 = KMatrix(),
+                                         PCESolver s = PCESolver::Damped);
 
   // calculate the [option,1] column vector of option-probabilities.
   // w is a [1,actor] row-vector of actor strengths, u is [act,option] utilities.
   static KMatrix scalarPCE(unsigned int numAct, unsigned int numOpt, const KMatrix & w,
-                           const KMatrix & u, VotingRule vr, VPModel vpm, PCEModel pcem, ReportingLevel rl);
+                           const KMatrix & u, VotingRule vr, VPModel vpm, PCEModel pcem, ReportingLevel rl,
+                           PCESolver s = PCESolver::Damped);
 
-
-  static KMatrix markovIncentivePCE(const KMatrix & coalitions, VPModel vpm);
+  // The same, but without logging, so that concurrent callers need not share a lock.
+  // It also returns the coalition strengths, c, and the pairwise victory probabilities, pv,
+  // so that the caller can pass them to showScalarPCE later.
+  static KMatrix scalarPCE(unsigned int numAct, unsigned int numOpt, const KMatrix & w,
+                           const KMatrix & u, VotingRule vr, VPModel vpm, PCEModel pcem,
+                           KMatrix & c, KMatrix & pv, PCESolver s = PCESolver::Damped);
+
+  // scalarPCE for each matrix of the stack u, all with the same [1,actor]
+  // strengths w and rule(s) vr, in parallel over the stack and reusing scratch
+  // space between them. Returns the [numOpt,1] probability vectors, the same
+  // bits as scalarPCE would, and fills c and pv (if given) as scalarPCE does.
+  static vector<KMatrix> scalarPCEBatch(const UtilStack & u, const KMatrix & w,
+                                        const vector<VotingRule> & vr, VPModel vpm, PCEModel pcem,
+                                        vector<KMatrix> * c = nullptr, vector<KMatrix> * pv = nullptr,
+                                        PCESolver s = PCESolver::Damped);
+  static vector<KMatrix> scalarPCEBatch(const UtilStack & u, const KMatrix & w,
+                                        VotingRule vr, VPModel vpm, PCEModel pcem,
+                                        vector<KMatrix> * c = nullptr, vector<KMatrix> * pv = nullptr,
+                                        PCESolver s = PCESolver::Damped);
+
+  // log the inputs and results of scalarPCE
+  static void showScalarPCE(unsigned int numAct, unsigned int numOpt, const KMatrix & w,
+                            const KMatrix & u, VotingRule vr,
+                            const KMatrix & c, const KMatrix & pv, const KMatrix & p);
+
+
+  static KMatrix markovIncentivePCE(const KMatrix & coalitions, VPModel vpm,
+                                    const KMatrix & p0 = KMatrix(),
+                                    PCESolver s = PCESolver::Damped);
+
+  // The stationary distribution p = Mp of the Markov voting process in which,
+  // while j is favoured, i challenges with probability cp(i,j) (each column sums
+  // to 1) and wins with probability pv(i,j). A solver other than Damped starts
+  // from p0 if it is a distribution of the right size, and falls back to Damped
+  // if it fails. Throws KException if Damped does not converge to within tol.
+  static KMatrix markovStationary(const KMatrix & pv, const KMatrix & cp, PCESolver s,
+                                  double tol, const KMatrix & p0 = KMatrix(),
+                                  PCEDiagnostics * diag = nullptr);
 
   virtual unsigned int addActor(Actor* a); // returns new number of actors, always at least 1
   int actrNdx(const Actor* a) const;
@@ -379,7 +504,18 @@ public:
   vector<State*> history = {};
 
   vector<KTable*> KTables = {}; // JAH added 20160728 this will hold info for all defined tables
-  vector<bool> sqlFlags= {};    // JAH added 20160730 this will hold the logging flag for each group of tables
+
+  // Which rows of which tables to record: at first every table of each group
+  // flagged in the constructor. Each table's rule is looked up once KTables is set.
+  void setLogPolicy(const LogPolicy & lp);
+  const LogPolicy & getLogPolicy() const { return logPolicy; }
+  const LogPolicy::Rule & logRule(const string & table) const; // throws KException if unknown
+
+  // Write the rows of a table, for turn t, that the run computes as it goes: now,
+  // if t was selected outright, or else hold them, in case the run ends within
+  // the table's last-turns window. releaseHeldRows writes those which did.
+  void sqlWriteTurn(const string & table, unsigned int t, SQLBatch && b);
+  void releaseHeldRows(unsigned int finalT);
 
   // output an existing actor util table, for the given turn, to SQLite
   void sqlAUtil(unsigned int t);
@@ -430,6 +566,9 @@ public:
   void commitDBTransaction();
   QSqlQuery getQuery();
 
+  // Hand the batch to the background writer during a run, or write it now otherwise.
+  void sqlWrite(SQLBatch && b) const;
+
   static void configLogger(string logFile);
   static string getLastError();
 
@@ -457,8 +596,41 @@ protected:
   static QString databaseName;
   static QString userName;
   static QString password;
+  static bool columnarResults; // "Format=columnar" in the connection string
+
+  static volatile std::sig_atomic_t checkpointWanted;
+
+  // The parts of a checkpoint which any model has: the scenario, the state of
+  // rng, the rows held for last-turns windows, and the size of each columnar
+  // file. Everything written before must already be stored (see run).
+  void saveModelState(CheckpointWriter & cw) const;
+  // Restore them, into a model built from the same input
+  void loadModelState(CheckpointReader & cr);
+  // Remove what this scenario stored after a checkpoint taken in state t: rows
+  // of turn t on in runTables, which are written as the run goes, and all rows
+  // in the other tables, which are written after it. Columnar files are cut
+  // back to their size at the checkpoint.
+  void rewindResults(unsigned int t, const vector<string> & runTables);
+  std::map<string, uint64_t> ckptColSizes = {}; // by file name, from loadModelState
+  LogPolicy logPolicy = LogPolicy();
+  std::map<string, LogPolicy::Rule> logRules = {};
+  struct HeldRows {
+    string table;
+    unsigned int turn;
+    SQLBatch rows;
+  };
+  vector<HeldRows> heldRows = {};
   QSqlDatabase *qtDB = nullptr;
   mutable QSqlQuery query;
+
+  // Model::run stores its tables through this, on a thread of its own.
+  // Nothing else may use qtDB or query while it exists.
+  SQLWriter * sqlWriter = nullptr;
+  void startSQLWriter();
+  void stopSQLWriter(); // waits for the writes to finish
+  vector<string> schemaSQL() const; // the CREATE TABLE statement of each of KTables
+  // Where the columnar files go, next to the database: "" unless columnarResults
+  string columnarDir() const;
   void configSqlite() const;
   void execQuery(std::string& qry);
   bool createDB(const QString& dbName);
@@ -471,12 +643,34 @@ protected:
 
   static string lastExceptionMsg;
 private:
-  static KMatrix markovUniformPCE(const KMatrix & pv);
+  static KMatrix markovUniformPCE(const KMatrix & pv, const KMatrix & p0 = KMatrix(),
+                                  PCESolver s = PCESolver::Damped);
   //static KMatrix markovIncentivePCE(const KMatrix & pv);
   static KMatrix condPCE(const KMatrix & pv);
 };
 
 
+// -------------------------------------------------
+// Some models can compute h's estimate of the utility to A_i of Pos_j
+// directly from a few small tables, so there is no need to store all
+// na of the na-by-na aUtil matrices in every State of the history.
+// A State given one of these reads through it instead of aUtil.
+class UtilProvider {
+public:
+  UtilProvider();
+  virtual ~UtilProvider();
+
+  // number of actors (and of perspectives) covered
+  virtual unsigned int numAct() const = 0;
+
+  // h's estimate of the utility to A_i of Pos_j
+  virtual double util(unsigned int h, unsigned int i, unsigned int j) const = 0;
+
+  // all of h's estimates, as the matrix aUtil[h] would have held them
+  virtual KMatrix utilMatrix(unsigned int h) const;
+};
+
+
 // -------------------------------------------------
 class State {
 public:
@@ -513,6 +707,22 @@ public:
 
   vector<KMatrix> aUtil = {}; // aUtil[h](i,j) is h's estimate of the utility to A_i of Pos_j
 
+  // If set, this supplies the utilities instead, and aUtil stays empty.
+  // It is const, so states in the history may share one.
+  shared_ptr<const UtilProvider> aUtilProv = nullptr;
+
+  // h's estimate of the utility to A_i of Pos_j, from whichever of the two is in use.
+  // Prefer this to indexing aUtil directly.
+  double aUtilAt(unsigned int h, unsigned int i, unsigned int j) const {
+    return (nullptr == aUtilProv) ? aUtil[h](i, j) : aUtilProv->util(h, i, j);
+  }
+
+  // a copy of h's whole estimate
+  KMatrix aUtilMatrix(unsigned int h) const;
+
+  // true once every actor's perspective is available
+  bool aUtilSet() const;
+
   // This sets the actor/position utility matrix as estimated by H.
   // If H == -1, then set them all.
   void setAUtil(int perspH = -1, ReportingLevel rl = ReportingLevel::Silent);
@@ -538,6 +748,11 @@ protected:
 
   virtual void setOneAUtil(unsigned int perspH, ReportingLevel rl); // TODO: make this non-dummy
 
+  // The unique and equivalent indices of the positions in this state, as set by setUENdx.
+  // By default, KBase::ueIndices over equivNdx, which compares every pair. A subclass
+  // which can index its positions should return the same ordering with fewer comparisons.
+  virtual tuple<VUI, VUI> uniqueEquivNdx() const;
+
 private:
 };
 
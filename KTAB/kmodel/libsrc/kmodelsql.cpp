@@ -33,6 +33,9 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QSqlDriver>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 
 namespace KBase
 {
@@ -46,6 +49,7 @@ int Model::port=5432; // Default port for postgresql
 QString Model::databaseName;
 QString Model::userName;
 QString Model::password;
+bool Model::columnarResults = false;
 
 void Model::initDBDriver(QString connectionName) {
   if (QSqlDatabase::contains(connectionName)) {
@@ -112,9 +116,13 @@ void Model::configSqlite() const {
   // the DB in case the system crashes in mid-operation.
   // Eliminating these checks can significantly speed operations.
   query.exec("PRAGMA journal_mode = MEMORY");
-  query.exec("PRAGMA locking_mode = EXCLUSIVE");
   query.exec("PRAGMA synchronous = OFF");
 
+  // Concurrent runs (SMPModel::runScenarios) may share one file, so each
+  // connection takes the lock only while it writes, and waits for the others.
+  query.exec("PRAGMA locking_mode = NORMAL");
+  query.exec("PRAGMA busy_timeout = 60000");
+
   // not a performance issue, but necessary for the data layout
   query.exec("PRAGMA foreign_keys = ON");
 }
@@ -128,13 +136,254 @@ void Model::execQuery(std::string& qry) {
 }
 
 void Model::beginDBTransaction() {
+  if (nullptr != sqlWriter) {
+    sqlWriter->push(SQLBatch(SQLBatch::Op::Begin));
+    return;
+  }
   qtDB->transaction();
 }
 
 void Model::commitDBTransaction() {
+  if (nullptr != sqlWriter) {
+    sqlWriter->push(SQLBatch(SQLBatch::Op::Commit));
+    return;
+  }
   qtDB->commit();
 }
 
+void Model::sqlWrite(SQLBatch && b) const {
+  if (nullptr != sqlWriter) {
+    sqlWriter->push(std::move(b));
+    return;
+  }
+  std::unique_ptr<SQLSink> sink(SQLSink::open(*qtDB, schemaSQL(), columnarDir()));
+  sink->write(b);
+  sink->flush();
+  return;
+}
+
+vector<string> Model::schemaSQL() const {
+  vector<string> sch = {};
+  for (auto t : KTables) {
+    sch.push_back(t->tabSQL);
+  }
+  return sch;
+}
+
+string Model::columnarDir() const {
+  if (!columnarResults) {
+    return "";
+  }
+  string dir = databaseName.toStdString();
+  const string ext = ".db";
+  if ((ext.size() < dir.size()) && (0 == dir.compare(dir.size() - ext.size(), ext.size(), ext))) {
+    dir.erase(dir.size() - ext.size());
+  }
+  return dir + ".kcol";
+}
+
+void Model::startSQLWriter() {
+  if ((nullptr == sqlWriter) && (nullptr != qtDB) && qtDB->isOpen()) {
+    sqlWriter = new SQLWriter(*qtDB, schemaSQL(), columnarDir());
+  }
+  return;
+}
+
+void Model::stopSQLWriter() {
+  if (nullptr != sqlWriter) {
+    sqlWriter->flush(); // rethrows any error from the writer
+    delete sqlWriter;
+    sqlWriter = nullptr;
+  }
+  return;
+}
+
+void Model::setLogPolicy(const LogPolicy & lp) {
+  vector<string> names = {};
+  for (auto t : KTables) {
+    names.push_back(t->tabName);
+  }
+  lp.check(names);
+  logPolicy = lp;
+  logRules.clear();
+  for (auto t : KTables) {
+    const LogPolicy::Rule r = logPolicy.rule(t->tabName, t->tabGrpID);
+    logRules[t->tabName] = r;
+    if (!r.on) {
+      LOG(INFO) << "Not recording" << t->tabName;
+    }
+    else if (r.turns.empty() && (0 == r.last) && r.ests.empty() && (1.0 <= r.rate)) {
+      LOG(INFO) << "Recording" << t->tabName;
+    }
+    else {
+      LOG(INFO) << "Recording" << t->tabName << "for selected"
+        << (r.ests.empty() ? "turns" : "turns and estimators")
+        << KBase::getFormattedString("at rate %.4f", r.rate);
+    }
+  }
+  return;
+}
+
+const LogPolicy::Rule & Model::logRule(const string & table) const {
+  auto r = logRules.find(table);
+  if (logRules.end() == r) {
+    throw KException("Model::logRule: no table named " + table);
+  }
+  return r->second;
+}
+
+void Model::sqlWriteTurn(const string & table, unsigned int t, SQLBatch && b) {
+  const LogPolicy::Rule & r = logRule(table);
+  if (r.turn(t)) {
+    sqlWrite(std::move(b));
+    return;
+  }
+  if (!r.needed(t)) {
+    return;
+  }
+  // Turns at least r.last before this one cannot be among the final r.last
+  auto stale = [this, &table, t](const HeldRows & h) {
+    return (h.table == table) && (h.turn + logRule(table).last <= t);
+  };
+  heldRows.erase(std::remove_if(heldRows.begin(), heldRows.end(), stale), heldRows.end());
+  heldRows.push_back(HeldRows{ table, t, std::move(b) });
+  return;
+}
+
+void Model::releaseHeldRows(unsigned int finalT) {
+  for (HeldRows & h : heldRows) {
+    if (logRule(h.table).lastTurn(h.turn, finalT)) {
+      sqlWrite(std::move(h.rows));
+    }
+  }
+  heldRows = {};
+  return;
+}
+
+void Model::saveModelState(CheckpointWriter & cw) const {
+  cw.str(scenId);
+  cw.str(scenName);
+  cw.str(scenDesc);
+  cw.u64(rngSeed);
+  cw.str(rng->getState());
+
+  cw.u32(heldRows.size());
+  for (const HeldRows & h : heldRows) {
+    cw.str(h.table);
+    cw.u32(h.turn);
+    cw.u32((uint32_t)h.rows.op);
+    cw.str(h.rows.sql);
+    cw.u32(h.rows.numCols);
+    cw.str(h.rows.who);
+    cw.u64(h.rows.vals.size());
+    for (const SQLValue & v : h.rows.vals) {
+      cw.u32((uint32_t)v.type);
+      if (SQLValue::Type::Real == v.type) {
+        cw.f64(v.d);
+      }
+      else {
+        cw.u64((uint64_t)v.i);
+      }
+    }
+  }
+
+  std::map<string, uint64_t> sizes = {};
+  const string colDir = columnarDir();
+  if (!colDir.empty()) {
+    const QDir dir(QString::fromStdString(ColumnarSink::scenarioDir(colDir, scenId)));
+    for (const QFileInfo & f : dir.entryInfoList(QStringList() << "*.kcol", QDir::Files)) {
+      sizes[f.fileName().toStdString()] = f.size();
+    }
+  }
+  cw.u32(sizes.size());
+  for (const auto & fs : sizes) {
+    cw.str(fs.first);
+    cw.u64(fs.second);
+  }
+  return;
+}
+
+void Model::loadModelState(CheckpointReader & cr) {
+  scenId = cr.str();
+  scenName = cr.str();
+  scenDesc = cr.str();
+  rngSeed = cr.u64();
+  rng->setState(cr.str());
+
+  heldRows = {};
+  const unsigned int nh = cr.u32();
+  for (unsigned int n = 0; n < nh; n++) {
+    HeldRows h = { "", 0, SQLBatch() };
+    h.table = cr.str();
+    logRule(h.table); // throws if there is no such table
+    h.turn = cr.u32();
+    const uint32_t op = cr.u32();
+    if (op > (uint32_t)SQLBatch::Op::Flush) {
+      throw KException("Model::loadModelState: unknown kind of batch");
+    }
+    h.rows.op = (SQLBatch::Op)op;
+    h.rows.sql = cr.str();
+    h.rows.numCols = cr.u32();
+    h.rows.who = cr.str();
+    const uint64_t nv = cr.u64();
+    for (uint64_t k = 0; k < nv; k++) {
+      SQLValue v;
+      const uint32_t type = cr.u32();
+      if (type > (uint32_t)SQLValue::Type::Real) {
+        throw KException("Model::loadModelState: unknown type of value");
+      }
+      v.type = (SQLValue::Type)type;
+      if (SQLValue::Type::Real == v.type) {
+        v.d = cr.f64();
+      }
+      else {
+        v.i = (int64_t)cr.u64();
+      }
+      h.rows.add(v);
+    }
+    heldRows.push_back(std::move(h));
+  }
+
+  ckptColSizes = {};
+  const unsigned int nf = cr.u32();
+  for (unsigned int n = 0; n < nf; n++) {
+    const string f = cr.str();
+    ckptColSizes[f] = cr.u64();
+  }
+  return;
+}
+
+void Model::rewindResults(unsigned int t, const vector<string> & runTables) {
+  for (auto tab : KTables) {
+    string sql = "DELETE FROM " + tab->tabName + " WHERE ScenarioId = '" + scenId + "'";
+    if (runTables.end() != std::find(runTables.begin(), runTables.end(), tab->tabName)) {
+      sql = sql + " AND Turn_t >= " + std::to_string(t);
+    }
+    execQuery(sql);
+  }
+
+  const string colDir = columnarDir();
+  if (!colDir.empty()) {
+    const string sub = ColumnarSink::scenarioDir(colDir, scenId);
+    const QDir dir(QString::fromStdString(sub));
+    for (const QFileInfo & f : dir.entryInfoList(QStringList() << "*.kcol", QDir::Files)) {
+      const string name = f.fileName().toStdString();
+      auto c = ckptColSizes.find(name);
+      bool ok = true;
+      if (ckptColSizes.end() == c) { // begun after the checkpoint
+        ok = QFile::remove(f.filePath());
+      }
+      else if (c->second != (uint64_t)f.size()) {
+        ok = QFile::resize(f.filePath(), c->second);
+      }
+      if (!ok) {
+        throw KException("Model::rewindResults: could not cut back " + sub + "/" + name);
+      }
+    }
+  }
+  return;
+}
+
 QSqlQuery Model::getQuery()
 {
   return query;
@@ -420,7 +669,7 @@ KTable * Model::createSQL(unsigned int n)
           "Rcvr_j     INTEGER     NOT NULL DEFAULT 0, "\
           "Prob       FLOAT       NOT NULL DEFAULT 0"\
           ");";
-    name = "PosVict";
+    name = "ProbVict";
     grpID = 2;
     break;
 
@@ -534,7 +783,9 @@ KTable * Model::createSQL(unsigned int n)
           "BigRRange INTEGER NULL DEFAULT NULL," \
           "ThirdPartyCommit INTEGER NULL DEFAULT NULL," \
           "InterVecBrgn INTEGER NULL DEFAULT NULL," \
-          "BargnModel INTEGER NULL DEFAULT NULL" \
+          "BargnModel INTEGER NULL DEFAULT NULL," \
+          "ParentScenarioId VARCHAR(32) NULL DEFAULT NULL," \
+          "ForkTurn INTEGER NULL DEFAULT NULL" \
           ");";
     name = "ScenarioDesc";
     grpID = 0;
@@ -560,7 +811,7 @@ void Model::sqlAUtil(unsigned int t)
   if (nullptr == st) {
     throw KException("Model::sqlAUtil: st is a null pointer.");
   }
-  if (numAct != st->aUtil.size()) {
+  if (!st->aUtilSet()) {
     throw KException("Model::sqlAUtil: Not all actors have utility values.");
   }
 
@@ -573,34 +824,38 @@ void Model::sqlAUtil(unsigned int t)
   string sql = "INSERT INTO PosUtil (ScenarioId, Turn_t, Est_h, Act_i, Pos_j, Util) VALUES ('"
     + scenId + "', :turn_t, :est_h, :act_i, :pos_j, :util)";
 
-  query.prepare(QString::fromStdString(sql));
-
-  // Prepared statements cache the execution plan for a query after the query optimizer has
-  // found the best plan, so there is no big gain with simple insertions.
-  // What makes a huge difference is bundling a few hundred into one atomic "transaction".
-  // For this case, runtime droped from 62-65 seconds to 0.5-0.6 (vs. 0.30-0.33 with no SQL at all).
-  qtDB->transaction();
+  SQLBatch b(sql, 5, "Model::sqlAUtil");
+  b.vals.reserve(5 * numAct * numAct * numAct);
+  const LogPolicy::Rule & r = logRule("PosUtil");
 
   for (unsigned int h = 0; h < numAct; h++)   // estimator is h
   {
-    KMatrix uij = st->aUtil[h]; // utility to actor i of the position held by actor j
+    if (!r.estimator(h)) {
+      continue;
+    }
     for (unsigned int i = 0; i < numAct; i++)
     {
       for (unsigned int j = 0; j < numAct; j++)
       {
-        query.bindValue(":turn_t", t);
-        query.bindValue(":est_h", h);
-        query.bindValue(":act_i", i);
-        query.bindValue(":pos_j", j);
-        query.bindValue(":util", uij(i, j));
-        if (!query.exec()) {
-          LOG(INFO) << query.lastError().text().toStdString();
-          throw KException("Model::sqlAUtil: DB query failed");
+        if (!r.sample(rngSeed, t, h, (i << 16) | j)) {
+          continue;
         }
+        b.add(t);
+        b.add(h);
+        b.add(i);
+        b.add(j);
+        b.add(st->aUtilAt(h, i, j)); // utility to actor i of the position held by actor j
       }
     }
   }
-  qtDB->commit();
+
+  // Prepared statements cache the execution plan for a query after the query optimizer has
+  // found the best plan, so there is no big gain with simple insertions.
+  // What makes a huge difference is bundling a few hundred into one atomic "transaction".
+  // For this case, runtime droped from 62-65 seconds to 0.5-0.6 (vs. 0.30-0.33 with no SQL at all).
+  beginDBTransaction();
+  sqlWrite(std::move(b));
+  commitDBTransaction();
   return;
 }
 
@@ -618,13 +873,15 @@ void Model::sqlPosEquiv(unsigned int t)
 
   string qsql = string("INSERT INTO PosEquiv (ScenarioId, Turn_t, Pos_i, Eqv_j) VALUES ('")
     + scenId + "', :turn_t, :pos_i, :eqv_j)";
-  query.prepare(QString::fromStdString(qsql));
-
-  qtDB->transaction();
+  SQLBatch b(qsql, 3, "Model::sqlPosEquiv");
+  const LogPolicy::Rule & r = logRule("PosEquiv");
 
   // Start inserting record
   for (unsigned int i = 0; i < numAct; i++)
   {
+    if (!r.sample(rngSeed, t, i)) {
+      continue;
+    }
     // calculate the equivalance
     int je = numAct + 1;
     for (unsigned int j = 0; j < numAct && je > numAct; j++)
@@ -634,16 +891,15 @@ void Model::sqlPosEquiv(unsigned int t)
         je = j;
       }
     }
-    query.bindValue(":turn_t", t);
-    query.bindValue(":pos_i", i);
-    query.bindValue(":eqv_j", je);
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("Model::sqlPosEquiv: DB query failed");
-    }
+    b.add(t);
+    b.add(i);
+    b.add(je);
   }
+
+  beginDBTransaction();
+  sqlWrite(std::move(b));
   // end databse transaction
-  qtDB->commit();
+  commitDBTransaction();
 
   return;
 }
@@ -653,26 +909,23 @@ void Model::sqlBargainEntries(unsigned int t, int bargainId, int initiator, int
   // prepare the sql statement to insert
   string sql = string("INSERT INTO Bargn (ScenarioId, Turn_t, BargnID, Init_Act_i, Recd_Act_j, Value) VALUES ('")
     + scenId + "', :turn_t, :bargnid, :init_i, :recd_j, :value)";
-  query.prepare(QString::fromStdString(sql));
-
-  // start for the transaction
-  //qtDB->transaction();
+  SQLBatch b(sql, 5, "Model::sqlBargainEntries");
+  // the same key as in SMPState::updateBargnTable, so that both pick the same rows
+  if (!logRule("Bargn").sample(rngSeed, t, bargainId, (initiator << 16) | receiver)) {
+    return;
+  }
 
   // Turn_t
-  query.bindValue(":turn_t", t);
+  b.add(t);
   //BargnID
-  query.bindValue(":bargnid", bargainId);
+  b.add(bargainId);
   //Init_Act_i
-  query.bindValue(":init_i", initiator);
+  b.add(initiator);
   //Recd_Act_j
-  query.bindValue(":recd_j", receiver);
+  b.add(receiver);
   //Value
-  query.bindValue(":value", val);
-  if (!query.exec()) {
-    LOG(INFO) << query.lastError().text().toStdString();
-    throw KException("Model::sqlBargainEntries: DB query failed");
-  }
-  //qtDB->commit();
+  b.add(val);
+  sqlWriteTurn("Bargn", t, std::move(b));
 }
 
 
@@ -687,33 +940,29 @@ void Model::sqlBargainCoords(unsigned int t, int bargnID, const KBase::VctrPstn
   // prepare the sql statement to insert
   string sql = string("INSERT INTO BargnCoords (ScenarioId, Turn_t, BargnID, Dim_k, Init_Coord, Recd_Coord) VALUES ('")
     + scenId + "', :turn_t, :bargnid, :dim_k, :init_coord, :recd_coord)";
-  query.prepare(QString::fromStdString(sql));
-
-  // start for the transaction
-  //qtDB->transaction();
+  SQLBatch b(sql, 5, "Model::sqlBargainCoords");
+  if (!logRule("BargnCoords").sample(rngSeed, t, bargnID)) {
+    return;
+  }
 
   for (int k = 0; k < nDim; k++)
   {
 
     // Turn_t
-    query.bindValue(":turn_t", t);
+    b.add(t);
     //Baragainer
-    query.bindValue(":bargnid", bargnID);
+    b.add(bargnID);
     //Dim_K
-    query.bindValue(":dim_k", k);
+    b.add(k);
 
     //Init_Coord
-    query.bindValue(":init_coord", initPos(k, 0) * 100.0);
+    b.add(initPos(k, 0) * 100.0);
     //Recd_Coord
 
-    query.bindValue(":recd_coord", rcvrPos(k, 0) * 100.0);
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("Model::sqlBargainCoords: DB query failed");
-    }
+    b.add(rcvrPos(k, 0) * 100.0);
   }
 
-  //qtDB->commit();
+  sqlWriteTurn("BargnCoords", t, std::move(b));
 }
 
 
@@ -728,32 +977,30 @@ void Model::sqlBargainUtil(unsigned int t, vector<uint64_t> bargnIds,  KBase::KM
   string sql = string("INSERT INTO BargnUtil  (ScenarioId, Turn_t,BargnId, Act_i, Util) VALUES ('")
     + scenId + "', :turn_t, :bgnId, :act_i, :util)";
 
-  query.prepare(QString::fromStdString(sql));
-  // start for the transaction
-  //qtDB->transaction();
+  SQLBatch b(sql, 4, "Model::sqlBargainUtil");
+  b.vals.reserve(4 * Util_mat_row * Util_mat_col);
+  const LogPolicy::Rule & r = logRule("BargnUtil");
   uint64_t Bargn_i = 0;
   for (unsigned int i = 0; i < Util_mat_row; i++)
   {
     for (unsigned int j = 0; j < Util_mat_col; j++)
     {
+      Bargn_i = bargnIds[j];
+      if (!r.sample(rngSeed, t, Bargn_i, i)) {
+        continue;
+      }
       // Turn_t
-      query.bindValue(":turn_t", t);
+      b.add(t);
       //Bargn_i
-      Bargn_i = bargnIds[j];
-      query.bindValue(":bgnId", (qulonglong)Bargn_i);
+      b.add((qulonglong)Bargn_i);
       //Act_i
-      query.bindValue(":act_i", i);
+      b.add(i);
       //Util
-      query.bindValue(":util", Util_mat(i, j));
-      // finish
-      if (!query.exec()) {
-        LOG(INFO) << query.lastError().text().toStdString();
-        throw KException("Model::sqlBargainUtil: DB query failed");
-      }
+      b.add(Util_mat(i, j));
     }
   }
 
-  //qtDB->commit();
+  sqlWriteTurn("BargnUtil", t, std::move(b));
 }
 
 // JAH 20160731 added this function in replacement to the separate
@@ -766,47 +1013,63 @@ void Model::LogInfoTables()
     throw KException("Model::LogInfoTables: Wrong Actor count");
   }
 
-  // for efficiency sake, we'll do all tables in a single transaction
-  // form the insert cmmands
-  // prepare the prepared statement statements
-  string sql = "INSERT INTO ActorDescription (ScenarioId,Act_i,Name,\"Desc\") VALUES ('"
-    + scenId + "', :act_i, :name, :desc)";
-  query.prepare(QString::fromStdString(sql));
-  qtDB->transaction();
-  // Actor Description Table
-  // For each actor fill the required information
-  for (unsigned int i = 0; i < actrs.size(); i++) {
-    Actor * act = actrs.at(i);
-    // bind the data
-    query.bindValue(":act_i", i);
-    query.bindValue(":name", act->name.c_str());
-    query.bindValue(":desc", act->desc.c_str());
-    // record
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("Model::LogInfoTables: DB query failed");
+  if (logRule("ActorDescription").on) {
+    // for efficiency sake, we'll do all tables in a single transaction
+    // form the insert cmmands
+    // prepare the prepared statement statements
+    string sql = "INSERT INTO ActorDescription (ScenarioId,Act_i,Name,\"Desc\") VALUES ('"
+      + scenId + "', :act_i, :name, :desc)";
+    query.prepare(QString::fromStdString(sql));
+    qtDB->transaction();
+    // Actor Description Table
+    // For each actor fill the required information
+    for (unsigned int i = 0; i < actrs.size(); i++) {
+      Actor * act = actrs.at(i);
+      // bind the data
+      query.bindValue(":act_i", i);
+      query.bindValue(":name", act->name.c_str());
+      query.bindValue(":desc", act->desc.c_str());
+      // record
+      if (!query.exec()) {
+        LOG(INFO) << query.lastError().text().toStdString();
+        throw KException("Model::LogInfoTables: DB query failed");
+      }
     }
+    qtDB->commit();
   }
-  qtDB->commit();
 
-  // Scenario Description
-  // Turn_t
-  // Scen Id
-  // rng seed JAH 20160711
-  // have to convert to text and store it that way, since sqlite3 doesn't really understand unsigned ints
-  char *seedBuff = newChars(50);
-  sprintf(seedBuff,"%20llu",rngSeed);
-  const char* strSeed = seedBuff;
-  sql = string("INSERT INTO ScenarioDesc (Scenario,\"Desc\",ScenarioId,RNGSeed,"
-    "VictoryProbModel,ProbCondorcetElection,StateTransition) VALUES ('"
-    + scenName + "', '" + scenDesc + "', '" + scenId + "', '" + strSeed + "', "
-    + std::to_string(static_cast<int>(vpm)) + ", "
-    + std::to_string(static_cast<int>(pcem)) + ", "
-    + std::to_string(static_cast<int>(stm))
-    + " )");
-
-  execQuery(sql);
-  delete [] seedBuff;
+  if (logRule("ScenarioDesc").on) {
+    // Scenario Description
+    // Turn_t
+    // Scen Id
+    // rng seed JAH 20160711
+    // have to convert to text and store it that way, since sqlite3 doesn't really understand unsigned ints
+    char *seedBuff = newChars(50);
+    sprintf(seedBuff,"%20llu",rngSeed);
+    const char* strSeed = seedBuff;
+    string sql = string("INSERT INTO ScenarioDesc (Scenario,\"Desc\",ScenarioId,RNGSeed,"
+      "VictoryProbModel,ProbCondorcetElection,StateTransition) VALUES ('"
+      + scenName + "', '" + scenDesc + "', '" + scenId + "', '" + strSeed + "', "
+      + std::to_string(static_cast<int>(vpm)) + ", "
+      + std::to_string(static_cast<int>(pcem)) + ", "
+      + std::to_string(static_cast<int>(stm))
+      + " )");
+    // only forks name the new columns, so that other runs can still use older databases
+    if (!parentScenId.empty()) {
+      sql = string("INSERT INTO ScenarioDesc (Scenario,\"Desc\",ScenarioId,RNGSeed,"
+        "VictoryProbModel,ProbCondorcetElection,StateTransition,ParentScenarioId,ForkTurn) VALUES ('"
+        + scenName + "', '" + scenDesc + "', '" + scenId + "', '" + strSeed + "', "
+        + std::to_string(static_cast<int>(vpm)) + ", "
+        + std::to_string(static_cast<int>(pcem)) + ", "
+        + std::to_string(static_cast<int>(stm)) + ", '"
+        + parentScenId + "', "
+        + std::to_string(forkTurn)
+        + " )");
+    }
+
+    execQuery(sql);
+    delete [] seedBuff;
+  }
   return;
 }
 
@@ -817,35 +1080,32 @@ void Model::sqlBargainVote(unsigned int t, vector< tuple<uint64_t, uint64_t>> ba
   // prepare the sql statement to insert
   string sql = string("INSERT INTO BargnVote (ScenarioId, Turn_t, BargnId_i, BargnId_j, Act_k, Vote) VALUES ('")
     + scenId + "', :turn_t, :bargnid_i, :bargnid_j, :act_k, :vote)";
-  query.prepare(QString::fromStdString(sql));
-
-  // start for the transaction
-  //qtDB->transaction();
+  SQLBatch b(sql, 5, "Model::sqlBargainVote");
+  b.vals.reserve(5 * Util_mat_row);
+  const LogPolicy::Rule & r = logRule("BargnVote");
 
   for (unsigned int i = 0; i <Util_mat_row ; i++)
   {
     tuple<uint64_t, uint64_t> tijids = barginidspair_i_j[i];
     uint64_t Bargn_i = std::get<0>(tijids);
     uint64_t Bargn_j = std::get<1>(tijids);
+    if (!r.sample(rngSeed, t, Bargn_i, (Bargn_j << 8) | act_k)) {
+      continue;
+    }
 
     // Turn_t
-    query.bindValue(":turn_t", t);
+    b.add(t);
     //Bargn_i
-    query.bindValue(":bargnid_i", (qulonglong)Bargn_i);
+    b.add((qulonglong)Bargn_i);
     //Bargn_j
-    query.bindValue(":bargnid_j", (qulonglong)Bargn_j);
+    b.add((qulonglong)Bargn_j);
     //Act_i
-    query.bindValue(":act_k", act_k);
+    b.add(act_k);
     //Util
     double voteMat = Vote_mat[i];
-    query.bindValue(":vote", voteMat);
-    // finish
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("Model::sqlBargainVote: DB query failed");
-    }
+    b.add(voteMat);
   }
-  //qtDB->commit();
+  sqlWriteTurn("BargnVote", t, std::move(b));
 }
 
 // populates record for table PosProb for each step of
@@ -863,13 +1123,15 @@ void Model::sqlPosProb(unsigned int t)
   // prepare the sql statement to insert
   string sql = string("INSERT INTO PosProb (ScenarioId, Turn_t, Est_h,Pos_i, Prob) VALUES ('")
     + scenId + "', :turn_t, :est_h, :pos_i, :prob)";
-  query.prepare(QString::fromStdString(sql));
+  SQLBatch b(sql, 4, "Model::sqlPosProb");
+  const LogPolicy::Rule & r = logRule("PosProb");
 
-  // start for the transaction
-  qtDB->transaction();
   // collect the information from each estimator,actor
   for (unsigned int h = 0; h < numAct; h++)   // estimator is h
   {
+    if (!r.estimator(h)) {
+      continue;
+    }
     // calculate the probablity with respect to each estimator
     auto pn = st->pDist(h);
     auto pdt = std::get<0>(pn); // note that these are unique positions
@@ -880,19 +1142,22 @@ void Model::sqlPosProb(unsigned int t)
     // for each actor pupulate the probablity information
     for (unsigned int i = 0; i < numAct; i++)
     {
+      if (!r.sample(rngSeed, t, h, i)) {
+        continue;
+      }
       // Extract the probabity for each actor
       double prob = st->posProb(i, unq, pdt);
-      query.bindValue(":turn_t", t);
-      query.bindValue(":est_h", h);
-      query.bindValue(":pos_i", i);
-      query.bindValue(":prob", prob);
-      if (!query.exec()) {
-        LOG(INFO) << query.lastError().text().toStdString();
-        throw KException("Model::sqlPosProb: DB query failed");
-      }
+      b.add(t);
+      b.add(h);
+      b.add(i);
+      b.add(prob);
     }
   }
-  qtDB->commit();
+
+  // start for the transaction
+  beginDBTransaction();
+  sqlWrite(std::move(b));
+  commitDBTransaction();
   return;
 }
 // populates record for table PosProb for each step of
@@ -912,10 +1177,9 @@ void Model::sqlPosVote(unsigned int t)
   // prepare the sql statement to insert
   string sql = string("INSERT INTO PosVote (ScenarioId, Turn_t, Est_h, Voter_k, Pos_i, Pos_j, Vote) VALUES ('")
     + scenId + "', :turn_t, :est_h, :voter_k, :pos_i, :pos_j, :vote)";
-  query.prepare(QString::fromStdString(sql));
+  SQLBatch b(sql, 6, "Model::sqlPosVote");
+  const LogPolicy::Rule & r = logRule("PosVote");
 
-  // start for the transaction
-  qtDB->transaction();
   auto vr = VotingRule::Proportional;
   // collect the information from each estimator
 
@@ -928,29 +1192,30 @@ void Model::sqlPosVote(unsigned int t)
       {
         for (unsigned int h = 0; h < numAct; h++)   // estimator is h
         {
-          if (((h == i) || (h == j)) && (i!=j))
+          if (((h == i) || (h == j)) && (i != j) && r.estimator(h)
+              && r.sample(rngSeed, t, (h << 16) | k, (i << 16) | j))
           {
             auto vij = rd->vote(h, i, j, st);
-            query.bindValue(":turn_t", t);
-            query.bindValue(":est_h", h);
+            b.add(t);
+            b.add(h);
             //voter_k
-            query.bindValue(":voter_k", k);
+            b.add(k);
             // position i
-            query.bindValue(":pos_i", i);
+            b.add(i);
             //position j
-            query.bindValue(":pos_j", j);
+            b.add(j);
             // vote ?
-            query.bindValue(":vote", vij);
-            if (!query.exec()) {
-              LOG(INFO) << query.lastError().text().toStdString();
-              throw KException("Model::sqlPosVote: DB query failed");
-            }
+            b.add(vij);
           }
         }
       }
     }
   }
-  qtDB->commit();
+
+  // start for the transaction
+  beginDBTransaction();
+  sqlWrite(std::move(b));
+  commitDBTransaction();
 
   return;
 }
@@ -982,7 +1247,8 @@ bool Model::loginCredentials(string connString) {
     Port,
     Database,
     Uid,
-    Pwd
+    Pwd,
+    Format
   };
 
   std::map<std::string, userParams> mapStringToUserParams =
@@ -993,6 +1259,7 @@ bool Model::loginCredentials(string connString) {
     { "database", userParams::Database },
     { "uid", userParams::Uid },
     { "pwd", userParams::Pwd },
+    { "format", userParams::Format },
   };
 
   auto trimWhites = [](string &input) {
@@ -1022,6 +1289,8 @@ bool Model::loginCredentials(string connString) {
     trimWhites(value);
   };
 
+  columnarResults = false; // unless this string asks for it
+
   string parsedParam;
   std::stringstream  inputCredential(const_cast<char*>(connString.c_str()));
   while (getline(inputCredential, parsedParam, ';'))
@@ -1072,6 +1341,15 @@ bool Model::loginCredentials(string connString) {
     case userParams::Pwd:
       password = QString::fromStdString(value);
       break;
+    case userParams::Format:
+      std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+      if ((value != "sql") && (value != "columnar")) {
+        lastExceptionMsg = "Error! Format must be sql or columnar";
+        LOG(INFO) << lastExceptionMsg;
+        return false;
+      }
+      columnarResults = (value == "columnar");
+      break;
     default:
       lastExceptionMsg = "Error in input credentials format";
       LOG(INFO) << lastExceptionMsg;
@@ -0,0 +1,309 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+//
+// Solvers for the stationary distribution of the Markov PCE models. With
+// challenge probabilities C (each column sums to 1) and victory probabilities
+// V, one round of voting takes p to q = Mp, where
+//
+//   q_i = sum_j V_ij (p_i C_ji + p_j C_ij)
+//
+// so M_ij = V_ij C_ij off the diagonal, and M_ii = V_ii C_ii + sum_j V_ij C_ji.
+// As V_ij + V_ji = 1, each column of M sums to 1, and the answer is an
+// eigenvector of M for eigenvalue 1, scaled to sum to 1.
+//
+// Damped   iterate p <- (p + Mp)/2 from the uniform distribution. This is the
+//          classic KTAB loop, and converges slowly when options are nearly tied.
+// Direct   solve (M - I)p = 0 with sum(p) = 1 by LU decomposition with partial
+//          pivoting: O(n^3) once, rather than O(n^2) per iteration.
+// Anderson the damped map, accelerated by Anderson mixing of the last few
+//          steps (for depth 1 this is close to Aitken's delta-squared), and able
+//          to start from the previous turn's distribution.
+//
+// Direct and Anderson check their answer, and fall back to Damped if it is
+// not a distribution within tolerance.
+// -------------------------------------------------
+
+#include <easylogging++.h>
+
+#include <cmath>
+
+#include "kmodel.h"
+
+namespace KBase {
+
+namespace {
+const unsigned int iMax = 1000;
+const unsigned int andersonDepth = 4;
+
+KMatrix transitionMatrix(const KMatrix & pv, const KMatrix & cp) {
+  const unsigned int n = pv.numR();
+  auto m = KMatrix(n, n);
+  for (unsigned int i = 0; i < n; i++) {
+    double mii = 0.0;
+    for (unsigned int j = 0; j < n; j++) {
+      m(i, j) = pv(i, j) * cp(i, j);
+      mii = mii + pv(i, j) * cp(j, i);
+    }
+    m(i, i) = m(i, i) + mii;
+  }
+  return m;
+}
+
+// max |Mp - p|, with Mp left in mp
+double residual(const KMatrix & m, const KMatrix & p, KMatrix & mp) {
+  const unsigned int n = p.numR();
+  double r = 0.0;
+  for (unsigned int i = 0; i < n; i++) {
+    double qi = 0.0;
+    for (unsigned int j = 0; j < n; j++) {
+      qi = qi + m(i, j) * p(j, 0);
+    }
+    mp(i, 0) = qi;
+    const double c = fabs(qi - p(i, 0));
+    r = (c > r) ? c : r;
+  }
+  return r;
+}
+
+bool isDistribution(const KMatrix & p, unsigned int n) {
+  if ((n != p.numR()) || (1 != p.numC())) {
+    return false;
+  }
+  double s = 0.0;
+  for (unsigned int i = 0; i < n; i++) {
+    if (!(0.0 <= p(i, 0))) { // also catches NaN
+      return false;
+    }
+    s = s + p(i, 0);
+  }
+  return (fabs(s - 1.0) < 1E-6);
+}
+
+// clip the small negatives of round-off and rescale to sum to 1;
+// false if nothing positive is left
+bool toSimplex(KMatrix & p) {
+  const unsigned int n = p.numR();
+  double s = 0.0;
+  for (unsigned int i = 0; i < n; i++) {
+    if (!(0.0 < p(i, 0))) {
+      p(i, 0) = 0.0;
+    }
+    s = s + p(i, 0);
+  }
+  if (!(0.0 < s) || !std::isfinite(s)) {
+    return false;
+  }
+  p /= s;
+  return true;
+}
+
+// solve a x = b in place by Gaussian elimination with partial pivoting;
+// false if a is (numerically) singular
+bool luSolve(KMatrix & a, KMatrix & b) {
+  const unsigned int n = a.numR();
+  for (unsigned int k = 0; k < n; k++) {
+    unsigned int pk = k;
+    for (unsigned int i = k + 1; i < n; i++) {
+      if (fabs(a(i, k)) > fabs(a(pk, k))) {
+        pk = i;
+      }
+    }
+    if (!(1E-14 < fabs(a(pk, k)))) {
+      return false;
+    }
+    if (pk != k) {
+      for (unsigned int j = k; j < n; j++) {
+        std::swap(a(k, j), a(pk, j));
+      }
+      std::swap(b(k, 0), b(pk, 0));
+    }
+    for (unsigned int i = k + 1; i < n; i++) {
+      const double f = a(i, k) / a(k, k);
+      if (0.0 != f) {
+        for (unsigned int j = k + 1; j < n; j++) {
+          a(i, j) = a(i, j) - f * a(k, j);
+        }
+        b(i, 0) = b(i, 0) - f * b(k, 0);
+      }
+    }
+  }
+  for (unsigned int k = n; 0 < k; k--) {
+    const unsigned int i = k - 1;
+    double s = b(i, 0);
+    for (unsigned int j = i + 1; j < n; j++) {
+      s = s - a(i, j) * b(j, 0);
+    }
+    b(i, 0) = s / a(i, i);
+  }
+  return true;
+}
+
+bool damped(const KMatrix & m, double tol, KMatrix & p, PCEDiagnostics & d) {
+  const unsigned int n = m.numR();
+  p = KMatrix(n, 1, 1.0) / n;
+  auto mp = p;
+  d.iterations = 0;
+  d.residual = residual(m, p, mp);
+  while ((tol < d.residual) && (d.iterations < iMax)) {
+    p += mp;
+    p /= 2.0;
+    d.iterations++;
+    d.residual = residual(m, p, mp);
+  }
+  return (d.residual <= tol);
+}
+
+bool direct(const KMatrix & m, double tol, KMatrix & p, PCEDiagnostics & d) {
+  const unsigned int n = m.numR();
+  auto a = m;
+  for (unsigned int i = 0; i < n; i++) {
+    a(i, i) = a(i, i) - 1.0;
+  }
+  // the rows of M - I are dependent, so one is replaced by sum(p) = 1
+  for (unsigned int j = 0; j < n; j++) {
+    a(n - 1, j) = 1.0;
+  }
+  p = KMatrix(n, 1);
+  p(n - 1, 0) = 1.0;
+  d.iterations = 0;
+  if (!luSolve(a, p) || !toSimplex(p)) {
+    return false;
+  }
+  auto mp = p;
+  d.residual = residual(m, p, mp);
+  return (d.residual <= tol);
+}
+
+// Anderson mixing of the damped map g(p) = (p + Mp)/2, whose own residual is
+// f(p) = g(p) - p. With dF and dG the differences of the last few f and g,
+// the next point is g - dG y, where y minimizes |f - dF y|.
+bool anderson(const KMatrix & m, double tol, KMatrix & p, PCEDiagnostics & d) {
+  auto mp = p;
+  vector<KMatrix> dF = {};
+  vector<KMatrix> dG = {};
+  auto fPrev = KMatrix();
+  auto gPrev = KMatrix();
+  d.iterations = 0;
+  d.residual = residual(m, p, mp);
+  while ((tol < d.residual) && (d.iterations < iMax)) {
+    const KMatrix g = (p + mp) / 2.0;
+    const KMatrix f = g - p;
+    if (0 < fPrev.numR()) {
+      dF.push_back(f - fPrev);
+      dG.push_back(g - gPrev);
+      if (andersonDepth < dF.size()) {
+        dF.erase(dF.begin());
+        dG.erase(dG.begin());
+      }
+    }
+    fPrev = f;
+    gPrev = g;
+
+    auto pNext = g;
+    const unsigned int k = dF.size();
+    if (0 < k) {
+      // normal equations, lightly regularized as the differences become parallel
+      auto a = KMatrix(k, k);
+      auto b = KMatrix(k, 1);
+      double scale = 0.0;
+      for (unsigned int r = 0; r < k; r++) {
+        for (unsigned int c = 0; c < k; c++) {
+          a(r, c) = dot(dF[r], dF[c]);
+        }
+        b(r, 0) = dot(dF[r], f);
+        scale = (a(r, r) > scale) ? a(r, r) : scale;
+      }
+      for (unsigned int r = 0; r < k; r++) {
+        a(r, r) = a(r, r) + 1E-10 * scale;
+      }
+      if (luSolve(a, b)) {
+        for (unsigned int r = 0; r < k; r++) {
+          pNext -= b(r, 0) * dG[r];
+        }
+      }
+      if (!toSimplex(pNext)) {
+        pNext = g;
+        dF.clear();
+        dG.clear();
+      }
+    }
+    p = pNext;
+    d.iterations++;
+    d.residual = residual(m, p, mp);
+    if (!std::isfinite(d.residual)) {
+      return false;
+    }
+  }
+  return (d.residual <= tol);
+}
+}
+
+KMatrix Model::markovStationary(const KMatrix & pv, const KMatrix & cp, PCESolver s,
+                                double tol, const KMatrix & p0, PCEDiagnostics * diag) {
+  const unsigned int n = pv.numR();
+  if ((n != pv.numC()) || (n != cp.numR()) || (n != cp.numC())) {
+    throw KException("Model::markovStationary: pv and cp must be square and of the same size");
+  }
+  const auto m = transitionMatrix(pv, cp);
+  auto d = PCEDiagnostics();
+  d.solver = s;
+  auto p = KMatrix();
+  bool ok = false;
+  switch (s) {
+  case PCESolver::Damped:
+    ok = damped(m, tol, p, d);
+    break;
+  case PCESolver::Direct:
+    ok = direct(m, tol, p, d);
+    break;
+  case PCESolver::Anderson:
+    d.warmStart = isDistribution(p0, n);
+    p = d.warmStart ? p0 : KMatrix(n, 1, 1.0) / n;
+    ok = anderson(m, tol, p, d);
+    break;
+  default:
+    throw KException("Model::markovStationary: unrecognized PCESolver");
+  }
+
+  if (!ok && (PCESolver::Damped != s)) {
+    LOG(INFO) << KBase::getFormattedString(
+      "Model::markovStationary: %s solver failed with residual %.3e after %u iterations, so falling back to Damped",
+      nameFromEnum<PCESolver>(s, PCESolverNames).c_str(), d.residual, d.iterations);
+    d.solver = PCESolver::Damped;
+    d.fellBack = true;
+    ok = damped(m, tol, p, d);
+  }
+  if (nullptr != diag) {
+    *diag = d;
+  }
+  if (!ok) { // no way to recover
+    throw KException("Model::markovStationary: Iteration exceeded upper limit");
+  }
+  return p;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
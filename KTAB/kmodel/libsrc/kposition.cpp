@@ -80,6 +80,15 @@ void MtchPstn::print(ostream& os) const {
   return;
 }
 
+VUI MtchPstn::eqvKey() const {
+  if (numItm != match.size()) {
+    throw KException("MtchPstn::eqvKey: Size of match is not correct");
+  }
+  VUI key = { numItm, numCat };
+  key.insert(key.end(), match.begin(), match.end());
+  return key;
+}
+
 vector< MtchPstn > MtchPstn::neighbors(unsigned int nVar) const {
   if (0 >= nVar) {
     throw KException("MtchPstn::neighbors: nVar must be positive");
@@ -55,6 +55,7 @@ void State::clear() {
   // We delete positions because they are part of the state.
   // Actors persist across states, so they are not deleted here.
   aUtil = {}; // vector<KMatrix>();
+  aUtilProv = nullptr;
   for (auto p : pstns) {
     if (nullptr != p) {
       delete p;
@@ -77,6 +78,7 @@ void State::randomizeUtils(double minU, double maxU, double uNoise) {
   auto rng = model->rng;
   unsigned int na = model->numAct;
   aUtil = vector<KMatrix>();
+  aUtilProv = nullptr;
   auto u = KMatrix::uniform(rng, na, na, minU, maxU);
   for (unsigned int i = 0; i < na; i++) {
     auto un = KMatrix::uniform(rng, na, na, -uNoise, +uNoise);
@@ -143,11 +145,6 @@ void State::setUENdx() {
     throw KException("State::setUENdx: eIndices must be empty");
   }
 
-  // Note that we have to lambda-bind 'this'. Otherwise, we'd need a 'static' function
-  // to give to uIndices.
-  auto efn = [this](unsigned int i, unsigned int j) {
-    return equivNdx(i, j);
-  };
   const unsigned int na = model->numAct;
   if (Model::minNumActor > na) {
     throw KException(string("State::setUENdx: Number of actors can not be less than ")
@@ -159,8 +156,7 @@ void State::setUENdx() {
       + std::to_string(Model::maxNumActor));
   }
 
-  auto ns = KBase::uiSeq(0, na - 1);
-  auto uePair = KBase::ueIndices<unsigned int>(ns, efn);
+  auto uePair = uniqueEquivNdx();
 
   uIndices = get<0>(uePair);
   auto nu = ((const unsigned int)(uIndices.size()));
@@ -180,13 +176,24 @@ void State::setUENdx() {
 }
 
 
+tuple<VUI, VUI> State::uniqueEquivNdx() const {
+  // Note that we have to lambda-bind 'this'. Otherwise, we'd need a 'static' function
+  // to give to uIndices.
+  auto efn = [this](unsigned int i, unsigned int j) {
+    return equivNdx(i, j);
+  };
+  auto ns = KBase::uiSeq(0, model->numAct - 1);
+  return KBase::ueIndices<unsigned int>(ns, efn);
+}
+
+
 void State::setAUtil(int perspH, ReportingLevel rl) {
   // we want to make sure that data is calculated at most once.
   // This is necessary because some utilities are very expensive to calculate,
   // it is easiest to be precise all the time.
 
   if (-1 == perspH) { // calculate them all at once
-    if (0 != aUtil.size()) {
+    if ((0 != aUtil.size()) || (nullptr != aUtilProv)) {
       throw KException("State::setAUtil: Util vector is not empty");
     }
 
@@ -198,6 +205,9 @@ void State::setAUtil(int perspH, ReportingLevel rl) {
       throw KException(string("State::setAUtil: Perspective of h must be in the range of [0,") + std::to_string(na) + ")");
     }
 
+    if (nullptr != aUtilProv) {
+      throw KException("State::setAUtil: Utilities already supplied by a provider");
+    }
     bool firstP = (0 == aUtil.size());
     bool firstForH = ((na == aUtil.size()) && (0 == aUtil[perspH].numR()) && (0 == aUtil[perspH].numC()));
     if (!(firstP || firstForH)) {
@@ -214,12 +224,52 @@ void State::setAUtil(int perspH, ReportingLevel rl) {
   return;
 }
 
+KMatrix State::aUtilMatrix(unsigned int h) const {
+  if (nullptr != aUtilProv) {
+    return aUtilProv->utilMatrix(h);
+  }
+  if (h >= aUtil.size()) {
+    throw KException("State::aUtilMatrix: No utilities for perspective " + std::to_string(h));
+  }
+  return aUtil[h];
+}
+
+bool State::aUtilSet() const {
+  const unsigned int na = model->numAct;
+  if (nullptr != aUtilProv) {
+    return (na == aUtilProv->numAct());
+  }
+  return (na == aUtil.size());
+}
+
 void State::setOneAUtil(unsigned int perspH, ReportingLevel rl) {
   // TODO: make this non-dummy
   throw KException("State::setOneAUtil: A dummy function");
   return;
 }
 
+
+// --------------------------------------------
+UtilProvider::UtilProvider() {
+}
+
+UtilProvider::~UtilProvider() {
+}
+
+KMatrix UtilProvider::utilMatrix(unsigned int h) const {
+  const unsigned int na = numAct();
+  if (h >= na) {
+    throw KException("UtilProvider::utilMatrix: Perspective h must be less than the number of actors");
+  }
+  auto u = KMatrix(na, na);
+  for (unsigned int i = 0; i < na; i++) {
+    for (unsigned int j = 0; j < na; j++) {
+      u(i, j) = util(h, i, j);
+    }
+  }
+  return u;
+}
+
 } // end of namespace
 
 // --------------------------------------------
@@ -0,0 +1,233 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+
+#include "kutils.h"
+#include "prng.h"
+#include "logpolicy.h"
+
+namespace KBase {
+
+namespace {
+unsigned int number(const string & s, const string & clause) {
+  return KBase::number(s, "LogPolicy::apply", clause, LogPolicy::noTurn - 1);
+}
+
+// FNV-1a, to give each table its own samples
+uint64_t nameHash(const string & s) {
+  uint64_t h = 0xCBF29CE484222325;
+  for (char c : s) {
+    h = (h ^ (unsigned char)c) * 0x100000001B3;
+  }
+  return h;
+}
+} // end of anonymous namespace
+
+const vector<string> LogPolicy::groupNames = {
+  "Information", "Position", "Challenge", "Bargain", "VectorPosition"
+};
+
+bool LogPolicy::Rule::turn(unsigned int t) const {
+  if (!on) {
+    return false;
+  }
+  if (turns.empty()) {
+    return (0 == last); // every turn, unless only the last ones were asked for
+  }
+  for (const auto & r : turns) {
+    if ((r.first <= t) && (t <= r.second)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LogPolicy::Rule::lastTurn(unsigned int t, unsigned int finalT) const {
+  return on && (t <= finalT) && (finalT - t < last);
+}
+
+bool LogPolicy::Rule::catchUp(unsigned int t, unsigned int finalT) const {
+  if (t == finalT) { // nothing is written for the final turn during the run
+    return selected(t, finalT);
+  }
+  return lastTurn(t, finalT) && !turn(t);
+}
+
+bool LogPolicy::Rule::estimator(unsigned int h) const {
+  return on && (ests.empty() || ((h < ests.size()) && ests[h]));
+}
+
+bool LogPolicy::Rule::sample(uint64_t seed, unsigned int t, uint64_t a, uint64_t b) const {
+  if (1.0 <= rate) {
+    return true;
+  }
+  uint64_t ctr[2] = { a, b };
+  StreamPRNG::philox(ctr, seed ^ salt ^ (0x9E3779B97F4A7C15 * (t + 1)));
+  return ((double)ctr[0]) < std::ldexp(rate, 64);
+}
+
+
+LogPolicy::LogPolicy() {
+  groupFlags = vector<bool>(groupNames.size(), true);
+}
+
+LogPolicy::LogPolicy(const vector<bool> & f) {
+  groupFlags = f;
+}
+
+LogPolicy::~LogPolicy() {}
+
+void LogPolicy::apply(const string & cs) {
+  for (const string & c : split(cs, ';')) {
+    if (!c.empty()) {
+      applyOne(c);
+    }
+  }
+  return;
+}
+
+void LogPolicy::applyOne(const string & clause) {
+  const vector<string> parts = split(clause, ':');
+  Clause c;
+  c.target = lowerCase(parts[0]);
+  c.rule.on = true;
+  if ((!c.target.empty()) && ('-' == c.target[0])) {
+    c.rule.on = false;
+    c.target = trimmed(c.target.substr(1));
+  }
+  if (c.target.empty()) {
+    throw KException("LogPolicy::apply: no table named in " + clause);
+  }
+  if ((!c.rule.on) && (1 < parts.size())) {
+    throw KException("LogPolicy::apply: a table which is not recorded takes no options, in " + clause);
+  }
+
+  bool turnsGiven = false;
+  for (size_t n = 1; n < parts.size(); n++) {
+    const size_t eq = parts[n].find('=');
+    if (string::npos == eq) {
+      throw KException("LogPolicy::apply: expected <key>=<value>, not '" + parts[n] + "', in " + clause);
+    }
+    const string key = lowerCase(trimmed(parts[n].substr(0, eq)));
+    const string val = trimmed(parts[n].substr(eq + 1));
+    if ("turns" == key) {
+      turnsGiven = true;
+      for (const string & r : split(val, ',')) {
+        const size_t dash = r.find('-');
+        if (string::npos == dash) {
+          const unsigned int t = number(r, clause);
+          c.rule.turns.push_back({ t, t });
+        }
+        else {
+          const string hi = trimmed(r.substr(dash + 1));
+          const unsigned int t0 = number(trimmed(r.substr(0, dash)), clause);
+          const unsigned int t1 = hi.empty() ? (noTurn - 1) : number(hi, clause);
+          if (t1 < t0) {
+            throw KException("LogPolicy::apply: empty range of turns " + r + " in " + clause);
+          }
+          c.rule.turns.push_back({ t0, t1 });
+        }
+      }
+    }
+    else if ("first" == key) {
+      turnsGiven = true;
+      const unsigned int k = number(val, clause);
+      if (0 < k) {
+        c.rule.turns.push_back({ 0, k - 1 });
+      }
+    }
+    else if ("last" == key) {
+      c.rule.last = number(val, clause);
+    }
+    else if ("est" == key) {
+      for (const string & h : split(val, ',')) {
+        const unsigned int e = number(h, clause);
+        if (c.rule.ests.size() <= e) {
+          c.rule.ests.resize(e + 1, false);
+        }
+        c.rule.ests[e] = true;
+      }
+    }
+    else if ("rate" == key) {
+      size_t used = 0;
+      double p = -1.0;
+      try {
+        p = std::stod(val, &used);
+      }
+      catch (...) {
+        used = 0;
+      }
+      if ((used != val.size()) || !(0.0 < p) || (1.0 < p)) {
+        throw KException("LogPolicy::apply: rate must be in (0, 1], in " + clause);
+      }
+      c.rule.rate = p;
+    }
+    else {
+      throw KException("LogPolicy::apply: unknown option '" + key + "' in " + clause);
+    }
+  }
+  // e.g. first=0 selects no turns, rather than every turn
+  if (turnsGiven && c.rule.turns.empty() && (0 == c.rule.last)) {
+    c.rule.on = false;
+  }
+  clauses.push_back(c);
+  return;
+}
+
+LogPolicy::Rule LogPolicy::rule(const string & table, unsigned int group) const {
+  Rule r;
+  r.on = (group < groupFlags.size()) && groupFlags[group];
+  const string tab = lowerCase(table);
+  const string grp = (group < groupNames.size()) ? lowerCase(groupNames[group]) : "";
+  for (const Clause & c : clauses) {
+    if ((c.target == tab) || (c.target == grp) || (c.target == "all")) {
+      r = c.rule;
+    }
+  }
+  r.salt = nameHash(tab);
+  return r;
+}
+
+void LogPolicy::check(const vector<string> & tables) const {
+  for (const Clause & c : clauses) {
+    bool known = ("all" == c.target);
+    for (const string & g : groupNames) {
+      known = known || (lowerCase(g) == c.target);
+    }
+    for (const string & tab : tables) {
+      known = known || (lowerCase(tab) == c.target);
+    }
+    if (!known) {
+      throw KException("LogPolicy::check: no table or group named " + c.target);
+    }
+  }
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
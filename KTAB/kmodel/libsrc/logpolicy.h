@@ -0,0 +1,126 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// Which rows of which tables a model records. A policy starts from the five
+// groups of tables that the sqlFlags used to switch (all of a group, or none
+// of it), and then applies clauses, each of which sets one table, one group
+// or all tables:
+//
+//   [-]<table|group|all>[:turns=<ranges>][:first=<k>][:last=<k>][:est=<list>][:rate=<p>]
+//
+// A leading '-' stops recording the target; otherwise the target is recorded
+// with exactly the options given, replacing whatever an earlier clause set.
+// Several clauses may be given at once, separated by ';'. For example,
+//
+//   -all; Information; VectorPosition; PosUtil:est=0,3:last=2; Challenge:est=0,3:rate=0.1
+//
+// records the scenario and the position histories, the utilities estimated by
+// actors 0 and 3 in the final two turns, and a tenth of their challenge rows.
+//
+//   turns  comma-separated turns or ranges, e.g. 0-2,5,8- (a missing end is open)
+//   first  the same as turns=0-<k-1>
+//   last   the final k turns, which are only known when the run is over
+//   est    the estimators (Est_h) to record; ignored by tables without one
+//   rate   the fraction of rows to keep, chosen pseudo-randomly but reproducibly
+//          from the model's seed, the table, the turn and the row
+//
+// With neither turns, first nor last, every turn is recorded.
+// -------------------------------------------------
+#ifndef KTAB_LOG_POLICY_H
+#define KTAB_LOG_POLICY_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace KBase {
+using std::string;
+using std::vector;
+
+class LogPolicy {
+public:
+  // What to record of one table. The caller asks before computing a row.
+  class Rule {
+  public:
+    // turn t is selected outright: by turns or first, or as every turn
+    bool turn(unsigned int t) const;
+    // turn t is one of the final k turns of a run which ended at finalT
+    bool lastTurn(unsigned int t, unsigned int finalT) const;
+    bool selected(unsigned int t, unsigned int finalT) const {
+      return turn(t) || lastTurn(t, finalT);
+    }
+    // For a table written as the run goes: whether turn t's rows are still
+    // wanted once the final turn is known, not having been written already.
+    bool catchUp(unsigned int t, unsigned int finalT) const;
+    // whether turn t's rows must be kept during the run, to write now or later
+    bool needed(unsigned int t) const { return on && (turn(t) || (0 < last)); }
+
+    bool estimator(unsigned int h) const;
+    // whether the row with key (a, b) in turn t is among those kept
+    bool sample(uint64_t seed, unsigned int t, uint64_t a, uint64_t b = 0) const;
+
+    bool on = false;
+    vector<std::pair<unsigned int, unsigned int>> turns = {}; // inclusive
+    unsigned int last = 0;
+    vector<bool> ests = {}; // indexed by h; empty for every estimator
+    double rate = 1.0;
+    uint64_t salt = 0;      // so that tables sample different rows
+  };
+
+  static const vector<string> groupNames;
+  static const unsigned int noTurn = ~0u;
+
+  LogPolicy(); // every table, every turn
+  LogPolicy(const vector<bool> & groupFlags); // every table of each group flagged
+  virtual ~LogPolicy();
+
+  // add one or more ';'-separated clauses; throws KException if one is malformed
+  void apply(const string & clauses);
+
+  // the rule for a table, given the group it belongs to
+  Rule rule(const string & table, unsigned int group) const;
+
+  // throws KException if a clause names neither one of these tables, nor a group
+  void check(const vector<string> & tables) const;
+
+  const vector<bool> & groups() const { return groupFlags; }
+
+protected:
+  struct Clause {
+    string target = ""; // lower case
+    Rule rule = Rule();
+  };
+
+  void applyOne(const string & clause);
+
+  vector<bool> groupFlags = {};
+  vector<Clause> clauses = {};
+};
+
+} // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
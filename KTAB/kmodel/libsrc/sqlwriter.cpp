@@ -0,0 +1,1411 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+
+#include <easylogging++.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+#include "kutils.h"
+#include "sqlwriter.h"
+
+#include <QDir>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QVariant>
+
+
+namespace KBase {
+
+SQLBatch::SQLBatch(const string & s, unsigned int nc, const string & w) {
+  op = Op::Rows;
+  sql = s;
+  numCols = nc;
+  who = w;
+}
+
+SQLBatch::SQLBatch(Op o) {
+  op = o;
+}
+
+// --------------------------------------------
+// Reading the few statement shapes the sinks rewrite
+
+namespace {
+string unquoted(const string & x) {
+  if ((2 <= x.size()) && ('"' == x.front()) && ('"' == x.back())) {
+    return x.substr(1, x.size() - 2);
+  }
+  return x;
+}
+
+// split on the commas which are outside parentheses and quotes
+vector<string> splitList(const string & x) {
+  vector<string> items = {};
+  string cur = "";
+  int depth = 0;
+  char quote = 0;
+  for (const char c : x) {
+    if (0 != quote) {
+      quote = (c == quote) ? 0 : quote;
+    }
+    else if (('\'' == c) || ('"' == c)) {
+      quote = c;
+    }
+    else if ('(' == c) {
+      depth++;
+    }
+    else if (')' == c) {
+      depth--;
+    }
+    else if ((',' == c) && (0 == depth)) {
+      items.push_back(trimmed(cur));
+      cur = "";
+      continue;
+    }
+    cur += c;
+  }
+  items.push_back(trimmed(cur));
+  return items;
+}
+
+// The columns of each "create table [if not exists] Name ( ... )", by
+// lower-case table name: each column's name (unquoted) and the rest of its
+// definition (type and constraints). Table constraints are left out.
+std::map<string, vector<std::pair<string, string>>> schemaColumns(const vector<string> & schema) {
+  std::map<string, vector<std::pair<string, string>>> tables = {};
+  for (const string & sql : schema) {
+    const size_t open = sql.find('(');
+    const size_t close = sql.rfind(')');
+    if ((string::npos == open) || (string::npos == close) || (close < open)) {
+      continue;
+    }
+    const string head = trimmed(sql.substr(0, open));
+    const string tbl = lowerCase(unquoted(head.substr(head.find_last_of(" \t\n") + 1)));
+    auto & cols = tables[tbl];
+    for (const string & def : splitList(sql.substr(open + 1, close - open - 1))) {
+      const size_t sp = def.find_first_of(" \t\n");
+      if (string::npos == sp) {
+        continue;
+      }
+      const string name = unquoted(def.substr(0, sp));
+      const string lname = lowerCase(name);
+      if (("check" == lname) || ("primary" == lname) || ("foreign" == lname) ||
+          ("unique" == lname) || ("constraint" == lname)) {
+        continue;
+      }
+      cols.push_back({ name, trimmed(def.substr(sp)) });
+    }
+  }
+  return tables;
+}
+
+// Split "INSERT INTO Name (columns) VALUES (items)", returning false for anything else.
+bool splitInsert(const string & sql, string & tbl, string & colList,
+                 vector<string> & cols, vector<string> & items) {
+  const string lsql = lowerCase(sql);
+  const size_t into = lsql.find("into");
+  const size_t cOpen = lsql.find('(');
+  const size_t cClose = lsql.find(')', cOpen);
+  const size_t vals = lsql.find("values", cClose);
+  const size_t vOpen = lsql.find('(', vals);
+  const size_t vClose = lsql.rfind(')');
+  if ((0 != lsql.find("insert")) || (string::npos == into) || (string::npos == cOpen) ||
+      (string::npos == cClose) || (string::npos == vals) || (string::npos == vOpen) ||
+      (string::npos == vClose) || (vClose < vOpen)) {
+    return false;
+  }
+  tbl = trimmed(sql.substr(into + 4, cOpen - into - 4));
+  colList = sql.substr(cOpen + 1, cClose - cOpen - 1);
+  cols = splitList(colList);
+  items = splitList(sql.substr(vOpen + 1, vClose - vOpen - 1));
+  return cols.size() == items.size();
+}
+
+// the text of a quoted SQL literal, where '' stands for '
+string unquotedText(const string & item) {
+  string txt = "";
+  for (size_t n = 1; n + 1 < item.size(); n++) {
+    txt += item[n];
+    if (('\'' == item[n]) && ('\'' == item[n + 1])) {
+      n++;
+    }
+  }
+  return txt;
+}
+}
+
+// --------------------------------------------
+
+SQLSink::SQLSink(const QSqlDatabase & d) : db(d) {
+}
+
+SQLSink::~SQLSink() {
+}
+
+SQLSink * SQLSink::open(const QSqlDatabase & d, const vector<string> & schema, const string & colDir) {
+  if (!colDir.empty()) {
+    return new ColumnarSink(d, colDir, schema);
+  }
+  if (d.driverName() == "QSQLITE") {
+    QVariant v = d.driver()->handle();
+    if (v.isValid() && (0 == strcmp(v.typeName(), "sqlite3*"))) {
+      sqlite3 * h = *static_cast<sqlite3 **>(v.data());
+      if (nullptr != h) {
+        return new SQLiteSink(d, h);
+      }
+    }
+  }
+#ifdef KTAB_PGCOPY
+  if (d.driverName() == "QPSQL") {
+    QVariant v = d.driver()->handle();
+    if (v.isValid() && (0 == strcmp(v.typeName(), "PGconn*"))) {
+      PGconn * c = *static_cast<PGconn **>(v.data());
+      if (nullptr != c) {
+        return new PgCopySink(d, c, schema);
+      }
+    }
+  }
+#endif
+  return new QtSQLSink(d);
+}
+
+void SQLSink::write(const SQLBatch & b) {
+  switch (b.op) {
+  case SQLBatch::Op::Begin:
+    db.transaction();
+    break;
+  case SQLBatch::Op::Commit:
+    flush();
+    db.commit();
+    break;
+  case SQLBatch::Op::Flush:
+    flush();
+    break;
+  case SQLBatch::Op::Rows:
+    if (0 < b.numRows()) {
+      writeRows(b);
+    }
+    break;
+  }
+  return;
+}
+
+void SQLSink::flush() {
+  return;
+}
+
+// --------------------------------------------
+
+QtSQLSink::QtSQLSink(const QSqlDatabase & d) : SQLSink(d), qry(d) {
+}
+
+QtSQLSink::~QtSQLSink() {
+}
+
+void QtSQLSink::writeRows(const SQLBatch & b) {
+  if (b.sql != prepSql) {
+    qry.prepare(QString::fromStdString(b.sql));
+    prepSql = b.sql;
+  }
+
+  const unsigned int nr = b.numRows();
+  for (unsigned int r = 0; r < nr; r++) {
+    for (unsigned int k = 0; k < b.numCols; k++) {
+      const SQLValue & v = b.vals[r * b.numCols + k];
+      switch (v.type) {
+      case SQLValue::Type::Null:
+        qry.bindValue(k, QVariant());
+        break;
+      case SQLValue::Type::Int:
+        qry.bindValue(k, (qlonglong)v.i);
+        break;
+      case SQLValue::Type::UInt:
+        qry.bindValue(k, (qulonglong)v.i);
+        break;
+      case SQLValue::Type::Real:
+        qry.bindValue(k, v.d);
+        break;
+      }
+    }
+    if (!qry.exec()) {
+      LOG(INFO) << qry.lastError().text().toStdString();
+      throw KException(b.who + ": DB query failed");
+    }
+  }
+  return;
+}
+
+// --------------------------------------------
+
+namespace {
+// Replace each :name placeholder by a plain '?', so that sqlite numbers them
+// in order even when the row is repeated. Quoted text is left alone.
+string positional(const string & sql) {
+  string out = "";
+  char quote = 0;
+  for (size_t n = 0; n < sql.size(); n++) {
+    const char c = sql[n];
+    if (0 != quote) {
+      quote = (c == quote) ? 0 : quote;
+    }
+    else if (('\'' == c) || ('"' == c)) {
+      quote = c;
+    }
+    else if ((':' == c) && (n + 1 < sql.size()) && (isalpha(sql[n + 1]) || ('_' == sql[n + 1]))) {
+      while ((n + 1 < sql.size()) && (isalnum(sql[n + 1]) || ('_' == sql[n + 1]))) {
+        n++;
+      }
+      out += '?';
+      continue;
+    }
+    out += c;
+  }
+  return out;
+}
+}
+
+SQLiteSink::SQLiteSink(const QSqlDatabase & d, sqlite3 * h) : SQLSink(d), lite(h) {
+}
+
+SQLiteSink::~SQLiteSink() {
+  for (auto & st : stmts) {
+    sqlite3_finalize(st.second);
+  }
+  stmts.clear();
+}
+
+sqlite3_stmt * SQLiteSink::prepared(const SQLBatch & b, unsigned int nr) {
+  auto key = std::make_pair(b.sql, nr);
+  auto it = stmts.find(key);
+  if (stmts.end() != it) {
+    return it->second;
+  }
+
+  string sql = positional(b.sql);
+  if (1 < nr) {
+    // repeat the row after VALUES: "... VALUES (a,?,?)" becomes "... VALUES (a,?,?),(a,?,?)"
+    const size_t open = sql.rfind('(');
+    const size_t close = sql.rfind(')');
+    const string row = sql.substr(open, close + 1 - open);
+    string rows = row;
+    rows.reserve(nr * (row.size() + 1));
+    for (unsigned int r = 1; r < nr; r++) {
+      rows += "," + row;
+    }
+    sql = sql.substr(0, open) + rows + sql.substr(close + 1);
+  }
+
+  sqlite3_stmt * st = nullptr;
+  if (SQLITE_OK != sqlite3_prepare_v2(lite, sql.c_str(), -1, &st, nullptr)) {
+    LOG(INFO) << sqlite3_errmsg(lite);
+    throw KException(b.who + ": could not prepare statement");
+  }
+  stmts[key] = st;
+  return st;
+}
+
+void SQLiteSink::writeRows(const SQLBatch & b) {
+  const unsigned int nr = b.numRows();
+  const unsigned int nc = b.numCols;
+
+  // Only a plain INSERT ... VALUES (...) can take several rows per statement.
+  // Stay within sqlite's limit on the number of placeholders.
+  unsigned int perStmt = 1;
+  string upper = b.sql.substr(0, 6);
+  std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+  if (("INSERT" == upper) && (')' == b.sql.back())) {
+    const unsigned int maxVars = sqlite3_limit(lite, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+    while ((2 * perStmt <= maxRows) && (2 * perStmt * nc <= maxVars) && (2 * perStmt <= nr)) {
+      perStmt = 2 * perStmt;
+    }
+  }
+
+  unsigned int r = 0;
+  while (r < nr) {
+    // whole blocks of perStmt rows, then the rest in halving blocks
+    while (nr - r < perStmt) {
+      perStmt = perStmt / 2;
+    }
+    sqlite3_stmt * st = prepared(b, perStmt);
+    const SQLValue * v = &(b.vals[r * nc]);
+    for (unsigned int m = 0; m < perStmt * nc; m++) {
+      switch (v[m].type) {
+      case SQLValue::Type::Null:
+        sqlite3_bind_null(st, m + 1);
+        break;
+      case SQLValue::Type::Int:
+      case SQLValue::Type::UInt:
+        sqlite3_bind_int64(st, m + 1, v[m].i);
+        break;
+      case SQLValue::Type::Real:
+        sqlite3_bind_double(st, m + 1, v[m].d);
+        break;
+      }
+    }
+    const int rc = sqlite3_step(st);
+    sqlite3_reset(st);
+    if (SQLITE_DONE != rc) {
+      LOG(INFO) << sqlite3_errmsg(lite);
+      throw KException(b.who + ": DB query failed");
+    }
+    r = r + perStmt;
+  }
+  return;
+}
+
+
+// --------------------------------------------
+namespace {
+// append v as an n-byte big-endian integer, as COPY's binary format wants
+void putBE(string & buf, uint64_t v, unsigned int n) {
+  for (unsigned int k = n; 0 < k; k--) {
+    buf += (char)((v >> (8 * (k - 1))) & 0xFF);
+  }
+}
+
+// the n-byte big-endian integer at data[at], moving at past it
+uint64_t getBE(const string & data, size_t & at, unsigned int n) {
+  if (data.size() < at + n) {
+    throw KException("PgCopyEncoder::decode: the data ends in the middle of a field");
+  }
+  uint64_t v = 0;
+  for (unsigned int k = 0; k < n; k++) {
+    v = (v << 8) | (unsigned char)data[at + k];
+  }
+  at = at + n;
+  return v;
+}
+}
+
+const int PgCopyEncoder::litVal;
+const int PgCopyEncoder::textLit;
+
+// signature, flags, extension length
+const string PgCopyEncoder::header = string("PGCOPY\n\377\r\n\0", 11) + string(8, '\0');
+const string PgCopyEncoder::trailer = string(2, '\377');
+
+PgCopyEncoder::PgCopyEncoder(const vector<string> & schema) {
+  // Columns of a type COPY is not given here are left out, so that
+  // statements which use them go through QSqlQuery.
+  for (const auto & t : schemaColumns(schema)) {
+    auto & cols = tables[t.first];
+    for (const auto & c : t.second) {
+      const string name = lowerCase(c.first);
+      const string type = lowerCase(c.second);
+      auto startsWith = [&type](const string & x) {
+        return 0 == type.compare(0, x.size(), x);
+      };
+      if (startsWith("bigint")) {
+        cols[name] = ColType::Int8;
+      }
+      else if (startsWith("smallint")) {
+        cols[name] = ColType::Int2;
+      }
+      else if (startsWith("int")) {
+        cols[name] = ColType::Int4;
+      }
+      else if (startsWith("real")) {
+        cols[name] = ColType::Float4;
+      }
+      else if (startsWith("float(")) {
+        // FLOAT(p) is single precision for p up to 24
+        cols[name] = (std::atoi(type.c_str() + 6) <= 24) ? ColType::Float4 : ColType::Float8;
+      }
+      else if (startsWith("float") || startsWith("double")) {
+        cols[name] = ColType::Float8;
+      }
+      else if (startsWith("varchar") || startsWith("text") || startsWith("char")) {
+        cols[name] = ColType::Text;
+      }
+    }
+  }
+}
+
+PgCopyEncoder::Plan & PgCopyEncoder::plan(const SQLBatch & b) {
+  auto it = plans.find(b.sql);
+  if (plans.end() != it) {
+    return it->second;
+  }
+  Plan & p = plans[b.sql];
+
+  // Only "INSERT INTO Name (columns) VALUES (values)" is copied.
+  string tbl = "";
+  string colList = "";
+  vector<string> cols = {};
+  vector<string> items = {};
+  if (!splitInsert(b.sql, tbl, colList, cols, items)) {
+    return p;
+  }
+  auto tit = tables.find(lowerCase(unquoted(tbl)));
+  if (tables.end() == tit) {
+    return p;
+  }
+
+  int numParams = 0;
+  for (unsigned int k = 0; k < cols.size(); k++) {
+    auto cit = tit->second.find(lowerCase(unquoted(cols[k])));
+    if (tit->second.end() == cit) {
+      return p;
+    }
+    p.types.push_back(cit->second);
+    const string & item = items[k];
+    if (item.empty()) {
+      return p;
+    }
+    SQLValue lit;
+    string litText = "";
+    if (':' == item.front()) {
+      p.param.push_back(numParams++);
+    }
+    else if ('\'' == item.front()) {
+      p.param.push_back(textLit);
+      litText = unquotedText(item);
+      if (ColType::Text != cit->second) {
+        return p;
+      }
+    }
+    else if ("null" == lowerCase(item)) {
+      p.param.push_back(litVal);
+    }
+    else {
+      p.param.push_back(litVal);
+      char * end = nullptr;
+      lit = SQLValue((int64_t)std::strtoll(item.c_str(), &end, 10));
+      if ('\0' != *end) {
+        lit = SQLValue(std::strtod(item.c_str(), &end));
+      }
+      if (('\0' != *end) || (ColType::Text == cit->second)) {
+        return p;
+      }
+    }
+    p.lit.push_back(lit);
+    p.litText.push_back(litText);
+  }
+  if (numParams != (int)b.numCols) {
+    return p;
+  }
+
+  p.copySql = "COPY " + tbl + " (" + colList + ") FROM STDIN (FORMAT binary)";
+  p.copyable = true;
+  return p;
+}
+
+void PgCopyEncoder::encode(Plan & p, const SQLBatch & b) const {
+  const unsigned int nr = b.numRows();
+  const unsigned int nf = p.types.size();
+  for (unsigned int r = 0; r < nr; r++) {
+    putBE(p.held, nf, 2);
+    for (unsigned int k = 0; k < nf; k++) {
+      if (textLit == p.param[k]) {
+        putBE(p.held, p.litText[k].size(), 4);
+        p.held += p.litText[k];
+        continue;
+      }
+      const SQLValue & v = (0 <= p.param[k]) ? b.vals[r * b.numCols + p.param[k]] : p.lit[k];
+      if (SQLValue::Type::Null == v.type) {
+        putBE(p.held, 0xFFFFFFFF, 4); // length -1 is NULL
+        continue;
+      }
+
+      const bool isReal = (SQLValue::Type::Real == v.type);
+      const bool tooBig = (SQLValue::Type::UInt == v.type) && (v.i < 0);
+      const int64_t iv = isReal ? (int64_t)std::llround(v.d) : v.i;
+      const double dv = isReal ? v.d : ((SQLValue::Type::UInt == v.type) ? (double)(uint64_t)v.i : (double)v.i);
+      switch (p.types[k]) {
+      case ColType::Int2:
+        if (tooBig || (iv < INT16_MIN) || (INT16_MAX < iv)) {
+          throw KException(b.who + ": value out of range for a SMALLINT column");
+        }
+        putBE(p.held, 2, 4);
+        putBE(p.held, (uint64_t)iv, 2);
+        break;
+      case ColType::Int4:
+        if (tooBig || (iv < INT32_MIN) || (INT32_MAX < iv)) {
+          throw KException(b.who + ": value out of range for an INTEGER column");
+        }
+        putBE(p.held, 4, 4);
+        putBE(p.held, (uint64_t)iv, 4);
+        break;
+      case ColType::Int8:
+        if (tooBig) {
+          throw KException(b.who + ": value out of range for a BIGINT column");
+        }
+        putBE(p.held, 8, 4);
+        putBE(p.held, (uint64_t)iv, 8);
+        break;
+      case ColType::Float4: {
+        const float f = (float)dv;
+        uint32_t bits = 0;
+        memcpy(&bits, &f, 4);
+        putBE(p.held, 4, 4);
+        putBE(p.held, bits, 4);
+        break;
+      }
+      case ColType::Float8: {
+        uint64_t bits = 0;
+        memcpy(&bits, &dv, 8);
+        putBE(p.held, 8, 4);
+        putBE(p.held, bits, 8);
+        break;
+      }
+      case ColType::Text: {
+        const string txt = isReal ? getFormattedString("%.17g", v.d) :
+          ((SQLValue::Type::UInt == v.type) ? std::to_string((uint64_t)v.i) : std::to_string(v.i));
+        putBE(p.held, txt.size(), 4);
+        p.held += txt;
+        break;
+      }
+      }
+    }
+  }
+  return;
+}
+
+vector<vector<string>> PgCopyEncoder::decode(const string & data, const vector<ColType> & types) {
+  const string who = "PgCopyEncoder::decode: ";
+  if ((data.size() < header.size() + trailer.size()) || (0 != data.compare(0, 11, header, 0, 11))) {
+    throw KException(who + "no COPY signature");
+  }
+  size_t at = 11;
+  if (0 != getBE(data, at, 4)) {
+    throw KException(who + "unexpected flags");
+  }
+  at = at + getBE(data, at, 4); // skip the header extension
+
+  vector<vector<string>> rows = {};
+  while (true) {
+    const uint64_t nf = getBE(data, at, 2);
+    if (0xFFFF == nf) { // the trailer
+      break;
+    }
+    if (types.size() != nf) {
+      throw KException(who + "a row has " + std::to_string(nf) + " fields, not "
+                       + std::to_string(types.size()));
+    }
+    vector<string> row = {};
+    for (unsigned int k = 0; k < nf; k++) {
+      const uint64_t len = getBE(data, at, 4);
+      if (0xFFFFFFFF == len) {
+        row.push_back("NULL");
+        continue;
+      }
+      const ColType t = types[k];
+      const uint64_t want = (ColType::Int2 == t) ? 2 :
+        (((ColType::Int4 == t) || (ColType::Float4 == t)) ? 4 : 8);
+      if ((ColType::Text != t) && (want != len)) {
+        throw KException(who + "field " + std::to_string(k) + " has " + std::to_string(len)
+                         + " bytes, not " + std::to_string(want));
+      }
+      switch (t) {
+      case ColType::Int2:
+        row.push_back(std::to_string((int16_t)getBE(data, at, 2)));
+        break;
+      case ColType::Int4:
+        row.push_back(std::to_string((int32_t)getBE(data, at, 4)));
+        break;
+      case ColType::Int8:
+        row.push_back(std::to_string((int64_t)getBE(data, at, 8)));
+        break;
+      case ColType::Float4: {
+        const uint32_t bits = (uint32_t)getBE(data, at, 4);
+        float f = 0;
+        memcpy(&f, &bits, 4);
+        row.push_back(getFormattedString("%.9g", f));
+        break;
+      }
+      case ColType::Float8: {
+        const uint64_t bits = getBE(data, at, 8);
+        double d = 0;
+        memcpy(&d, &bits, 8);
+        row.push_back(getFormattedString("%.17g", d));
+        break;
+      }
+      case ColType::Text:
+        if (data.size() < at + len) {
+          throw KException(who + "the data ends in the middle of a field");
+        }
+        row.push_back(data.substr(at, len));
+        at = at + len;
+        break;
+      }
+    }
+    rows.push_back(row);
+  }
+  if (at != data.size()) {
+    throw KException(who + "there is data after the trailer");
+  }
+  return rows;
+}
+
+#ifdef KTAB_PGCOPY
+
+PgCopySink::PgCopySink(const QSqlDatabase & d, PGconn * c, const vector<string> & schema) :
+  SQLSink(d), conn(c), enc(schema), viaQt(d) {
+}
+
+PgCopySink::~PgCopySink() {
+  for (auto & p : enc.plans) {
+    if (!p.second.held.empty()) {
+      LOG(INFO) << "PgCopySink: rows for " << p.second.copySql << " were never stored";
+    }
+  }
+}
+
+void PgCopySink::writeRows(const SQLBatch & b) {
+  PgCopyEncoder::Plan & p = enc.plan(b);
+  if (!p.copyable) {
+    // keep the order of everything written so far
+    flush();
+    viaQt.write(b);
+    return;
+  }
+
+  enc.encode(p, b);
+  if (maxHeld < p.held.size()) {
+    send(p, b.who);
+  }
+  return;
+}
+
+void PgCopySink::flush() {
+  for (auto & p : enc.plans) {
+    send(p.second, "PgCopySink::flush");
+  }
+  return;
+}
+
+void PgCopySink::send(PgCopyEncoder::Plan & p, const string & who) {
+  if (p.held.empty()) {
+    return;
+  }
+  string data = "";
+  data.swap(p.held);
+
+  PGresult * res = PQexec(conn, p.copySql.c_str());
+  const bool started = (PGRES_COPY_IN == PQresultStatus(res));
+  PQclear(res);
+  if (!started) {
+    LOG(INFO) << PQerrorMessage(conn);
+    throw KException(who + ": could not start " + p.copySql);
+  }
+
+  bool ok = (1 == PQputCopyData(conn, PgCopyEncoder::header.data(), (int)PgCopyEncoder::header.size()));
+  ok = ok && (1 == PQputCopyData(conn, data.data(), (int)data.size()));
+  ok = ok && (1 == PQputCopyData(conn, PgCopyEncoder::trailer.data(), (int)PgCopyEncoder::trailer.size()));
+  ok = (1 == PQputCopyEnd(conn, ok ? nullptr : "KTAB: could not send the rows")) && ok;
+
+  // read every result, so that the connection is ready for the next command
+  string msg = ok ? "" : PQerrorMessage(conn);
+  while (nullptr != (res = PQgetResult(conn))) {
+    if (PGRES_COMMAND_OK != PQresultStatus(res)) {
+      ok = false;
+      msg = PQresultErrorMessage(res);
+    }
+    PQclear(res);
+  }
+  if (!ok) {
+    LOG(INFO) << msg;
+    throw KException(who + ": " + p.copySql + " failed");
+  }
+  return;
+}
+
+#endif
+
+// --------------------------------------------
+
+namespace {
+// store v in row r of c, as the database would
+void setValue(ColumnData & c, size_t r, const SQLValue & v, const string & who) {
+  c.null[r] = (SQLValue::Type::Null == v.type) ? 1 : 0;
+  switch (c.kind) {
+  case ColumnData::Kind::Int:
+    c.ints[r] = 0;
+    if (SQLValue::Type::Real == v.type) {
+      if ((v.d != std::floor(v.d)) || !(std::fabs(v.d) < 9.2e18)) {
+        throw KException(who + ": a fractional value for an integer column");
+      }
+      c.ints[r] = (int64_t)v.d;
+    }
+    else if (SQLValue::Type::Null != v.type) {
+      c.ints[r] = v.i; // UInt keeps its bits
+    }
+    break;
+  case ColumnData::Kind::Real:
+    c.reals[r] = (SQLValue::Type::Real == v.type) ? v.d :
+      ((SQLValue::Type::UInt == v.type) ? (double)(uint64_t)v.i : (double)v.i);
+    c.reals[r] = (SQLValue::Type::Null == v.type) ? 0.0 : c.reals[r];
+    break;
+  case ColumnData::Kind::Text:
+    c.ints[r] = 0;
+    if (SQLValue::Type::Real == v.type) {
+      c.ints[r] = c.code(getFormattedString("%.17g", v.d));
+    }
+    else if (SQLValue::Type::UInt == v.type) {
+      c.ints[r] = c.code(std::to_string((uint64_t)v.i));
+    }
+    else if (SQLValue::Type::Int == v.type) {
+      c.ints[r] = c.code(std::to_string(v.i));
+    }
+    break;
+  }
+  return;
+}
+
+// row r of a numeric column, as a key
+uint64_t keyBits(const ColumnData & c, size_t r) {
+  uint64_t bits = 0;
+  if (ColumnData::Kind::Real == c.kind) {
+    memcpy(&bits, &c.reals[r], sizeof(bits));
+  }
+  else {
+    bits = (uint64_t)c.ints[r];
+  }
+  return bits;
+}
+
+// a literal number (or NULL) from a statement; false for anything else
+bool numberLiteral(const string & item, SQLValue & v) {
+  if ("null" == lowerCase(item)) {
+    v = SQLValue();
+    return true;
+  }
+  char * end = nullptr;
+  v = SQLValue((int64_t)std::strtoll(item.c_str(), &end, 10));
+  if ('\0' != *end) {
+    v = SQLValue(std::strtod(item.c_str(), &end));
+  }
+  return !item.empty() && ('\0' == *end);
+}
+
+// keep a name to the characters safe in a file name
+string fileName(const string & x) {
+  string f = x;
+  for (char & c : f) {
+    c = (std::isalnum((unsigned char)c) || ('-' == c) || ('_' == c)) ? c : '_';
+  }
+  return f.empty() ? "_" : f;
+}
+}
+
+const int ColumnarSink::noParam;
+const int ColumnarSink::textLit;
+
+ColumnarSink::ColumnarSink(const QSqlDatabase & d, const string & cd, const vector<string> & schema) :
+  SQLSink(d), dir(cd), viaQt(d) {
+  // Only tables with a text ScenarioId, and columns of known types, are written here.
+  for (const auto & t : schemaColumns(schema)) {
+    Table tab;
+    bool known = true;
+    for (const auto & c : t.second) {
+      const string type = lowerCase(c.second);
+      auto startsWith = [&type](const string & x) {
+        return 0 == type.compare(0, x.size(), x);
+      };
+      ColumnData::Kind kind = ColumnData::Kind::Int;
+      if (startsWith("int") || startsWith("bigint") || startsWith("smallint") || startsWith("bool")) {
+        kind = ColumnData::Kind::Int;
+      }
+      else if (startsWith("real") || startsWith("float") || startsWith("double")) {
+        kind = ColumnData::Kind::Real;
+      }
+      else if (startsWith("varchar") || startsWith("text") || startsWith("char")) {
+        kind = ColumnData::Kind::Text;
+      }
+      else {
+        known = false;
+      }
+      tab.index[lowerCase(c.first)] = tab.names.size();
+      tab.names.push_back(c.first);
+      tab.kinds.push_back(kind);
+
+      // what a row gets when an INSERT leaves the column out
+      int dp = noParam;
+      SQLValue dv;
+      string dt = "";
+      const size_t at = type.find("default ");
+      if (string::npos != at) {
+        const string item = trimmed(c.second.substr(at + 8));
+        const string first = item.substr(0, item.find_first_of(" \t\n"));
+        if ((!first.empty()) && ('\'' == first.front())) {
+          dp = (ColumnData::Kind::Text == kind) ? textLit : noParam;
+          dt = unquotedText(item.substr(0, item.find('\'', 1) + 1));
+        }
+        else if (!numberLiteral(first, dv)) {
+          dv = SQLValue();
+        }
+      }
+      tab.defaultParam.push_back(dp);
+      tab.defaults.push_back(dv);
+      tab.defaultText.push_back(dt);
+    }
+    auto sit = tab.index.find("scenarioid");
+    if (known && (tab.index.end() != sit) && (ColumnData::Kind::Text == tab.kinds[sit->second])) {
+      tables[t.first] = tab;
+    }
+  }
+}
+
+ColumnarSink::~ColumnarSink() {
+  for (auto & h : held) {
+    if ((!h.second.empty()) && (0 < h.second[0].size())) {
+      LOG(INFO) << "ColumnarSink: rows for " << h.first.second << " were never stored";
+    }
+  }
+}
+
+ColumnarSink::Plan & ColumnarSink::plan(const SQLBatch & b) {
+  auto it = plans.find(b.sql);
+  if (plans.end() != it) {
+    return it->second;
+  }
+  Plan & p = plans[b.sql];
+  const string lsql = lowerCase(trimmed(b.sql));
+  int numParams = 0;
+
+  string tbl = "";
+  string colList = "";
+  vector<string> cols = {};
+  vector<string> items = {};
+  if (splitInsert(b.sql, tbl, colList, cols, items)) {
+    // INSERT INTO Name (columns) VALUES (placeholders or literals)
+    auto tit = tables.find(lowerCase(unquoted(tbl)));
+    if (tables.end() == tit) {
+      return p;
+    }
+    Table & tab = tit->second;
+    tab.name = tab.name.empty() ? fileName(unquoted(tbl)) : tab.name; // as the statements write it
+    p.table = tit->first;
+    p.param = tab.defaultParam;
+    p.lit = tab.defaults;
+    p.litText = tab.defaultText;
+    bool hasScen = false;
+    for (unsigned int k = 0; k < cols.size(); k++) {
+      auto cit = tab.index.find(lowerCase(unquoted(cols[k])));
+      if ((tab.index.end() == cit) || items[k].empty()) {
+        return p;
+      }
+      const unsigned int n = cit->second;
+      const string & item = items[k];
+      p.param[n] = noParam;
+      if (':' == item.front()) {
+        p.param[n] = numParams++;
+      }
+      else if ('\'' == item.front()) {
+        if (ColumnData::Kind::Text != tab.kinds[n]) {
+          return p;
+        }
+        p.param[n] = textLit;
+        p.litText[n] = unquotedText(item);
+        if ("scenarioid" == lowerCase(unquoted(cols[k]))) {
+          p.scen = p.litText[n];
+          hasScen = true;
+        }
+      }
+      else if (!numberLiteral(item, p.lit[n])) {
+        return p;
+      }
+    }
+    if (hasScen && (numParams == (int)b.numCols)) {
+      p.kind = Plan::Kind::Insert;
+    }
+    return p;
+  }
+
+  // UPDATE Name SET column = :x, ... WHERE (column = :y) and ('literal' = ScenarioId) ...
+  const size_t set = lsql.find(" set ");
+  const size_t where = lsql.find(" where ", set);
+  if ((0 != lsql.find("update ")) || (string::npos == set) || (string::npos == where)) {
+    return p;
+  }
+  const string sql = trimmed(b.sql);
+  auto tit = tables.find(lowerCase(unquoted(trimmed(sql.substr(7, set - 7)))));
+  if (tables.end() == tit) {
+    return p;
+  }
+  const Table & tab = tit->second;
+  p.table = tit->first;
+
+  // one "a = b" term: a column of the table on one side, a placeholder or literal on the other
+  auto term = [&tab, &numParams](string x, unsigned int & col, int & param, string & text) {
+    while ((!x.empty()) && ('(' == x.front()) && (')' == x.back())) {
+      x = trimmed(x.substr(1, x.size() - 2));
+    }
+    const size_t eq = x.find('=');
+    if (string::npos == eq) {
+      return false;
+    }
+    string lhs = trimmed(x.substr(0, eq));
+    string rhs = trimmed(x.substr(eq + 1));
+    if (lhs.empty() || rhs.empty()) {
+      return false;
+    }
+    if ((':' == lhs.front()) || ('\'' == lhs.front())) {
+      std::swap(lhs, rhs);
+    }
+    auto cit = tab.index.find(lowerCase(unquoted(lhs)));
+    if (tab.index.end() == cit) {
+      return false;
+    }
+    col = cit->second;
+    param = noParam;
+    text = "";
+    if (':' == rhs.front()) {
+      param = numParams++;
+      return true;
+    }
+    if (('\'' == rhs.front()) && (ColumnData::Kind::Text == tab.kinds[col])) {
+      text = unquotedText(rhs);
+      return true;
+    }
+    return false;
+  };
+
+  for (const string & item : splitList(sql.substr(set + 5, where - set - 5))) {
+    unsigned int col = 0;
+    int param = noParam;
+    string text = "";
+    if ((!term(item, col, param, text)) || (noParam == param)) {
+      return p;
+    }
+    p.set.push_back({ col, param });
+  }
+  string rest = sql.substr(where + 7);
+  while (!rest.empty()) {
+    const size_t andPos = lowerCase(rest).find(" and ");
+    const string item = trimmed(rest.substr(0, andPos));
+    rest = (string::npos == andPos) ? "" : rest.substr(andPos + 5);
+    unsigned int col = 0;
+    int param = noParam;
+    string text = "";
+    if (!term(item, col, param, text)) {
+      return p;
+    }
+    if (noParam != param) {
+      if (ColumnData::Kind::Text == tab.kinds[col]) {
+        return p;
+      }
+      p.where.push_back({ col, param });
+    }
+    else if ("scenarioid" == lowerCase(tab.names[col])) {
+      p.scen = text;
+    }
+    else {
+      return p;
+    }
+  }
+  if ((!p.scen.empty()) && (numParams == (int)b.numCols)) {
+    p.kind = Plan::Kind::Update;
+  }
+  return p;
+}
+
+void ColumnarSink::writeRows(const SQLBatch & b) {
+  const Plan & p = plan(b);
+  switch (p.kind) {
+  case Plan::Kind::Insert:
+    insertRows(p, b);
+    break;
+  case Plan::Kind::Update:
+    updateRows(p, b);
+    break;
+  case Plan::Kind::Other:
+    // keep the order of everything written so far
+    flush();
+    viaQt.write(b);
+    break;
+  }
+  return;
+}
+
+void ColumnarSink::insertRows(const Plan & p, const SQLBatch & b) {
+  const Table & tab = tables[p.table];
+  auto & cols = held[{ p.scen, p.table }];
+  if (cols.empty()) {
+    for (const auto k : tab.kinds) {
+      cols.push_back(ColumnData(k));
+    }
+  }
+  const unsigned int nr = b.numRows();
+  for (unsigned int r = 0; r < nr; r++) {
+    for (unsigned int k = 0; k < cols.size(); k++) {
+      ColumnData & c = cols[k];
+      c.addNull();
+      if (0 <= p.param[k]) {
+        setValue(c, c.size() - 1, b.vals[r * b.numCols + p.param[k]], b.who);
+      }
+      else if (textLit == p.param[k]) {
+        c.null.back() = 0;
+        c.ints.back() = c.code(p.litText[k]);
+      }
+      else {
+        setValue(c, c.size() - 1, p.lit[k], b.who);
+      }
+    }
+  }
+  return;
+}
+
+void ColumnarSink::updateRows(const Plan & p, const SQLBatch & b) {
+  const unsigned int nr = b.numRows();
+  auto hit = held.find({ p.scen, p.table });
+  unsigned int missed = 0;
+  if ((held.end() == hit) || hit->second.empty()) {
+    missed = nr;
+  }
+  else {
+    vector<ColumnData> & cols = hit->second;
+
+    // the held rows, by the values of the WHERE columns
+    auto keyOf = [&p, &cols](size_t r, vector<uint64_t> & key) {
+      key.clear();
+      for (const auto & w : p.where) {
+        const ColumnData & c = cols[w.first];
+        if (0 != c.null[r]) {
+          return false; // NULL equals nothing
+        }
+        key.push_back(keyBits(c, r));
+      }
+      return true;
+    };
+    std::map<vector<uint64_t>, vector<size_t>> rows = {};
+    vector<uint64_t> key = {};
+    for (size_t r = 0; r < cols[0].size(); r++) {
+      if (keyOf(r, key)) {
+        rows[key].push_back(r);
+      }
+    }
+
+    // a one-row column, to convert each placeholder's value as the column would
+    vector<ColumnData> probe = {};
+    for (const auto & w : p.where) {
+      probe.push_back(ColumnData(cols[w.first].kind));
+      probe.back().addNull();
+    }
+    for (unsigned int r = 0; r < nr; r++) {
+      bool found = true;
+      for (unsigned int k = 0; k < p.where.size(); k++) {
+        const SQLValue & v = b.vals[r * b.numCols + p.where[k].second];
+        found = found && (SQLValue::Type::Null != v.type) &&
+          ((ColumnData::Kind::Int != probe[k].kind) || (SQLValue::Type::Real != v.type) ||
+           (v.d == std::floor(v.d)));
+        if (found) {
+          setValue(probe[k], 0, v, b.who);
+        }
+      }
+      vector<size_t> * match = nullptr;
+      if (found) {
+        key.clear();
+        for (const auto & c : probe) {
+          key.push_back(keyBits(c, 0));
+        }
+        auto mit = rows.find(key);
+        match = (rows.end() == mit) ? nullptr : &mit->second;
+      }
+      if (nullptr == match) {
+        missed++;
+        continue;
+      }
+      for (const size_t row : *match) {
+        for (const auto & s : p.set) {
+          setValue(cols[s.first], row, b.vals[r * b.numCols + s.second], b.who);
+        }
+      }
+    }
+  }
+  if (0 < missed) {
+    LOG(INFO) << "ColumnarSink: " << missed << " rows of " << b.who
+              << " matched no rows still held; they were not applied";
+  }
+  return;
+}
+
+string ColumnarSink::scenarioDir(const string & colDir, const string & scen) {
+  return colDir + "/" + fileName(scen);
+}
+
+void ColumnarSink::flush() {
+  for (auto & h : held) {
+    vector<ColumnData> & cols = h.second;
+    if (cols.empty() || (0 == cols[0].size())) {
+      continue;
+    }
+    const Table & tab = tables[h.first.second];
+    auto & w = writers[h.first];
+    if (nullptr == w) {
+      const string sub = scenarioDir(dir, h.first.first);
+      if (!QDir().mkpath(QString::fromStdString(sub))) {
+        throw KException("ColumnarSink: could not create " + sub);
+      }
+      w.reset(new ColumnarWriter(sub + "/" + tab.name + ".kcol", tab.names, tab.kinds));
+    }
+    vector<ColumnData> rows = {};
+    for (const auto k : tab.kinds) {
+      rows.push_back(ColumnData(k));
+    }
+    rows.swap(cols);
+    w->append(rows);
+  }
+  return;
+}
+
+// --------------------------------------------
+
+SQLWriter::SQLWriter(const QSqlDatabase & d, const vector<string> & sch, const string & cd,
+                     unsigned int cap) :
+  db(d), schema(sch), colDir(cd), mask(nextPow2(cap) - 1), enqPos(0), deqPos(0), numPushed(0), numDone(0),
+  writerAsleep(false), numAsleep(0), stopping(false), failed(false) {
+  ring = std::unique_ptr<Cell[]>(new Cell[mask + 1]);
+  for (uint64_t n = 0; n <= mask; n++) {
+    ring[n].seq.store(n, std::memory_order_relaxed);
+  }
+  thr = std::thread([this]() {
+    writeLoop();
+  });
+}
+
+SQLWriter::~SQLWriter() {
+  stopping.store(true);
+  {
+    std::lock_guard<std::mutex> lk(sleepMtx);
+    wakeWriter.notify_one();
+  }
+  thr.join();
+  if (failed.load()) {
+    LOG(INFO) << "SQLWriter: some rows were not written: " << errMsg;
+  }
+}
+
+uint64_t SQLWriter::nextPow2(unsigned int n) {
+  uint64_t p = 2;
+  while (p < n) {
+    p = 2 * p;
+  }
+  return p;
+}
+
+// The ring is Vyukov's bounded queue: a cell whose sequence number equals
+// the enqueue position is free, and one whose number is one more holds a
+// batch for that position.
+bool SQLWriter::tryPush(SQLBatch & b) {
+  uint64_t pos = enqPos.load(std::memory_order_relaxed);
+  Cell * c = nullptr;
+  while (true) {
+    c = &ring[pos & mask];
+    const uint64_t seq = c->seq.load(std::memory_order_acquire);
+    const int64_t dif = (int64_t)seq - (int64_t)pos;
+    if (0 == dif) {
+      if (enqPos.compare_exchange_weak(pos, pos + 1)) {
+        break;
+      }
+    }
+    else if (dif < 0) {
+      return false; // full
+    }
+    else {
+      pos = enqPos.load(std::memory_order_relaxed);
+    }
+  }
+  c->batch = std::move(b);
+  c->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool SQLWriter::tryPop(SQLBatch & b) {
+  uint64_t pos = deqPos.load(std::memory_order_relaxed);
+  Cell * c = nullptr;
+  while (true) {
+    c = &ring[pos & mask];
+    const uint64_t seq = c->seq.load(std::memory_order_acquire);
+    const int64_t dif = (int64_t)seq - (int64_t)(pos + 1);
+    if (0 == dif) {
+      if (deqPos.compare_exchange_weak(pos, pos + 1)) {
+        break;
+      }
+    }
+    else if (dif < 0) {
+      return false; // empty
+    }
+    else {
+      pos = deqPos.load(std::memory_order_relaxed);
+    }
+  }
+  b = std::move(c->batch);
+  c->batch = SQLBatch();
+  c->seq.store(pos + mask + 1, std::memory_order_release);
+  return true;
+}
+
+void SQLWriter::push(SQLBatch && b) {
+  checkError();
+  while (!tryPush(b)) {
+    // the writer is more than a ring-full behind, so wait for it
+    std::unique_lock<std::mutex> lk(sleepMtx);
+    numAsleep++;
+    wakeOthers.wait(lk, [this]() {
+      return (enqPos.load() - deqPos.load() <= mask) || failed.load();
+    });
+    numAsleep--;
+    lk.unlock();
+    checkError();
+  }
+  numPushed++;
+
+  if (writerAsleep.load()) {
+    std::lock_guard<std::mutex> lk(sleepMtx);
+    wakeWriter.notify_one();
+  }
+  return;
+}
+
+void SQLWriter::flush() {
+  push(SQLBatch(SQLBatch::Op::Flush));
+  waitFor(numPushed.load());
+  checkError();
+  return;
+}
+
+void SQLWriter::turnBarrier() {
+  push(SQLBatch(SQLBatch::Op::Flush));
+  const uint64_t n = numPushed.load();
+  waitFor(lastBarrier);
+  lastBarrier = n;
+  checkError();
+  return;
+}
+
+void SQLWriter::waitFor(uint64_t n) {
+  if (numDone.load() >= n) {
+    return;
+  }
+  std::unique_lock<std::mutex> lk(sleepMtx);
+  numAsleep++;
+  wakeOthers.wait(lk, [this, n]() {
+    return numDone.load() >= n;
+  });
+  numAsleep--;
+  return;
+}
+
+void SQLWriter::checkError() {
+  if (failed.load()) {
+    std::lock_guard<std::mutex> lk(sleepMtx);
+    throw KException(errMsg);
+  }
+  return;
+}
+
+// Qt connections may only be used by the thread which opened them, so the
+// writer opens a connection of its own to the same database, and removes it
+// once the loop is done.
+void SQLWriter::writeLoop() {
+  static std::atomic<unsigned int> numConns(0);
+  const QString cn = QString::fromStdString("KTAB_SQLWriter_" + std::to_string(numConns++));
+  {
+    QSqlDatabase wdb = QSqlDatabase::cloneDatabase(db, cn);
+    std::unique_ptr<SQLSink> sink = nullptr;
+    if (wdb.open()) {
+      if (wdb.driverName() == "QSQLITE") {
+        // these are set per connection: as Model::configSqlite does
+        QSqlQuery q(wdb);
+        q.exec("PRAGMA journal_mode = MEMORY");
+        q.exec("PRAGMA synchronous = OFF");
+        q.exec("PRAGMA busy_timeout = 60000");
+        q.exec("PRAGMA foreign_keys = ON");
+      }
+      sink = std::unique_ptr<SQLSink>(SQLSink::open(wdb, schema, colDir));
+    }
+    else {
+      std::lock_guard<std::mutex> lk(sleepMtx);
+      errMsg = "SQLWriter: could not open a connection of its own: "
+               + wdb.lastError().text().toStdString();
+      failed.store(true);
+    }
+    writeLoop(sink.get());
+    sink = nullptr;
+    wdb.close();
+  }
+  QSqlDatabase::removeDatabase(cn);
+  return;
+}
+
+void SQLWriter::writeLoop(SQLSink * sink) {
+  SQLBatch b;
+
+  while (true) {
+    if (tryPop(b)) {
+      if (!failed.load()) {
+        try {
+          sink->write(b);
+        }
+        catch (KException & ke) {
+          std::lock_guard<std::mutex> lk(sleepMtx);
+          errMsg = ke.msg;
+          failed.store(true);
+        }
+      }
+      b = SQLBatch();
+      numDone++;
+      if (0 < numAsleep.load()) {
+        std::lock_guard<std::mutex> lk(sleepMtx);
+        wakeOthers.notify_all();
+      }
+      continue;
+    }
+
+    if (stopping.load()) {
+      break;
+    }
+
+    std::unique_lock<std::mutex> lk(sleepMtx);
+    writerAsleep.store(true);
+    wakeWriter.wait(lk, [this]() {
+      return (enqPos.load() != deqPos.load()) || stopping.load();
+    });
+    writerAsleep.store(false);
+    lk.unlock();
+    // a producer may have taken a cell without filling it yet
+    std::this_thread::yield();
+  }
+
+  // store whatever the sink still holds before it goes
+  if (!failed.load()) {
+    try {
+      sink->flush();
+    }
+    catch (KException & ke) {
+      std::lock_guard<std::mutex> lk(sleepMtx);
+      errMsg = ke.msg;
+      failed.store(true);
+    }
+  }
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
@@ -0,0 +1,365 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// Writes batches of rows to the database on a thread of its own, so that
+// the model can compute the next turn while the last one is being stored.
+//
+// The batches go through a bounded ring buffer: pushing and popping are
+// lock-free, and a mutex is taken only to sleep when the ring is full (the
+// producer waits) or empty (the writer waits). Batches are written in the
+// order they were pushed.
+//
+// The writer thread stores rows through a clone of the connection it is
+// given, opened and closed on that thread. An in-memory SQLite database
+// cannot be shared that way. While a writer is running, nothing else should
+// write to the database. Call flush() first, or delete the writer.
+//
+// Built with KTAB_PGCOPY (and libpq), rows bound for PostgreSQL are loaded
+// with binary COPY rather than one INSERT at a time.
+//
+// Given a directory for columnar results, INSERTed rows go to columnar
+// files there (see kcolumnar.h) instead of the database.
+// -------------------------------------------------
+#ifndef KTAB_SQLWRITER_H
+#define KTAB_SQLWRITER_H
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sqlite3.h>
+#ifdef KTAB_PGCOPY
+#include <libpq-fe.h>
+#endif
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "kcolumnar.h"
+
+namespace KBase {
+using std::string;
+using std::vector;
+
+// A value for one placeholder. Only what the tables need: integers, reals and NULL.
+class SQLValue {
+public:
+  enum class Type : unsigned char { Null, Int, UInt, Real };
+
+  SQLValue() {}; // NULL
+  SQLValue(double v) : type(Type::Real), d(v) {};
+  template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+  SQLValue(T v) : type(std::is_signed<T>::value ? Type::Int : Type::UInt), i((int64_t)v) {};
+
+  Type type = Type::Null;
+  union {
+    int64_t i = 0; // UInt values keep their bits, as sqlite would store them
+    double d;
+  };
+};
+
+
+// One prepared statement and the rows to run it on, or a transaction marker.
+// The values of each row are bound by position, in the order of the
+// placeholders in the statement.
+class SQLBatch {
+public:
+  enum class Op { Rows, Begin, Commit, Flush }; // Flush: store anything a sink is holding back
+
+  SQLBatch() {};
+  SQLBatch(const string & s, unsigned int nc, const string & w);
+  explicit SQLBatch(Op o);
+
+  // append one value; rows are stored one after another
+  void add(const SQLValue & v) { vals.push_back(v); }
+  unsigned int numRows() const { return (0 == numCols) ? 0 : vals.size() / numCols; }
+
+  Op op = Op::Rows;
+  string sql = "";
+  unsigned int numCols = 0;
+  vector<SQLValue> vals = {};
+  string who = ""; // named in the error message
+};
+
+
+// Where batches end up. Each sink belongs to the thread which opened it.
+class SQLSink {
+public:
+  explicit SQLSink(const QSqlDatabase & d);
+  virtual ~SQLSink();
+
+  // The fastest sink for that connection: native SQLite when the driver is
+  // QSQLITE, binary COPY for QPSQL (given KTAB_PGCOPY), otherwise one going
+  // through QSqlQuery. The schema is the CREATE TABLE statement of each table,
+  // from which the COPY and columnar sinks take the column types.
+  // With a columnar directory, the sink is a ColumnarSink writing there.
+  static SQLSink * open(const QSqlDatabase & d, const vector<string> & schema = {},
+                        const string & colDir = "");
+
+  // run it, throwing KException on failure
+  void write(const SQLBatch & b);
+
+  // store any rows held back; write calls this for Commit and Flush
+  virtual void flush();
+
+protected:
+  virtual void writeRows(const SQLBatch & b) = 0;
+  QSqlDatabase db;
+};
+
+class QtSQLSink : public SQLSink {
+public:
+  explicit QtSQLSink(const QSqlDatabase & d);
+  virtual ~QtSQLSink();
+
+protected:
+  virtual void writeRows(const SQLBatch & b) override;
+  QSqlQuery qry;
+  string prepSql = ""; // the statement qry holds, so it is not prepared twice
+};
+
+// Calls sqlite3 directly on Qt's handle. An INSERT ... VALUES (...) is
+// rewritten to insert up to maxRows rows per statement, and the statements
+// are kept prepared for as long as the sink lives (normally a whole run).
+class SQLiteSink : public SQLSink {
+public:
+  SQLiteSink(const QSqlDatabase & d, sqlite3 * h);
+  virtual ~SQLiteSink();
+
+  static const unsigned int maxRows = 256;
+
+protected:
+  virtual void writeRows(const SQLBatch & b) override;
+
+  // statement inserting nr rows at once (nr is a power of two)
+  sqlite3_stmt * prepared(const SQLBatch & b, unsigned int nr);
+
+  sqlite3 * lite = nullptr;
+  std::map<std::pair<string, unsigned int>, sqlite3_stmt *> stmts = {};
+};
+
+// The binary format of PostgreSQL's COPY, as PgCopySink sends it. It needs
+// no libpq, so it is built either way, and smpc --copycheck can check it by
+// decoding what it encodes.
+class PgCopyEncoder {
+public:
+  explicit PgCopyEncoder(const vector<string> & schema);
+
+  enum class ColType { Int2, Int4, Int8, Float4, Float8, Text };
+  static const int litVal = -1;
+  static const int textLit = -2;
+
+  // How to turn one INSERT statement into COPY rows
+  struct Plan {
+    bool copyable = false;
+    string copySql = "";       // COPY table (columns) FROM STDIN (FORMAT binary)
+    vector<ColType> types = {};
+    vector<int> param = {};    // which placeholder fills each column, or litVal or textLit
+    vector<SQLValue> lit = {}; // for litVal: the number (or NULL) given in the statement
+    vector<string> litText = {}; // for textLit: the quoted text given in the statement
+    string held = "";          // encoded rows not yet sent
+  };
+
+  // The plan for the statement of b, made on first use. It is copyable only
+  // for a plain INSERT ... VALUES into a table of the schema, with columns
+  // of the types above.
+  Plan & plan(const SQLBatch & b);
+
+  // Append the rows of b to p.held; throws KException if a value does not fit its column.
+  void encode(Plan & p, const SQLBatch & b) const;
+
+  // what comes before and after the rows
+  static const string header;
+  static const string trailer;
+
+  // Read back a whole COPY stream, header and trailer included, of rows with
+  // the given column types. Each field is given as text: integers in decimal,
+  // floats with %.9g or %.17g, and NULL as "NULL". Throws KException if the
+  // stream is malformed, or if a field is not as long as its type says.
+  static vector<vector<string>> decode(const string & data, const vector<ColType> & types);
+
+  std::map<string, Plan> plans = {}; // by statement
+
+protected:
+  std::map<string, std::map<string, ColType>> tables = {}; // by lower-case table and column
+};
+
+#ifdef KTAB_PGCOPY
+// Loads rows into PostgreSQL with COPY ... FROM STDIN in binary format, on
+// Qt's own connection. The rows of each INSERT statement are held until the
+// next Commit or Flush (normally once per turn), or until a lot have built
+// up, and then sent as a single COPY. Anything which is not a plain
+// INSERT ... VALUES into a known table goes through QSqlQuery, after the
+// held rows have been stored.
+class PgCopySink : public SQLSink {
+public:
+  PgCopySink(const QSqlDatabase & d, PGconn * c, const vector<string> & schema);
+  virtual ~PgCopySink();
+
+  virtual void flush() override;
+
+  static const size_t maxHeld = 16 * 1024 * 1024; // bytes per statement
+
+protected:
+  virtual void writeRows(const SQLBatch & b) override;
+  void send(PgCopyEncoder::Plan & p, const string & who);
+
+  PGconn * conn = nullptr;
+  PgCopyEncoder enc;
+  QtSQLSink viaQt;
+};
+#endif
+
+// Writes the rows of each INSERT into the file colDir/ScenarioId/Table.kcol,
+// in the columnar format of kcolumnar.h, with every column of the table.
+// Rows are held until the next Commit or Flush (normally once per turn),
+// and UPDATEs of held rows, such as SMPState::updateBargnTable makes, are
+// applied to them there. Statements of any other shape, or for tables
+// without a text ScenarioId given literally, go through QSqlQuery.
+class ColumnarSink : public SQLSink {
+public:
+  ColumnarSink(const QSqlDatabase & d, const string & colDir, const vector<string> & schema);
+  virtual ~ColumnarSink();
+
+  virtual void flush() override;
+
+  // the directory, under colDir, holding the files of scenario scen
+  static string scenarioDir(const string & colDir, const string & scen);
+
+protected:
+  struct Table {
+    string name = ""; // for the file, as the INSERTs write it
+    vector<string> names = {};
+    vector<ColumnData::Kind> kinds = {};
+    // for columns an INSERT leaves out: noParam with a number (or NULL), or textLit with text
+    vector<int> defaultParam = {};
+    vector<SQLValue> defaults = {};
+    vector<string> defaultText = {};
+    std::map<string, unsigned int> index = {}; // by lower-case column name
+  };
+
+  // What a statement does to which columns of a table
+  struct Plan {
+    enum class Kind { Other, Insert, Update };
+    Kind kind = Kind::Other;
+    string table = ""; // lower-case
+    string scen = "";  // the ScenarioId it gives
+    // Insert: for each column of the table, the placeholder filling it,
+    // or noParam for the number (or NULL) in lit, or textLit for litText
+    vector<int> param = {};
+    vector<SQLValue> lit = {};
+    vector<string> litText = {};
+    // Update: column = placeholder, for SET and for each term of WHERE
+    vector<std::pair<unsigned int, int>> set = {};
+    vector<std::pair<unsigned int, int>> where = {};
+  };
+  static const int noParam = -1;
+  static const int textLit = -2;
+
+  virtual void writeRows(const SQLBatch & b) override;
+  Plan & plan(const SQLBatch & b);
+  void insertRows(const Plan & p, const SQLBatch & b);
+  void updateRows(const Plan & p, const SQLBatch & b);
+
+  const string dir;
+  std::map<string, Table> tables = {}; // by lower-case name
+  std::map<string, Plan> plans = {};
+  std::map<std::pair<string, string>, vector<ColumnData>> held = {}; // by scenario and table
+  std::map<std::pair<string, string>, std::unique_ptr<ColumnarWriter>> writers = {};
+  QtSQLSink viaQt;
+};
+
+
+class SQLWriter {
+public:
+  // with colDir, rows are written there as SQLSink::open describes
+  explicit SQLWriter(const QSqlDatabase & d, const vector<string> & schema = {},
+                     const string & colDir = "", unsigned int cap = 256);
+  ~SQLWriter(); // writes what is left, then stops; logs but cannot rethrow errors
+
+  // Queue a batch, waiting while the ring is full.
+  // Throws KException if an earlier batch failed.
+  void push(SQLBatch && b);
+
+  // Return once everything pushed so far is in the database.
+  // This and turnBarrier also store what the sink may be holding back.
+  // Throws KException if any batch failed.
+  void flush();
+
+  // Called once per turn. Returns once everything pushed before the previous
+  // call is in the database, so storage runs at most one turn behind.
+  void turnBarrier();
+
+protected:
+  struct Cell {
+    std::atomic<uint64_t> seq;
+    SQLBatch batch;
+  };
+
+  static uint64_t nextPow2(unsigned int n);
+  bool tryPush(SQLBatch & b);
+  bool tryPop(SQLBatch & b);
+  void writeLoop(); // on a connection of its own
+  void writeLoop(SQLSink * sink); // nullptr if that could not be opened
+  void waitFor(uint64_t n); // until n batches have been written
+  void checkError();
+
+  QSqlDatabase db;
+  const vector<string> schema;
+  const string colDir;
+  const uint64_t mask;
+  std::unique_ptr<Cell[]> ring;
+  std::atomic<uint64_t> enqPos;
+  std::atomic<uint64_t> deqPos;
+
+  std::atomic<uint64_t> numPushed;
+  std::atomic<uint64_t> numDone;
+  uint64_t lastBarrier = 0;
+
+  std::mutex sleepMtx;
+  std::condition_variable wakeWriter;
+  std::condition_variable wakeOthers;
+  std::atomic<bool> writerAsleep;
+  std::atomic<unsigned int> numAsleep; // producers and flushers
+  std::atomic<bool> stopping;
+
+  std::atomic<bool> failed;
+  string errMsg = "";
+
+  std::thread thr;
+};
+
+} // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
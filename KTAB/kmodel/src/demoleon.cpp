@@ -1056,7 +1056,7 @@ void LeonModel::makeIOModel(const KMatrix & trns, const KMatrix & rev, const KMa
   }
   LOG(INFO) << "ok";
 
-  auto alpha = A + (zeta * expnd * rho);
+  KMatrix alpha = A + (zeta * expnd * rho);
   LOG(INFO) << "alpha ";
   alpha.mPrintf(" %.4f ");
   for (auto a : alpha) {
@@ -1429,7 +1429,7 @@ void LeonModel::prepModel(unsigned int numFac, unsigned int numCon, unsigned int
   LOG(INFO) << "ok";
 
   // compute & validate alpha, then invert & validate I-alpha
-  auto alpha = A + (zeta * expnd * rho);
+  KMatrix alpha = A + (zeta * expnd * rho);
   LOG(INFO) << "alpha:";
   alpha.mPrintf(" %.4f ");
   for (auto a : alpha) {
@@ -2213,7 +2213,7 @@ void demoRealEcon(bool OSPonly, uint64_t s, PRNG* rng)
     0.0076, 0.0056, 0.0224, 0.0301, 0.0054, 0.0038, 0.0009, 0.0005, 0.0002, 0.0006,
     0.0004, 0.0014, 0.0003, 0.0003, 0.0002, 0.0000, 0.0000, 0.0000, 0.0005, 0.0002,
     0.0000, 0.0000, 0.0000, 0.0005};
-  auto Bmat = regul*KMatrix::vecInit(bInput,N,N);
+  KMatrix Bmat = regul*KMatrix::vecInit(bInput,N,N);
 
   // set up for scenarios of capacities
   // 0 = random, 1 = equal, 2 = self-weighted, 3 = input-weighted
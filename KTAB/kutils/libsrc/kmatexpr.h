@@ -0,0 +1,484 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// Lazy, element-wise KMatrix arithmetic via expression templates.
+//
+// An expression like (p+q)/2.0 normally builds two temporary KMatrix
+// objects, each with its own heap allocation and its own pass over the data.
+// Here, the operators instead return small expression objects that only
+// remember their operands; the whole chain is evaluated in a single loop
+// when it is assigned to (or used to construct) a KMatrix. Assigning to a
+// KMatrix of the right shape reuses its storage, so "p = (p+q)/2.0"
+// allocates nothing at all.
+//
+// There are two ways to use this:
+// - locally, by wrapping an operand: p = (lazy(p) + q) / 2.0;
+// - everywhere, by defining KTAB_KMATRIX_EXPR for the whole build
+//   (see the CMake option of the same name). Then the element-wise
+//   operators, trans and clip in kmatrix.h are all lazy.
+//
+// Results are bit-for-bit the same as the eager versions, as each element
+// is computed by the same formula. Things that take a const KMatrix&
+// (norm, inv, matrix multiply, VctrPstn(...), etc.) accept an expression
+// and evaluate it on the way in. The one thing to watch is 'auto':
+// "auto d = a - b;" holds an unevaluated expression which reads a and b
+// whenever it is used, so write "KMatrix d = a - b;" if you need a snapshot,
+// or want to modify d.
+//
+// This file is included at the end of kmatrix.h; do not include it directly.
+// -------------------------------------------------
+#ifndef KMATEXPR_H
+#define KMATEXPR_H
+
+#include <type_traits>
+#include <utility>
+
+namespace KBase {
+
+// marker, so the operators can tell an expression from anything else
+class KMatExprBase { };
+
+template <class E>
+class KMatExpr : public KMatExprBase {
+public:
+    const E & self() const {
+        return static_cast<const E &>(*this);
+    };
+
+    // bounds-checked, read-only element access, just like KMatrix
+    double operator() (unsigned int i, unsigned int j) const {
+        if ((self().numR() <= i) || (self().numC() <= j)) {
+            throw KException("KMatExpr::operator(): index out of range");
+        }
+        return self().at(i, j);
+    };
+
+    void mPrintf(string fs, string msg = string()) const {
+        KMatrix(*this).mPrintf(fs, msg);
+    };
+};
+
+
+// reference to an existing, named matrix
+class KMatRef : public KMatExpr<KMatRef> {
+public:
+    explicit KMatRef(const KMatrix & m) : mat(m) { };
+    unsigned int numR() const {
+        return mat.rows;
+    };
+    unsigned int numC() const {
+        return mat.clms;
+    };
+    double at(unsigned int i, unsigned int j) const {
+        return mat.vals[i*mat.clms + j];
+    };
+    bool refersTo(const KMatrix * m) const {
+        return (&mat == m);
+    };
+    bool reorders() const {
+        return false;
+    };
+private:
+    const KMatrix & mat;
+};
+
+
+// a temporary operand (e.g. the result of a function call), which we keep
+// by value so the expression never refers to something already destroyed
+class KMatVal : public KMatExpr<KMatVal> {
+public:
+    explicit KMatVal(const KMatrix & m) : mat(m) { };
+    unsigned int numR() const {
+        return mat.rows;
+    };
+    unsigned int numC() const {
+        return mat.clms;
+    };
+    double at(unsigned int i, unsigned int j) const {
+        return mat.vals[i*mat.clms + j];
+    };
+    bool refersTo(const KMatrix *) const {
+        return false;
+    };
+    bool reorders() const {
+        return false;
+    };
+private:
+    KMatrix mat;
+};
+
+
+// the element-wise operations
+struct KMatOpAdd {
+    static double apply(double a, double b) {
+        return a + b;
+    };
+};
+
+struct KMatOpSub {
+    static double apply(double a, double b) {
+        return a - b;
+    };
+};
+
+struct KMatOpMul {
+    static double apply(double a, double b) {
+        return a * b;
+    };
+};
+
+struct KMatOpDiv {
+    static double apply(double a, double b) {
+        return a / b;
+    };
+};
+
+
+// matrix (op) matrix
+template <class Op, class L, class R>
+class KMatBinary : public KMatExpr<KMatBinary<Op, L, R>> {
+public:
+    KMatBinary(const L & l, const R & r) : lhs(l), rhs(r) { };
+    unsigned int numR() const {
+        return lhs.numR();
+    };
+    unsigned int numC() const {
+        return lhs.numC();
+    };
+    double at(unsigned int i, unsigned int j) const {
+        return Op::apply(lhs.at(i, j), rhs.at(i, j));
+    };
+    bool refersTo(const KMatrix * m) const {
+        return (lhs.refersTo(m) || rhs.refersTo(m));
+    };
+    bool reorders() const {
+        return (lhs.reorders() || rhs.reorders());
+    };
+private:
+    L lhs;
+    R rhs;
+};
+
+
+// matrix (op) scalar, or scalar (op) matrix if scalarFirst
+template <class Op, class L, bool scalarFirst>
+class KMatScalar : public KMatExpr<KMatScalar<Op, L, scalarFirst>> {
+public:
+    KMatScalar(const L & l, double v) : lhs(l), x(v) { };
+    unsigned int numR() const {
+        return lhs.numR();
+    };
+    unsigned int numC() const {
+        return lhs.numC();
+    };
+    double at(unsigned int i, unsigned int j) const {
+        return scalarFirst ? Op::apply(x, lhs.at(i, j)) : Op::apply(lhs.at(i, j), x);
+    };
+    bool refersTo(const KMatrix * m) const {
+        return lhs.refersTo(m);
+    };
+    bool reorders() const {
+        return lhs.reorders();
+    };
+private:
+    L lhs;
+    double x;
+};
+
+
+template <class L>
+class KMatTrans : public KMatExpr<KMatTrans<L>> {
+public:
+    explicit KMatTrans(const L & l) : lhs(l) { };
+    unsigned int numR() const {
+        return lhs.numC();
+    };
+    unsigned int numC() const {
+        return lhs.numR();
+    };
+    double at(unsigned int i, unsigned int j) const {
+        return lhs.at(j, i);
+    };
+    bool refersTo(const KMatrix * m) const {
+        return lhs.refersTo(m);
+    };
+    bool reorders() const {
+        return true;
+    };
+private:
+    L lhs;
+};
+
+
+template <class L>
+class KMatClip : public KMatExpr<KMatClip<L>> {
+public:
+    KMatClip(const L & l, double xMin, double xMax) : lhs(l), lo(xMin), hi(xMax) { };
+    unsigned int numR() const {
+        return lhs.numR();
+    };
+    unsigned int numC() const {
+        return lhs.numC();
+    };
+    double at(unsigned int i, unsigned int j) const {
+        double mij = lhs.at(i, j);
+        mij = (mij < lo) ? lo : mij;
+        mij = (hi < mij) ? hi : mij;
+        return mij;
+    };
+    bool refersTo(const KMatrix * m) const {
+        return lhs.refersTo(m);
+    };
+    bool reorders() const {
+        return lhs.reorders();
+    };
+private:
+    L lhs;
+    double lo;
+    double hi;
+};
+
+
+// -------------------------------------------------
+// Mapping an operand (as deduced by a forwarding reference) to
+// the node stored in the expression tree: expressions are kept as-is,
+// named matrices by reference, temporary matrices by value.
+template <class T>
+struct KMatIsExpr {
+    static const bool value =
+        std::is_base_of<KMatExprBase, typename std::decay<T>::type>::value;
+};
+
+template <class T>
+struct KMatIsMatrix {
+    static const bool value =
+        std::is_base_of<KMatrix, typename std::decay<T>::type>::value;
+};
+
+template <class T, class Enable = void>
+struct KMatOperand { }; // not an operand: no 'type', so templates drop out
+
+template <class T>
+struct KMatOperand<T, typename std::enable_if<KMatIsExpr<T>::value>::type> {
+    typedef typename std::decay<T>::type type;
+    static const type & wrap(const type & e) {
+        return e;
+    };
+};
+
+template <class T>
+struct KMatOperand<T, typename std::enable_if<KMatIsMatrix<T>::value
+                                              && std::is_lvalue_reference<T>::value>::type> {
+    typedef KMatRef type;
+    static type wrap(const KMatrix & m) {
+        return KMatRef(m);
+    };
+};
+
+template <class T>
+struct KMatOperand<T, typename std::enable_if<KMatIsMatrix<T>::value
+                                              && !std::is_lvalue_reference<T>::value>::type> {
+    typedef KMatVal type;
+    static type wrap(const KMatrix & m) {
+        return KMatVal(m);
+    };
+};
+
+// Which argument lists switch on the lazy operators. Without KTAB_KMATRIX_EXPR,
+// at least one operand must already be an expression (e.g. from lazy(m)),
+// so plain KMatrix arithmetic still goes to the eager functions in kmatrix.cpp.
+template <class L, class R = KMatExprBase>
+struct KMatLazyP {
+#ifdef KTAB_KMATRIX_EXPR
+    static const bool value = (KMatIsExpr<L>::value || KMatIsMatrix<L>::value)
+                              && (KMatIsExpr<R>::value || KMatIsMatrix<R>::value);
+#else
+    static const bool value = (KMatIsExpr<L>::value && (KMatIsExpr<R>::value || KMatIsMatrix<R>::value))
+                              || (KMatIsMatrix<L>::value && KMatIsExpr<R>::value);
+#endif
+};
+
+// result types of the operators, which only exist when the operator applies
+template <class Op, class L, class R, bool P = KMatLazyP<L, R>::value>
+struct KMatBinaryOf { };
+
+template <class Op, class L, class R>
+struct KMatBinaryOf<Op, L, R, true> {
+    typedef KMatBinary<Op, typename KMatOperand<L>::type, typename KMatOperand<R>::type> type;
+};
+
+template <class Op, class L, bool scalarFirst, bool P = KMatLazyP<L>::value>
+struct KMatScalarOf { };
+
+template <class Op, class L, bool scalarFirst>
+struct KMatScalarOf<Op, L, scalarFirst, true> {
+    typedef KMatScalar<Op, typename KMatOperand<L>::type, scalarFirst> type;
+};
+
+
+// -------------------------------------------------
+// start a lazy chain from a named matrix
+inline KMatRef lazy(const KMatrix & m) {
+    return KMatRef(m);
+}
+
+template <class L, class R>
+typename KMatBinaryOf<KMatOpAdd, L, R>::type
+operator+ (L && m1, R && m2) {
+    if ((m1.numR() != m2.numR()) || (m1.numC() != m2.numC())) {
+        throw KException("operator+: m1 and m2 matrices are not of same shape");
+    }
+    return typename KMatBinaryOf<KMatOpAdd, L, R>::type(KMatOperand<L>::wrap(m1), KMatOperand<R>::wrap(m2));
+}
+
+template <class L, class R>
+typename KMatBinaryOf<KMatOpSub, L, R>::type
+operator- (L && m1, R && m2) {
+    if ((m1.numR() != m2.numR()) || (m1.numC() != m2.numC())) {
+        throw KException("operator-: m1 and m2 matrices are not of same shape");
+    }
+    return typename KMatBinaryOf<KMatOpSub, L, R>::type(KMatOperand<L>::wrap(m1), KMatOperand<R>::wrap(m2));
+}
+
+template <class L>
+typename KMatScalarOf<KMatOpAdd, L, false>::type
+operator+ (L && m1, double x) {
+    return typename KMatScalarOf<KMatOpAdd, L, false>::type(KMatOperand<L>::wrap(m1), x);
+}
+
+template <class L>
+typename KMatScalarOf<KMatOpSub, L, false>::type
+operator- (L && m1, double x) {
+    return typename KMatScalarOf<KMatOpSub, L, false>::type(KMatOperand<L>::wrap(m1), x);
+}
+
+template <class L>
+typename KMatScalarOf<KMatOpMul, L, true>::type
+operator* (double x, L && m1) {
+    return typename KMatScalarOf<KMatOpMul, L, true>::type(KMatOperand<L>::wrap(m1), x);
+}
+
+template <class L>
+typename KMatScalarOf<KMatOpMul, L, true>::type
+operator* (L && m1, double x) {
+    // the eager version computes x*m(i,j), and so do we
+    return typename KMatScalarOf<KMatOpMul, L, true>::type(KMatOperand<L>::wrap(m1), x);
+}
+
+template <class L>
+typename KMatScalarOf<KMatOpDiv, L, false>::type
+operator/ (L && m1, double x) {
+    return typename KMatScalarOf<KMatOpDiv, L, false>::type(KMatOperand<L>::wrap(m1), x);
+}
+
+template <class L>
+typename std::enable_if<KMatLazyP<L>::value, KMatTrans<typename KMatOperand<L>::type>>::type
+trans(L && m1) {
+    return KMatTrans<typename KMatOperand<L>::type>(KMatOperand<L>::wrap(m1));
+}
+
+template <class L>
+typename std::enable_if<KMatLazyP<L>::value, KMatClip<typename KMatOperand<L>::type>>::type
+clip(L && m1, double xMin, double xMax) {
+    if (xMin > xMax) {
+      throw KException("clip: xMin can not be more than xMax");
+    }
+    return KMatClip<typename KMatOperand<L>::type>(KMatOperand<L>::wrap(m1), xMin, xMax);
+}
+
+// Reductions straight off an expression, so norm(a - b) needs no temporary.
+// Summation order is the same as in the eager versions.
+template <class E>
+double sum(const KMatExpr<E> & e) {
+    const E & x = e.self();
+    double s = 0.0;
+    for (unsigned int i = 0; i < x.numR(); i++) {
+        for (unsigned int j = 0; j < x.numC(); j++) {
+            s = s + x.at(i, j);
+        }
+    }
+    return s;
+}
+
+template <class E>
+double norm(const KMatExpr<E> & e) {
+    const E & x = e.self();
+    double s = 0.0;
+    for (unsigned int i = 0; i < x.numR(); i++) {
+        for (unsigned int j = 0; j < x.numC(); j++) {
+            const double xij = x.at(i, j);
+            s = s + xij*xij;
+        }
+    }
+    return sqrt(s);
+}
+
+
+// -------------------------------------------------
+// evaluation into a KMatrix
+
+template <class E>
+KMatrix::KMatrix(const KMatExpr<E> & e) {
+    const E & x = e.self();
+    rows = x.numR();
+    clms = x.numC();
+    vals.resize(rows*clms);
+    double * v = vals.data();
+    for (unsigned int i = 0; i < rows; i++) {
+        for (unsigned int j = 0; j < clms; j++) {
+            v[i*clms + j] = x.at(i, j);
+        }
+    }
+}
+
+template <class E>
+KMatrix & KMatrix::operator= (const KMatExpr<E> & e) {
+    const E & x = e.self();
+    if (x.reorders() && x.refersTo(this)) {
+        // e.g. m = trans(m): elements would be overwritten before they are read
+        KMatrix tmp = KMatrix(e);
+        rows = tmp.rows;
+        clms = tmp.clms;
+        vals.swap(tmp.vals);
+        return *this;
+    }
+    // An element-wise expression which refers to this matrix has the same
+    // shape, and element n only reads element n, so it is safe to overwrite.
+    rows = x.numR();
+    clms = x.numC();
+    vals.resize(rows*clms);
+    double * v = vals.data();
+    for (unsigned int i = 0; i < rows; i++) {
+        for (unsigned int j = 0; j < clms; j++) {
+            v[i*clms + j] = x.at(i, j);
+        }
+    }
+    return *this;
+}
+
+}; // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
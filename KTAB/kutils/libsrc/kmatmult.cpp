@@ -0,0 +1,391 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// Blocked matrix multiply for KMatrix.
+//
+// The classic formulation (map a lambda over (i,j), walking down
+// a column of m2 through the bounds-checked operator()) is about as
+// cache-unfriendly as it gets. Here we do the textbook GEMM dance:
+// split the inner dimension into KC-sized slabs, pack each slab of m2
+// into contiguous NR-wide column panels, pack MR rows of m1 at a time,
+// and let a small MR x NR register-tiled kernel do the arithmetic.
+// The kernel is chosen once at runtime from what the CPU offers.
+// -------------------------------------------------
+
+#include <algorithm>
+#include <vector>
+
+#include "kmatrix.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KTAB_GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace KBase {
+
+using std::vector;
+
+namespace {
+
+// Register tile is MR rows by NR columns. MR is the same for every kernel,
+// so one packing of m1 serves them all; NR depends on the vector width.
+const unsigned int gemmMR = 4;
+const unsigned int gemmKC = 256; // depth of one slab of the inner dimension
+const unsigned int gemmNC = 512; // width of one packed slab of m2
+
+// Below this many multiply-adds, or for products only a few columns wide,
+// packing costs more than it saves.
+const unsigned int gemmMinWork = 16 * 16 * 16;
+const unsigned int gemmMinClms = 8;
+
+typedef void(*GemmTileFn)(unsigned int kc, const double * aP, const double * bP,
+                          double * c, unsigned int ldc);
+
+
+// The plain triple loop on the raw storage. This is the reference order
+// of summation: s = ((0 + a0*b0) + a1*b1) + ...
+void naiveMult(unsigned int nr, unsigned int nm, unsigned int nc,
+               const double * a, const double * b, double * c) {
+    for (unsigned int i = 0; i < nr; i++) {
+        for (unsigned int j = 0; j < nc; j++) {
+            double sij = 0.0;
+            for (unsigned int k = 0; k < nm; k++) {
+                sij = sij + a[i*nm + k] * b[k*nc + j];
+            }
+            c[i*nc + j] = sij;
+        }
+    }
+    return;
+}
+
+
+// c[r,j] += sum_k aP[k,r]*bP[k,j] over a 4x8 tile.
+// Accumulators start from c, so the order of summation for each
+// element is exactly the same as in naiveMult.
+void tileScalar8(unsigned int kc, const double * aP, const double * bP,
+                 double * c, unsigned int ldc) {
+    const unsigned int nr = 8;
+    double acc[gemmMR][nr];
+    for (unsigned int r = 0; r < gemmMR; r++) {
+        for (unsigned int j = 0; j < nr; j++) {
+            acc[r][j] = c[r*ldc + j];
+        }
+    }
+    for (unsigned int k = 0; k < kc; k++) {
+        const double * ak = aP + k*gemmMR;
+        const double * bk = bP + k*nr;
+        for (unsigned int r = 0; r < gemmMR; r++) {
+            const double ar = ak[r];
+            for (unsigned int j = 0; j < nr; j++) {
+                acc[r][j] = acc[r][j] + ar*bk[j];
+            }
+        }
+    }
+    for (unsigned int r = 0; r < gemmMR; r++) {
+        for (unsigned int j = 0; j < nr; j++) {
+            c[r*ldc + j] = acc[r][j];
+        }
+    }
+    return;
+}
+
+
+#ifdef KTAB_GEMM_X86
+
+// 4x8 tile in eight 256-bit accumulators
+__attribute__((target("avx2,fma")))
+void tileAVX2(unsigned int kc, const double * aP, const double * bP,
+              double * c, unsigned int ldc) {
+    __m256d c00 = _mm256_loadu_pd(c + 0*ldc);
+    __m256d c01 = _mm256_loadu_pd(c + 0*ldc + 4);
+    __m256d c10 = _mm256_loadu_pd(c + 1*ldc);
+    __m256d c11 = _mm256_loadu_pd(c + 1*ldc + 4);
+    __m256d c20 = _mm256_loadu_pd(c + 2*ldc);
+    __m256d c21 = _mm256_loadu_pd(c + 2*ldc + 4);
+    __m256d c30 = _mm256_loadu_pd(c + 3*ldc);
+    __m256d c31 = _mm256_loadu_pd(c + 3*ldc + 4);
+    for (unsigned int k = 0; k < kc; k++) {
+        const __m256d b0 = _mm256_loadu_pd(bP);
+        const __m256d b1 = _mm256_loadu_pd(bP + 4);
+        __m256d a = _mm256_broadcast_sd(aP + 0);
+        c00 = _mm256_fmadd_pd(a, b0, c00);
+        c01 = _mm256_fmadd_pd(a, b1, c01);
+        a = _mm256_broadcast_sd(aP + 1);
+        c10 = _mm256_fmadd_pd(a, b0, c10);
+        c11 = _mm256_fmadd_pd(a, b1, c11);
+        a = _mm256_broadcast_sd(aP + 2);
+        c20 = _mm256_fmadd_pd(a, b0, c20);
+        c21 = _mm256_fmadd_pd(a, b1, c21);
+        a = _mm256_broadcast_sd(aP + 3);
+        c30 = _mm256_fmadd_pd(a, b0, c30);
+        c31 = _mm256_fmadd_pd(a, b1, c31);
+        aP += gemmMR;
+        bP += 8;
+    }
+    _mm256_storeu_pd(c + 0*ldc, c00);
+    _mm256_storeu_pd(c + 0*ldc + 4, c01);
+    _mm256_storeu_pd(c + 1*ldc, c10);
+    _mm256_storeu_pd(c + 1*ldc + 4, c11);
+    _mm256_storeu_pd(c + 2*ldc, c20);
+    _mm256_storeu_pd(c + 2*ldc + 4, c21);
+    _mm256_storeu_pd(c + 3*ldc, c30);
+    _mm256_storeu_pd(c + 3*ldc + 4, c31);
+    return;
+}
+
+
+// 4x16 tile in eight 512-bit accumulators
+__attribute__((target("avx512f")))
+void tileAVX512(unsigned int kc, const double * aP, const double * bP,
+                double * c, unsigned int ldc) {
+    __m512d c00 = _mm512_loadu_pd(c + 0*ldc);
+    __m512d c01 = _mm512_loadu_pd(c + 0*ldc + 8);
+    __m512d c10 = _mm512_loadu_pd(c + 1*ldc);
+    __m512d c11 = _mm512_loadu_pd(c + 1*ldc + 8);
+    __m512d c20 = _mm512_loadu_pd(c + 2*ldc);
+    __m512d c21 = _mm512_loadu_pd(c + 2*ldc + 8);
+    __m512d c30 = _mm512_loadu_pd(c + 3*ldc);
+    __m512d c31 = _mm512_loadu_pd(c + 3*ldc + 8);
+    for (unsigned int k = 0; k < kc; k++) {
+        const __m512d b0 = _mm512_loadu_pd(bP);
+        const __m512d b1 = _mm512_loadu_pd(bP + 8);
+        __m512d a = _mm512_set1_pd(aP[0]);
+        c00 = _mm512_fmadd_pd(a, b0, c00);
+        c01 = _mm512_fmadd_pd(a, b1, c01);
+        a = _mm512_set1_pd(aP[1]);
+        c10 = _mm512_fmadd_pd(a, b0, c10);
+        c11 = _mm512_fmadd_pd(a, b1, c11);
+        a = _mm512_set1_pd(aP[2]);
+        c20 = _mm512_fmadd_pd(a, b0, c20);
+        c21 = _mm512_fmadd_pd(a, b1, c21);
+        a = _mm512_set1_pd(aP[3]);
+        c30 = _mm512_fmadd_pd(a, b0, c30);
+        c31 = _mm512_fmadd_pd(a, b1, c31);
+        aP += gemmMR;
+        bP += 16;
+    }
+    _mm512_storeu_pd(c + 0*ldc, c00);
+    _mm512_storeu_pd(c + 0*ldc + 8, c01);
+    _mm512_storeu_pd(c + 1*ldc, c10);
+    _mm512_storeu_pd(c + 1*ldc + 8, c11);
+    _mm512_storeu_pd(c + 2*ldc, c20);
+    _mm512_storeu_pd(c + 2*ldc + 8, c21);
+    _mm512_storeu_pd(c + 3*ldc, c30);
+    _mm512_storeu_pd(c + 3*ldc + 8, c31);
+    return;
+}
+
+#endif // KTAB_GEMM_X86
+
+
+// Pack rows [i0, i0+mr) and clms [k0, k0+kc) of a (nm columns) as
+// kc consecutive groups of MR values, zero-padding missing rows.
+void packA(const double * a, unsigned int nm, unsigned int i0, unsigned int mr,
+           unsigned int k0, unsigned int kc, double * aP) {
+    for (unsigned int k = 0; k < kc; k++) {
+        for (unsigned int r = 0; r < gemmMR; r++) {
+            aP[k*gemmMR + r] = (r < mr) ? a[(i0 + r)*nm + k0 + k] : 0.0;
+        }
+    }
+    return;
+}
+
+
+// Pack rows [k0, k0+kc) and clms [j0, j0+nc) of b (ldb columns) into
+// NR-wide panels, each stored as kc consecutive rows of NR values.
+// Missing columns in the last panel are zero-padded.
+void packB(const double * b, unsigned int ldb, unsigned int k0, unsigned int kc,
+           unsigned int j0, unsigned int nc, unsigned int nr, double * bP) {
+    for (unsigned int p = 0; p < nc; p += nr) {
+        const unsigned int w = std::min(nr, nc - p);
+        for (unsigned int k = 0; k < kc; k++) {
+            const double * bk = b + (k0 + k)*ldb + j0 + p;
+            for (unsigned int j = 0; j < nr; j++) {
+                bP[j] = (j < w) ? bk[j] : 0.0;
+            }
+            bP += nr;
+        }
+    }
+    return;
+}
+
+
+void blockedMult(unsigned int nr, unsigned int nm, unsigned int nc,
+                 const double * a, const double * b, double * c,
+                 GemmTileFn tile, unsigned int tileNR) {
+    auto aP = vector<double>(gemmKC * gemmMR);
+    auto bP = vector<double>(gemmKC * (gemmNC + tileNR));
+    auto edge = vector<double>(gemmMR * tileNR);
+
+    for (unsigned int j0 = 0; j0 < nc; j0 += gemmNC) {
+        const unsigned int ncb = std::min(gemmNC, nc - j0);
+        for (unsigned int k0 = 0; k0 < nm; k0 += gemmKC) {
+            const unsigned int kc = std::min(gemmKC, nm - k0);
+            packB(b, nc, k0, kc, j0, ncb, tileNR, bP.data());
+
+            for (unsigned int i0 = 0; i0 < nr; i0 += gemmMR) {
+                const unsigned int mr = std::min(gemmMR, nr - i0);
+                packA(a, nm, i0, mr, k0, kc, aP.data());
+
+                for (unsigned int p = 0; p < ncb; p += tileNR) {
+                    const unsigned int w = std::min(tileNR, ncb - p);
+                    const double * bPanel = bP.data() + p*kc;
+                    double * cij = c + i0*nc + j0 + p;
+                    if ((gemmMR == mr) && (tileNR == w)) {
+                        tile(kc, aP.data(), bPanel, cij, nc);
+                    }
+                    else { // ragged edge: work in a scratch tile
+                        std::fill(edge.begin(), edge.end(), 0.0);
+                        for (unsigned int r = 0; r < mr; r++) {
+                            for (unsigned int j = 0; j < w; j++) {
+                                edge[r*tileNR + j] = cij[r*nc + j];
+                            }
+                        }
+                        tile(kc, aP.data(), bPanel, edge.data(), tileNR);
+                        for (unsigned int r = 0; r < mr; r++) {
+                            for (unsigned int j = 0; j < w; j++) {
+                                cij[r*nc + j] = edge[r*tileNR + j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return;
+}
+
+} // end of anonymous namespace
+
+
+bool gemmKernelAvailable(GemmKernel gk) {
+    bool ok = false;
+#ifdef KTAB_GEMM_X86
+    __builtin_cpu_init();
+#endif
+    switch (gk) {
+    case GemmKernel::Naive:
+    case GemmKernel::Scalar:
+        ok = true;
+        break;
+#ifdef KTAB_GEMM_X86
+    case GemmKernel::AVX2:
+        ok = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+        break;
+    case GemmKernel::AVX512:
+        ok = __builtin_cpu_supports("avx512f");
+        break;
+#endif
+    default:
+        ok = false;
+        break;
+    }
+    return ok;
+}
+
+
+GemmKernel bestGemmKernel() {
+    // checked once, on first use
+    static const GemmKernel best = []() {
+        GemmKernel gk = GemmKernel::Scalar;
+        if (gemmKernelAvailable(GemmKernel::AVX512)) {
+            gk = GemmKernel::AVX512;
+        }
+        else if (gemmKernelAvailable(GemmKernel::AVX2)) {
+            gk = GemmKernel::AVX2;
+        }
+        return gk;
+    }();
+    return best;
+}
+
+
+string gemmKernelName(GemmKernel gk) {
+    string s = "Unknown";
+    switch (gk) {
+    case GemmKernel::Naive:
+        s = "Naive";
+        break;
+    case GemmKernel::Scalar:
+        s = "Scalar";
+        break;
+    case GemmKernel::AVX2:
+        s = "AVX2";
+        break;
+    case GemmKernel::AVX512:
+        s = "AVX512";
+        break;
+    default:
+        break;
+    }
+    return s;
+}
+
+
+KMatrix matMult(const KMatrix & m1, const KMatrix & m2, GemmKernel gk) {
+    const unsigned int nr3 = m1.numR();
+    const unsigned int nm3 = m1.numC();
+    if (nm3 != m2.numR()) {
+      throw KException("matMult: m1 and m2 matrices don't qualify for matrix multiplication");
+    }
+    if (!gemmKernelAvailable(gk)) {
+      throw KException("matMult: requested kernel " + gemmKernelName(gk) + " is not supported on this CPU");
+    }
+    const unsigned int nc3 = m2.numC();
+    auto m3 = KMatrix(nr3, nc3);
+    if ((0 == nr3) || (0 == nc3) || (0 == nm3)) {
+        return m3;
+    }
+
+    const double * a = m1.vals.data();
+    const double * b = m2.vals.data();
+    double * c = m3.vals.data();
+
+    const double work = ((double)nr3) * nm3 * nc3;
+    if ((GemmKernel::Naive == gk) || (work < gemmMinWork) || (nc3 < gemmMinClms)) {
+        naiveMult(nr3, nm3, nc3, a, b, c);
+        return m3;
+    }
+
+    switch (gk) {
+#ifdef KTAB_GEMM_X86
+    case GemmKernel::AVX2:
+        blockedMult(nr3, nm3, nc3, a, b, c, tileAVX2, 8);
+        break;
+    case GemmKernel::AVX512:
+        blockedMult(nr3, nm3, nc3, a, b, c, tileAVX512, 16);
+        break;
+#endif
+    default:
+        blockedMult(nr3, nm3, nc3, a, b, c, tileScalar8, 8);
+        break;
+    }
+    return m3;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
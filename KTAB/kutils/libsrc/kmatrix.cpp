@@ -26,6 +26,8 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 #include "prng.h"
@@ -209,6 +211,139 @@ KMatrix::KMatrix(unsigned int nr, unsigned int nc, double iv) {
     vFillVec(nr, nc, iv);
 }
 
+
+KMatrix::KMatrix(unsigned int nr, unsigned int nc, vector<double> && v) {
+    if (v.size() != nr*nc) {
+      throw KException("KMatrix::KMatrix: vector size must be nr*nc");
+    }
+    rows = nr;
+    clms = nc;
+    vals = std::move(v);
+}
+
+
+KMatrix::KMatrix(KMatrix && m) noexcept :
+    rows(m.rows), clms(m.clms), vals(std::move(m.vals)) {
+    m.rows = 0;
+    m.clms = 0;
+    m.vals.clear();
+}
+
+
+KMatrix & KMatrix::operator= (KMatrix && m) noexcept {
+    if (this != &m) {
+        rows = m.rows;
+        clms = m.clms;
+        vals = std::move(m.vals);
+        m.rows = 0;
+        m.clms = 0;
+        m.vals.clear();
+    }
+    return *this;
+}
+
+
+void KMatrix::swap(KMatrix & m) noexcept {
+    std::swap(rows, m.rows);
+    std::swap(clms, m.clms);
+    vals.swap(m.vals);
+    return;
+}
+
+
+void swap(KMatrix & m1, KMatrix & m2) noexcept {
+    m1.swap(m2);
+    return;
+}
+
+
+KMatrix & KMatrix::operator+= (const KMatrix & m2) {
+    if (!sameShape(*this, m2)) {
+      throw KException("KMatrix::operator+=: matrices are not of same shape");
+    }
+    const unsigned int n = rows*clms;
+    for (unsigned int k = 0; k < n; k++) {
+        vals[k] = vals[k] + m2.vals[k];
+    }
+    return *this;
+}
+
+
+KMatrix & KMatrix::operator-= (const KMatrix & m2) {
+    if (!sameShape(*this, m2)) {
+      throw KException("KMatrix::operator-=: matrices are not of same shape");
+    }
+    const unsigned int n = rows*clms;
+    for (unsigned int k = 0; k < n; k++) {
+        vals[k] = vals[k] - m2.vals[k];
+    }
+    return *this;
+}
+
+
+KMatrix & KMatrix::operator+= (double x) {
+    for (auto & v : vals) {
+        v = v + x;
+    }
+    return *this;
+}
+
+
+KMatrix & KMatrix::operator-= (double x) {
+    for (auto & v : vals) {
+        v = v - x;
+    }
+    return *this;
+}
+
+
+KMatrix & KMatrix::operator*= (double x) {
+    scale(x);
+    return *this;
+}
+
+
+KMatrix & KMatrix::operator/= (double x) {
+    for (auto & v : vals) {
+        v = v / x;
+    }
+    return *this;
+}
+
+
+void KMatrix::scale(double x) {
+    for (auto & v : vals) {
+        v = x*v;
+    }
+    return;
+}
+
+
+void KMatrix::axpy(double a, const KMatrix & x) {
+    if (!sameShape(*this, x)) {
+      throw KException("KMatrix::axpy: matrices are not of same shape");
+    }
+    const unsigned int n = rows*clms;
+    for (unsigned int k = 0; k < n; k++) {
+        vals[k] = vals[k] + a*x.vals[k];
+    }
+    return;
+}
+
+
+void KMatrix::fill(double v) {
+    std::fill(vals.begin(), vals.end(), v);
+    return;
+}
+
+
+void KMatrix::resize(unsigned int nr, unsigned int nc, double iv) {
+    rows = nr;
+    clms = nc;
+    vals.assign(nr*nc, iv); // reuses the capacity when it can
+    return;
+}
+
 // if double mv[] = { 11, 12, 13, 21, 22, 23 }, then
 // mArrayInit (mv, 2, 3) yields
 // 11  12  13
@@ -232,16 +367,23 @@ KMatrix KMatrix::arrayInit(const double mv[], const unsigned int & nr, const uns
 void KMatrix::mPrintf(string fs, string msg) const {
     const char * fc = fs.c_str();
     string rowVals = msg;
-    auto pf = [fc, this, &rowVals, msg](unsigned int i, unsigned int j) {
-        rowVals += KBase::getFormattedString(fc, (*this)(i, j));
-        if (j == (this->numC() - 1)) {
-            LOG(INFO) << rowVals;
-            // Reset the string object before processing next row in the matrix
-            rowVals.clear();
+    char buff[64];
+    for (unsigned int i = 0; (0 < clms) && (i < rows); i++) {
+        for (unsigned int j = 0; j < clms; j++) {
+            // format into a stack buffer, falling back to the heap only for very wide fields
+            const double v = (*this)(i, j);
+            const int n = snprintf(buff, sizeof(buff), fc, v);
+            if ((0 <= n) && (n < int(sizeof(buff)))) {
+                rowVals.append(buff, n);
+            }
+            else {
+                rowVals += KBase::getFormattedString(fc, v);
+            }
         }
-        return;
-    };
-    mapV(pf, rows, clms);
+        LOG(INFO) << rowVals;
+        // Reset the string object before processing next row in the matrix
+        rowVals.clear();
+    }
     return;
 }
 
@@ -251,11 +393,7 @@ void KMatrix::vFillVec(unsigned int nr, unsigned int nc, double iv) {
     clms = nc;
 
     const unsigned int n = nr*nc;
-    vals = {}; // 0-length vector
-    vals.resize(n);
-    for (unsigned int i = 0; i < n; i++) {
-        vals[i] = iv;
-    }
+    vals.assign(n, iv);
     return;
 }
 
@@ -308,18 +446,16 @@ void KMatrix::rcFromN(const unsigned int n, unsigned int & r, unsigned int &c) c
 
 
 KMatrix operator+ (const KMatrix & m1, double x) {
-    auto af = [x, &m1](unsigned int i, unsigned int j) {
-        return m1(i, j) + x;
-    };
-    return KMatrix::map(af, m1.numR(), m1.numC());
+    KMatrix m3 = m1;
+    m3 += x;
+    return m3;
 }
 
 
 KMatrix operator- (const KMatrix & m1, double x) {
-    auto sf = [x, &m1](unsigned int i, unsigned int j) {
-        return m1(i, j) - x;
-    };
-    return KMatrix::map(sf, m1.numR(), m1.numC());
+    KMatrix m3 = m1;
+    m3 -= x;
+    return m3;
 }
 
 
@@ -334,10 +470,9 @@ KMatrix operator+ (const KMatrix & m1, const KMatrix & m2) {
     if (!sameShape(m1, m2)) {
       throw KException("operator+: m1 and m2 matrices are not of same shape");
     }
-    auto af = [m1, m2](unsigned int i, unsigned int j) {
-        return m1(i, j) + m2(i, j);
-    };
-    return KMatrix::map(af, m1.numR(), m1.numC());
+    KMatrix m3 = m1;
+    m3 += m2;
+    return m3;
 }
 
 
@@ -345,52 +480,38 @@ KMatrix operator- (const KMatrix & m1, const KMatrix & m2) {
   if (!sameShape(m1, m2)) {
     throw KException("operator-: m1 and m2 matrices are not of same shape");
   }
-  auto sf = [&m1, &m2](unsigned int i, unsigned int j) {
-        return m1(i, j) - m2(i, j);
-    };
-    return KMatrix::map(sf, m1.numR(), m1.numC());
+  KMatrix m3 = m1;
+  m3 -= m2;
+  return m3;
 }
 
 
 KMatrix operator* (double x, const KMatrix & m1) {
-    auto mf = [x, &m1](unsigned int i, unsigned int j) {
-        return x*m1(i, j);
-    };
-    return KMatrix::map(mf, m1.numR(), m1.numC());
+    KMatrix m3 = m1;
+    m3.scale(x);
+    return m3;
 }
 
 
 KMatrix operator* (const KMatrix & m1, double x) {
-    auto mf = [x, &m1](unsigned int i, unsigned int j) {
-        return x*m1(i, j);
-    };
-    return KMatrix::map(mf, m1.numR(), m1.numC());
+    KMatrix m3 = m1;
+    m3.scale(x);
+    return m3;
 }
 
 
 KMatrix operator/ (const KMatrix & m1, double x) {
-    auto df = [x, &m1](unsigned int i, unsigned int j) {
-        return m1(i, j) / x;
-    };
-    return KMatrix::map(df, m1.numR(), m1.numC());
+    KMatrix m3 = m1;
+    m3 /= x;
+    return m3;
 }
 
 
 KMatrix operator* (const KMatrix & m1, const KMatrix & m2) {
-    const unsigned int nr3 = m1.numR();
-    const unsigned int nm3 = m1.numC();
-    if (nm3 != m2.numR()) {
+    if (m1.numC() != m2.numR()) {
       throw KException("operator*: m1 and m2 matrices don't qualify for matrix multiplication");
     }
-    const unsigned int nc3 = m2.numC();
-    auto f = [nm3, &m1, &m2](unsigned int i, unsigned int j) {
-        double sij = 0.0;
-        for (unsigned int k = 0; k < nm3; k++) {
-            sij = sij + m1(i, k)*m2(k, j);
-        }
-        return sij;
-    };
-    return KMatrix::map(f, nr3, nc3);
+    return matMult(m1, m2, bestGemmKernel());
 }
 
 
@@ -553,7 +674,7 @@ KMatrix clip(const KMatrix & m, double xMin, double xMax) {
     }
     const unsigned int nr = m.numR();
     const unsigned int nc = m.numC();
-    auto cfn = [m, xMin, xMax] (unsigned int i, unsigned int j) {
+    auto cfn = [&m, xMin, xMax] (unsigned int i, unsigned int j) {
         double mij = m(i,j);
         mij = (mij < xMin) ? xMin : mij;
         mij = (xMax < mij) ? xMax : mij;
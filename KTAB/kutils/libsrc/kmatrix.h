@@ -30,6 +30,7 @@
 #ifndef KMATRIX_H
 #define KMATRIX_H
 
+#include <cmath>
 #include <cstdint>
 #include <functional>
 #include <tuple>
@@ -44,6 +45,7 @@ using std::tuple;
 
 class KMatrix;
 class PRNG;
+template <class E> class KMatExpr;
 
 KMatrix subMatrix(const KMatrix & m1,
                   unsigned int i1, unsigned int i2,  // requires i1 <= i2
@@ -55,7 +57,6 @@ KMatrix hSlice(const KMatrix & m1, unsigned int i);
 // return clm-vector from clm number i
 KMatrix vSlice(const KMatrix & m1, unsigned int j);
 
-KMatrix trans(const KMatrix & m);
 double  norm(const KMatrix & m);
 double  rms(const KMatrix & m);
 KMatrix unitize(const KMatrix & m);
@@ -67,12 +68,17 @@ tuple<unsigned int, unsigned int>  ndxMaxAbs(const KMatrix & m);
 double  dot(const KMatrix & m1, const KMatrix & m2);
 double  lCorr(const KMatrix & m1, const KMatrix & m2);
 KMatrix inv(const KMatrix & m);
-KMatrix clip(const KMatrix & m, double xMin, double xMax);
 KMatrix iMat(unsigned int n);
 bool    iMatP(const KMatrix & m);
 KMatrix makePerp(const KMatrix & x, const KMatrix & p);
 KMatrix joinH(const KMatrix & mL, const KMatrix & mR);
 KMatrix joinV(const KMatrix & mT, const KMatrix & mB);
+
+// Element-wise operations. When KTAB_KMATRIX_EXPR is defined for the
+// whole build, these are replaced by the lazy versions in kmatexpr.h
+#ifndef KTAB_KMATRIX_EXPR
+KMatrix trans(const KMatrix & m);
+KMatrix clip(const KMatrix & m, double xMin, double xMax);
 KMatrix operator+ (const KMatrix & m1, const KMatrix & m2);
 KMatrix operator+ (const KMatrix & m1, double x);
 KMatrix operator- (const KMatrix & m1, const KMatrix & m2);
@@ -80,9 +86,24 @@ KMatrix operator- (const KMatrix & m1, double x);
 KMatrix operator* (double x, const KMatrix & m1);
 KMatrix operator* (const KMatrix & m1, double x);
 KMatrix operator/ (const KMatrix & m1, double x);
+#endif // KTAB_KMATRIX_EXPR
+
 bool    sameShape(const KMatrix & m1, const KMatrix & m2);
+void    swap(KMatrix & m1, KMatrix & m2) noexcept;
 KMatrix operator* (const KMatrix & m1, const KMatrix & m2);
 
+// Matrix multiplication (see kmatmult.cpp). operator* uses the fastest kernel
+// the CPU supports, picked once at runtime; matMult lets you choose one.
+// Naive and Scalar give exactly the same bits as the textbook triple loop.
+// AVX2 and AVX512 use fused multiply-add, so each element can differ from
+// the triple loop by rounding: |c_ij - cRef_ij| <= nm * 2^-52 * sum_k |a_ik*b_kj|,
+// where nm is the inner dimension. In practice it is a few ulps of that sum.
+enum class GemmKernel : uint8_t { Naive = 0, Scalar, AVX2, AVX512 };
+KMatrix matMult(const KMatrix & m1, const KMatrix & m2, GemmKernel gk);
+bool    gemmKernelAvailable(GemmKernel gk);
+GemmKernel bestGemmKernel();
+string  gemmKernelName(GemmKernel gk);
+
 KMatrix rescaleRows(const KMatrix& m1, const double vMin, const double vMax);
 
 
@@ -94,14 +115,50 @@ KMatrix firstEigenvector( const KMatrix& A, double tol);
 
 class KMatrix {
     friend KMatrix  inv(const KMatrix & m);
+    friend KMatrix  matMult(const KMatrix & m1, const KMatrix & m2, GemmKernel gk);
+    friend class KMatRef;
+    friend class KMatVal;
 public:
 
     KMatrix();
     KMatrix(unsigned int nr, unsigned int nc, double iv = 0.0);
 
-    // default copy constructor, copy assigment, etc. are sufficient
+    // take over an existing row-major vector of nr*nc values, without copying,
+    // e.g. vector<KMatrix>::emplace_back(nr, nc, std::move(v))
+    KMatrix(unsigned int nr, unsigned int nc, vector<double> && v);
+
+    // Spell out the rule of five: the virtual destructor would
+    // otherwise suppress the implicit moves, so every return-by-value and
+    // push_back deep-copied the values. A moved-from matrix is 0x0.
+    KMatrix(const KMatrix & m) = default;
+    KMatrix(KMatrix && m) noexcept;
+    KMatrix & operator= (const KMatrix & m) = default;
+    KMatrix & operator= (KMatrix && m) noexcept;
+
+    // evaluate a lazy expression (see kmatexpr.h) in one pass
+    template <class E> KMatrix(const KMatExpr<E> & e);
+    template <class E> KMatrix & operator= (const KMatExpr<E> & e);
+
     double operator() (unsigned int i, unsigned int j) const;  // readable rvalue
     double& operator() (unsigned int i, unsigned int j);       // assignable lvalue
+
+    // In-place arithmetic, which reuses the existing storage.
+    // Each gives exactly the same values as the corresponding
+    // "m = m + m2", "m = x*m", "m = m + a*x", etc.
+    KMatrix & operator+= (const KMatrix & m2);
+    KMatrix & operator-= (const KMatrix & m2);
+    KMatrix & operator+= (double x);
+    KMatrix & operator-= (double x);
+    KMatrix & operator*= (double x);
+    KMatrix & operator/= (double x);
+    void scale(double x);                       // this = x * this
+    void axpy(double a, const KMatrix & x);     // this = this + a*x
+    void fill(double v);                        // set every element to v
+
+    // Reshape to nr-by-nc, with every element set to iv. The old values are
+    // not preserved, but no memory is allocated if the capacity suffices.
+    void resize(unsigned int nr, unsigned int nc, double iv = 0.0);
+    void swap(KMatrix & m) noexcept;
     void mPrintf(string, string msg=string()) const;
     unsigned int numR() const;
     unsigned int numC() const;
@@ -175,6 +232,8 @@ private:
 
 };
 
+#include "kmatexpr.h"
+
 // -------------------------------------------------
 #endif
 // --------------------------------------------
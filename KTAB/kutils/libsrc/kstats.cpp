@@ -0,0 +1,160 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+
+#include "kutils.h"
+#include "kstats.h"
+
+namespace KBase {
+
+void RunningStats::add(double x) {
+  n++;
+  if (1 == n) {
+    lo = x;
+    hi = x;
+  }
+  lo = std::min(lo, x);
+  hi = std::max(hi, x);
+  const double d = x - m;
+  m = m + d / n;
+  s2 = s2 + d * (x - m);
+  return;
+}
+
+double RunningStats::variance() const {
+  return (n < 2) ? 0.0 : s2 / (n - 1);
+}
+
+double RunningStats::stdv() const {
+  return std::sqrt(variance());
+}
+
+
+P2Quantile::P2Quantile(double pp) : p(pp) {
+  if ((p < 0.0) || (1.0 < p)) {
+    throw KException("P2Quantile: p must be in [0, 1]");
+  }
+  want[0] = 0.0;
+  want[1] = 2 * p;
+  want[2] = 4 * p;
+  want[3] = 2 + 2 * p;
+  want[4] = 4.0;
+}
+
+void P2Quantile::add(double x) {
+  // the first five are kept, in order
+  if (n < 5) {
+    unsigned int k = n;
+    while ((0 < k) && (x < q[k - 1])) {
+      q[k] = q[k - 1];
+      k--;
+    }
+    q[k] = x;
+    n++;
+    return;
+  }
+
+  // the cell into which x falls, stretching the ends if need be
+  unsigned int k = 0;
+  if (x < q[0]) {
+    q[0] = x;
+  }
+  else if (q[4] <= x) {
+    q[4] = x;
+    k = 3;
+  }
+  else {
+    while (q[k + 1] <= x) {
+      k++;
+    }
+  }
+  for (unsigned int i = k + 1; i < 5; i++) {
+    pos[i] = pos[i] + 1;
+  }
+  want[1] = want[1] + p / 2;
+  want[2] = want[2] + p;
+  want[3] = want[3] + (1 + p) / 2;
+  want[4] = want[4] + 1;
+  n++;
+
+  // move each inner marker at most one place toward where it ought to be
+  for (unsigned int i = 1; i < 4; i++) {
+    const double d = want[i] - pos[i];
+    if (((1 <= d) && (1 < pos[i + 1] - pos[i])) || ((d <= -1) && (1 < pos[i] - pos[i - 1]))) {
+      const double s = (0 < d) ? 1.0 : -1.0;
+      const double qp = q[i] + s / (pos[i + 1] - pos[i - 1])
+        * ((pos[i] - pos[i - 1] + s) * (q[i + 1] - q[i]) / (pos[i + 1] - pos[i])
+           + (pos[i + 1] - pos[i] - s) * (q[i] - q[i - 1]) / (pos[i] - pos[i - 1]));
+      if ((q[i - 1] < qp) && (qp < q[i + 1])) {
+        q[i] = qp; // parabolic
+      }
+      else {
+        const unsigned int j = (0 < s) ? i + 1 : i - 1;
+        q[i] = q[i] + s * (q[j] - q[i]) / (pos[j] - pos[i]); // linear
+      }
+      pos[i] = pos[i] + s;
+    }
+  }
+  return;
+}
+
+double P2Quantile::value() const {
+  if (0 == n) {
+    return 0.0;
+  }
+  if (n <= 5) {
+    const unsigned int k = (unsigned int)std::lround(p * (n - 1));
+    return q[k];
+  }
+  return q[2];
+}
+
+
+Histogram::Histogram(double l, double h, unsigned int nb) : lo(l), hi(h) {
+  if ((0 == nb) || !(lo < hi)) {
+    throw KException("Histogram: there must be at least one bin, over a non-empty range");
+  }
+  counts = vector<uint64_t>(nb, 0);
+}
+
+void Histogram::add(double x) {
+  const unsigned int nb = counts.size();
+  const double f = (x - lo) / (hi - lo);
+  unsigned int k = 0;
+  if (1.0 <= f) {
+    k = nb - 1;
+  }
+  else if (0.0 < f) {
+    k = std::min(nb - 1, (unsigned int)(f * nb));
+  }
+  counts[k]++;
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
@@ -0,0 +1,99 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// Statistics of a stream of numbers, each in memory which does not grow with
+// the length of the stream, for summarizing many runs of a model as they
+// finish rather than keeping them all. None of them is thread-safe.
+// -------------------------------------------------
+#ifndef KTAB_STATS_H
+#define KTAB_STATS_H
+
+#include <cstdint>
+#include <vector>
+
+namespace KBase {
+using std::vector;
+
+// Count, mean, variance and range, by Welford's method, which does not lose
+// precision to cancellation as the sum of squares would.
+class RunningStats {
+public:
+  void add(double x);
+
+  uint64_t count() const { return n; }
+  double mean() const { return m; }
+  double variance() const; // of the sample, so 0 until there are two
+  double stdv() const;
+  double min() const { return lo; }
+  double max() const { return hi; }
+
+protected:
+  uint64_t n = 0;
+  double m = 0.0;
+  double s2 = 0.0; // sum of squared deviations from the mean
+  double lo = 0.0;
+  double hi = 0.0;
+};
+
+// An estimate of the p-quantile, by the P-squared algorithm of Jain and Chlamtac
+// ("The P2 algorithm for dynamic calculation of quantiles and histograms without
+// storing observations", CACM 28(10), 1985): five markers, moved as the
+// observations arrive so that the middle one tracks the quantile. It is exact
+// for up to five observations.
+class P2Quantile {
+public:
+  explicit P2Quantile(double p = 0.5);
+  void add(double x);
+
+  uint64_t count() const { return n; }
+  double value() const; // 0 if there are no observations
+
+protected:
+  double p = 0.5;
+  uint64_t n = 0;
+  double q[5] = { 0, 0, 0, 0, 0 }; // heights of the markers
+  double pos[5] = { 0, 1, 2, 3, 4 }; // their positions, from 0
+  double want[5] = { 0, 0, 0, 0, 0 }; // where they ought to be
+};
+
+// Counts in equal bins over [lo, hi]; values outside go in the end bins.
+class Histogram {
+public:
+  Histogram(double lo = 0.0, double hi = 1.0, unsigned int nBins = 10);
+  void add(double x);
+
+  unsigned int numBins() const { return counts.size(); }
+  const vector<uint64_t> & binCounts() const { return counts; }
+
+protected:
+  double lo = 0.0;
+  double hi = 1.0;
+  vector<uint64_t> counts = {};
+};
+
+} // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
@@ -24,11 +24,14 @@
 // --------------------------------------------
 
 //#include <assert.h>
+#include <cctype>
+#include <cmath>
 #include <tuple>
 #include <easylogging++.h>
 
 #include "kutils.h"
 #include "prng.h"
+#include "threadpool.h"
 
 namespace KBase {
 
@@ -153,56 +156,7 @@ void printVUI(const VUI& p) {
 
 void groupThreads(function<void(unsigned int)> tfn,
                   unsigned int numLow, unsigned int numHigh, unsigned int numPar) {
-  const auto rl = ReportingLevel::Silent;
-  using std::thread;
-  const unsigned int threadsPerHWC = 4;
-  unsigned int numHWC = 0;
-  const unsigned int dfltNumThreads = 10;
-  if (0 == numPar) { // no specific number requested, so guess
-
-    // As of OCt. 2016, this function might or might not have one or two
-    // of the following problems, depending on your implementation.
-    // 1: It might not be implemented, and just return 0.
-    // 2: It might not take into account "hyperthreading", and return
-    //    half the expected number.
-    numHWC = std::thread::hardware_concurrency();
-    if (0 == numHWC) {
-      numPar = dfltNumThreads; // arbitrary default
-    }
-    else {
-      // four times the number of threads is not too inefficient,
-      // and 2 times the number of hyperthreads is not too wasteful.
-      numPar = threadsPerHWC * numHWC;
-    }
-  }
-  if (ReportingLevel::Silent < rl) {
-    if (0 == numHWC) {
-      LOG(INFO) << "Could not detect hardware concurrency";
-    }
-    else {
-      LOG(INFO) << "Detected hardware concurrency:" << numHWC;
-    }
-    LOG(INFO) << "Using groups of" << numPar;
-  }
-
-  unsigned int cntr = numLow;
-  while (cntr <= numHigh) {
-    vector<thread> myThreads = {};
-    for (unsigned int i = 0; ((i < numPar) && (cntr <= numHigh)); i++) {
-      if (ReportingLevel::Medium < rl) {
-        LOG(INFO) << KBase::getFormattedString(
-          "Launching thread %3u / %3u / [%3u,%3u]", i, cntr, numLow, numHigh);
-      }
-      myThreads.push_back(thread(tfn, cntr));
-      cntr++;
-    }
-    if (ReportingLevel::Low < rl) {
-      LOG(INFO) << "Joining ...";
-    }
-    for (auto& ti : myThreads) {
-      ti.join();
-    }
-  }
+  ThreadPool::global().parallelFor(numLow, numHigh, tfn, numPar);
   return;
 }
 
@@ -244,8 +198,140 @@ double rescale(double x, double x0, double x1, double y0, double y1) {
   return y0 + (y1 - y0)*f;
 }
 
+size_t VUIHash::operator()(const VUI & v) const {
+  // FNV-1a, a word at a time
+  uint64_t h = 14695981039346656037ULL;
+  for (auto e : v) {
+    h = (h ^ e) * 1099511628211ULL;
+  }
+  return ((size_t)h);
+}
+
+tuple<VUI, VUI> ueIndicesGrid(const vector<double> & x, unsigned int dim, double tol,
+                              function<bool(unsigned int i, unsigned int j)> eqv) {
+  if ((0 == dim) || (0 != (x.size() % dim))) {
+    throw KException("ueIndicesGrid: the number of coordinates must be a multiple of dim");
+  }
+  const unsigned int n = x.size() / dim;
+  if (0 == n) {
+    return tuple<VUI, VUI>(VUI(), VUI());
+  }
+
+  // Only the first few coordinates are gridded, as 3^g cells are searched
+  // around each point. The cells are slightly wider than tol, so that points
+  // which eqv could match are never two cells apart because of rounding,
+  // as long as the cell numbers stay well inside the precision of a double.
+  const unsigned int g = (dim < 3) ? dim : 3;
+  const double width = tol * (1.0 + 1E-6);
+  const double maxCell = 1E9;
+  bool gridOK = (0.0 < tol);
+  for (unsigned int i = 0; gridOK && (i < n); i++) {
+    for (unsigned int k = 0; k < g; k++) {
+      const double c = x[i * dim + k] / width;
+      gridOK = gridOK && std::isfinite(c) && (std::fabs(c) < maxCell);
+    }
+  }
+  if (!gridOK) {
+    auto efn = [&eqv](const unsigned int & i, const unsigned int & j) {
+      return eqv(i, j);
+    };
+    return ueIndices<unsigned int>(uiSeq(0, n - 1), efn);
+  }
+
+  // Cells are found by a hash of their numbers. Two cells which happen to
+  // share a hash only add candidates, each of which is still checked by eqv.
+  auto cellKey = [g](const int64_t * c) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned int k = 0; k < g; k++) {
+      h = (h ^ ((uint64_t)c[k])) * 1099511628211ULL;
+    }
+    return h;
+  };
+  unsigned int numNbr = 1;
+  for (unsigned int k = 0; k < g; k++) {
+    numNbr = 3 * numNbr;
+  }
+
+  VUI uns = {};
+  VUI ens = {};
+  auto cells = std::unordered_map<uint64_t, VUI>(); // cell -> indices into uns, in order
+  int64_t c[3] = { 0, 0, 0 };
+  int64_t nc[3] = { 0, 0, 0 };
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int k = 0; k < g; k++) {
+      c[k] = ((int64_t)std::floor(x[i * dim + k] / width));
+    }
+    unsigned int best = uns.size(); // no match yet
+    for (unsigned int m = 0; m < numNbr; m++) {
+      unsigned int r = m;
+      for (unsigned int k = 0; k < g; k++) {
+        nc[k] = c[k] + ((int64_t)(r % 3)) - 1;
+        r = r / 3;
+      }
+      auto it = cells.find(cellKey(nc));
+      if (it == cells.end()) {
+        continue;
+      }
+      for (auto j : it->second) {
+        if (best <= j) {
+          break;
+        }
+        if (eqv(i, uns[j])) {
+          best = j;
+          break;
+        }
+      }
+    }
+    if (uns.size() == best) {
+      cells[cellKey(c)].push_back(best);
+      uns.push_back(i);
+    }
+    ens.push_back(best);
+  }
+  return tuple<VUI, VUI>(uns, ens);
+}
+
 // -------------------------------------------------
 
+string lowerCase(string s) {
+  std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+  return s;
+}
+
+string trimmed(const string & s) {
+  const size_t b = s.find_first_not_of(" \t\r\n");
+  if (string::npos == b) {
+    return "";
+  }
+  const size_t e = s.find_last_not_of(" \t\r\n");
+  return s.substr(b, e - b + 1);
+}
+
+vector<string> split(const string & s, char sep) {
+  vector<string> parts = {};
+  size_t pos = 0;
+  while (true) {
+    const size_t n = s.find(sep, pos);
+    parts.push_back(trimmed(s.substr(pos, (string::npos == n) ? string::npos : n - pos)));
+    if (string::npos == n) {
+      return parts;
+    }
+    pos = n + 1;
+  }
+}
+
+unsigned int number(const string & s, const string & who, const string & clause, unsigned int maxN) {
+  if (s.empty() || (string::npos != s.find_first_not_of("0123456789"))) {
+    throw KException(who + ": expected a number, not '" + s + "', in " + clause);
+  }
+  const size_t nz = s.find_first_not_of('0');
+  const bool big = (string::npos != nz) && (s.size() - nz > 10);
+  if (big || (std::stoull(s) > maxN)) {
+    throw KException(who + ": " + s + " is too large, in " + clause);
+  }
+  return (unsigned int)std::stoul(s);
+}
+
 KException::KException(string m) {
   msg = m;
 }
@@ -47,6 +47,7 @@
 #include <string>
 #include <thread>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace KBase {
@@ -81,9 +82,10 @@ double nProd(double x, double y);
 
 double trim(double x, double minX, double maxX, bool strict = false);
 
-// This launches a number of threads, but no more than numPar at a time.
+// This runs the function on the shared ThreadPool, but no more than numPar at a time.
 // The function is given unsigned ints in a range, like [0, n-1] inclusive.
-// If no value is given for numPar, it will guess from the number of cores.
+// If no value is given for numPar, it uses every worker in the pool.
+// An exception thrown by any call is rethrown here, once all have finished.
 void groupThreads(function<void(unsigned int)> tfn,
                   unsigned int numLow, unsigned int numHigh, unsigned int numPar=0);
 
@@ -158,6 +160,45 @@ ueIndices(const vector<T> &xs, function<bool(const T &a, const T &b)> eqv) {
   return tuple<VUI, VUI>(uns, ens);
 }
 
+// The same result as ueIndices, when two items are equivalent exactly when
+// their keys are equal. Each key is looked up in a hash table of the unique
+// keys seen so far, rather than compared with every unique item in turn.
+template <typename K, typename H = std::hash<K>>
+tuple<VUI, VUI> ueIndicesByKey(const vector<K> & keys) {
+  VUI uns = {};
+  VUI ens = {};
+  auto firstOf = std::unordered_map<K, unsigned int, H>(); // key -> index into uns
+  auto n = ((const unsigned int)(keys.size()));
+  for (unsigned int i = 0; i < n; i++) {
+    auto it = firstOf.find(keys[i]);
+    if (it != firstOf.end()) {
+      ens.push_back(it->second);
+    }
+    else {
+      const unsigned int en = uns.size();
+      firstOf.emplace(keys[i], en);
+      uns.push_back(i);
+      ens.push_back(en);
+    }
+  }
+  return tuple<VUI, VUI>(uns, ens);
+}
+
+// so that a VUI can be the key for ueIndicesByKey
+struct VUIHash {
+  size_t operator()(const VUI & v) const;
+};
+
+// The same result as ueIndices(uiSeq(0, n-1), eqv), for n points stored
+// one after another in x, each of dim coordinates, when eqv(i, j) can hold
+// only if no coordinate of points i and j differs by tol or more (as is so
+// when eqv is norm(xi - xj) < tol). The unique points are kept in a grid of
+// cells about tol wide, so each point is compared only with those in the
+// cells around it; of those which match, the earliest unique one is taken,
+// just as ueIndices would.
+tuple<VUI, VUI> ueIndicesGrid(const vector<double> & x, unsigned int dim, double tol,
+                              function<bool(unsigned int i, unsigned int j)> eqv);
+
 // the unsigned ints in order from n1 to n2, inclusive.
 VUI uiSeq(const unsigned int n1, const unsigned int n2, const unsigned int ns = 1);
 
@@ -168,6 +209,16 @@ public:
   string msg = "";
 };
 
+// Helpers for reading option clauses and SQL text.
+string lowerCase(string s);
+string trimmed(const string & s); // without leading or trailing blanks, tabs and line ends
+vector<string> split(const string & s, char sep); // each part trimmed
+
+// The decimal number s, which must be at most maxN. If it is not, this throws a
+// KException which names who (e.g. "SMPSweep::apply") and the clause it was in.
+unsigned int number(const string & s, const string & who, const string & clause,
+                    unsigned int maxN = 999999999);
+
 template <typename... Args>
 string getFormattedString(const char* formatSpec, const Args&... args) {
   // Find the size of the buffer required to hold the formatted string
@@ -24,8 +24,14 @@
 
 //#include <assert.h>
 
+#include <sstream>
+
 #include "prng.h"
 
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
 
 namespace KBase {
 
@@ -126,6 +132,37 @@ W64 rotr(const W64 x, unsigned int n) {
 }
 
 
+namespace {
+// select an index of the column-vector of probabilities, given p uniform on [0,1]
+unsigned int probSelP(const KMatrix & cv, double p) {
+  const unsigned int nr = cv.numR();
+  if (0 >= nr) {
+    throw KException("PRNG::probSel: cv matrix has got no records");
+  }
+  if (1 != cv.numC()) {
+    throw KException("PRNG::probSel: cv matrix doesn't have only one column");
+  }
+  const double pTol = 1E-8;
+  if (fabs(KBase::sum(cv) - 1.0) >= pTol) {
+    throw KException("PRNG::probSel: sum total of probabilities can not exceed 1.0");
+  }
+
+  int iMax = -1;
+  double sum = 0.0;
+  for (unsigned int i = 0; (i < nr) && (iMax < 0); i++) {
+    sum = sum + cv(i, 0);
+    if (p <= sum) {
+      iMax = i;
+    }
+  }
+  if (iMax < 0) { // round-off error
+    iMax = nr - 1;
+  }
+  // obviously, now 0 <= iMax <= nr-1
+  return ((unsigned int)iMax);
+}
+}
+
 PRNG::PRNG(uint64_t sd) {
   setSeed(sd);
 }
@@ -142,9 +179,33 @@ uint64_t PRNG::setSeed(uint64_t s) {
     s = dist(mt1);
   }
   mt.seed(s);
+  seed = s;
   return s;
 }
 
+StreamPRNG PRNG::stream(unsigned int i, unsigned int j) const {
+  return StreamPRNG(seed, (((uint64_t)i) << 32) | j);
+}
+
+string PRNG::getState() const {
+  std::ostringstream os;
+  os << seed << ' ' << mt;
+  return os.str();
+}
+
+void PRNG::setState(const string & st) {
+  std::istringstream is(st);
+  uint64_t s = 0;
+  mt19937_64 m;
+  is >> s >> m;
+  if (is.fail()) {
+    throw KException("PRNG::setState: not the state of a PRNG");
+  }
+  seed = s;
+  mt = m;
+  return;
+}
+
 
 double PRNG::uniform(double a, double b) {
   uint64_t n = uniform();
@@ -160,33 +221,8 @@ double PRNG::uniform(double a, double b) {
 }
 
 unsigned int PRNG::probSel(const KMatrix & cv) {
-  const unsigned int nr = cv.numR();
-  if (0 >= nr) {
-    throw KException("PRNG::probSel: cv matrix has got no records");
-  }
-  if (1 != cv.numC()) {
-    throw KException("PRNG::probSel: cv matrix doesn't have only one column");
-  }
-  const double pTol = 1E-8;
-  if (fabs(KBase::sum(cv) - 1.0) >= pTol) {
-    throw KException("PRNG::probSel: sum total of probabilities can not exceed 1.0");
-  }
-
-  int iMax = -1;
-  const double p = uniform(0.0, 1.0);
-  double sum = 0.0;
-  for (unsigned int i = 0; (i < nr) && (iMax < 0); i++) {
-    sum = sum + cv(i, 0);
-    if (p <= sum) {
-      iMax = i;
-    }
-  }
-  if (iMax < 0) { // round-off error
-    iMax = nr - 1;
-  }
-  // obviously, now 0 <= iMax <= nr-1
-  return ((unsigned int)iMax);
-};
+  return probSelP(cv, uniform(0.0, 1.0));
+}
 
 
 uint64_t PRNG::uniform() {
@@ -215,6 +251,69 @@ VBool PRNG::bits(unsigned int nb) {
   return bv;
 }
 
+
+// --------------------------------------------
+
+StreamPRNG::StreamPRNG(uint64_t k, uint64_t stream) {
+  key = k;
+  strm = stream;
+}
+
+namespace {
+// the high and low 64 bits of the 128-bit product a*b
+inline uint64_t mulHiLo(uint64_t a, uint64_t b, uint64_t & lo) {
+#if defined(__SIZEOF_INT128__)
+  const unsigned __int128 p = ((unsigned __int128)a) * b;
+  lo = (uint64_t)p;
+  return (uint64_t)(p >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  uint64_t hi = 0;
+  lo = _umul128(a, b, &hi);
+  return hi;
+#else
+  const uint64_t aL = a & MASK32, aH = a >> 32;
+  const uint64_t bL = b & MASK32, bH = b >> 32;
+  const uint64_t ll = aL * bL, lh = aL * bH, hl = aH * bL, hh = aH * bH;
+  const uint64_t mid = (ll >> 32) + (lh & MASK32) + (hl & MASK32);
+  lo = (mid << 32) | (ll & MASK32);
+  return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+}
+
+void StreamPRNG::philox(uint64_t ctr[2], uint64_t key) {
+  const uint64_t mulA = 0xD2B74407B1CE6E93;
+  const uint64_t weylA = 0x9E3779B97F4A7C15; // golden ratio
+  for (unsigned int r = 0; r < 10; r++) {
+    uint64_t lo = 0;
+    const uint64_t hi = mulHiLo(mulA, ctr[0], lo);
+    ctr[0] = hi ^ key ^ ctr[1];
+    ctr[1] = lo;
+    key = key + weylA;
+  }
+  return;
+}
+
+uint64_t StreamPRNG::uniform() {
+  if (2 == blkUsed) { // the counter is (block number, stream number)
+    blk[0] = blkNum;
+    blk[1] = strm;
+    philox(blk, key);
+    blkNum++;
+    blkUsed = 0;
+  }
+  return blk[blkUsed++];
+}
+
+double StreamPRNG::uniform(double a, double b) {
+  const double x = ((double)uniform()) / ((double)0xFFFFFFFFFFFFFFFF);
+  return a + ((b - a)*x);
+}
+
+unsigned int StreamPRNG::probSel(const KMatrix & cv) {
+  return probSelP(cv, uniform(0.0, 1.0));
+}
+
 } // end of namespace
 
 // --------------------------------------------
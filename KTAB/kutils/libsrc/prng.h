@@ -64,6 +64,28 @@ W64 qTrans(W64 s);
 W64 rotl(const W64 x, unsigned int n);
 W64 rotr(const W64 x, unsigned int n);
 
+// A counter-based generator, Philox2x64-10 (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3", SC11). The n-th output of a stream is a pure function of the
+// key, the stream number and n, so streams are independent and need no shared state:
+// each gives the same sequence whichever thread draws from it, and whenever.
+class StreamPRNG {
+public:
+  StreamPRNG(uint64_t key, uint64_t stream);
+  uint64_t uniform();
+  double uniform(double a, double b);
+  unsigned int probSel(const KMatrix & cv);
+
+  // replace the 128-bit counter by its pseudo-random image under the key
+  static void philox(uint64_t ctr[2], uint64_t key);
+
+protected:
+  uint64_t key = 0;
+  uint64_t strm = 0;
+  uint64_t blkNum = 0; // number of the next block of this stream
+  uint64_t blk[2] = { 0, 0 };
+  unsigned int blkUsed = 2; // how many words of blk have been used
+};
+
 class PRNG {
 public:
   explicit PRNG(uint64_t sd = KBase::dSeed);
@@ -73,8 +95,21 @@ public:
   unsigned int probSel(const KMatrix & cv);
   VBool bits(unsigned int nb);
   uint64_t setSeed(uint64_t sd);
+
+  // The seed and the generator's whole state, as text, so that a resumed run
+  // draws exactly what the interrupted one would have. setState throws
+  // KException if given anything else.
+  string getState() const;
+  void setState(const string & st);
+
+  // An independent stream keyed by (seed, i, j), e.g. (seed, turn, actor).
+  // Unlike the PRNG itself, threads may each draw from their own stream at once,
+  // and the results do not depend on how the work was divided among them.
+  StreamPRNG stream(unsigned int i, unsigned int j) const;
+
 protected:
   mt19937_64 mt = mt19937_64();
+  uint64_t seed = 0;
 };
 
 };
@@ -0,0 +1,279 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "threadpool.h"
+
+
+namespace KBase {
+
+namespace {
+// which pool, and which of its workers, the current thread is (if any)
+thread_local ThreadPool * tlPool = nullptr;
+thread_local unsigned int tlWorker = 0;
+}
+
+std::mutex ThreadPool::globalLock;
+std::unique_ptr<ThreadPool> ThreadPool::globalPool = nullptr;
+unsigned int ThreadPool::globalThreads = 0;
+
+// --------------------------------------------
+
+ThreadPool::TaskGroup::TaskGroup(ThreadPool & p) : pool(p), pending(0) {
+}
+
+ThreadPool::TaskGroup::~TaskGroup() {
+  finishWait();
+}
+
+void ThreadPool::TaskGroup::run(function<void()> fn) {
+  pending++;
+  pool.push(Task{ fn, this });
+  return;
+}
+
+void ThreadPool::TaskGroup::wait() {
+  finishWait();
+  if (nullptr != firstErr) {
+    auto e = firstErr;
+    firstErr = nullptr;
+    std::rethrow_exception(e);
+  }
+  return;
+}
+
+void ThreadPool::TaskGroup::finishWait() {
+  while (0 < pending) {
+    if (pool.tryRunOne()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lk(pool.wakeLock);
+    pool.wakeCV.wait(lk, [this]() {
+      return (0 == pending) || (0 < pool.queued);
+    });
+  }
+  return;
+}
+
+// --------------------------------------------
+
+ThreadPool::ThreadPool(unsigned int n) : queued(0), stopping(false) {
+  if (0 == n) {
+    n = 1;
+  }
+  for (unsigned int w = 0; w <= n; w++) { // the extra one is shared
+    queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+  }
+  for (unsigned int w = 0; w < n; w++) {
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this, w));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  stopping = true;
+  notifyAll();
+  for (auto & t : workers) {
+    t.join();
+  }
+}
+
+unsigned int ThreadPool::numThreads() const {
+  return ((unsigned int)(workers.size()));
+}
+
+void ThreadPool::notifyAll() {
+  // taking the lock orders this after any waiter's check of its condition
+  wakeLock.lock();
+  wakeLock.unlock();
+  wakeCV.notify_all();
+  return;
+}
+
+void ThreadPool::push(Task t) {
+  const unsigned int q = (this == tlPool) ? tlWorker : ((unsigned int)(queues.size() - 1));
+  queued++;
+  queues[q]->qLock.lock();
+  queues[q]->tasks.push_back(std::move(t));
+  queues[q]->qLock.unlock();
+  notifyAll();
+  return;
+}
+
+bool ThreadPool::tryRunOne() {
+  const unsigned int nq = ((unsigned int)(queues.size()));
+  const bool isWorker = (this == tlPool);
+  const unsigned int own = isWorker ? tlWorker : (nq - 1);
+  Task t;
+  bool found = false;
+
+  // a worker takes its newest task, which is the most likely to be in cache
+  WorkQueue * wq = queues[own].get();
+  wq->qLock.lock();
+  if (!wq->tasks.empty()) {
+    if (isWorker) {
+      t = std::move(wq->tasks.back());
+      wq->tasks.pop_back();
+    }
+    else {
+      t = std::move(wq->tasks.front());
+      wq->tasks.pop_front();
+    }
+    found = true;
+  }
+  wq->qLock.unlock();
+
+  // otherwise, steal the oldest task from someone else
+  for (unsigned int k = 1; (!found) && (k < nq); k++) {
+    wq = queues[(own + k) % nq].get();
+    wq->qLock.lock();
+    if (!wq->tasks.empty()) {
+      t = std::move(wq->tasks.front());
+      wq->tasks.pop_front();
+      found = true;
+    }
+    wq->qLock.unlock();
+  }
+
+  if (!found) {
+    return false;
+  }
+  queued--;
+  runTask(t);
+  return true;
+}
+
+void ThreadPool::runTask(Task & t) {
+  TaskGroup * grp = t.grp;
+  try {
+    t.fn();
+  }
+  catch (...) {
+    grp->errLock.lock();
+    if (nullptr == grp->firstErr) {
+      grp->firstErr = std::current_exception();
+    }
+    grp->errLock.unlock();
+  }
+  t.fn = nullptr; // release anything captured before the group can finish
+  // once pending reaches zero, the group may be gone
+  if (1 == grp->pending.fetch_sub(1)) {
+    notifyAll();
+  }
+  return;
+}
+
+void ThreadPool::workerLoop(unsigned int w) {
+  tlPool = this;
+  tlWorker = w;
+  while (true) {
+    if (tryRunOne()) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lk(wakeLock);
+    wakeCV.wait(lk, [this]() {
+      return stopping || (0 < queued);
+    });
+    if (stopping && (0 == queued)) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::parallelFor(unsigned int numLow, unsigned int numHigh,
+                             function<void(unsigned int)> fn, unsigned int maxPar) {
+  if (numHigh < numLow) {
+    return;
+  }
+  const uint64_t count = ((uint64_t)numHigh) - numLow + 1;
+  uint64_t numRun = (0 == maxPar) ? (numThreads() + 1) : maxPar;
+  if (numRun > count) {
+    numRun = count;
+  }
+
+  // each runner takes the next index until they are all gone,
+  // so one slow index does not hold up a whole batch
+  std::atomic<uint64_t> next(numLow);
+  auto runner = [&next, numHigh, &fn]() {
+    for (uint64_t n = next++; n <= numHigh; n = next++) {
+      fn((unsigned int)n);
+    }
+  };
+
+  TaskGroup grp(*this);
+  for (uint64_t r = 1; r < numRun; r++) {
+    grp.run(runner);
+  }
+  try {
+    runner(); // the caller is one of the runners
+  }
+  catch (...) {
+    next = ((uint64_t)numHigh) + 1; // no new indices; the others are still using next and fn
+    grp.finishWait();
+    throw;
+  }
+  grp.wait();
+  return;
+}
+
+// --------------------------------------------
+
+unsigned int ThreadPool::defaultNumThreads() {
+  const unsigned int dfltNumThreads = 10;
+  const char * env = std::getenv("KTAB_NUM_THREADS");
+  if (nullptr != env) {
+    const long n = std::strtol(env, nullptr, 10);
+    if (0 < n) {
+      return ((unsigned int)n);
+    }
+  }
+  // This might not be implemented, and just return 0.
+  const unsigned int numHWC = std::thread::hardware_concurrency();
+  return (0 == numHWC) ? dfltNumThreads : numHWC;
+}
+
+ThreadPool & ThreadPool::global() {
+  globalLock.lock();
+  if (nullptr == globalPool) {
+    const unsigned int n = (0 == globalThreads) ? defaultNumThreads() : globalThreads;
+    globalPool = std::unique_ptr<ThreadPool>(new ThreadPool(n));
+  }
+  ThreadPool & p = *globalPool;
+  globalLock.unlock();
+  return p;
+}
+
+void ThreadPool::setGlobalThreads(unsigned int n) {
+  globalLock.lock();
+  globalThreads = n;
+  globalPool = nullptr; // joins the old workers; the next use starts the new ones
+  globalLock.unlock();
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
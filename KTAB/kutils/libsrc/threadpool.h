@@ -0,0 +1,129 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// -------------------------------------------------
+// A process-wide pool of worker threads, with work-stealing.
+//
+// Each worker keeps its own deque of tasks: it takes the newest from its
+// own end and, when that is empty, steals the oldest from the others.
+// Threads outside the pool submit to a shared queue. A thread waiting for
+// a TaskGroup runs queued tasks while it waits, so tasks may start and wait
+// for tasks of their own without tying up a worker (or deadlocking).
+// Do not hold a lock across TaskGroup::wait, as the waiting thread may run
+// an unrelated task which wants the same lock.
+// -------------------------------------------------
+#ifndef KTAB_THREADPOOL_H
+#define KTAB_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KBase {
+using std::function;
+using std::vector;
+
+class ThreadPool {
+public:
+  // A set of tasks which can be waited for together.
+  class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool & p = ThreadPool::global());
+    ~TaskGroup(); // waits, but cannot rethrow
+
+    void run(function<void()> fn);
+
+    // Return once every task run so far has finished, helping in the meantime.
+    // If any task threw, rethrow the first such exception.
+    void wait();
+
+  private:
+    friend class ThreadPool;
+    ThreadPool & pool;
+    std::atomic<unsigned int> pending;
+    std::exception_ptr firstErr = nullptr;
+    std::mutex errLock;
+    void finishWait();
+  };
+
+  explicit ThreadPool(unsigned int n);
+  virtual ~ThreadPool();
+
+  unsigned int numThreads() const;
+
+  // Call fn(i) for i in [numLow, numHigh], inclusive, returning when all are done.
+  // Indices are handed out dynamically to at most maxPar concurrent runners
+  // (default: one per worker, plus the caller).
+  void parallelFor(unsigned int numLow, unsigned int numHigh,
+                   function<void(unsigned int)> fn, unsigned int maxPar = 0);
+
+  // The shared pool, created on first use. Its size is set by setGlobalThreads, else
+  // by the environment variable KTAB_NUM_THREADS, else by the hardware concurrency.
+  static ThreadPool & global();
+
+  // Resize the shared pool; 0 restores the default. It must be idle.
+  static void setGlobalThreads(unsigned int n);
+
+  static unsigned int defaultNumThreads();
+
+private:
+  struct Task {
+    function<void()> fn;
+    TaskGroup * grp;
+  };
+  struct WorkQueue {
+    std::mutex qLock;
+    std::deque<Task> tasks;
+  };
+
+  // one queue per worker, then the shared one for other threads
+  vector<std::unique_ptr<WorkQueue>> queues = {};
+  vector<std::thread> workers = {};
+
+  std::atomic<unsigned int> queued;
+  std::atomic<bool> stopping;
+  std::mutex wakeLock;
+  std::condition_variable wakeCV;
+
+  void push(Task t);
+  bool tryRunOne();
+  void runTask(Task & t);
+  void workerLoop(unsigned int w);
+  void notifyAll();
+
+  static std::mutex globalLock;
+  static std::unique_ptr<ThreadPool> globalPool;
+  static unsigned int globalThreads;
+};
+
+}; // end of namespace
+
+// -------------------------------------------------
+#endif
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
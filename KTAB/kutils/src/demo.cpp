@@ -33,6 +33,8 @@
 // -------------------------------------------------
 
 #include <inttypes.h>
+#include <algorithm>
+#include <chrono>
 #include "demo.h"
 
 using KBase::newChars;
@@ -140,8 +142,7 @@ double bvu(const KBase::KMatrix & d, const KBase::KMatrix & s, double R) {
 
 // -------------------------------------------------
 void demoThreadLambda(unsigned int n) {
-    // Interestingly, this starts all CPU's right away,
-    // unlike parallelMatrixMult.
+    // Interestingly, this starts all CPU's right away.
     auto ts = vector<thread>();
     auto ifn = [](const unsigned int s, const unsigned int m) {
         unsigned int k = s + 114367;
@@ -603,7 +604,7 @@ void demoPCA(PRNG* rng) {
     }
     const KMatrix yMat = xMat;
     auto cvrMat = (trans(yMat) * yMat) / nSample;
-    auto f1 = trans(firstEigenvector(cvrMat, evTol));
+    KMatrix f1 = trans(firstEigenvector(cvrMat, evTol));
     auto w1 = yMat * trans(f1); 
 
     auto showErr = [yMat] (const KMatrix & w, const KMatrix & f) {
@@ -2074,67 +2075,155 @@ double TargetedBV::tblEval(double minD, vector<double> wght, vector<VBool> tbl)
 }
 
 void parallelMatrixMult(PRNG * rng) {
-    // Interestingly, this does not start all CPU's right away,
-    // unlike demoThreadLambda
-
-    using std::async;
-    using std::future;
-    using std::launch;
-
-    // With [150,7000]*[7000,150], this flock of threads spends about the first 15% of its time
-    // effectively single-threaded, then suddenly switches over to using all four CPUs
-    // for the other 85%.
-    // With shorter tasks, the "one-cpu-leadin" is reduced or eliminated.
-    const unsigned int crc = 150 * 7000 * 150 / 2;
-    const unsigned int r1 = 100;
-    const unsigned int c2 = r1;
-    const unsigned int cr = crc / (r1*c2);
-    LOG(INFO) << getFormattedString(
-        "Starting concurrent matrix multiply of [%u,%u] by [%u, %u]", r1, cr, cr, c2);
-    LOG(INFO) << "This will launch" << r1*c2 << "threads";
-
-    auto m1 = KMatrix::uniform(rng, r1, cr, -10, 50);
-    auto m2 = KMatrix::uniform(rng, cr, c2, -10, 50);
-    auto m3A = m1 * m2;
-    auto m3B = KMatrix(r1, c2);
-
-    auto mik = [&m1, &m2, &m3B](unsigned int i, unsigned int k) {
-        const unsigned int cr = m1.numC();
-        const unsigned m = 7;
-        const unsigned int st = 1;
-        if (m2.numR() != cr) {
-          throw KException("parallelMatrixMult: columns of m1 and rows of m2 must have same size");
-        }
-        double s = 0.0;
-        for (unsigned int j = 0; j < cr; j++) {
-            if (0 == (j%m)) { // force interleaving
-                //printf("Thread %3i,%3i sleeping %2i milliseconds \n", i, k, st);
-                //cout << flush;
-                std::this_thread::sleep_for(std::chrono::milliseconds(st));
+    // This used to launch one thread per element of the product, which mostly
+    // measured the cost of thread creation. Now it compares the throughput of
+    // the different matrix-multiply kernels on a few shapes, and checks each
+    // result against the old element-by-element formulation.
+    using KBase::GemmKernel;
+    using KBase::matMult;
+    using KBase::gemmKernelAvailable;
+    using KBase::gemmKernelName;
+    using std::chrono::duration;
+    using std::chrono::steady_clock;
+
+    // the old way: map a lambda over (i,j), going through bounds-checked operator()
+    auto mapMult = [](const KMatrix & m1, const KMatrix & m2) {
+        const unsigned int nm = m1.numC();
+        auto f = [nm, &m1, &m2](unsigned int i, unsigned int j) {
+            double sij = 0.0;
+            for (unsigned int k = 0; k < nm; k++) {
+                sij = sij + m1(i, k)*m2(k, j);
             }
-            s = s + m1(i, j)*m2(j, k);
+            return sij;
+        };
+        return KMatrix::map(f, m1.numR(), m2.numC());
+    };
+
+    // largest relative difference, scaled so tiny elements do not dominate
+    auto relDiff = [](const KMatrix & mA, const KMatrix & mB) {
+        double s = 1.0;
+        for (auto x : mB) {
+            s = std::max(s, fabs(x));
         }
-        m3B(i, k) = s;
-        LOG(INFO) << "Thread (" << i << "," << k << ") completed";
-        return;
+        double d = 0.0;
+        for (unsigned int i = 0; i < mA.numR(); i++) {
+            for (unsigned int j = 0; j < mA.numC(); j++) {
+                d = std::max(d, fabs(mA(i, j) - mB(i, j)));
+            }
+        }
+        return d / s;
     };
 
-    auto pfs = vector< thread >();
-    for (unsigned int i = 0; i < r1; i++) {
-        for (unsigned int k = 0; k < c2; k++) {
-            pfs.push_back(thread([mik, i, k]() {
-                mik(i, k);
-                return;
-            }));
+    const vector<GemmKernel> kernels = { GemmKernel::Naive, GemmKernel::Scalar,
+                                         GemmKernel::AVX2, GemmKernel::AVX512 };
+
+    LOG(INFO) << "operator* uses kernel" << gemmKernelName(KBase::bestGemmKernel());
+
+    // actor-by-option sized products, then some larger ones
+    const vector<vector<unsigned int>> shapes = { {10, 10, 10}, {50, 50, 50},
+        {100, 100, 100}, {100, 100, 5}, {250, 250, 250}, {150, 7000, 150} };
+
+    for (auto shp : shapes) {
+        const unsigned int r1 = shp[0];
+        const unsigned int cr = shp[1];
+        const unsigned int c2 = shp[2];
+        auto m1 = KMatrix::uniform(rng, r1, cr, -10, 50);
+        auto m2 = KMatrix::uniform(rng, cr, c2, -10, 50);
+        const double flop = 2.0 * r1 * cr * c2;
+
+        // repeat small products enough to get a measurable time
+        const unsigned int reps = std::max(1u, (unsigned int)(2.0E8 / flop));
+
+        LOG(INFO) << getFormattedString(
+            "Multiply [%u,%u] by [%u,%u], %u repetitions", r1, cr, cr, c2, reps);
+
+        auto t0 = steady_clock::now();
+        KMatrix m3Ref;
+        for (unsigned int n = 0; n < reps; n++) {
+            m3Ref = mapMult(m1, m2);
+        }
+        double dt = duration<double>(steady_clock::now() - t0).count();
+        const double refRate = (flop * reps) / dt;
+        LOG(INFO) << getFormattedString("  %-8s %8.3f GFLOP/s", "Map", refRate / 1.0E9);
+
+        for (auto gk : kernels) {
+            if (!gemmKernelAvailable(gk)) {
+                LOG(INFO) << getFormattedString("  %-8s not supported on this CPU",
+                                                gemmKernelName(gk).c_str());
+                continue;
+            }
+            t0 = steady_clock::now();
+            KMatrix m3;
+            for (unsigned int n = 0; n < reps; n++) {
+                m3 = matMult(m1, m2, gk);
+            }
+            dt = duration<double>(steady_clock::now() - t0).count();
+            const double rate = (flop * reps) / dt;
+            LOG(INFO) << getFormattedString("  %-8s %8.3f GFLOP/s  speedup %6.2f  rel diff %.2E",
+                                            gemmKernelName(gk).c_str(), rate / 1.0E9,
+                                            rate / refRate, relDiff(m3, m3Ref));
         }
     }
 
-    for (auto & t : pfs) {
-        t.join();
+    return;
+}
+
+void comparePRNG(PRNG * rng) {
+    // Check the Philox2x64-10 block function against the published
+    // known-answer vectors, then compare the throughput of the sequential
+    // generator with that of the per-(turn, actor) streams.
+    using std::chrono::steady_clock;
+    using std::chrono::duration;
+    using KBase::StreamPRNG;
+
+    struct KAT { uint64_t ctr[2]; uint64_t key; uint64_t out[2]; };
+    const vector<KAT> kats = {
+        { { 0, 0 }, 0, { 0xca00a0459843d731ULL, 0x66c24222c9a845b5ULL } },
+        { { ~0ULL, ~0ULL }, ~0ULL, { 0x65b021d60cd8310fULL, 0x4d02f3222f86df20ULL } },
+        { { 0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL }, 0xa4093822299f31d0ULL,
+          { 0x0a5e742c2997341cULL, 0xb0f883d38000de5dULL } }
+    };
+    for (auto k : kats) {
+        uint64_t c[2] = { k.ctr[0], k.ctr[1] };
+        StreamPRNG::philox(c, k.key);
+        const bool ok = (c[0] == k.out[0]) && (c[1] == k.out[1]);
+        LOG(INFO) << getFormattedString("Philox2x64-10 KAT: %016llx %016llx  %s",
+                                        (unsigned long long)c[0], (unsigned long long)c[1],
+                                        ok ? "ok" : "FAILED");
+        if (!ok) {
+            throw KException("comparePRNG: Philox2x64-10 known-answer test failed");
+        }
     }
 
-    LOG(INFO) << getFormattedString("Diff in matrix mults: %.3E", norm(m3A - m3B));
+    const unsigned int n = 10000000;
+    uint64_t sum = 0; // keep the optimizer from discarding the draws
+
+    auto t0 = steady_clock::now();
+    for (unsigned int i = 0; i < n; i++) {
+        sum += rng->uniform();
+    }
+    double dt = duration<double>(steady_clock::now() - t0).count();
+    LOG(INFO) << getFormattedString("  %-8s %7.2f ns per 64 bits", "PRNG", 1.0E9 * dt / n);
 
+    auto sp = rng->stream(0, 0);
+    t0 = steady_clock::now();
+    for (unsigned int i = 0; i < n; i++) {
+        sum += sp.uniform();
+    }
+    dt = duration<double>(steady_clock::now() - t0).count();
+    LOG(INFO) << getFormattedString("  %-8s %7.2f ns per 64 bits", "Stream", 1.0E9 * dt / n);
+
+    // the cost that matters for the models: a fresh stream for every (turn, actor)
+    const unsigned int na = 1000;
+    t0 = steady_clock::now();
+    for (unsigned int t = 0; t < n / na; t++) {
+        for (unsigned int i = 0; i < na; i++) {
+            sum += rng->stream(t, i).uniform();
+        }
+    }
+    dt = duration<double>(steady_clock::now() - t0).count();
+    LOG(INFO) << getFormattedString("  %-8s %7.2f ns per new stream (checksum %llx)",
+                                    "Stream", 1.0E9 * dt / n, (unsigned long long)sum);
     return;
 }
 
@@ -2158,6 +2247,7 @@ int main(int ac, char **av) {
     bool ghcP = false;
     // unsigned int ghcN = 0;
     bool pMultP = false;
+    bool prngP = false;
     bool vimcpP = false;
     unsigned int vimcpN = 0;
     bool threadP = false;
@@ -2176,7 +2266,9 @@ int main(int ac, char **av) {
         printf("\n");
         printf("--matrix          matrix functions \n");
         printf("\n");
-        printf("--pMult           asynchronous parallel matrix multiply (very slow) \n");
+        printf("--pMult           compare throughput of the matrix multiply kernels \n");
+        printf("\n");
+        printf("--prng            check and time the per-(turn, actor) random streams \n");
         printf("\n");
         printf("--gopt            genetic optimization \n");
         printf("\n");
@@ -2216,6 +2308,9 @@ int main(int ac, char **av) {
             else if (strcmp(av[i], "--pMult") == 0) {
                 pMultP = true;
             }
+            else if (strcmp(av[i], "--prng") == 0) {
+                prngP = true;
+            }
             else if (strcmp(av[i], "--thread") == 0) {
                 threadP = true;
             }
@@ -2319,6 +2414,19 @@ int main(int ac, char **av) {
         }
     }
 
+    if (prngP) {
+        rng->setSeed(seed);
+        try {
+          UDemo::comparePRNG(rng);
+        }
+        catch (KException &ke) {
+          LOG(INFO) << ke.msg;
+        }
+        catch (...) {
+          LOG(INFO) << "Unknown exception from UDemo::comparePRNG";
+        }
+    }
+
     if (goptP) {
         rng->setSeed(seed);
         try {
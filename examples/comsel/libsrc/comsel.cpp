@@ -539,36 +539,16 @@ namespace ComSelLib {
         // This entails juggling back and forth between the all current positions
         // and the one hypothetical position (mph at h).
         // Thus, the next call to euMat will consider only unique options.
-        auto equivHNdx = [this, h, mph](const unsigned int i, const unsigned int j) {
-          // this little function takes care of the different types needed to compare
-          // dynamic pointers to positions (all but h) with a constant position (h itself).
-          // In other words, the comparisons for index 'h' use the hypothetical mph, not pstns[h]
-          bool rslt = false;
+        // For h, use the hypothetical mph, and for all others use the stored pointers.
+        auto ns = vector<VUI>(model->numAct);
+        for (unsigned int i = 0; i < model->numAct; i++) {
           auto mpi = ((const MtchPstn *)(pstns[i]));
-          auto mpj = ((const MtchPstn *)(pstns[j]));
           if (mpi == nullptr) {
             throw KException("CSState::doSUSN: mpi is null pointer");
           }
-          if (mpj == nullptr) {
-            throw KException("CSState::doSUSN: mpj is null pointer");
-          }
-          if (i == j) {
-            rslt = true; // Pi == Pj, always
-          }
-          else if (h == i) {
-            rslt = (mph == (*mpj));
-          }
-          else if (h == j) {
-            rslt = ((*mpi) == mph);
-          }
-          else {
-            rslt = ((*mpi) == (*mpj));
-          }
-          return rslt;
-        };
-
-        auto ns = KBase::uiSeq(0, model->numAct - 1);
-        const VUI uNdx = get<0>(KBase::ueIndices<unsigned int>(ns, equivHNdx));
+          ns[i] = (i == h) ? mph.eqvKey() : mpi->eqvKey();
+        }
+        const VUI uNdx = get<0>(KBase::ueIndicesByKey<VUI, KBase::VUIHash>(ns));
         auto numU = ((const unsigned int)(uNdx.size()));
         auto hypUtil = KMatrix(model->numAct, numU);
         // we need now to go through 'uh', copying column J the first time
@@ -742,6 +722,18 @@ namespace ComSelLib {
     return rslt;
   }
 
+  tuple<VUI, VUI> CSState::uniqueEquivNdx() const {
+    auto ns = vector<VUI>(pstns.size());
+    for (unsigned int i = 0; i < pstns.size(); i++) {
+      auto mpi = ((const MtchPstn *)(pstns[i]));
+      if (mpi == nullptr) {
+        throw KException("CSState::uniqueEquivNdx: mpi is null pointer");
+      }
+      ns[i] = mpi->eqvKey();
+    }
+    return KBase::ueIndicesByKey<VUI, KBase::VUIHash>(ns);
+  }
+
   void CSState::setAllAUtil(ReportingLevel rl) {
     auto csm = ((CSModel*)model);
     const unsigned int na = csm->numAct;
@@ -178,6 +178,9 @@ namespace ComSelLib {
      
     virtual bool equivNdx(unsigned int i, unsigned int j) const;
 
+    // look positions up by MtchPstn::eqvKey, rather than comparing every pair
+    virtual tuple<VUI, VUI> uniqueEquivNdx() const;
+
   private:
   };
 
@@ -798,6 +798,19 @@ bool RPState::equivNdx(unsigned int i, unsigned int j) const
 }
 
 
+tuple<VUI, VUI> RPState::uniqueEquivNdx() const {
+  auto ns = vector<VUI>(pstns.size());
+  for (unsigned int i = 0; i < pstns.size(); i++) {
+    auto mpi = ((const MtchPstn *)(pstns[i]));
+    if (mpi == nullptr) {
+      throw KException("RPState::uniqueEquivNdx: mpi is null pointer");
+    }
+    ns[i] = mpi->eqvKey();
+  }
+  return KBase::ueIndicesByKey<VUI, KBase::VUIHash>(ns);
+}
+
+
 tuple <KMatrix, VUI> RPState::pDist(int persp) const
 {
   /// Calculate the probability distribution over states from this perspective
@@ -987,41 +1000,17 @@ RPState* RPState::doSUSN(ReportingLevel rl) const {
       // This entails juggling back and forth between the all current positions
       // and the one hypothetical position (mph at h).
       // Thus, the next call to euMat will consider only unique options.
-      auto equivHNdx = [this, h, mph](const unsigned int i, const unsigned int j)
+      // For h, use the hypothetical mph, and for all others use the stored pointers.
+      auto ns = vector<VUI>(rpMod->numAct);
+      for (unsigned int i = 0; i < rpMod->numAct; i++)
       {
-        // this little function takes care of the different types needed to compare
-        // dynamic pointers to positions (all but h) with a constant position (h itself).
-        // In other words, the comparisons for index 'h' use the hypothetical mph, not pstns[h]
-        bool rslt = false;
         auto mpi = ((const MtchPstn *)(pstns[i]));
-        auto mpj = ((const MtchPstn *)(pstns[j]));
         if (mpi == nullptr) {
           throw KException("RPState::equivNdx: mpi is null pointer");
         }
-        if (mpj == nullptr) {
-          throw KException("RPState::equivNdx: mpj is null pointer");
-        }
-        if (i == j)
-        {
-          rslt = true; // Pi == Pj, always
-        }
-        else if (h == i)
-        {
-          rslt = (mph == (*mpj));
-        }
-        else if (h == j)
-        {
-          rslt = ((*mpi) == mph);
-        }
-        else
-        {
-          rslt = ((*mpi) == (*mpj));
-        }
-        return rslt;
-      };
-
-      auto ns = KBase::uiSeq(0, model->numAct - 1);
-      const VUI uNdx = get<0>(KBase::ueIndices<unsigned int>(ns, equivHNdx));
+        ns[i] = (i == h) ? mph.eqvKey() : mpi->eqvKey();
+      }
+      const VUI uNdx = get<0>(KBase::ueIndicesByKey<VUI, KBase::VUIHash>(ns));
       const unsigned int numU = uNdx.size();
       auto hypUtil = KMatrix(rpMod->numAct, numU);
       // we need now to go through 'uh', copying column J the first time
@@ -197,6 +197,9 @@ protected:
   // determine if the i-th position in this state is equivalent to the j-th position
   virtual bool equivNdx(unsigned int i, unsigned int j) const;
 
+  // look positions up by MtchPstn::eqvKey, rather than comparing every pair
+  virtual tuple<VUI, VUI> uniqueEquivNdx() const;
+
 private:
 };
 
@@ -20,6 +20,16 @@ void RunModel::runSMPModel(QStringList fileNames, bool logStatus, QString seedVa
 
     QString con = configureDbRun(dbFilePath);
 
+    // Each spec logs to a file of its own only with "New", which needs them one
+    // at a time; otherwise they share the log, so run them all at once.
+    if(logType!="New" && fileNames.length() > 1 && !con.isEmpty())
+    {
+        logSMPDataOptionsAnalysis(logType,QString("_spec_0"));
+        runModels(fileNames,logStatus,seedVal);
+        QMessageBox::information(0,"Done", "Model run completed");
+        return;
+    }
+
     for( int fileIndex = 0 ; fileIndex < fileNames.length() ; ++ fileIndex)
     {
         logSMPDataOptionsAnalysis(logType,QString("_spec_"+ QString::number(fileIndex)));
@@ -102,6 +112,39 @@ void RunModel::runModel(QString conStr, QString fileName, bool logStatus, QStrin
 
 }
 
+void RunModel::runModels(QStringList fileNames, bool logStatus, QString seedVal)
+{
+    auto sTime = KBase::displayProgramStart(DemoSMP::appName, DemoSMP::appVersion);
+
+    uint64_t seed = seedVal.toULongLong();
+    std::vector<bool> sqlFlags = {true,true,true,true,true};
+    if(true==logStatus)
+    {
+        sqlFlags = {true,false,false,false,true};
+    }
+
+    std::vector<std::string> inputs;
+    for( int fileIndex = 0 ; fileIndex < fileNames.length() ; ++ fileIndex)
+    {
+        inputs.push_back(fileNames.at(fileIndex).toStdString());
+    }
+
+    auto runs = SMPLib::SMPModel::runScenarios(sqlFlags, inputs, seed, false);
+    for(size_t i = 0; i < runs.size(); ++i)
+    {
+        if(runs[i].ok())
+        {
+            qDebug()<<"runModel" << i << QString::fromStdString(runs[i].scenarioID);
+        }
+        else
+        {
+            qDebug()<<"runModel" << i << "failed:" << QString::fromStdString(runs[i].error);
+        }
+    }
+
+    KBase::displayProgramEnd(sTime);
+}
+
 void RunModel::logSMPDataOptionsAnalysis(QString logType, QString specCount)
 {
     QDateTime UTC = QDateTime::currentDateTime().toTimeSpec(Qt::UTC);
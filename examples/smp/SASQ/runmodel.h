@@ -119,6 +119,7 @@ public slots:
 private:
     QString configureDbRun(QString dbFilePath);
     void runModel(QString conStr, QString fileName,bool logStatus, QString seedVal);
+    void runModels(QStringList fileNames, bool logStatus, QString seedVal);
     void logSMPDataOptionsAnalysis(QString logType, QString specCount);
 
     el::Configurations loggerConf;
@@ -22,6 +22,8 @@
 // -------------------------------------------------
 
 #include "database.h"
+#include "kutils.h"
+#include "kcolumnar.h"
 
 Database::Database()
 {
@@ -81,6 +83,8 @@ void Database::openDB(QString dbPath, QString dbType, QString connectionString,
 
         if(db->isOpen())
         {
+            loadColumnarResults(dbPath);
+
             // Scenarios list in db
             getScenarioList(run);
 
@@ -487,6 +491,87 @@ void Database::getUtilChlgAndSQvalues(QVector<int> VHAxisValues)
     }
 }
 
+void Database::loadColumnarResults(QString dbPath)
+{
+    // A run made with "Format=columnar" keeps its per-turn tables in files
+    // <name>.kcol/<ScenarioId>/<Table>.kcol rather than in the database.
+    // Each is loaded into a TEMP table of the same name, which SQLite then
+    // uses in place of the database's own table in every query below.
+    QFileInfo dbFile(dbPath);
+    QDir colDir(dbFile.absolutePath() + "/" + dbFile.completeBaseName() + ".kcol");
+    if(!colDir.exists())
+    {
+        return;
+    }
+
+    QStringList loaded;
+    db->transaction();
+    foreach (const QString & scen, colDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        QDir scenDir(colDir.filePath(scen));
+        foreach (const QString & file, scenDir.entryList(QStringList() << "*.kcol", QDir::Files))
+        {
+            QString table = QFileInfo(file).completeBaseName();
+            try
+            {
+                KBase::ColumnarReader reader(scenDir.filePath(file).toStdString());
+                const std::vector<KBase::ColumnData> & data = reader.columns();
+
+                QStringList cols;
+                QStringList marks;
+                for (const std::string & name : reader.names())
+                {
+                    cols << ("\"" + QString::fromStdString(name) + "\"");
+                    marks << "?";
+                }
+                if(!loaded.contains(table))
+                {
+                    // keeping any rows the database itself holds
+                    if(!qry->exec("CREATE TEMP TABLE " + table + " AS SELECT * FROM main." + table))
+                    {
+                        qry->exec("CREATE TEMP TABLE " + table + " (" + cols.join(", ") + ")");
+                    }
+                    loaded << table;
+                }
+
+                // one list of values per column, as the file holds them
+                qry->prepare("INSERT INTO temp." + table + " (" + cols.join(", ") + ") VALUES ("
+                             + marks.join(", ") + ")");
+                for (const KBase::ColumnData & c : data)
+                {
+                    QVariantList values;
+                    values.reserve(c.size());
+                    for (size_t r = 0; r < c.size(); ++r)
+                    {
+                        switch (c.kind)
+                        {
+                        case KBase::ColumnData::Kind::Int:
+                            values << (c.null[r] ? QVariant(QVariant::LongLong) : QVariant((qlonglong)c.ints[r]));
+                            break;
+                        case KBase::ColumnData::Kind::Real:
+                            values << (c.null[r] ? QVariant(QVariant::Double) : QVariant(c.reals[r]));
+                            break;
+                        case KBase::ColumnData::Kind::Text:
+                            values << (c.null[r] ? QVariant(QVariant::String) : QVariant(QString::fromStdString(c.textAt(r))));
+                            break;
+                        }
+                    }
+                    qry->addBindValue(values);
+                }
+                if(!qry->execBatch())
+                {
+                    emit Message("Columnar Results", qry->lastError().text());
+                }
+            }
+            catch (KBase::KException & ke)
+            {
+                emit Message("Columnar Results", QString::fromStdString(ke.msg));
+            }
+        }
+    }
+    db->commit();
+}
+
 void Database::releaseDB()
 {
     if(db != nullptr) {
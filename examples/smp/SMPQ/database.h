@@ -168,6 +168,9 @@ private:
 
     void readVectorPositionTableEdit(QString scenario);
 
+    // results which the run wrote to columnar files, next to the database
+    void loadColumnarResults(QString dbPath);
+
     //postgres
     void getDatabaseList(bool imp, QString &connectionName);
 
@@ -26,6 +26,8 @@
 // --------------------------------------------
 
 #include "smp.h"
+#include <chrono>
+#include <thread>
 #include <QSqlQuery>
 #include <QVariant>
 #include <QSqlError>
@@ -157,6 +159,8 @@ using KBase::ReportingLevel;
 
 SMPModel * md0 = nullptr;
 
+unsigned int SMPModel::implicitUtilActors = 100;
+
 // big enough buffer to build all desired SQLite statements
 const unsigned int sqlBuffSize = 250;
 
@@ -203,9 +207,8 @@ SMPActor::~SMPActor() {
 
 double SMPActor::vote(unsigned int est, unsigned int i, unsigned int j, const State*st) const {
     unsigned int k = st->model->actrNdx(this);
-    auto uk = st->aUtil[est];
-    double uhki = uk(k, i);
-    double uhkj = uk(k, j);
+    double uhki = st->aUtilAt(est, k, i);
+    double uhkj = st->aUtilAt(est, k, j);
     const double vij = Model::vote(vr, sCap, uhki, uhkj);
     return vij;
 }
@@ -231,7 +234,7 @@ double SMPActor::posUtil(const Position * ap1, const SMPState* as) const {
     if (0 > ai) {
       throw KException("SMPActor::posUtil: ai must be non-negative");
     }
-    const VctrPstn actorIdeal = as->getIdeal(ai);
+    const VctrPstn & actorIdeal = as->getIdeal(ai);
     const VctrPstn* p0 = &actorIdeal;
     if (nullptr == p0) {
       throw KException("SMPActor::posUtil: p0 is null pointer");
@@ -325,7 +328,7 @@ void SMPActor::interpBrgnS2PMax(double tik, double sik, double prbI,
 
 BargainSMP* SMPActor::interpolateBrgn(const SMPActor* ai, const SMPActor* aj,
                                       const VctrPstn* posI, const VctrPstn * posJ,
-                                      double prbI, double prbJ, InterVecBrgn ivb) {
+                                      double prbI, double prbJ, InterVecBrgn ivb, uint64_t id) {
     if ((1 != posI->numC()) || (1 != posJ->numC())) {
       throw KException("SMPActor::interpolateBrgn: position vectors posI and posJ must be column vectors");
     }
@@ -364,12 +367,57 @@ BargainSMP* SMPActor::interpolateBrgn(const SMPActor* ai, const SMPActor* aj,
         brgnJ(k, 0) = bjk;
     }
 
-    auto brgn = new BargainSMP(ai, aj, brgnI, brgnJ);
+    auto brgn = new BargainSMP(ai, aj, brgnI, brgnJ, id);
     return brgn;
 }
 
 
 
+SMPUtilProvider::SMPUtilProvider(const KMatrix & vd, const KMatrix & rha) : UtilProvider() {
+    na = vd.numR();
+    if ((na != vd.numC()) || (na != rha.numR()) || (na != rha.numC())) {
+      throw KException("SMPUtilProvider::SMPUtilProvider: vd and rha must both be square and of the same size");
+    }
+    vDiff.reserve(na*na);
+    rhi.reserve(na*na);
+    for (unsigned int i = 0; i < na; i++) {
+        for (unsigned int j = 0; j < na; j++) {
+            vDiff.push_back(vd(i, j));
+            rhi.push_back(rha(i, j));
+        }
+    }
+}
+
+SMPUtilProvider::~SMPUtilProvider() {
+}
+
+unsigned int SMPUtilProvider::numAct() const {
+    return na;
+}
+
+double SMPUtilProvider::util(unsigned int h, unsigned int i, unsigned int j) const {
+    if ((h >= na) || (i >= na) || (j >= na)) {
+      throw KException("SMPUtilProvider::util: h, i and j must each be less than the number of actors");
+    }
+    return SMPModel::bsUtil(vDiff[i*na + j], rhi[h*na + i]);
+}
+
+KMatrix SMPUtilProvider::utilMatrix(unsigned int h) const {
+    if (h >= na) {
+      throw KException("SMPUtilProvider::utilMatrix: h must be less than the number of actors");
+    }
+    auto u = KMatrix(na, na);
+    for (unsigned int i = 0; i < na; i++) {
+        const double rh_i = rhi[h*na + i];
+        for (unsigned int j = 0; j < na; j++) {
+            u(i, j) = SMPModel::bsUtil(vDiff[i*na + j], rh_i);
+        }
+    }
+    return u;
+}
+
+// --------------------------------------------
+
 SMPState::SMPState(Model * m) : State(m), turn(m->history.size()) {
 }
 
@@ -381,19 +429,19 @@ SMPState::~SMPState() {
 }
 
 void SMPState::setVDiff(const vector<VctrPstn> & vPos) {
-    auto dfn = [vPos, this](unsigned int i, unsigned int j) {
+    auto dfn = [&vPos, this](unsigned int i, unsigned int j) {
         auto ai = ((const SMPActor*)(model->actrs[i]));
-        KMatrix si = ai->vSal;
+        const KMatrix & si = ai->vSal;
         auto posJ = ((const VctrPstn*)(pstns[j]));
         double dij = 0.0;
         if (0 == vPos.size()) {
             auto posI = ((const VctrPstn*)(pstns[i]));
-            auto idlI = ideals[i];
+            const VctrPstn & idlI = ideals[i];
             //dij = SMPModel::bvDiff((*posI) - (*posJ), si);
             dij = SMPModel::bvDiff(idlI - (*posJ), si);
         }
         else {
-            auto vpi = vPos[i];
+            const VctrPstn & vpi = vPos[i];
             dij = SMPModel::bvDiff(vpi - (*posJ), si);
         }
         return dij;
@@ -414,6 +462,47 @@ void SMPState::setVDiff(const vector<VctrPstn> & vPos) {
     return;
 }
 
+void SMPState::updateVDiff(const SMPState * s0) {
+    const unsigned int na = model->numAct;
+    if (na != ideals.size()) {
+      throw KException("SMPState::updateVDiff: Ideals for one or more actors missing");
+    }
+    if ((na != pstnMoved.size()) || (na != idealMoved.size())) {
+      throw KException("SMPState::updateVDiff: the changes since the state before are not known");
+    }
+    vDiff = s0->vDiff;
+    for (unsigned int i = 0; i < na; i++) {
+        auto ai = ((const SMPActor*)(model->actrs[i]));
+        const KMatrix & si = ai->vSal;
+        const VctrPstn & idlI = ideals[i];
+        for (unsigned int j = 0; j < na; j++) {
+            if (idealMoved[i] || pstnMoved[j]) {
+                auto posJ = ((const VctrPstn*)(pstns[j]));
+                vDiff(i, j) = SMPModel::bvDiff(idlI - (*posJ), si);
+            }
+        }
+    }
+    return;
+}
+
+const SMPState * SMPState::reusableState() const {
+    const unsigned int na = model->numAct;
+    if ((na != pstnMoved.size()) || (na != idealMoved.size())) {
+        return nullptr;
+    }
+    if ((0 == turn) || (turn > model->history.size())) {
+        return nullptr;
+    }
+    auto s0 = ((const SMPState*)(model->history[turn - 1]));
+    if (nullptr == s0) {
+        return nullptr;
+    }
+    const bool resultsP = (na == s0->vDiff.numR()) && (na == s0->vDiff.numC())
+      && (na == s0->nra.numR()) && (na == s0->nraProb.numR())
+      && ((na == s0->aUtil.size()) || (nullptr != s0->aUtilProv));
+    return resultsP ? s0 : nullptr;
+}
+
 double SMPState::estNRA(unsigned int h, unsigned int i, BigRAdjust ra) const {
     double rh = nra(h, 0);
     double ri = nra(i, 0);
@@ -451,8 +540,36 @@ void SMPState::setAllAUtil(ReportingLevel rl) {
       throw KException("SMPState::setAllAUtil: size of uIndices can't exceed the count of actors");
     }
 
+    // When no position or ideal changed since the state before, neither did anything
+    // computed from them, so it is all taken from that state. Otherwise, only the
+    // distances which do not depend on the changes are copied from it: the risk
+    // attitudes come from a PCE over every actor, so all the utilities change.
+    const SMPState * s0 = reusableState();
+    const unsigned int numPM = (nullptr == s0) ? na : std::count(pstnMoved.begin(), pstnMoved.end(), true);
+    const unsigned int numIM = (nullptr == s0) ? na : std::count(idealMoved.begin(), idealMoved.end(), true);
+    if ((nullptr != s0) && (ReportingLevel::Silent < rl)) {
+        LOG(INFO) << "Since the state before," << numPM << "positions and" << numIM << "ideals changed";
+    }
+    const bool sameP = (nullptr != s0) && (0 == numPM) && (0 == numIM);
+    if (sameP) {
+        vDiff = s0->vDiff;
+        nra = s0->nra;
+        nraProb = s0->nraProb;
+        aUtil = s0->aUtil;
+        aUtilProv = s0->aUtilProv;
+        if (ReportingLevel::Silent < rl) {
+            LOG(INFO) << "No position or ideal changed, so the utilities are those of the state before";
+        }
+        return;
+    }
+
     auto w_j = actrCaps();
-    setVDiff();
+    if (nullptr == s0) {
+        setVDiff();
+    }
+    else {
+        updateVDiff(s0);
+    }
     nra = KMatrix(na, 1); // zero-filled, i.e. risk neutral
     auto uFn1 = [this](unsigned int i, unsigned int j) {
         return  SMPModel::bsUtil(vDiff(i, j), nra(i, 0));
@@ -466,15 +583,18 @@ void SMPState::setAllAUtil(ReportingLevel rl) {
     }
 
 
-    auto vfn = [vrCoalition, &w_j, &rnUtil_ij](unsigned int k, unsigned int i, unsigned int j) {
-        double vkij = Model::vote(vrCoalition, w_j(0, k), rnUtil_ij(k, i), rnUtil_ij(k, j));
-        return vkij;
-    };
-    const auto c = Model::coalitions(vfn, na, na); // c(i,j) = strength of coaltion for i against j
-    const auto pv2 = Model::probCE2(model->pcem, vpmCoalition, c);
+    const auto c = Model::coalitions(vrCoalition, w_j, rnUtil_ij); // c(i,j) = strength of coaltion for i against j
+    // the options are the actors' positions, as in the previous turn, so its
+    // distribution is a good start for the solvers which can use one
+    auto p0 = KMatrix();
+    if ((0 < turn) && (turn <= model->history.size()) && (nullptr != model->history[turn - 1])) {
+        p0 = ((const SMPState*)(model->history[turn - 1]))->nraProb;
+    }
+    const auto pv2 = Model::probCE2(model->pcem, vpmCoalition, c, p0, model->pceSolver);
     const auto p_i = get<0>(pv2); // column
     const auto pv_ij = get<1>(pv2); // square
     nra = Model::bigRfromProb(p_i, rr);
+    nraProb = p_i;
 
     if (ReportingLevel::Silent < rl) {
         LOG(INFO) << "Inferred risk attitudes:";
@@ -519,8 +639,42 @@ void SMPState::setAllAUtil(ReportingLevel rl) {
     }
 
     aUtil = vector<KMatrix>();
+    aUtilProv = nullptr;
+    const bool implicitP = (SMPModel::implicitUtilActors <= na);
+    if (implicitP) {
+        auto rhaFn = [this, ra](unsigned int h, unsigned int i) {
+            return estNRA(h, i, ra);
+        };
+        aUtilProv = std::make_shared<const SMPUtilProvider>(vDiff, KMatrix::map(rhaFn, na, na));
+    }
+    else {
+        aUtil.reserve(na);
+    }
+
     for (unsigned int h = 0; h < na; h++) {
-        auto u_h_ij = KMatrix(na, na);
+        if (implicitP) {
+            // nothing is stored, so check h's estimates by streaming over them
+            double ssd = 0.0;
+            for (unsigned int i = 0; i < na; i++) {
+                for (unsigned int j = 0; j < na; j++) {
+                    const double d = aUtilProv->util(h, i, j) - raUtil_ij(i, j);
+                    ssd = ssd + (d*d);
+                }
+            }
+            if (ReportingLevel::Silent < rl) {
+                LOG(INFO) << "Estimate by" << h << "of risk-aware utility matrix:";
+                aUtilProv->utilMatrix(h).mPrintf(" %+.4f ");
+
+                LOG(INFO) << "RMS change in util^h vs utility:" << sqrt(ssd) / na;
+            }
+            if (duTol >= sqrt(ssd)) { // I've never seen it below 0.03
+              throw KException("SMPState::setAllAUtil: Estimate of change in utility by h out of valid range");
+            }
+            continue;
+        }
+
+        aUtil.emplace_back(na, na); // fill it in place, rather than copying it in
+        KMatrix & u_h_ij = aUtil.back();
         for (unsigned int i = 0; i < na; i++) {
             double rhi = estNRA(h, i, ra);
             for (unsigned int j = 0; j < na; j++) {
@@ -528,7 +682,6 @@ void SMPState::setAllAUtil(ReportingLevel rl) {
                 u_h_ij(i, j) = SMPModel::bsUtil(dij, rhi);
             }
         }
-        aUtil.push_back(u_h_ij);
 
 
         if (ReportingLevel::Silent < rl) {
@@ -538,7 +691,7 @@ void SMPState::setAllAUtil(ReportingLevel rl) {
             LOG(INFO) << "RMS change in util^h vs utility:" << norm(u_h_ij - raUtil_ij) / na;
         }
 
-        if (duTol >= norm(u_h_ij - raUtil_ij)) { // I've never seen it below 0.03
+        if (duTol >= norm(KBase::lazy(u_h_ij) - raUtil_ij)) { // I've never seen it below 0.03
           throw KException("SMPState::setAllAUtil: Estimate of change in utility by h out of valid range");
         }
     }
@@ -634,7 +787,7 @@ void  SMPState::setAccomodate(const KMatrix & aMat) {
     return;
 }
 
-VctrPstn SMPState::getIdeal(unsigned int n) const
+const VctrPstn & SMPState::getIdeal(unsigned int n) const
 {
     return ideals[n];
 }
@@ -668,6 +821,26 @@ bool SMPState::equivNdx(unsigned int i, unsigned int j) const {
     return rslt;
 }
 
+tuple<VUI, VUI> SMPState::uniqueEquivNdx() const {
+    auto sm = ((const SMPModel*)model);
+    const unsigned int na = pstns.size();
+    const unsigned int nd = sm->numDim;
+    auto x = vector<double>(na * nd);
+    for (unsigned int i = 0; i < na; i++) {
+        auto vpi = ((const VctrPstn *)(pstns[i]));
+        if (vpi == nullptr) {
+            throw KException("SMPState::uniqueEquivNdx: vpi is a null pointer");
+        }
+        for (unsigned int k = 0; k < nd; k++) {
+            x[i * nd + k] = (*vpi)(k, 0);
+        }
+    }
+    auto efn = [this](unsigned int i, unsigned int j) {
+        return equivNdx(i, j);
+    };
+    return KBase::ueIndicesGrid(x, nd, sm->posTol, efn);
+}
+
 
 // set the diff matrix, do probCE for risk neutral,
 // estimate Ri, and set all the aUtil[h] matrices
@@ -676,20 +849,26 @@ SMPState* SMPState::stepBCN() {
         if ((0 == s->uIndices.size()) || (0 == s->eIndices.size())) {
             s->setUENdx();
         }
-        if (0 == s->aUtil.size()) {
+        if (!s->aUtilSet()) {
             s->setAUtil(-1, ReportingLevel::Low);
         }
         return;
     };
     gSetup(this);
 
-    // JAH 20160802 toggle population of PosUtil, PosEquiv, PosVote, and PosBrob
-    // en masse based on value at index 1 of the sqlFlags vector
-    // VectorPosition, which is in this same group, is handled separately
-    if (model->sqlFlags[1])
+    // JAH 20160802 toggle population of PosEquiv, PosVote, and PosProb.
+    // Turns which only a last-turns window selects are written once the run
+    // is over, along with the final state: see SMPModel::configExec
+    if (model->logRule("PosEquiv").turn(turn))
     {
         model->sqlPosEquiv(turn);
+    }
+    if (model->logRule("PosProb").turn(turn))
+    {
         model->sqlPosProb(turn);
+    }
+    if (model->logRule("PosVote").turn(turn))
+    {
         model->sqlPosVote(turn);
     }
     // That gets recorded upon the next state - but it
@@ -786,6 +965,14 @@ void SMPState::newIdeals() {
         nIdeals.push_back(VctrPstn(newIP));
     }
 
+    idealMoved = vector<bool>(na, false);
+    for (unsigned int i = 0; i < na; i++) {
+        for (unsigned int k = 0; k < nDim; k++) {
+            if (nIdeals[i](k, 0) != ideals[i](k, 0)) {
+                idealMoved[i] = true;
+            }
+        }
+    }
     ideals = nIdeals;
 
     if (identP) {
@@ -902,17 +1089,16 @@ tuple< KMatrix, VUI> SMPState::pDist(int persp) const {
     const KMatrix w = actrCaps();
 
     auto uij = KMatrix(na, na); // full utility matrix, including duplicate columns
-    if (na != aUtil.size()) { // must have been filled in
+    if (!aUtilSet()) { // must have been filled in
       throw KException("SMPState::pDist: size of utility matrix must be equal to number of actors");
     }
     if ((0 <= persp) && (persp < na)) {
-        uij = aUtil[persp];
+        uij = aUtilMatrix(persp);
     }
     else if (-1 == persp) {
         for (unsigned int i = 0; i < na; i++) {
             for (unsigned int j = 0; j < na; j++) {
-                auto ui = aUtil[i];
-                uij(i, j) = aUtil[i](i, j);
+                uij(i, j) = aUtilAt(i, i, j);
             }
         }
     }
@@ -939,7 +1125,8 @@ tuple< KMatrix, VUI> SMPState::pDist(int persp) const {
         return uij(i, uIndices[j]);
     };
     auto uUij = KMatrix::map(uufn, na, uIndices.size());
-    auto upd = Model::scalarPCE(na, uIndices.size(), w, uUij, vr, model->vpm, model->pcem, rl);
+    auto upd = Model::scalarPCE(na, uIndices.size(), w, uUij, vr, model->vpm, model->pcem, rl,
+                                model->pceSolver);
 
     return tuple< KMatrix, VUI>(upd, uIndices);
 }
@@ -1286,7 +1473,7 @@ void SMPModel::sankeyOutput(string outputFile, string dbName, string scenarioId)
     return;
 }
 
-// JAH 20160801 changed to refer to model sqlFlags vector to decide
+// JAH 20160801 changed to refer to the model's logging rules to decide
 // whether or not to populate the table
 void SMPModel::showVPHistory() const {
     if (numAct != actrs.size()) {
@@ -1296,34 +1483,17 @@ void SMPModel::showVPHistory() const {
       throw KException("SMPModel::showVPHistory: dimension count in error");
     }
 
-    // first need to get the group ID for this table
-    // so then we can get the flag to populate the table or not
-    // note the implicit assumption that there will never be 43+ groups :-)
-    unsigned int grpID = 42;
-    for (unsigned int t = 0; t<KTables.size(); t++)
-    {
-        if (KTables[t]->tabName == "VectorPosition")
-        {
-            grpID = KTables[t]->tabGrpID;
-            break;
-        }
-    }
-    // be sure that it found this table
-    if (grpID == 42) {
-      throw KException("SMPModel::showVPHistory: VectorPosition table wasn't found in the group of tables");
-    }
-    if (grpID >= sqlFlags.size()) {
-      throw KException(string("SMPModel::showVPHistory: invalid group id in sqlflags: ") + std::to_string(grpID));
-    }
+    const KBase::LogPolicy::Rule & vpRule = logRule("VectorPosition");
+    const unsigned int finalT = history.size() - 1;
 
     // JAH 20160801 only populate the table if this group is turned on
-    if (sqlFlags[grpID])
+    if (vpRule.on)
     {
         string sql = "INSERT INTO VectorPosition "
           "(ScenarioId, Turn_t, Act_i, Dim_k, Pos_Coord, Idl_Coord, Mover_BargnId)"
           "VALUES ('" + scenId + "', :turn_t, :act_i, :dim_k, :pos_coord, :idl_coord, :mover_bgnId)";
 
-        query.prepare(QString::fromStdString(sql));
+        KBase::SQLBatch vpBatch(sql, 6, "SMPModel::showVPHistory");
 
         // Prepared statements cache the execution plan for a query after the query optimizer has
         // found the best plan, so there is no big gain with simple insertions.
@@ -1354,24 +1524,24 @@ void SMPModel::showVPHistory() const {
                     const double pCoord = (*vpit)(k, 0) * 100.0; // Use the scale of [0,100]
                     // have to print "100.0" sometimes
                     actorPosHistory += KBase::getFormattedString(" %5.1f", pCoord);
-                    query.bindValue(":turn_t", t);
-                    query.bindValue(":act_i", i);
-                    query.bindValue(":dim_k", k);
-                    query.bindValue(":pos_coord", pCoord);
+                    // a fork's earlier turns are its parent's
+                    if ((t < forkTurn) || !(vpRule.selected(t, finalT) && vpRule.sample(rngSeed, t, i, k))) {
+                        continue;
+                    }
+                    vpBatch.add(t);
+                    vpBatch.add(i);
+                    vpBatch.add(k);
+                    vpBatch.add(pCoord);
                     const double iCoord = vidl(k, 0) * 100.0; // Log at the scale of [0,100];
-                    query.bindValue(":idl_coord", iCoord);
+                    vpBatch.add(iCoord);
 
                     // This try block is necessary to make sure there is a bargin which caused the move
                     try {
-                      query.bindValue(":mover_bgnId",  (qulonglong)(sst->getPosMoverBargain(i)));
+                      vpBatch.add(sst->getPosMoverBargain(i));
                     }
                     catch (const std::out_of_range& oor) { // exception thrown by std::map::at() method
                       // Insert a null value
-                      query.bindValue(":mover_bgnId", QVariant(QVariant::Int));
-                    }
-                    if (!query.exec()) {
-                      LOG(INFO) << query.lastError().text().toStdString();
-                      throw KException("SMPModel::showVPHistory: Could not write into VectorPosition table");
+                      vpBatch.add(KBase::SQLValue());
                     }
                 }
                 LOG(INFO) << actorPosHistory;
@@ -1379,6 +1549,8 @@ void SMPModel::showVPHistory() const {
             }
         }
 
+        sqlWrite(std::move(vpBatch));
+
         qtDB->commit();
     }
 
@@ -1388,7 +1560,7 @@ void SMPModel::showVPHistory() const {
     vector<VUI> unqHist = {};
     for (unsigned int t = 0; t < history.size(); t++) {
         auto sst = (SMPState*)history[t];
-        if (numAct != sst->aUtil.size()) { // should be fully initialized
+        if (!sst->aUtilSet()) { // should be fully initialized
           throw KException("SMPModel::showVPHistory: Each actor must have a utility value");
         }
         auto pn = sst->pDist(-1);
@@ -1484,19 +1656,34 @@ void SMPModel::displayModelParams(SMPModel *md0)
     LOG(INFO) << "BargnModel:" << md0->brgnMod;
 }
 
-string SMPModel::runModel(vector<bool> sqlFlags,
-                          string inputDataFile, uint64_t seed, bool saveHist, vector<int> modelParams) {
+string SMPModel::runModel(const KBase::LogPolicy & logPolicy,
+                          string inputDataFile, uint64_t seed, bool saveHist, vector<int> modelParams,
+                          const SMPRunOptions & opts) {
     if (md0 != nullptr) {
         delete md0;
         md0 = nullptr;
     }
 
+    SMPRun r = runScenario(logPolicy, inputDataFile, seed, saveHist, modelParams, opts);
+    if (!r.ok()) {
+        lastExceptionMsg = r.error;
+        return "";
+    }
+    md0 = r.release();
+    return md0->getScenarioID();
+}
+
+SMPRun SMPModel::runScenario(const KBase::LogPolicy & logPolicy,
+                             string inputDataFile, uint64_t seed, bool saveHist, vector<int> modelParams,
+                             const SMPRunOptions & opts) {
+    SMPRun r;
+
     // Supported files for input data: xml, csv
     size_t dotPos = inputDataFile.find_last_of(".");
     if (string::npos == dotPos) { // A file name without extension
-      lastExceptionMsg = "Error: Input file name without extension is invalid.";
-      LOG(INFO) << lastExceptionMsg;
-      return "";
+      r.error = "Error: Input file name without extension is invalid.";
+      LOG(INFO) << r.error;
+      return r;
     }
 
     string fileExt = inputDataFile.substr(dotPos+1);
@@ -1507,124 +1694,143 @@ string SMPModel::runModel(vector<bool> sqlFlags,
 
     // Make sure the file extension is either csv or xml only
     if((0 != fileExt.compare("csv")) && (0 != fileExt.compare("xml"))) {
-      lastExceptionMsg = "Error: Only xml or csv files supported.";
-      LOG(INFO) << lastExceptionMsg;
-      return "";
+      r.error = "Error: Only xml or csv files supported.";
+      LOG(INFO) << r.error;
+      return r;
     }
 
+    SMPModel * md = nullptr;
     if (fileExt == "xml") {
       try {
-        md0 = xmlRead(inputDataFile, sqlFlags);
+        md = xmlRead(inputDataFile, logPolicy.groups());
       }
       catch (KException &ke) {
-        lastExceptionMsg = ke.msg;
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+        r.error = ke.msg;
+        return r;
       }
       catch (std::exception &std_ex) {
-        lastExceptionMsg = std_ex.what();
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+        r.error = std_ex.what();
+        return r;
       }
       catch (...) {
-        lastExceptionMsg = "SMPModel::runModel: Unknown Exception Caught from xmlRead";
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+        r.error = "SMPModel::runScenario: Unknown Exception Caught from xmlRead";
+        return r;
       }
 
-      if (nullptr == md0) {
-        lastExceptionMsg = "Model object couldn't be created in xmlRead";
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+      if (nullptr == md) {
+        r.error = "Model object couldn't be created in xmlRead";
+        return r;
       }
 
         if (-1 != seed) {
-            md0->setSeed(seed);
+            md->setSeed(seed);
             LOG(INFO) << KBase::getFormattedString(
-              "Using PRNG seed provided by the user: %020llu", md0->getSeed());
+              "Using PRNG seed provided by the user: %020llu", md->getSeed());
         }
         else {
             LOG(INFO) << KBase::getFormattedString(
-              "Using PRNG seed provided by xml file: %020llu", md0->getSeed());
+              "Using PRNG seed provided by xml file: %020llu", md->getSeed());
         }
     }
     else if (fileExt == "csv") {
       try {
-        md0 = csvRead(inputDataFile, seed, sqlFlags);
+        md = csvRead(inputDataFile, seed, logPolicy.groups());
       }
       catch (KException &ke) {
-        lastExceptionMsg = ke.msg;
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+        r.error = ke.msg;
+        return r;
       }
       catch (std::exception &std_ex) {
-        lastExceptionMsg = std_ex.what();
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+        r.error = std_ex.what();
+        return r;
       }
       catch (...) {
-        lastExceptionMsg = "SMPModel::runModel: Unknown Exception Caught from csvRead";
-        //LOG(INFO) << lastExceptionMsg;
-        return "";
+        r.error = "SMPModel::runScenario: Unknown Exception Caught from csvRead";
+        return r;
       }
 
-      if (nullptr == md0) {
-        lastExceptionMsg = "Model object couldn't be created in csvRead";
-        LOG(INFO) << lastExceptionMsg;
-        return "";
+      if (nullptr == md) {
+        r.error = "Model object couldn't be created in csvRead";
+        LOG(INFO) << r.error;
+        return r;
       }
-        //md0 = csvRead(inputDataFile, seed, sqlFlags);
     }
 
     if (!modelParams.empty()) {
-        SMPModel::updateModelParameters(md0, modelParams);
+        SMPModel::updateModelParameters(md, modelParams);
     }
 
-    displayModelParams(md0);
-
-    auto cleanup = [] {
-      md0->releaseDB();
-
-      delete md0;
-      md0 = nullptr;
-    };
+    displayModelParams(md);
 
     try {
-      configExec(md0);
+      md->setLogPolicy(logPolicy);
+      md->pceSolver = opts.pceSolver;
+      md->checkpointPath = opts.checkpointFile;
+      md->checkpointEvery = opts.checkpointTurns;
+      if (!opts.resumeFile.empty()) {
+        md->resume(opts.resumeFile);
+      }
+      configExec(md);
 
-      md0->releaseDB();
+      md->releaseDB();
       if (saveHist) {
-        md0->sankeyOutput(fileName);
+        md->sankeyOutput(fileName);
       }
     }
     catch (KException &ke) {
-      lastExceptionMsg = ke.msg;
-      LOG(INFO) << lastExceptionMsg;
-      //md0->releaseDB();
-
-      //delete md0;
-      //md0 = nullptr;
-      cleanup();
-      return "";
+      r.error = ke.msg;
     }
     catch (std::exception &std_ex) {
-      lastExceptionMsg = std_ex.what();
-      LOG(INFO) << lastExceptionMsg;
-      cleanup();
-      return "";
+      r.error = std_ex.what();
     }
     catch (...) {
-      lastExceptionMsg = "SMPModel::runModel: Unknown Exception Caught from configExec";
-      LOG(INFO) << lastExceptionMsg;
-      cleanup();
-      return "";
-    }
-    //md0->releaseDB();
-    //if (saveHist)
-    //{
-    //    md0->sankeyOutput(fileName);
-    //}
-    return md0->getScenarioID();
+      r.error = "SMPModel::runScenario: Unknown Exception Caught from configExec";
+    }
+    if (!r.error.empty()) {
+      LOG(INFO) << r.error;
+      md->releaseDB();
+      delete md;
+      return r;
+    }
+
+    r.md = md;
+    r.scenarioID = md->getScenarioID();
+    return r;
+}
+
+vector<SMPRun> SMPModel::runScenarios(const KBase::LogPolicy & logPolicy,
+                                      const vector<string> & inputDataFiles, uint64_t seed, bool saveHist,
+                                      vector<int> modelParams, unsigned int maxPar,
+                                      const SMPRunOptions & opts) {
+    const unsigned int n = inputDataFiles.size();
+    vector<SMPRun> runs(n);
+    if (!opts.checkpointFile.empty() || !opts.resumeFile.empty()) {
+        for (auto & r : runs) {
+            r.error = "SMPModel::runScenarios: checkpoints are for one run at a time";
+        }
+        return runs;
+    }
+    if (0 == maxPar) {
+        maxPar = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Each run gets a thread of its own, rather than a task in the shared pool,
+    // because its turns wait on its writer; the runs share the pool for their steps.
+    std::atomic<unsigned int> next(0);
+    auto runner = [&]() {
+        for (unsigned int k = next++; k < n; k = next++) {
+            runs[k] = runScenario(logPolicy, inputDataFiles[k], seed, saveHist, modelParams, opts);
+        }
+        return;
+    };
+    vector<std::thread> thrds = {};
+    for (unsigned int p = 0; p < std::min(maxPar, n); p++) {
+        thrds.push_back(std::thread(runner));
+    }
+    for (auto & t : thrds) {
+        t.join();
+    }
+    return runs;
 }
 
 string SMPModel::csvReadExec(uint64_t seed, string inputCSV, vector<bool> f, vector<int> par) {
@@ -1680,25 +1886,39 @@ void SMPModel::configExec(SMPModel * md0)
     // log data, or not
     // JAH 20160731 added to either log all information tables or none
     // this takes care of info re. actors, dimensions, scenario, capabilities, and saliences
-    if (md0->sqlFlags[0])
-    {
-        md0->LogInfoTables();
-    }
-
-    if (md0->sqlFlags[4]) {
-        for (auto turn = 0; turn < nState; ++turn) {
+    // each table checks its own rule
+    md0->LogInfoTables();
+
+    // A fork records only its own turns; the earlier ones are its parent's.
+    const unsigned int finalT = nState - 1;
+    const KBase::LogPolicy::Rule & utilRule = md0->logRule("PosUtil");
+    for (unsigned int turn = md0->forkTurn; turn < nState; ++turn) {
+        if (utilRule.selected(turn, finalT)) {
             md0->sqlAUtil(turn);
         }
     }
 
     // JAH 20160802 added logging control flag for the last state
-    // also added the sqlPosVote and sqlPosEquiv calls to get the final state
-    if (md0->sqlFlags[1])
-    {
-        md0->sqlPosProb(nState - 1);
-        md0->sqlPosEquiv(nState - 1);
-        md0->sqlPosVote(nState - 1);
+    // also added the sqlPosVote and sqlPosEquiv calls to get the final state.
+    // The run wrote the turns selected outright; now that the final turn
+    // is known, add the last-turns windows.
+    for (unsigned int turn = md0->forkTurn; turn < nState; ++turn) {
+        if (md0->logRule("PosProb").catchUp(turn, finalT)) {
+            md0->sqlPosProb(turn);
+        }
+        if (md0->logRule("PosEquiv").catchUp(turn, finalT)) {
+            md0->sqlPosEquiv(turn);
+        }
+        if (md0->logRule("PosVote").catchUp(turn, finalT)) {
+            md0->sqlPosVote(turn);
+        }
+        // the final state never looked for challenges
+        if (turn < finalT) {
+            auto st = dynamic_cast<SMPState *>(md0->history[turn]);
+            st->regenChlgs(turn, finalT);
+        }
     }
+    md0->releaseHeldRows(finalT);
 
     LOG(INFO) << "Completed model run";
     LOG(INFO) << KBase::getFormattedString(
@@ -1745,38 +1965,47 @@ vector<int> SMPModel::getDefaultModelParameters()
 }
 
 double SMPModel::getQuadMapPoint(size_t t, size_t est_h, size_t aff_k, size_t init_i, size_t rcvr_j) {
-    auto smpState = md0->history[t];
-    auto autil = smpState->aUtil;
-    double uii = autil[est_h](init_i, init_i);
-    double uij = autil[est_h](init_i, rcvr_j);
-    double uji = autil[est_h](rcvr_j, init_i);
-    double ujj = autil[est_h](rcvr_j, rcvr_j);
+    return md0->quadMapPoint(t, est_h, aff_k, init_i, rcvr_j);
+}
+
+double SMPModel::quadMapPoint(size_t t, size_t est_h, size_t aff_k, size_t init_i, size_t rcvr_j) const {
+    auto smpState = history[t];
+    if (!smpState->aUtilSet()) {
+      throw KException("SMPModel::getQuadMapPoint: utilities are not set for this turn");
+    }
+    auto autil = [smpState](size_t h, size_t i, size_t j) {
+        return smpState->aUtilAt(h, i, j);
+    };
+    double uii = autil(est_h, init_i, init_i);
+    double uij = autil(est_h, init_i, rcvr_j);
+    double uji = autil(est_h, rcvr_j, init_i);
+    double ujj = autil(est_h, rcvr_j, rcvr_j);
 
     // h's estimate of utility to k of status-quo positions of i and j
-    const double euSQ = autil[est_h](aff_k, init_i) + autil[est_h](aff_k, rcvr_j);
+    const double euSQ = autil(est_h, aff_k, init_i) + autil(est_h, aff_k, rcvr_j);
     if ((0.0 > euSQ) || (euSQ > 2.0)) {
       throw KException("SMPModel::getQuadMapPoint: euSQ should be between 0.0 and 2.0");
     }
 
     // h's estimate of utility to k of i defeating j, so j adopts i's position
-    const double uhkij = autil[est_h](aff_k, init_i) + autil[est_h](aff_k, init_i);
+    const double uhkij = autil(est_h, aff_k, init_i) + autil(est_h, aff_k, init_i);
     if ((0.0 > uhkij) || (uhkij > 2.0)) {
       throw KException("SMPModel::getQuadMapPoint: uhkij should be between 0.0 and 2.0");
     }
 
     // h's estimate of utility to k of j defeating i, so i adopts j's position
-    const double uhkji = autil[est_h](aff_k, rcvr_j) + autil[est_h](aff_k, rcvr_j);
+    const double uhkji = autil(est_h, aff_k, rcvr_j) + autil(est_h, aff_k, rcvr_j);
     if ((0.0 > uhkji) || (uhkji > 2.0)) {
       throw KException("SMPModel::getQuadMapPoint: uhkji should be between 0.0 and 2.0");
     }
 
-    auto ai = ((const SMPActor*)(md0->actrs[init_i]));
+    auto ai = ((const SMPActor*)(actrs[init_i]));
     double si = KBase::sum(ai->vSal);
     if ((0 >= si) || (si > 1)) {
       throw KException("SMPModel::getQuadMapPoint: si should be between 0 and 1");
     }
     double ci = ai->sCap;
-    auto aj = ((const SMPActor*)(md0->actrs[rcvr_j]));
+    auto aj = ((const SMPActor*)(actrs[rcvr_j]));
     double sj = KBase::sum(aj->vSal);
     if ((0 >= sj) || (sj > 1)) {
       throw KException("SMPModel::getQuadMapPoint: sj should be between 0 and 1");
@@ -1784,7 +2013,7 @@ double SMPModel::getQuadMapPoint(size_t t, size_t est_h, size_t aff_k, size_t in
     double cj = aj->sCap;
     const double minCltn = 1E-10;
 
-    auto contribs = calcContribs(md0->vrCltn, si*ci, sj*cj, tuple<double, double, double, double>(uii, uij, uji, ujj));
+    auto contribs = calcContribs(vrCltn, si*ci, sj*cj, tuple<double, double, double, double>(uii, uij, uji, ujj));
 
     double chij = get<0>(contribs); // strength of complete coalition supporting i over j (initially empty)
     double chji = get<1>(contribs); // strength of complete coalition supporting j over i (initially empty)
@@ -1796,19 +2025,19 @@ double SMPModel::getQuadMapPoint(size_t t, size_t est_h, size_t aff_k, size_t in
     // we assess the overall coalition strengths by adding up the contribution of
     // individual actors (including i and j, above). We assess the contribution of third
     // parties (n) by looking at little coalitions in the hypothetical (in:j) or (i:nj) contests.
-    for (unsigned int n = 0; n < md0->numAct; n++) {
+    for (unsigned int n = 0; n < numAct; n++) {
         if ((n != init_i) && (n != rcvr_j)) { // already got their influence-contributions
-            auto an = ((const SMPActor*)(md0->actrs[n]));
+            auto an = ((const SMPActor*)(actrs[n]));
 
             double cn = an->sCap;
             double sn = KBase::sum(an->vSal);
-            double uni = autil[est_h](n, init_i);
-            double unj = autil[est_h](n, rcvr_j);
-            double unn = autil[est_h](n, n);
+            double uni = autil(est_h, n, init_i);
+            double unj = autil(est_h, n, rcvr_j);
+            double unn = autil(est_h, n, n);
 
             // notice that each third party starts afresh,
             // considering only contributions of principals and itself
-            double pin = Actor::vProbLittle(md0->vrCltn, sn*cn, uni, unj, contrib_i_ij, contrib_j_ij);
+            double pin = Actor::vProbLittle(vrCltn, sn*cn, uni, unj, contrib_i_ij, contrib_j_ij);
 
             if (0.0 > pin) {
               throw KException("SMPModel::getQuadMapPoint: pin must be non-negative");
@@ -1817,7 +2046,7 @@ double SMPModel::getQuadMapPoint(size_t t, size_t est_h, size_t aff_k, size_t in
               throw KException("SMPModel::getQuadMapPoint: pin must not be more than 1.0");
             }
             double pjn = 1.0 - pin;
-            auto vt_uv_ul = Actor::thirdPartyVoteSU(sn*cn, md0->vrCltn, md0->tpCommit, pin, pjn, uni, unj, unn);
+            auto vt_uv_ul = Actor::thirdPartyVoteSU(sn*cn, vrCltn, tpCommit, pin, pjn, uni, unj, unn);
             const double vnij = get<0>(vt_uv_ul);
             chij = (vnij > 0) ? (chij + vnij) : chij;
             if (0 >= chij) {
@@ -2215,7 +2444,8 @@ void SMPModel::randomSMP(unsigned int numA, unsigned int sDim, bool accP, uint64
     const KBase::VPModel vpm = md0->vpm;
     const KBase::PCEModel pcem = md0->pcem;
 
-    KMatrix p = Model::scalarPCE(numA, numA, w, u, vr, vpm, pcem, ReportingLevel::Medium);
+    KMatrix p = Model::scalarPCE(numA, numA, w, u, vr, vpm, pcem, ReportingLevel::Medium,
+                                  md0->pceSolver);
 
     LOG(INFO) << "Expected utility to actors:";
     (u*p).mPrintf(" %.3f ");
@@ -2245,6 +2475,89 @@ void SMPModel::randomSMP(unsigned int numA, unsigned int sDim, bool accP, uint64
     return;
 }
 
+void SMPModel::benchStalledTurn(unsigned int numA, uint64_t s, vector<bool> f) {
+    const unsigned int nd = 2;
+    if (Model::minNumActor > numA) {
+      throw KException("SMPModel::benchStalledTurn: too few actors");
+    }
+    auto md = new SMPModel("", s, f);
+    for (unsigned int k = 0; k < nd; k++) {
+        md->addDim(KBase::getFormattedString("SDim-%02u", k));
+    }
+    auto st0 = new SMPState(md);
+    md->addState(st0);
+    for (unsigned int i = 0; i < numA; i++) {
+        auto ai = new SMPActor(KBase::getFormattedString("SActor-%02u", i), "Random spatial actor");
+        ai->randomize(md->rng, nd);
+        md->addActor(ai);
+        st0->pushPstn(new VctrPstn(KMatrix::uniform(md->rng, nd, 1, 0.0, 1.0)));
+    }
+    st0->setAccomodate(1.0);
+    st0->idealsFromPstns();
+
+    // a state after st0, as doBCN and newIdeals would make it, in which only
+    // the first numMoved actors moved; with no flags, nothing can be reused
+    auto nextState = [md, st0, numA](unsigned int numMoved, bool flagsP) {
+        auto st = new SMPState(md);
+        md->addState(st);
+        for (unsigned int i = 0; i < numA; i++) {
+            auto pi = new VctrPstn(*((const VctrPstn*)(st0->pstns[i])));
+            if (i < numMoved) {
+                (*pi)(0, 0) = 0.99 * (*pi)(0, 0) + 0.005;
+            }
+            st->pstns[i] = pi;
+        }
+        st->setAccomodate(1.0);
+        st->idealsFromPstns();
+        if (flagsP) {
+            st->pstnMoved = vector<bool>(numA, false);
+            st->idealMoved = vector<bool>(numA, false);
+            for (unsigned int i = 0; i < numMoved; i++) {
+                st->pstnMoved[i] = true;
+                st->idealMoved[i] = true;
+            }
+        }
+        return st;
+    };
+    // each state follows st0, so is dropped from the history once timed
+    auto timeAUtil = [md](SMPState * st) {
+        auto t0 = std::chrono::steady_clock::now();
+        st->setUENdx();
+        st->setAUtil(-1, ReportingLevel::Silent);
+        const double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        md->history.pop_back();
+        return dt;
+    };
+
+    st0->setUENdx();
+    st0->setAUtil(-1, ReportingLevel::Silent);
+    auto stFull = nextState(0, false);
+    const double dtFull = timeAUtil(stFull);
+    auto stOne = nextState(1, true);
+    const double dtOne = timeAUtil(stOne);
+    auto stNone = nextState(0, true);
+    const double dtNone = timeAUtil(stNone);
+
+    // the stalled state must come out as if it had been worked out afresh
+    bool sameP = (0.0 == KBase::norm(stNone->nra - stFull->nra))
+      && (stNone->aUtil.size() == stFull->aUtil.size());
+    for (unsigned int h = 0; sameP && (h < stNone->aUtil.size()); h++) {
+        sameP = (0.0 == KBase::norm(stNone->aUtil[h] - stFull->aUtil[h]));
+    }
+    delete stFull;
+    delete stOne;
+    delete stNone;
+
+    LOG(INFO) << KBase::getFormattedString(
+      "setAllAUtil with %u actors: %.3f ms with nothing reused, %.3f ms after one actor moved,"
+      " %.3f ms after none did (risk attitudes and utilities %s)",
+      numA, 1000 * dtFull, 1000 * dtOne, 1000 * dtNone,
+      sameP ? "as if worked out afresh" : "NOT as if worked out afresh");
+
+    delete md;
+    return;
+}
+
 uint SMPModel::getIterationCount() {
   return md0->history.size();
 }
@@ -2261,6 +2574,45 @@ SMPModel * SMPModel::getSmpModel() {
   return md0;
 }
 
+uint64_t SMPModel::newBargainIDs(unsigned int n) {
+  return nextBargainID.fetch_add(n);
+}
+
+// --------------------------------------------
+
+SMPRun::SMPRun() {
+}
+
+SMPRun::~SMPRun() {
+  delete md;
+  md = nullptr;
+}
+
+SMPRun::SMPRun(SMPRun && that) {
+  *this = std::move(that);
+}
+
+SMPRun & SMPRun::operator=(SMPRun && that) {
+  if (this != &that) {
+    delete md;
+    md = that.md;
+    that.md = nullptr;
+    scenarioID = std::move(that.scenarioID);
+    error = std::move(that.error);
+  }
+  return *this;
+}
+
+SMPModel * SMPRun::release() {
+  SMPModel * m = md;
+  md = nullptr;
+  return m;
+}
+
+unsigned int SMPRun::iterationCount() const {
+  return (nullptr == md) ? 0 : md->history.size();
+}
+
 }; // end of namespace
 
 // --------------------------------------------
@@ -24,14 +24,17 @@
 #ifndef SMP_LIB_H
 #define SMP_LIB_H
 
+#include <atomic>
 #include <string>
 #include <map>
+#include <mutex>
 
 #include <easylogging++.h>
 #include "sqlite3.h"
 #include "kutils.h"
 #include "prng.h"
 #include "kmatrix.h"
+#include "kstats.h"
 #include "gaopt.h"
 #include "kmodel.h"
 
@@ -50,6 +53,7 @@ using KBase::PRNG;
 using KBase::Actor;
 using KBase::Position;
 using KBase::State;
+using KBase::UtilProvider;
 using KBase::Model;
 using KBase::VotingRule;
 using KBase::ReportingLevel;
@@ -64,6 +68,8 @@ using eduChlgsI = std::map<unsigned int /*j*/, tuple<double, double> >;
 class SMPActor;
 class SMPState;
 class SMPModel;
+class SMPRun;
+class SMPSweep;
 
 const string appVersion = "0.1.1";
 //const bool testProbPCE = true;
@@ -95,7 +101,7 @@ ostream& operator<< (ostream& os, const InterVecBrgn& ivb);
 // Plain-Old-Data
 struct BargainSMP {
 public:
-  BargainSMP(const SMPActor* ai, const SMPActor* ar, const VctrPstn & pi, const VctrPstn & pr);
+  BargainSMP(const SMPActor* ai, const SMPActor* ar, const VctrPstn & pi, const VctrPstn & pr, uint64_t id);
   ~BargainSMP();
 
 
@@ -105,8 +111,59 @@ public:
   VctrPstn posRcvr = VctrPstn();
   uint64_t getID() const;
 protected:
-  static uint64_t highestBargainID;
-  uint64_t myBargainID = 0;
+  uint64_t myBargainID = 0; // see SMPState::firstBargainID
+};
+
+// -------------------------------------------------
+// What probEduChlg records for the Challenge Tables, one entry per (h,k,i,j)
+// call which the log policy keeps. The third parties' (prob, util_v, util_l) depend
+// only on (h,i,j), so all calls for the same challenge share one na-by-3 block of tpv,
+// held by whichever log first computed it: chlgLogs[tpvLog].tpv[tpvAt + 3*n + c].
+// Entries whose third parties are not recorded have tpvLog == ChlgCache::noLog.
+// Each thread appends only to its own ChlgLog, so recording needs neither
+// a lock nor any string formatting.
+struct ChlgEntry {
+  unsigned int h = 0;
+  unsigned int k = 0;
+  unsigned int i = 0;
+  unsigned int j = 0;
+  unsigned int tpvLog = 0;
+  size_t tpvAt = 0;
+  double phij = 0.0;
+  double euSQ = 0.0;
+  double euVict = 0.0;
+  double euCntst = 0.0;
+  double euChlg = 0.0;
+};
+
+struct ChlgLog {
+  vector<ChlgEntry> entries = {};
+  vector<double> tpv = {};
+};
+
+// The coalition strengths behind i's challenges depend on (h,i,j), but not on
+// the affected actor k. doBCN(i) keeps one of these while it and its calcUtils
+// thread evaluate i's challenges, so each (h,j) is worked out once rather than
+// once for every k. Both threads use it, so lookups take a (brief) lock.
+class ChlgCache {
+public:
+  explicit ChlgCache(unsigned int n);
+
+  static const unsigned int noLog = ~0u; // the coalitions were computed without recording
+
+  bool find(unsigned int h, unsigned int j, double & chij, double & chji,
+            unsigned int & tpvLog, size_t & tpvAt);
+  void store(unsigned int h, unsigned int j, double chij, double chji,
+             unsigned int tpvLog, size_t tpvAt);
+
+protected:
+  unsigned int na = 0;
+  std::mutex cacheLock;
+  vector<bool> done = {}; // all of these are indexed by h*na + j
+  vector<double> cij = {};
+  vector<double> cji = {};
+  vector<unsigned int> tLog = {};
+  vector<size_t> tAt = {};
 };
 
 // -------------------------------------------------
@@ -147,7 +204,7 @@ public:
   // other actors, and not all positions can be represented as a list of doubles.
   static BargainSMP* interpolateBrgn(const SMPActor* ai, const SMPActor* aj,
                                      const VctrPstn* posI, const VctrPstn * posJ,
-                                     double prbI, double prbJ, InterVecBrgn ivb);
+                                     double prbI, double prbJ, InterVecBrgn ivb, uint64_t id);
 
 
 protected:
@@ -162,7 +219,31 @@ protected:
 
 };
 
+// Supplies aUtil[h](i,j) = bsUtil(vDiff(i,j), r^h_i) on demand, rather than
+// storing na matrices of na-by-na utilities for every state. It keeps its own
+// copies of the distance matrix and of the na-by-na table of risk attitudes
+// (row h holds h's estimates of every actor's), so it is O(n^2) in memory and
+// independent of later changes to the state.
+class SMPUtilProvider : public UtilProvider {
+public:
+  SMPUtilProvider(const KMatrix & vd, const KMatrix & rha);
+  virtual ~SMPUtilProvider();
+
+  virtual unsigned int numAct() const;
+  virtual double util(unsigned int h, unsigned int i, unsigned int j) const;
+  virtual KMatrix utilMatrix(unsigned int h) const;
+
+protected:
+  // Both tables are na-by-na and kept row-major in flat vectors, because
+  // util() sits in the innermost loops and indexes them directly.
+  unsigned int na = 0;
+  vector<double> vDiff = {}; // vDiff[i*na + j], as vDiff(i,j) in SMPState
+  vector<double> rhi = {}; // rhi[h*na + i] = h's estimate of i's risk attitude
+};
+
+
 class SMPState : public State {
+  friend class SMPModel; // which saves and restores states in checkpoints
 
 public:
   explicit SMPState(Model * m);
@@ -220,23 +301,49 @@ public:
   // initialize the actors' ideals from the given list of VctrPstn.
   // If the list is omitted or empty, it uses their current positions
   void idealsFromPstns(const vector<VctrPstn> &  ps = {});
-  VctrPstn getIdeal(unsigned int n) const;
+  const VctrPstn & getIdeal(unsigned int n) const;
 
   uint64_t getPosMoverBargain(unsigned int actor) const;
 
   void setPosMoverBargain(unsigned int actor, uint64_t bargainID);
 
+  // Recompute the challenges that doBCN evaluates in turn t and record them in the
+  // Challenge Tables. Needs only the actors, aUtil and the accommodation matrix.
+  // Given the final turn of a run, it records only the turns which the tables'
+  // last-turns windows still want (see LogPolicy::Rule::catchUp).
+  void regenChlgs(unsigned int t, unsigned int finalT = KBase::LogPolicy::noTurn);
+
 protected:
+  // positions are equivalent only when closer than posTol, so only nearby ones are compared
+  virtual tuple<VUI, VUI> uniqueEquivNdx() const;
 
 private:
 
-  void calcUtils(unsigned int i, unsigned int bestJ) const;  // i == actor id
-  mutable std::mutex utilDataLock;
-  mutable std::multimap<string, KMatrix> tpvData;
-  mutable std::multimap<string, double>phijData;
-  mutable std::multimap<string, vector<double>> euData;
+  // The state before, if setAllAUtil can reuse its results: both lists of changes
+  // are known, and it has the distances, risk attitudes and utilities; else nullptr.
+  const SMPState * reusableState() const;
+
+  // setVDiff, copying from s0 every distance whose ideal and position are unchanged
+  void updateVDiff(const SMPState * s0);
+
+  void calcUtils(unsigned int i, unsigned int bestJ, ChlgCache * cache) const;  // i == actor id
+
+  // Challenge records, two logs per initiator: chlgLogs[2*i] is written only by
+  // the doBCN(i) thread and chlgLogs[2*i+1] only by its calcUtils thread.
+  // Sized by doBCN() before the threads start; empty when not recording.
+  mutable vector<ChlgLog> chlgLogs = {};
+  ChlgLog * chlgLog(unsigned int i, bool calcThrd) const;
   void recordProbEduChlg() const;
 
+  // The rules of UtilChlg, ProbVict and TPProbVictLoss, or nullptr for those
+  // not recorded in this turn: during the run, or (given finalT) after it.
+  const KBase::LogPolicy::Rule * chlgRules[3] = { nullptr, nullptr, nullptr };
+  bool setChlgLogging(unsigned int finalT);
+  // whether h's estimate of the effect on k of i->j is recorded, in any of the tables
+  bool chlgEntryLogged(unsigned int h, unsigned int k, unsigned int i, unsigned int j) const;
+  // whether h's estimate of the third parties' votes in i->j is recorded
+  bool chlgTPLogged(unsigned int h, unsigned int i, unsigned int j) const;
+
   // this sets the values in all the AUtil matrices
   virtual void setAllAUtil(ReportingLevel rl);
 
@@ -248,14 +355,28 @@ private:
   // risk-aware probabilities are uProb
 
   KMatrix nra = KMatrix();
+  KMatrix nraProb = KMatrix(); // probability of each actor's position, from which nra was inferred
+
+  // Which actors' positions and ideals differ from those in the state before, as
+  // doBCN and newIdeals find when they make this one; empty when that is not known
+  // (the first turn or a fork's first turn). setAllAUtil then copies the distances
+  // which do not depend on them, and everything if nothing changed.
+  vector<bool> pstnMoved = {};
+  vector<bool> idealMoved = {};
 
   SMPState* doBCN();
 
   void doBCN(unsigned int i);
 
   // returns estimated probability k wins (given likely coaltiions), and expected delta-util of that challenge.
-  // If desired, record in SQLite.
-  tuple<double, double> probEduChlg(unsigned int h, unsigned int k, unsigned int i, unsigned int j, bool sqlP) const;
+  // If a log is given, record the details there for SQLite.
+  // If a cache is given, reuse the coalitions for (h,i,j) from any earlier k.
+  tuple<double, double> probEduChlg(unsigned int h, unsigned int k, unsigned int i, unsigned int j,
+                                    ChlgLog * cLog, ChlgCache * cache) const;
+
+  // returns h's estimate of the strengths of the complete coalitions for and against i in i->j
+  tuple<double, double> chlgCoalitions(unsigned int h, unsigned int i, unsigned int j,
+                                       ChlgLog * cLog, size_t & tpvAt) const;
 
   // return best j, p[i>j], edu[i->j]
   tuple<int, double, double> bestChallenge(eduChlgsI &eduI) const;
@@ -268,20 +389,21 @@ private:
   KMatrix accomodate = KMatrix();
   bool identAccMat = true;
 
-  // rest the new ideal points, based on other's positions and one's old ideal point
+  // rest the new ideal points, based on other's positions and one's old ideal point,
+  // and note in idealMoved which of them changed
   void newIdeals();
 
   // return RMS distance between ideals and positions
   double posIdealDist(ReportingLevel rl = ReportingLevel::Silent) const;
 
   void updateBargnTable(const vector<vector<BargainSMP*>> & brgns,
-                        map<unsigned int, KBase::KMatrix>  actorBargains,
-                        map<unsigned int, unsigned int>  actorMaxBrgNdx) const;
+                        const vector<KBase::KMatrix> & actorBargains,
+                        const vector<unsigned int> & actorMaxBrgNdx) const;
 
   /**
    * Calculate all challenge utilities (i, i, i, j) which would be used to find the best challenge
    */
-  eduChlgsI bestChallengeUtils(unsigned int i /* initiator actor */) const;
+  eduChlgsI bestChallengeUtils(unsigned int i /* initiator actor */, ChlgCache * cache) const;
 
   // Record the bargain id that caused an actor to move in each turn
   using moverBargains = std::map<
@@ -296,16 +418,36 @@ private:
 
   std::mutex brgnsLock;
 
+  // doBCN(i) numbers its bargains from firstBargainID + i*bargainsPerActor, so
+  // that they do not depend on the order in which the threads run
+  static const unsigned int bargainsPerActor = 4;
+  uint64_t firstBargainID = 0;
+
   KBase::KMatrix w;
 
   SMPState* s2 = nullptr;
 
-  std::map<unsigned int, KBase::KMatrix> actorBargains;
-
-  std::map<unsigned int, unsigned int> actorMaxBrgNdx;
+  // Both are indexed by actor: actorBargains is filled by one batched scalarPCE
+  // before the updateBestBrgnPositions threads start, and actorMaxBrgNdx is sized
+  // then, so each thread fills its own entry without a lock.
+  vector<KBase::KMatrix> actorBargains = {}; // probability of each of k's bargains
+  vector<unsigned int> actorMaxBrgNdx = {}; // which of k's bargains was chosen
+
+  // The rest of what updateBestBrgnPositions(k) found, kept so that it can be
+  // logged in actor order by showBrgnPCE once all the threads are done
+  struct BrgnPCE {
+    KBase::KMatrix u_im = KBase::KMatrix(); // utility to each actor of each of k's bargains
+    KBase::KMatrix c = KBase::KMatrix(); // coalition strengths, from scalarPCE
+    KBase::KMatrix pv = KBase::KMatrix(); // pairwise victory probabilities, from scalarPCE
+    uint64_t chosenID = 0; // id of the chosen bargain
+    bool moved = false; // true if the chosen bargain changed k's position
+  };
+  vector<BrgnPCE> brgnPCEs = {};
+  void showBrgnPCE(unsigned int k) const;
 
   std::mutex mtxLock;
 
+  void setBrgnUtils(unsigned int k, double * u_im) const;
   void updateBestBrgnPositions(int k);
 
   vector<double> calcVotes(KMatrix w, KMatrix u, int actor) const;
@@ -338,7 +480,7 @@ private:
     unsigned int                        //actor k
   >;
   using BrgnVotes = vector<BrgnVote>;
-  vector<BrgnVotes> brgnVotes;
+  vector<BrgnVotes> brgnVotes; // indexed by actor, like actorBargains
 
   using BrgnUtil = tuple<
     unsigned int,      //turn id
@@ -346,28 +488,83 @@ private:
     KBase::KMatrix     //Util_mat
   >;
   using BrgnUtils = vector<BrgnUtil>;
-  BrgnUtils brgnUtils;
-  std::mutex brgnPosLock;
+  BrgnUtils brgnUtils; // indexed by actor, like actorBargains
+};
+
+// How a run is made, as distinct from the model parameters of its scenario.
+struct SMPRunOptions {
+  KBase::PCESolver pceSolver = KBase::PCESolver::Damped; // see Model::pceSolver
+
+  // Checkpointing: where to save checkpoints and how often (see
+  // Model::checkpointPath), and a checkpoint from which to resume, if any.
+  string checkpointFile = "";
+  unsigned int checkpointTurns = 0;
+  string resumeFile = "";
 };
 
 class SMPModel : public Model {
   friend class SMPState;
+  friend class SMPSweep; // which reads the parameters of the scenario it varies
 public:
   explicit SMPModel( string desc = "", uint64_t s=KBase::dSeed, vector<bool> f={}, string sceName = ""); // JAH 20160711 added rng seed
   virtual ~SMPModel();
 
   static const unsigned int maxDimDescLen = 256; // JAH 20160727 added
 
+  // Scenarios with at least this many actors compute aUtil on demand through an
+  // SMPUtilProvider instead of storing it; the values are the same either way.
+  // 0 means always; the default keeps the dense matrices for small scenarios.
+  static unsigned int implicitUtilActors;
+
   static double bsUtil(double sd, double R);
   static double bvDiff(const KMatrix & vd, const  KMatrix & vs);
   static double bvUtil(const KMatrix & vd, const  KMatrix & vs, double R);
 
-  static std::string runModel(std::vector<bool> sqlFlags,
-      std::string inputDataFile, uint64_t seed, bool saveHist, std::vector<int> modelParams = std::vector<int>());
+  // The log policy may be given as the five group flags, as before.
+  // The model is kept in md0 until the next call, or destroyModel.
+  static std::string runModel(const KBase::LogPolicy & logPolicy,
+      std::string inputDataFile, uint64_t seed, bool saveHist, std::vector<int> modelParams = std::vector<int>(),
+      const SMPRunOptions & opts = SMPRunOptions());
+
+  // The same, but re-entrant: the run uses no md0 and no lastExceptionMsg, and
+  // has a database connection of its own, so several may be made at once on
+  // different threads. The result holds the model, or what went wrong.
+  static SMPRun runScenario(const KBase::LogPolicy & logPolicy,
+      string inputDataFile, uint64_t seed, bool saveHist, vector<int> modelParams = vector<int>(),
+      const SMPRunOptions & opts = SMPRunOptions());
+
+  // runScenario for each input, at most maxPar at once (0 means one per hardware
+  // thread), each on a thread of its own. The results are in the order of the
+  // inputs. Checkpoints are for one run at a time, so they must not be set.
+  static vector<SMPRun> runScenarios(const KBase::LogPolicy & logPolicy,
+      const vector<string> & inputDataFiles, uint64_t seed, bool saveHist,
+      vector<int> modelParams = vector<int>(), unsigned int maxPar = 0,
+      const SMPRunOptions & opts = SMPRunOptions());
 
   // this sets up a standard configuration and runs it
   static void configExec(SMPModel * md0);
 
+  // Save the scenario, every state so far and what the run needs to continue.
+  virtual void saveCheckpoint(const string & path) override;
+
+  // Replace the history with that saved in the checkpoint, and remove what the
+  // run stored after it was taken, so that run() continues exactly as the
+  // interrupted run would have. The model must have been read from the same
+  // input, with the same parameters; if not, this throws KException.
+  void resume(const string & path);
+
+  // A what-if branch of this run, as a new scenario which continues from turn t.
+  // It shares this model's states before t (see Model::forkTurn), starts from a
+  // copy of state t, and has its own copies of the actors and parameters, so
+  // they may be changed before it is run with configExec. Its first turn is
+  // then worked out again under those changes. This model must outlive it.
+  SMPModel * fork(unsigned int t, string name = "", string desc = "") const;
+
+  // Fork the model of the last runModel at turn t, let edit change the fork,
+  // and run and record it. Returns the fork's scenario ID, or "" on error, as
+  // runModel does. Each fork costs only the turns from t on.
+  static string runFork(unsigned int t, const function<void(SMPModel *)> & edit, string name = "");
+
   // read, configure, and run from CSV
   static string csvReadExec(uint64_t seed, string inputCSV, vector<bool> f,
                           vector<int> par=vector<int>());
@@ -377,9 +574,20 @@ public:
 
   static void randomSMP(unsigned int numA, unsigned int sDim, bool accP, uint64_t s, vector<bool> f);
 
+  // Time SMPState::setAllAUtil on a random scenario with numA actors: for its
+  // first state, for a state after it in which one actor moved, and for one in
+  // which none did, which should cost next to nothing.
+  static void benchStalledTurn(unsigned int numA, uint64_t s, vector<bool> f);
+
   static SMPModel * csvRead(string fName, uint64_t s, vector<bool> f);
   static SMPModel * xmlRead(string fName,vector<bool> f);
 
+  // The first of n new, consecutive IDs for bargains of this run
+  uint64_t newBargainIDs(unsigned int n);
+
+  // h's estimate of the utility to k of i->j in turn t, on the quad map
+  double quadMapPoint(size_t t, size_t est_h, size_t aff_k, size_t init_i, size_t rcvr_j) const;
+
   static  SMPModel * initModel(vector<string> aName, vector<string> aDesc, vector<string> dName,
 	  const KMatrix & cap, // one row per actor
 	  const KMatrix & pos, // one row per actor, one column per dimension
@@ -441,6 +649,11 @@ public:
 
   static SMPModel * getSmpModel();
 
+  // Regenerate the Challenge Tables (UtilChlg, ProbVict, TPProbVictLoss) of a scenario
+  // already in the database, e.g. one run with --logmin, from its Information Tables
+  // and PosUtil. With no turns given, it does every turn which took a step.
+  static void regenChlgTables(const string & scenarioID, const vector<unsigned int> & turns = {});
+
 protected:
   //sqlite3 *smpDB = nullptr; // keep this protected, to ease multi-threading
   //string scenName = "Scen";
@@ -470,6 +683,8 @@ protected:
   SMPBargnModel brgnMod = SMPBargnModel::InitOnlyInterpSMPBM;
   // PWCompInterSMPBM, InitOnlyInterpSMPBM or InitRcvrInterpSMPBM;
 
+  std::atomic<uint64_t> nextBargainID{ 1000 };
+
 private:
   void releaseDB();
 
@@ -479,6 +694,149 @@ private:
  };
 
 
+// The outcome of SMPModel::runScenario. It owns the model, and so the run's
+// history, until it is destroyed or the model is released.
+class SMPRun {
+public:
+  SMPRun();
+  ~SMPRun();
+  SMPRun(SMPRun && that);
+  SMPRun & operator=(SMPRun && that);
+  SMPRun(const SMPRun &) = delete;
+
+  bool ok() const { return !scenarioID.empty(); }
+  string scenarioID = ""; // "" if the run failed
+  string error = ""; // what went wrong, if it did
+
+  SMPModel * model() const { return md; } // nullptr if the run failed
+  SMPModel * release(); // the caller then owns the model
+  unsigned int iterationCount() const;
+
+protected:
+  friend class SMPModel;
+  SMPModel * md = nullptr;
+};
+
+// A sensitivity sweep over one scenario: a run for each combination of the
+// chosen values of the nine model parameters, times a number of draws, each
+// of which scales every actor's capability and saliences at random and has a
+// seed of its own (see smpsweep.cpp). Each run's final positions, turn count
+// and position probabilities go to one results file; the database records
+// the runs only if asked.
+class SMPSweep {
+public:
+  // What makes one run of a sweep differ from the others.
+  struct Point {
+    unsigned int run = 0;
+    unsigned int draw = 0;
+    uint64_t seed = 0;
+    vector<int> params = {}; // as for updateModelParameters
+    KMatrix capScale = KMatrix(); // numAct-by-1
+    KMatrix salScale = KMatrix(); // numAct-by-numDim
+  };
+
+  // The names of the parameters in clauses, in the order of updateModelParameters.
+  static const vector<string> paramNames;
+
+  // Add one or more ';'-separated clauses; throws KException if one is malformed.
+  //   <parameter>=<values>  comma-separated names or numbers of the enum, a-b
+  //                         ranges of numbers, or 'all'; e.g. VotingRule=0-2,Cubic
+  //   cap=<s>, sal=<s>      scale each capability or salience by 1+u, with u
+  //                         uniform in [-s, s]; s must be in [0, 1)
+  //   draws=<n>             runs for each combination of parameters
+  void apply(const string & clauses);
+
+  unsigned int numRuns() const;
+
+  // Make every run of the scenario in inputDataFile, as tasks of the shared
+  // ThreadPool, at most maxPar at once (0 means as many as the pool runs),
+  // calling onRun from the run's thread as each succeeds. Returns how many
+  // did; throws KException if the input cannot be read.
+  unsigned int run(const string & inputDataFile,
+    const function<void(const Point &, const SMPModel *)> & onRun) const;
+
+  // The same, writing a line of CSV to resultsFile for each run, in order of run:
+  // each is written once it and every run before it have finished.
+  unsigned int run(const string & inputDataFile, const string & resultsFile) const;
+
+  // the values to try of each parameter; an empty list keeps the scenario's own
+  vector<vector<int>> paramValues = vector<vector<int>>(9);
+  double capSpread = 0.0;
+  double salSpread = 0.0;
+  unsigned int draws = 1;
+  uint64_t seed = KBase::dSeed; // of the draws; see Point
+  unsigned int maxPar = 0;
+
+  // Whether the database records each run as a scenario, under logPolicy.
+  bool fullLogs = false;
+  KBase::LogPolicy logPolicy = KBase::LogPolicy();
+
+  SMPRunOptions runOptions = SMPRunOptions(); // for every run; its checkpoints are not used
+
+protected:
+  Point point(unsigned int r, const vector<int> & base, unsigned int na, unsigned int nd) const;
+};
+
+// A Monte-Carlo ensemble of one scenario under stochastic state transitions.
+// The replicates are the draws of an unperturbed SMPSweep, so each has a
+// seed, and so a stream of random numbers, of its own. Each is folded into
+// running statistics and then dropped, so memory does not grow with their
+// number (see smpensemble.cpp). They are folded in order of replicate, as the
+// quantile estimates depend on the order, so one which finishes early waits
+// for those before it; the summary is then the same however many run at once.
+class SMPEnsemble {
+public:
+  explicit SMPEnsemble(unsigned int replicates, uint64_t seed = KBase::dSeed);
+
+  // Run the replicates of the scenario in inputDataFile, at most maxPar at
+  // once (0 means as many as the shared ThreadPool runs), under modelParams
+  // (empty means the scenario's own) but always with StochasticSTM. Returns
+  // how many succeeded; throws KException if the input cannot be read.
+  unsigned int run(const string & inputDataFile, const vector<int> & modelParams = {},
+    unsigned int maxPar = 0);
+
+  // The statistics of the last run, as one table of CSV.
+  void writeSummary(const string & fileName) const;
+
+  unsigned int histBins = 20; // for the final positions, over [0, 1]
+  SMPRunOptions runOptions = SMPRunOptions(); // for every replicate; its checkpoints are not used
+
+protected:
+  // the statistics kept of each quantity
+  struct Cell {
+    KBase::RunningStats st;
+    KBase::P2Quantile q05{ 0.05 };
+    KBase::P2Quantile q50{ 0.5 };
+    KBase::P2Quantile q95{ 0.95 };
+    void add(double x);
+  };
+
+  // what a replicate adds to the statistics, taken from its model
+  struct Replicate {
+    unsigned int finalT = 0;
+    unsigned int numAct = 0;
+    unsigned int numDim = 0;
+    vector<double> pos = {}; // [(t*numAct + i)*numDim + k], for each turn t to finalT
+    vector<double> prob = {}; // [i], of the final positions
+  };
+
+  void add(unsigned int r, const SMPModel * md);
+  void fold(const Replicate & rp);
+
+  unsigned int replicates = 0;
+  uint64_t seed = 0;
+  unsigned int na = 0;
+  unsigned int nd = 0;
+  vector<vector<Cell>> turnPos = {}; // [t][i*nd + k], over the replicates which reached t
+  vector<Cell> finalPos = {}; // [i*nd + k]
+  vector<KBase::Histogram> finalHist = {}; // [i*nd + k]
+  vector<Cell> finalProb = {}; // [i]
+  Cell turns;
+  std::map<unsigned int, Replicate> held = {}; // replicates which finished early, by replicate
+  unsigned int nextFold = 0; // the replicate to be folded next
+  std::mutex mtx; // replicates finish on threads of their own
+};
+
 extern SMPModel * md0 ;
 };// end of namespace
 
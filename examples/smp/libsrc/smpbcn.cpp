@@ -26,6 +26,8 @@
 // --------------------------------------------
 
 #include "smp.h"
+#include "threadpool.h"
+#include <algorithm>
 #include <QSqlQuery>
 #include <QVariant>
 #include <QSqlError>
@@ -54,8 +56,6 @@ using KBase::ReportingLevel;
 using KBase::nameFromEnum;
 
 // --------------------------------------------
-uint64_t BargainSMP::highestBargainID = 1000;
-
 // big enough buffer to build all desired SQLite statements
 const unsigned int sqlBuffSize = 250;
 
@@ -74,7 +74,8 @@ ostream& operator<< (ostream& os, const InterVecBrgn& ivb) {
 
 // --------------------------------------------
 
-BargainSMP::BargainSMP(const SMPActor* ai, const SMPActor* ar, const VctrPstn & pi, const VctrPstn & pr) {
+BargainSMP::BargainSMP(const SMPActor* ai, const SMPActor* ar, const VctrPstn & pi, const VctrPstn & pr,
+                       uint64_t id) {
   if (nullptr == ai) {
     throw KException("BargainSMP::BargainSMP: Initiator actor is null");
   }
@@ -85,7 +86,7 @@ BargainSMP::BargainSMP(const SMPActor* ai, const SMPActor* ar, const VctrPstn &
   actRcvr = ar;
   posInit = pi;
   posRcvr = pr;
-  myBargainID = BargainSMP::highestBargainID++;
+  myBargainID = id;
 }
 
 BargainSMP::~BargainSMP() {
@@ -107,11 +108,17 @@ uint64_t BargainSMP::getID() const {
  * Calculate all the utilities and record in database. utitlity for (i,i,i,j)
  * combination is getting calculated and recorded in a separate method
  */
-void SMPState::calcUtils(unsigned int i, unsigned int bestJ ) const { // i == actor id
+void SMPState::calcUtils(unsigned int i, unsigned int bestJ, ChlgCache * cache) const { // i == actor id
   const unsigned int na = model->numAct;
-  const bool recordTmpSQLP = true;  // Record this in SQLite
-  auto pFn = [this, recordTmpSQLP](unsigned int h, unsigned int k, unsigned int i, unsigned int j) {
-    probEduChlg(h, k, i, j, recordTmpSQLP); // H's estimate of the effect on K of I->J
+  ChlgLog * cLog = chlgLog(i, true);  // Record this in SQLite
+  if (nullptr != cLog) {
+    cLog->entries.reserve(3 * na * na);
+  }
+  // These estimates are computed only to be recorded, so skip those the log policy leaves out
+  auto pFn = [this, cLog, cache](unsigned int h, unsigned int k, unsigned int i, unsigned int j) {
+    if ((nullptr != cLog) && chlgEntryLogged(h, k, i, j)) {
+      probEduChlg(h, k, i, j, cLog, cache); // H's estimate of the effect on K of I->J
+    }
   };
 
   auto getUtils = [this, na, pFn, i](unsigned int j) {
@@ -158,13 +165,99 @@ void SMPState::calcUtils(unsigned int i, unsigned int bestJ ) const { // i == ac
 }
 
 // --------------------------------------------
-eduChlgsI SMPState::bestChallengeUtils(unsigned int i) const {
+ChlgCache::ChlgCache(unsigned int n) {
+  na = n;
+  done = vector<bool>(na * na, false);
+  cij = vector<double>(na * na, 0.0);
+  cji = vector<double>(na * na, 0.0);
+  tLog = vector<unsigned int>(na * na, noLog);
+  tAt = vector<size_t>(na * na, 0);
+}
+
+bool ChlgCache::find(unsigned int h, unsigned int j, double & chij, double & chji,
+                     unsigned int & tpvLog, size_t & tpvAt) {
+  if ((h >= na) || (j >= na)) {
+    throw KException("ChlgCache::find: h and j must be less than the number of actors");
+  }
+  const unsigned int n = h * na + j;
+  cacheLock.lock();
+  const bool found = done[n];
+  if (found) {
+    chij = cij[n];
+    chji = cji[n];
+    tpvLog = tLog[n];
+    tpvAt = tAt[n];
+  }
+  cacheLock.unlock();
+  return found;
+}
+
+void ChlgCache::store(unsigned int h, unsigned int j, double chij, double chji,
+                      unsigned int tpvLog, size_t tpvAt) {
+  if ((h >= na) || (j >= na)) {
+    throw KException("ChlgCache::store: h and j must be less than the number of actors");
+  }
+  const unsigned int n = h * na + j;
+  cacheLock.lock();
+  if (!done[n]) { // else the other thread got there first, with the same values
+    done[n] = true;
+    cij[n] = chij;
+    cji[n] = chji;
+    tLog[n] = tpvLog;
+    tAt[n] = tpvAt;
+  }
+  cacheLock.unlock();
+  return;
+}
+
+// --------------------------------------------
+ChlgLog * SMPState::chlgLog(unsigned int i, bool calcThrd) const {
+  const size_t n = 2 * i + (calcThrd ? 1 : 0);
+  if (n >= chlgLogs.size()) { // not recording
+    return nullptr;
+  }
+  return &(chlgLogs[n]);
+}
+
+bool SMPState::setChlgLogging(unsigned int finalT) {
+  const char * tables[3] = { "UtilChlg", "ProbVict", "TPProbVictLoss" };
+  bool any = false;
+  for (unsigned int n = 0; n < 3; n++) {
+    const KBase::LogPolicy::Rule & r = model->logRule(tables[n]);
+    const bool rec = (KBase::LogPolicy::noTurn == finalT) ? r.turn(turn) : r.catchUp(turn, finalT);
+    chlgRules[n] = rec ? &r : nullptr;
+    any = any || rec;
+  }
+  return any;
+}
+
+bool SMPState::chlgEntryLogged(unsigned int h, unsigned int k, unsigned int i, unsigned int j) const {
+  const uint64_t seed = model->getSeed();
+  for (unsigned int n = 0; n < 2; n++) { // UtilChlg and ProbVict have a row per entry
+    const KBase::LogPolicy::Rule * r = chlgRules[n];
+    if ((nullptr != r) && r->estimator(h) && r->sample(seed, turn, (h << 16) | k, (i << 16) | j)) {
+      return true;
+    }
+  }
+  return chlgTPLogged(h, i, j); // which hang off the entries
+}
+
+bool SMPState::chlgTPLogged(unsigned int h, unsigned int i, unsigned int j) const {
+  const KBase::LogPolicy::Rule * r = chlgRules[2];
+  return (nullptr != r) && r->estimator(h) && r->sample(model->getSeed(), turn, h, (i << 16) | j);
+}
+
+// --------------------------------------------
+eduChlgsI SMPState::bestChallengeUtils(unsigned int i, ChlgCache * cache) const {
   const unsigned int na = model->numAct;
-  const bool recordTmpSQLP = true;  // Record this in SQLite
+  ChlgLog * cLog = chlgLog(i, false);  // Record this in SQLite
+  if (nullptr != cLog) {
+    cLog->entries.reserve(na + 2); // these, plus the three in doBCN(i)
+  }
   eduChlgsI eduI;
   for (unsigned int j = 0; j < na; j++) {
     if( i != j ) {
-        eduI[j] = probEduChlg(i, i, i, j, recordTmpSQLP);
+        eduI[j] = probEduChlg(i, i, i, j, cLog, cache);
     }
   }
 
@@ -201,19 +294,34 @@ SMPState* SMPState::doBCN() {
     brgns[i] = vector<BargainSMP*>();
   }
 
+  // each thread records its challenges into its own log; see chlgLog
+  chlgLogs = vector<ChlgLog>(setChlgLogging(KBase::LogPolicy::noTurn) ? (2 * na) : 0);
+  const KBase::LogPolicy::Rule & coRule = model->logRule("BargnCoords");
+  const KBase::LogPolicy::Rule & valRule = model->logRule("Bargn");
+
+  firstBargainID = ((SMPModel*)model)->newBargainIDs(bargainsPerActor * na);
   auto thrBCN = [this](unsigned int i) {
     this->doBCN(i);
   };
 
   KBase::groupThreads(thrBCN, 0, na - 1);
 
+  // the threads added to each other's lists in whatever order they ran; in
+  // order of ID, each list is the same from run to run, and so is every sum over it
+  auto byID = [](const BargainSMP* b1, const BargainSMP* b2) {
+    return b1->getID() < b2->getID();
+  };
+  for (auto & bk : brgns) {
+    std::sort(bk.begin(), bk.end(), byID);
+  }
+
   model->beginDBTransaction();
 
-  if (model->sqlFlags[2]) {
+  if (!chlgLogs.empty()) {
     recordProbEduChlg();
   }
 
-  if (model->sqlFlags[3]) {
+  if (coRule.needed(turn)) {
     for (auto brgnCoord : brgnCos) {
       model->sqlBargainCoords(
         get<0>(brgnCoord), //turn
@@ -224,7 +332,7 @@ SMPState* SMPState::doBCN() {
     }
   }
 
-  if (model->sqlFlags[4]) {
+  if (valRule.needed(turn)) {
     for (auto brgnVal : brgnVals) {
       model->sqlBargainEntries(
         get<0>(brgnVal), //turn
@@ -247,15 +355,55 @@ SMPState* SMPState::doBCN() {
 
   s2 = new SMPState(model);
 
+  // each thread fills in only its own actor's entries
+  actorMaxBrgNdx = vector<unsigned int>(na, 0);
+  brgnPCEs = vector<BrgnPCE>(na);
+  const bool votesP = model->logRule("BargnVote").needed(turn);
+  const bool utilsP = model->logRule("BargnUtil").needed(turn);
+  brgnVotes = vector<BrgnVotes>(votesP ? na : 0);
+  brgnUtils = BrgnUtils(utilsP ? na : 0);
+
+  // the utilities of every actor's bargains, as one stack, so that all their
+  // scalarPCEs are done in a single batch
+  auto smod = (const SMPModel*)model;
+  auto brgnU = KBase::UtilStack(na);
+  for (unsigned int k = 0; k < na; k++) {
+    brgnU.add(brgns[k].size());
+  }
+  auto thrBrgnUtils = [this, &brgnU](unsigned int k) {
+    this->setBrgnUtils(k, brgnU.data(k));
+  };
+  KBase::groupThreads(thrBrgnUtils, 0, na - 1);
+
+  vector<KMatrix> brgnC = {};
+  vector<KMatrix> brgnPV = {};
+  actorBargains = Model::scalarPCEBatch(brgnU, w, smod->vrCltn, smod->vpm, smod->pcem, &brgnC, &brgnPV,
+                                        smod->pceSolver);
+  for (unsigned int k = 0; k < na; k++) {
+    brgnPCEs[k].u_im = brgnU.matrix(k);
+    brgnPCEs[k].c = std::move(brgnC[k]);
+    brgnPCEs[k].pv = std::move(brgnPV[k]);
+  }
+
   auto thrCalcPosts = [this](unsigned int k) {
     this->updateBestBrgnPositions(k);
   };
 
   KBase::groupThreads(thrCalcPosts, 0, na - 1);
 
+  s2->pstnMoved = vector<bool>(na, false);
+  for (unsigned int k = 0; k < na; k++) {
+    showBrgnPCE(k);
+    if (brgnPCEs[k].moved) {
+      s2->setPosMoverBargain(k, brgnPCEs[k].chosenID);
+      s2->pstnMoved[k] = true;
+    }
+  }
+  brgnPCEs = {};
+
   //model->beginDBTransaction();
 
-  if (model->sqlFlags[3]) {
+  if (votesP) {
     for (auto votes : brgnVotes) {
       for (auto vote : votes) {
         model->sqlBargainVote(
@@ -266,7 +414,9 @@ SMPState* SMPState::doBCN() {
         );
       }
     }
+  }
 
+  if (utilsP) {
     for (auto util : brgnUtils) {
       model->sqlBargainUtil(
         get<0>(util), //turn
@@ -277,7 +427,7 @@ SMPState* SMPState::doBCN() {
   }
 
   // record data so far
-  if (model->sqlFlags[4]) {
+  if (valRule.needed(turn)) {
     updateBargnTable(brgns, actorBargains, actorMaxBrgNdx);
   }
 
@@ -327,6 +477,9 @@ SMPState* SMPState::doBCN() {
     s2->ideals = ideals; // copy s1's old ideals
   }
   s2->newIdeals(); // adjust s2 ideals toward new ones
+  if (0 == ideals.size()) {
+    s2->idealMoved = {}; // they did not start from this state's ideals
+  }
   double ipDist = s2->posIdealDist(ReportingLevel::Medium);
   LOG(INFO) << KBase::getFormattedString("rms (pstn, ideal) = %.5f", ipDist);
   return s2;
@@ -338,41 +491,27 @@ void SMPState::doBCN(unsigned int i) {
     auto smod = dynamic_cast<SMPModel *>(model);
     const InterVecBrgn ivb = smod->ivBrgn;
     const SMPBargnModel bMod = smod->brgnMod;
+    uint64_t nextID = firstBargainID + bargainsPerActor * i;
 
-    auto sqBrgnI = new BargainSMP(ai, ai, *posI, *posI);
+    auto sqBrgnI = new BargainSMP(ai, ai, *posI, *posI, nextID++);
     brgnsLock.lock();
     brgns[i].push_back(sqBrgnI);
     brgnsLock.unlock();
 
-    // before we can log this bargain, we need to get the group ID for this table
-    // so then we can get the flag to populate the table or not
-    // note the implicit assumption that there will never be 43+ groups :-)
-    unsigned int grpID = 42;
-    for (unsigned int t = 0; t<model->KTables.size(); t++)
-    {
-        if (model->KTables[t]->tabName == "Bargn")
-        {
-            grpID = model->KTables[t]->tabGrpID;
-            break;
-        }
-    }
-    // be sure that it found this table
-    //assert(grpID != 42);
-    if (grpID == 42) {
-      throw KException("SMPState::doBCN(i): The Bargn table's entry was not found in model");
-    }
-    if (grpID >= model->sqlFlags.size()) {
-      throw KException("SMPState::doBCN(i): Table's group id is not matching the logging flags");
-    }
+    // whether the bargains of this turn are recorded, now or in case it is among the last
+    const bool valsP = model->logRule("Bargn").needed(turn);
+    const bool cosP = model->logRule("BargnCoords").needed(turn);
 
-    if (model->sqlFlags[grpID])
+    if (valsP)
     {
       brgnValsLock.lock();
       brgnVals.push_back(BrgnValue(turn, sqBrgnI->getID(), i, i, 0));
       brgnValsLock.unlock();
     }
 
-    eduChlgsI eduI = bestChallengeUtils(i);
+    // shared with the calcUtils thread below, so each (h,i,j) coalition is computed once
+    ChlgCache chlgCache(model->numAct);
+    eduChlgsI eduI = bestChallengeUtils(i, &chlgCache);
 
     auto chlgI = bestChallenge(eduI);
     const double bestEU = get<2>(chlgI);
@@ -388,13 +527,21 @@ void SMPState::doBCN(unsigned int i) {
       auto aj = ((const SMPActor*)(model->actrs[j]));
       auto posJ = ((const VctrPstn*)pstns[j]);
 
-      std::thread thr(&SMPState::calcUtils, this, i, bestJ);
+      // calcUtils only fills the Challenge Tables, so skip it when they are not recorded;
+      // SMPModel::regenChlgTables can reproduce them later from PosUtil.
+      // It runs as a nested task on the shared pool, alongside the rest of doBCN(i).
+      KBase::ThreadPool::TaskGroup calcGrp;
+      if (nullptr != chlgLog(i, true)) {
+        calcGrp.run([this, i, bestJ, &chlgCache]() {
+          calcUtils(i, bestJ, &chlgCache);
+        });
+      }
 
       // make the variables local to lexical scope of this block.
       // for testing, calculate and print out a block of data showing each's perspective
-      bool recordTmpSQLP = true;  // Record this in SQLite
-      auto pFn = [this, recordTmpSQLP](unsigned int h, unsigned int k, unsigned int i, unsigned int j) {
-        auto est = probEduChlg(h, k, i, j, recordTmpSQLP); // H's estimate of the effect on K of I->J
+      ChlgLog * cLog = chlgLog(i, false);  // Record this in SQLite
+      auto pFn = [this, cLog, &chlgCache](unsigned int h, unsigned int k, unsigned int i, unsigned int j) {
+        auto est = probEduChlg(h, k, i, j, cLog, &chlgCache); // H's estimate of the effect on K of I->J
         double phij = get<0>(est);
         double edu_hk_ij = get<1>(est);
         return est;
@@ -407,7 +554,8 @@ void SMPState::doBCN(unsigned int i) {
       auto est_jjij = pFn(j, j, i, j); // J's estimate of the effect on J of I->J
 
       // interpolate a bargain from I's perspective
-      BargainSMP* brgnIIJ = SMPActor::interpolateBrgn(ai, aj, posI, posJ, piiJ, 1 - piiJ, ivb);
+      BargainSMP* brgnIIJ = SMPActor::interpolateBrgn(ai, aj, posI, posJ, piiJ, 1 - piiJ, ivb,
+                                                      nextID++);
       const int nai = model->actrNdx(brgnIIJ->actInit);
       const int naj = model->actrNdx(brgnIIJ->actRcvr);
       // verify that identities match up as expected
@@ -421,7 +569,8 @@ void SMPState::doBCN(unsigned int i) {
 
       // interpolate a bargain from targeted J's perspective
       double pjiJ = get<1>(Vjij); // j's estimate of the probability that i defeats j
-      BargainSMP* brgnJIJ = SMPActor::interpolateBrgn(ai, aj, posI, posJ, pjiJ, 1 - pjiJ, ivb);
+      BargainSMP* brgnJIJ = SMPActor::interpolateBrgn(ai, aj, posI, posJ, pjiJ, 1 - pjiJ, ivb,
+                                                      nextID++);
 
       // calcluate weights as capability times salience
       double sci = brgnIIJ->actInit->sCap;
@@ -434,7 +583,8 @@ void SMPState::doBCN(unsigned int i) {
       // create a new bargain whose positions are the weighted averages
       auto bpi = VctrPstn((wi*brgnIIJ->posInit + wj*brgnJIJ->posInit) / (wi + wj));
       auto bpj = VctrPstn((wi*brgnIIJ->posRcvr + wj*brgnJIJ->posRcvr) / (wi + wj));
-      BargainSMP *brgnIJ = new  BargainSMP(brgnIIJ->actInit, brgnIIJ->actRcvr, bpi, bpj);
+      BargainSMP *brgnIJ = new  BargainSMP(brgnIIJ->actInit, brgnIIJ->actRcvr, bpi, bpj,
+                                           nextID++);
 
       mtxLock.lock();
       LOG(INFO) << KBase::getFormattedString(
@@ -517,13 +667,13 @@ void SMPState::doBCN(unsigned int i) {
       switch (bMod) {
       case SMPBargnModel::InitOnlyInterpSMPBM:
         // record the only one used into SQLite JAH 20160802 use the flag
-        if(model->sqlFlags[grpID])
+        if (valsP)
         {
           brgnValsLock.lock();
           brgnVals.push_back(BrgnValue(turn, brgnIIJ->getID(), i, j, bestEU));
           brgnValsLock.unlock();
         }
-        if(model->sqlFlags[3])
+        if (cosP)
         {          
           brgnCosLock.lock();
           brgnCos.push_back(BrgnCoord(turn, brgnIIJ->getID(), brgnIIJ->posInit, brgnIIJ->posRcvr));
@@ -544,14 +694,14 @@ void SMPState::doBCN(unsigned int i) {
 
       case SMPBargnModel::InitRcvrInterpSMPBM:
         // record the pair used into SQLite JAH 20160802 use the flag
-        if(model->sqlFlags[grpID])
+        if (valsP)
         {
           brgnValsLock.lock();
           brgnVals.push_back(BrgnValue(turn, brgnIIJ->getID(), i, j, bestEU));
           brgnVals.push_back(BrgnValue(turn, brgnJIJ->getID(), i, j, bestEU));
           brgnValsLock.unlock();
         }
-        if(model->sqlFlags[3])
+        if (cosP)
         {
           brgnCosLock.lock();
           brgnCos.push_back(BrgnCoord(turn, brgnIIJ->getID(), brgnIIJ->posInit, brgnIIJ->posRcvr));
@@ -573,13 +723,13 @@ void SMPState::doBCN(unsigned int i) {
 
       case SMPBargnModel::PWCompInterpSMPBM:
         // record the only one used into SQLite JAH 20160802 use the flag
-        if(model->sqlFlags[grpID])
+        if (valsP)
         {
           brgnValsLock.lock();
           brgnVals.push_back(BrgnValue(turn, brgnIJ->getID(), i, j, bestEU));
           brgnValsLock.unlock();
         }
-        if(model->sqlFlags[3])
+        if (cosP)
         {
           brgnCosLock.lock();
           brgnCos.push_back(BrgnCoord(turn, brgnIJ->getID(), brgnIJ->posInit, brgnIJ->posRcvr));
@@ -603,37 +753,54 @@ void SMPState::doBCN(unsigned int i) {
         throw KException("SMPState::doBCN(i): unrecognized SMPBargnModel");
       }
 
-      thr.join();
+      calcGrp.wait();
     }
     else {
       LOG(INFO) << "In turn" << turn << "Actor" << i << "has no advantageous targets";
     }
 }
 
-void SMPState::updateBestBrgnPositions(int k) {
-  auto ndxMaxProb = [](const KMatrix & cv) {
-    const double pTol = 1E-8;
-    if (fabs(KBase::sum(cv) - 1.0) >= pTol) {
-      throw KException("SMPState::updateBestBrgnPositions: Sum of cv is greater than 1");
-    }
-    if (0 == cv.numR()) {
-      throw KException("SMPState::updateBestBrgnPositions: cv doesn't have records");
-    }
-    if (1 != cv.numC()) {
-      throw KException("SMPState::updateBestBrgnPositions: cv must be a column matrix");
+void SMPState::regenChlgs(unsigned int t, unsigned int finalT) {
+  const unsigned int na = model->numAct;
+  turn = t;
+  if (!setChlgLogging(finalT)) {
+    return;
+  }
+  chlgLogs = vector<ChlgLog>(2 * na);
+
+  // the same challenge estimates that doBCN(i) records, without the bargaining
+  auto thrChlg = [this](unsigned int i) {
+    ChlgCache chlgCache(model->numAct);
+    eduChlgsI eduI = bestChallengeUtils(i, &chlgCache);
+    auto chlgI = bestChallenge(eduI);
+    if (0 < get<2>(chlgI)) {
+      const unsigned int j = get<0>(chlgI);
+      ChlgLog * cLog = chlgLog(i, false);
+      probEduChlg(i, j, i, j, cLog, &chlgCache);
+      probEduChlg(j, i, i, j, cLog, &chlgCache);
+      probEduChlg(j, j, i, j, cLog, &chlgCache);
+      calcUtils(i, j, &chlgCache);
     }
-    auto ndxIJ = ndxMaxAbs(cv);
-    unsigned int iMax = get<0>(ndxIJ);
-    return iMax;
   };
 
+  KBase::groupThreads(thrChlg, 0, na - 1);
+
+  model->beginDBTransaction();
+  recordProbEduChlg();
+  model->commitDBTransaction();
+  return;
+}
+
+// Fill u_im (row-major, [actor, bargain]) with the utility to each actor of the
+// state after each of actor k's bargains.
+void SMPState::setBrgnUtils(unsigned int k, double * u_im) const {
   // what is the utility to actor nai of the state resulting after
   // the nbj-th bargain of the k-th actor is implemented?
   auto brgnUtil = [this](unsigned int nk, unsigned int nai, unsigned int nbj) {
     const unsigned int na = model->numAct;
     BargainSMP * b = brgns[nk][nbj];
     if (nullptr == b) {
-      throw KException("SMPState::updateBestBrgnPositions: bargain smp pointer is null");
+      throw KException("SMPState::setBrgnUtils: bargain smp pointer is null");
     }
     double uAvrg = 0.0;
 
@@ -641,7 +808,7 @@ void SMPState::updateBestBrgnPositions(int k) {
       uAvrg = 0.0;
       for (unsigned int n = 0; n < na; n++) {
         // nai's estimate of the utility to nai of position n, i.e. the true value
-        uAvrg = uAvrg + aUtil[nai](nai, n);
+        uAvrg = uAvrg + aUtilAt(nai, nai, n);
       }
     }
 
@@ -649,14 +816,14 @@ void SMPState::updateBestBrgnPositions(int k) {
       uAvrg = 0.0;
       auto ndxInit = model->actrNdx(b->actInit);
       if ((0 > ndxInit) || (ndxInit >= na)) { // must find it
-        throw KException("SMPState::updateBestBrgnPositions This initiator actor number is not present in model");
+        throw KException("SMPState::setBrgnUtils This initiator actor number is not present in model");
       }
       double uPosInit = ((SMPActor*)(model->actrs[nai]))->posUtil(&(b->posInit), this);
       uAvrg = uAvrg + uPosInit;
 
       auto ndxRcvr = model->actrNdx(b->actRcvr);
       if ((0 > ndxRcvr) || (ndxRcvr >= na)) {
-        throw KException("SMPState::updateBestBrgnPositions: This receiver actor number is not present in model");
+        throw KException("SMPState::setBrgnUtils: This receiver actor number is not present in model");
       }
       double uPosRcvr = ((SMPActor*)(model->actrs[nai]))->posUtil(&(b->posRcvr), this);
       uAvrg = uAvrg + uPosRcvr;
@@ -664,7 +831,7 @@ void SMPState::updateBestBrgnPositions(int k) {
       for (unsigned int n = 0; n < na; n++) {
         if ((ndxInit != n) && (ndxRcvr != n)) {
           // again, nai's estimate of the utility to nai of position n, i.e. the true value
-          uAvrg = uAvrg + aUtil[nai](nai, n);
+          uAvrg = uAvrg + aUtilAt(nai, nai, n);
         }
       }
     }
@@ -672,50 +839,71 @@ void SMPState::updateBestBrgnPositions(int k) {
     uAvrg = uAvrg / na;
 
     if (0.0 >= uAvrg) { // none negative, at least own is positive
-      throw KException("SMPState::updateBestBrgnPositions: uAvrg should be non-negative");
+      throw KException("SMPState::setBrgnUtils: uAvrg should be non-negative");
     }
     if (uAvrg > 1.0) { // can not all be over 1.0
-      throw KException("SMPState::updateBestBrgnPositions: uAvrg can't be over 1.0");
+      throw KException("SMPState::setBrgnUtils: uAvrg can't be over 1.0");
     }
     return uAvrg;
   };
   // end of λ-fn
 
+  const unsigned int na = model->numAct;
+  const unsigned int nb = brgns[k].size();
+  for (unsigned int nai = 0; nai < na; nai++) {
+    for (unsigned int nbj = 0; nbj < nb; nbj++) {
+      u_im[nai * nb + nbj] = brgnUtil(k, nai, nbj);
+    }
+  }
+  return;
+}
+
+void SMPState::updateBestBrgnPositions(int k) {
+  auto ndxMaxProb = [](const KMatrix & cv) {
+    const double pTol = 1E-8;
+    if (fabs(KBase::sum(cv) - 1.0) >= pTol) {
+      throw KException("SMPState::updateBestBrgnPositions: Sum of cv is greater than 1");
+    }
+    if (0 == cv.numR()) {
+      throw KException("SMPState::updateBestBrgnPositions: cv doesn't have records");
+    }
+    if (1 != cv.numC()) {
+      throw KException("SMPState::updateBestBrgnPositions: cv must be a column matrix");
+    }
+    auto ndxIJ = ndxMaxAbs(cv);
+    unsigned int iMax = get<0>(ndxIJ);
+    return iMax;
+  };
+
 
-  // The key is to build the usual matrix of U_ai (Brgn_m) for all bargains in brgns[k],
-  // making sure to divide the sum of the utilities of positions by 1/N
-  // so 0 <= Util(state after Brgn_m) <= 1, then do the standard scalarPCE for bargains involving k.
 
-    auto buk = [brgnUtil, k](unsigned int nai, unsigned int nbj) {
-      return brgnUtil(k, nai, nbj);
-    };
+  // The key is the usual matrix of U_ai (Brgn_m) for all bargains in brgns[k],
+  // dividing the sum of the utilities of positions by 1/N so 0 <= Util(state after Brgn_m) <= 1,
+  // and the standard scalarPCE for bargains involving k; doBCN has done both, for all actors at once.
+
     auto smod = dynamic_cast<SMPModel *>(model);
     unsigned int na = smod->numAct;
     unsigned int nb = brgns[k].size();
 
-    mtxLock.lock();
-    auto u_im = KMatrix::map(buk, na, nb);
-
-    LOG(INFO) << "u_im:";
-    u_im.mPrintf(" %.5f ");
+    // Nothing here is shared with the other threads. The logging waits for showBrgnPCE.
+    BrgnPCE & bp = brgnPCEs[k];
+    const KMatrix & u_im = bp.u_im;
 
-    LOG(INFO) << "Doing scalarPCE for the" << nb << "bargains of actor" << k << "...";
-    auto p = Model::scalarPCE(na, nb, w, u_im, smod->vrCltn, smod->vpm, smod->pcem, ReportingLevel::Medium);
+    const KMatrix & p = actorBargains[k];
     if (nb != p.numR()) {
       throw KException("SMPState::updateBestBrgnPositions: number of bargains mismatched with scalar PCE row count");
     }
     if (1 != p.numC()) {
       throw KException("SMPState::updateBestBrgnPositions: scalar pce column size is not 1");
     }
-    actorBargains.insert(map<unsigned int, KBase::KMatrix>::value_type(k, p));
-
     unsigned int mMax = nb; // indexing actors by i, bargains by m
     switch (smod->stm) {
     case StateTransMode::DeterminsticSTM:
       mMax = ndxMaxProb(p);
       break;
     case StateTransMode::StochasticSTM:
-      mMax = model->rng->probSel(p);
+      // k's own stream for this turn, so the choice does not depend on the threads
+      mMax = model->rng->stream(turn, k).probSel(p);
       break;
     default:
       throw KException("SMPState::updateBestBrgnPositions - unrecognized StateTransMode");
@@ -725,23 +913,16 @@ void SMPState::updateBestBrgnPositions(int k) {
     if (mMax >= nb) {
       throw KException("SMPState::updateBestBrgnPositions: Bargain number with max probability can't be more than bargain count");
     }
-    actorMaxBrgNdx.insert(map<unsigned int, unsigned int>::value_type(k, mMax));
+    actorMaxBrgNdx[k] = mMax;
     auto bkm = brgns[k][mMax];
-    LOG(INFO) << "Chosen bargain (" << smod->stm << "):" << bkm->getID()
-      << mMax + 1 << "out of" << nb << "bargains";
-    mtxLock.unlock();
+    bp.chosenID = bkm->getID();
 
     //populate the Bargain Vote & Util tables
     // JAH added sql flag logging control
-  if (model->sqlFlags[3])
+  if (!brgnVotes.empty())
   {
     auto brgns_k = brgns[k];
     vector< std::tuple<uint64_t, uint64_t>> barginIDsPair_i_j;
-    vector<uint64_t> bargnIdsRows = {};
-    for (int j = 0; j < nb; j++)
-    {
-      bargnIdsRows.push_back(brgns[k][j]->getID());
-    }
     for (unsigned int brgnFirst = 0; brgnFirst < nb; brgnFirst++)
     {
       for (unsigned int brgnSecond = 0; brgnSecond < brgnFirst; brgnSecond++)
@@ -756,10 +937,16 @@ void SMPState::updateBestBrgnPositions(int k) {
 
       votes.push_back(BrgnVote(turn, barginIDsPair_i_j, pv_ij, actor));
     }
-    brgnPosLock.lock();
-    brgnVotes.push_back(votes);
-    brgnUtils.push_back(BrgnUtil(turn, bargnIdsRows, u_im));
-    brgnPosLock.unlock();
+    brgnVotes[k] = votes;
+  }
+  if (!brgnUtils.empty())
+  {
+    vector<uint64_t> bargnIdsRows = {};
+    for (int j = 0; j < nb; j++)
+    {
+      bargnIdsRows.push_back(brgns[k][j]->getID());
+    }
+    brgnUtils[k] = BrgnUtil(turn, bargnIdsRows, u_im);
   }
 
     // TODO: create a fresh position for k, from the selected bargain mMax.
@@ -787,7 +974,7 @@ void SMPState::updateBestBrgnPositions(int k) {
         auto pCoordOld = (*oldPK)(dimen, 0);
         auto pCoord = (*pk)(dimen, 0);
         if (pCoord != pCoordOld) {
-          s2->setPosMoverBargain(k, bkm->getID());
+          bp.moved = true; // recorded in s2 afterwards, as its map is not thread-safe
         }
       }
     }
@@ -799,44 +986,39 @@ void SMPState::updateBestBrgnPositions(int k) {
     s2->pstns[k] = pk;
 }
 
+void SMPState::showBrgnPCE(unsigned int k) const {
+  auto smod = (const SMPModel*)model;
+  const BrgnPCE & bp = brgnPCEs[k];
+  const unsigned int na = model->numAct;
+  const unsigned int nb = brgns[k].size();
 
-// h's estimate of the victory probability and expected delta in utility for k from i challenging j,
-// compared to status quo.
-// Note that the  aUtil vector of KMatrix must be set before starting this.
-// TODO: offer a choice the different ways of estimating value-of-a-state: even sum or expected value.
-// TODO: we may need to separate euConflict from this at some point
-tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsigned int i, unsigned int j, bool sqlP) const {
+  LOG(INFO) << "u_im:";
+  bp.u_im.mPrintf(" %.5f ");
+
+  LOG(INFO) << "Doing scalarPCE for the" << nb << "bargains of actor" << k << "...";
+  Model::showScalarPCE(na, nb, w, bp.u_im, smod->vrCltn, bp.c, bp.pv, actorBargains[k]);
 
+  LOG(INFO) << "Chosen bargain (" << smod->stm << "):" << bp.chosenID
+    << actorMaxBrgNdx[k] + 1 << "out of" << nb << "bargains";
+  return;
+}
+
+
+// h's estimate of the complete coalitions for and against i in the challenge i->j:
+// the principals' own contributions plus every third party's. None of this depends
+// on which actor k is affected. If recording, the third parties' values are also
+// written to the log, starting at tpvAt.
+tuple<double, double> SMPState::chlgCoalitions(unsigned int h, unsigned int i, unsigned int j,
+                                               ChlgLog * cLog, size_t & tpvAt) const {
   // you could make other choices for these two sub-models
   auto sMod = (const SMPModel*)model;
   auto vr = sMod->vrCltn; //VotingRule::Proportional;
   auto tpc = sMod->tpCommit;// KBase::ThirdPartyCommit::SemiCommit;
 
-  double uii = aUtil[h](i, i);
-  double uij = aUtil[h](i, j);
-  double uji = aUtil[h](j, i);
-  double ujj = aUtil[h](j, j);
-
-  // h's estimate of utility to k of status-quo positions of i and j
-  const double euSQ = aUtil[h](k, i) + aUtil[h](k, j);
-  if ((0.0 > euSQ) || (euSQ > 2.0)) {
-    LOG(INFO) << "euSQ =" << euSQ;
-    throw KException("SMPState::probEduChlg: euSQ must be in the range [0.0, 2.0]");
-  }
-
-  // h's estimate of utility to k of i defeating j, so j adopts i's position
-  const double uhkij = aUtil[h](k, i) + aUtil[h](k, i);
-  if ((0.0 > uhkij) || (uhkij > 2.0)) {
-    LOG(INFO) << "uhkij =" << uhkij;
-    throw KException("SMPState::probEduChlg: uhkij must be in the range [0.0, 2.0]");
-  }
-
-  // h's estimate of utility to k of j defeating i, so i adopts j's position
-  const double uhkji = aUtil[h](k, j) + aUtil[h](k, j);
-  if ((0.0 > uhkji) || (uhkji > 2.0)) {
-    LOG(INFO) << "uhkji =" << uhkji;
-    throw KException("SMPState::probEduChlg: uhkji must be in the range [0.0, 2.0]");
-  }
+  double uii = aUtilAt(h, i, i);
+  double uij = aUtilAt(h, i, j);
+  double uji = aUtilAt(h, j, i);
+  double ujj = aUtilAt(h, j, j);
 
   auto ai = ((const SMPActor*)(model->actrs[i]));
   double si = KBase::sum(ai->vSal);
@@ -845,7 +1027,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
   double sj = KBase::sum(aj->vSal);
   if ((0 >= sj) || (sj > 1)) {
     LOG(INFO) << "sj =" << sj;
-    throw KException("SMPState::probEduChlg: sj must be in the range (0, 1]");
+    throw KException("SMPState::chlgCoalitions: sj must be in the range (0, 1]");
   }
   double cj = aj->sCap;
   const double minCltn = 1E-10;
@@ -857,7 +1039,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
   double contrib_i_ij = Model::vote(vr, si*ci, uii, uij);
   if (identAccMat) {
     if (0 > contrib_i_ij) {
-      throw KException("SMPState::probEduChlg: h's estimate of i's contribution to (i:j) must be positive");
+      throw KException("SMPState::chlgCoalitions: h's estimate of i's contribution to (i:j) must be positive");
     }
   }
   // If not, you could have the ordering (Idl_i, Pos_j, Pos_i)
@@ -869,7 +1051,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
   double contrib_j_ij = Model::vote(vr, sj*cj, uji, ujj);
   if (identAccMat) {
     if (contrib_j_ij > 0) {
-      throw KException("SMPState::probEduChlg: h's estimate of j's contribution to (i:j) must be positive");
+      throw KException("SMPState::chlgCoalitions: h's estimate of j's contribution to (i:j) must be positive");
     }
   }
   // Similarly, you could have an ordering like (Idl_j, Pos_i, Pos_j)
@@ -883,7 +1065,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
     chij = chij + contrib_i_ij;
   }
   if (0.0 >= chij) {
-    throw KException("SMPState::probEduChlg: "
+    throw KException("SMPState::chlgCoalitions: "
       "i's contribution to the complete coalition supporting i over j must be positive");
   }
 
@@ -891,7 +1073,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
     chji = chji - contrib_i_ij;
   }
   if (0.0 >= chji) {
-    throw KException("SMPState::probEduChlg: "
+    throw KException("SMPState::chlgCoalitions: "
       "i's contribution to the complete coalition supporting j over i must be positive");
   }
 
@@ -900,7 +1082,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
     chij = chij + contrib_j_ij;
   }
   if (0.0 >= chij) {
-    throw KException("SMPState::probEduChlg: "
+    throw KException("SMPState::chlgCoalitions: "
       "j's contribution to the complete coalition supporting i over j must be positive");
   }
 
@@ -908,7 +1090,7 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
     chji = chji - contrib_j_ij;
   }
   if (0.0 >= chji) {
-    throw KException("SMPState::probEduChlg: "
+    throw KException("SMPState::chlgCoalitions: "
       "j's contribution to the complete coalition supporting j over i must be positive");
   }
 
@@ -922,47 +1104,120 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
   // we assess the overall coalition strengths by adding up the contribution of
   // individual actors (including i and j, above). We assess the contribution of third
   // parties (n) by looking at little coalitions in the hypothetical (in:j) or (i:nj) contests.
-  auto tpvArray = KMatrix(na, 3);
+  // If recording, the third-party values go straight into the log
+  double * tpv = nullptr;
+  tpvAt = 0;
+  if (nullptr != cLog) {
+    tpvAt = cLog->tpv.size();
+    cLog->tpv.resize(tpvAt + 3 * na, 0.0);
+    tpv = &(cLog->tpv[tpvAt]);
+  }
   for (unsigned int n = 0; n < na; n++) {
     if ((n != i) && (n != j)) { // already got their influence-contributions
       auto an = ((const SMPActor*)(model->actrs[n]));
 
       double cn = an->sCap;
       double sn = KBase::sum(an->vSal);
-      double uni = aUtil[h](n, i);
-      double unj = aUtil[h](n, j);
-      double unn = aUtil[h](n, n);
+      double uni = aUtilAt(h, n, i);
+      double unj = aUtilAt(h, n, j);
+      double unn = aUtilAt(h, n, n);
 
       // notice that each third party starts afresh,
       // considering only contributions of principals and itself
       double pin = Actor::vProbLittle(vr, sn*cn, uni, unj, contrib_i_ij, contrib_j_ij);
 
       if ((0.0 > pin) && (pin > 1.0)) {
-        throw KException("SMPState::probEduChlg: Principal contribution of third party out of bound");
+        throw KException("SMPState::chlgCoalitions: Principal contribution of third party out of bound");
       }
       double pjn = 1.0 - pin;
       auto vt_uv_ul = Actor::thirdPartyVoteSU(sn*cn, vr, tpc, pin, pjn, uni, unj, unn);
       const double vnij = get<0>(vt_uv_ul);
       chij = (vnij > 0) ? (chij + vnij) : chij;
       if (0 >= chij) {
-        throw KException("SMPState::probEduChlg: "
+        throw KException("SMPState::chlgCoalitions: "
           "3rd party contribution to the complete coalition supporting i over j must be positive");
       }
       chji = (vnij < 0) ? (chji - vnij) : chji;
       if (0 >= chji) {
-        throw KException("SMPState::probEduChlg: "
+        throw KException("SMPState::chlgCoalitions: "
           "3rd party contribution to complete coalition supporting j over i must be positive");
       }
 
       const double utpv = get<1>(vt_uv_ul);
       const double utpl = get<2>(vt_uv_ul);
       // record for SQLite
-      tpvArray(n, 0) = pin;
-      tpvArray(n, 1) = utpv;
-      tpvArray(n, 2) = utpl;
+      if (nullptr != tpv) {
+        tpv[3 * n + 0] = pin;
+        tpv[3 * n + 1] = utpv;
+        tpv[3 * n + 2] = utpl;
+      }
     }
   }
 
+  return tuple<double, double>(chij, chji);
+}
+
+
+// h's estimate of the victory probability and expected delta in utility for k from i challenging j,
+// compared to status quo.
+// Note that the  aUtil vector of KMatrix must be set before starting this.
+// TODO: offer a choice the different ways of estimating value-of-a-state: even sum or expected value.
+// TODO: we may need to separate euConflict from this at some point
+tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsigned int i, unsigned int j,
+                                            ChlgLog * cLog, ChlgCache * cache) const {
+  // h's estimate of utility to k of status-quo positions of i and j
+  const double euSQ = aUtilAt(h, k, i) + aUtilAt(h, k, j);
+  if ((0.0 > euSQ) || (euSQ > 2.0)) {
+    LOG(INFO) << "euSQ =" << euSQ;
+    throw KException("SMPState::probEduChlg: euSQ must be in the range [0.0, 2.0]");
+  }
+
+  // h's estimate of utility to k of i defeating j, so j adopts i's position
+  const double uhkij = aUtilAt(h, k, i) + aUtilAt(h, k, i);
+  if ((0.0 > uhkij) || (uhkij > 2.0)) {
+    LOG(INFO) << "uhkij =" << uhkij;
+    throw KException("SMPState::probEduChlg: uhkij must be in the range [0.0, 2.0]");
+  }
+
+  // h's estimate of utility to k of j defeating i, so i adopts j's position
+  const double uhkji = aUtilAt(h, k, j) + aUtilAt(h, k, j);
+  if ((0.0 > uhkji) || (uhkji > 2.0)) {
+    LOG(INFO) << "uhkji =" << uhkji;
+    throw KException("SMPState::probEduChlg: uhkji must be in the range [0.0, 2.0]");
+  }
+
+  auto aj = ((const SMPActor*)(model->actrs[j]));
+  const double sj = KBase::sum(aj->vSal);
+
+  // the log policy may leave out this estimate, or only its third parties' votes,
+  // which depend on (h,i,j) alone, as the cache below does
+  ChlgLog * tpLog = ((nullptr != cLog) && chlgTPLogged(h, i, j)) ? cLog : nullptr;
+  if ((nullptr != cLog) && !chlgEntryLogged(h, k, i, j)) {
+    cLog = nullptr;
+  }
+
+  // the coalitions do not depend on k, so look for them before working them out
+  double chij = 0.0;
+  double chji = 0.0;
+  unsigned int tpvLog = 0;
+  size_t tpvAt = 0;
+  bool found = false;
+  if (nullptr != cache) {
+    found = cache->find(h, j, chij, chji, tpvLog, tpvAt);
+  }
+  if (!found) {
+    auto ch = chlgCoalitions(h, i, j, tpLog, tpvAt);
+    chij = get<0>(ch);
+    chji = get<1>(ch);
+    tpvLog = (nullptr != tpLog) ? ((unsigned int)(tpLog - &(chlgLogs[0]))) : ChlgCache::noLog;
+    if (nullptr != cache) {
+      cache->store(h, j, chij, chji, tpvLog, tpvAt);
+    }
+  }
+  if ((nullptr != tpLog) && (ChlgCache::noLog == tpvLog)) {
+    throw KException("SMPState::probEduChlg: Cached coalitions have no recorded third party values");
+  }
+
   const double phij = chij / (chij + chji); // ProbVict, for i
   const double phji = chji / (chij + chji);
 
@@ -973,40 +1228,24 @@ tuple<double, double> SMPState::probEduChlg(unsigned int h, unsigned int k, unsi
   auto rslt = tuple<double, double>(phij, duChlg);
 
   // JAH 20160802 switched to use the model sql flags vector to control logging
-  // I keep sqlP and short-circuit & it because sometimes probEduChlg is called to
-  // do some temporary calcs which should not be store - this is controlled with sqlP
-  if (sqlP && model->sqlFlags[2]) {
-    // now that the computation is finished, record everything into SQLite
-    //
-    // record tpvArray into SQLite turn, est (h), init (i), third party (n), receiver (j), and tpvArray[n]
-    // printf ("SMPState::probEduChlg(%2i, %2i, %2i, %i2) = %+6.4f - %+6.4f = %+6.4f\n", h, k, i, j, euCh, euSQ, euChlg);
-
-    string thij = std::to_string(turn)
-      + "," + std::to_string(h)
-      + "," + std::to_string(i)
-      + "," + std::to_string(j);
-
-    // formatting note: %d means an integer, base 10
-    // we will use base 10 by default, and these happen to be unsigned integers, so %i is appropriate
-
-    string thkij = std::to_string(turn)
-      + "," + std::to_string(h)
-      + "," + std::to_string(k)
-      + "," + std::to_string(i)
-      + "," + std::to_string(j);
-
-    std::vector<double> eu;
-    eu.push_back(euSQ);
-    eu.push_back(euVict);
-    eu.push_back(euCntst);
-    eu.push_back(euChlg);
-
-    // Thread safety lock
-    utilDataLock.lock();
-    euData.emplace(thkij,eu);
-    tpvData.emplace(thij, tpvArray);
-    phijData.emplace(thij, phij);
-    utilDataLock.unlock();
+  // Callers pass a log only when the Challenge Tables are recorded in this turn,
+  // and not at all for temporary calculations which should not be stored.
+  if (nullptr != cLog) {
+    // now that the computation is finished, record everything for SQLite:
+    // turn, est (h), aff (k), init (i), receiver (j), and the third party values
+    ChlgEntry e;
+    e.h = h;
+    e.k = k;
+    e.i = i;
+    e.j = j;
+    e.tpvLog = tpvLog;
+    e.tpvAt = tpvAt;
+    e.phij = phij;
+    e.euSQ = euSQ;
+    e.euVict = euVict;
+    e.euCntst = euCntst;
+    e.euChlg = euChlg;
+    cLog->entries.push_back(e);
   }
   return rslt;
 }
@@ -0,0 +1,277 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// --------------------------------------------
+//
+// Checkpoints of an SMP run. After what every model saves (see
+// Model::saveModelState), a checkpoint holds enough of the input to check
+// that a resumed run was read from the same one, then the next bargain ID,
+// then each state in turn: positions, ideals, risk attitudes and the
+// probabilities they were inferred from, the accommodation matrix (only where
+// it differs from the state before), the bargains which moved actors into it,
+// and which positions and ideals changed from the state before.
+//
+// Everything else a state has (utilities, probabilities, ...) is worked out
+// again from those, by the same code and so to the same bits. Knowing the
+// changes, setAllAUtil takes the same results from the state before as it did
+// in the run, and each turn's PCE starts from the same distribution, that of
+// the state before. The risk attitudes and probabilities are stored only to
+// check that it all came out the same.
+//
+// --------------------------------------------
+
+#include <cstring>
+
+#include "smp.h"
+
+namespace SMPLib {
+using std::string;
+using std::vector;
+
+using KBase::KMatrix;
+using KBase::KException;
+using KBase::VctrPstn;
+using KBase::ReportingLevel;
+using KBase::CheckpointWriter;
+using KBase::CheckpointReader;
+
+namespace {
+const uint32_t ckptVersion = 2;
+
+// The tables which SMPState::stepBCN writes as the run goes;
+// configExec writes all the others once the run is over.
+const vector<string> runTables = {
+  "PosEquiv", "PosProb", "PosVote", "UtilChlg", "ProbVict", "TPProbVictLoss",
+  "Bargn", "BargnCoords", "BargnUtil", "BargnVote" };
+
+bool sameBits(const KMatrix & a, const KMatrix & b) {
+  if ((a.numR() != b.numR()) || (a.numC() != b.numC())) {
+    return false;
+  }
+  for (unsigned int i = 0; i < a.numR(); i++) {
+    for (unsigned int j = 0; j < a.numC(); j++) {
+      const double x = a(i, j);
+      const double y = b(i, j);
+      if (0 != std::memcmp(&x, &y, sizeof(double))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Which actors changed; none are listed when the changes are not known.
+void saveFlags(CheckpointWriter & cw, const vector<bool> & f) {
+  cw.u32(f.size());
+  for (bool b : f) {
+    cw.u32(b ? 1 : 0);
+  }
+  return;
+}
+
+vector<bool> loadFlags(CheckpointReader & cr) {
+  vector<bool> f(cr.u32(), false);
+  for (unsigned int i = 0; i < f.size(); i++) {
+    f[i] = (1 == cr.u32());
+  }
+  return f;
+}
+}
+
+void SMPModel::saveCheckpoint(const string & path) {
+  if (!parentScenId.empty()) {
+    throw KException("SMPModel::saveCheckpoint: a fork shares states with its parent, so cannot be checkpointed");
+  }
+  CheckpointWriter cw;
+  cw.u32(ckptVersion);
+  saveModelState(cw);
+
+  // the input, and the parameters in the order of updateModelParameters,
+  // then the solver of the PCEs
+  cw.u32(numAct);
+  cw.u32(numDim);
+  for (auto a : actrs) {
+    auto sa = ((const SMPActor*)a);
+    cw.str(sa->name);
+    cw.f64(sa->sCap);
+    cw.matrix(sa->vSal);
+  }
+  const vector<int> params = { (int)vpm, (int)pcem, (int)stm, (int)vrCltn, (int)bigRAdj,
+    (int)bigRRng, (int)tpCommit, (int)ivBrgn, (int)brgnMod, (int)pceSolver };
+  for (int p : params) {
+    cw.u32(p);
+  }
+
+  cw.u64(nextBargainID);
+
+  cw.u32(history.size());
+  const KMatrix * prevAcc = nullptr;
+  for (auto s : history) {
+    auto st = ((const SMPState*)s);
+    auto pos = KMatrix(numAct, numDim);
+    auto idl = KMatrix(numAct, numDim);
+    for (unsigned int i = 0; i < numAct; i++) {
+      auto pi = ((const VctrPstn*)(st->pstns[i]));
+      for (unsigned int k = 0; k < numDim; k++) {
+        pos(i, k) = (*pi)(k, 0);
+        idl(i, k) = st->ideals[i](k, 0);
+      }
+    }
+    cw.matrix(pos);
+    cw.matrix(idl);
+    cw.matrix(st->nra);
+    cw.matrix(st->nraProb);
+
+    const bool sameAcc = (nullptr != prevAcc) && sameBits(*prevAcc, st->accomodate);
+    cw.u32(sameAcc ? 1 : 0);
+    if (!sameAcc) {
+      cw.matrix(st->accomodate);
+    }
+    prevAcc = &(st->accomodate);
+
+    cw.u32(st->positionMovers.size());
+    for (const auto & m : st->positionMovers) {
+      cw.u32(m.first);
+      cw.u64(m.second);
+    }
+    saveFlags(cw, st->pstnMoved);
+    saveFlags(cw, st->idealMoved);
+  }
+
+  cw.save(path);
+  return;
+}
+
+void SMPModel::resume(const string & path) {
+  CheckpointReader cr(path);
+  if (ckptVersion != cr.u32()) {
+    throw KException("SMPModel::resume: " + path + " was saved by another version of SMP");
+  }
+  loadModelState(cr);
+
+  // read it all before comparing, as each read moves on
+  bool same = (numAct == cr.u32());
+  same = (numDim == cr.u32()) && same;
+  for (unsigned int i = 0; same && (i < numAct); i++) {
+    auto ai = ((const SMPActor*)(actrs[i]));
+    const string n = cr.str();
+    const double c = cr.f64();
+    const KMatrix sal = cr.matrix();
+    same = (ai->name == n) && (ai->sCap == c) && sameBits(ai->vSal, sal);
+  }
+  const vector<int> params = { (int)vpm, (int)pcem, (int)stm, (int)vrCltn, (int)bigRAdj,
+    (int)bigRRng, (int)tpCommit, (int)ivBrgn, (int)brgnMod, (int)pceSolver };
+  for (unsigned int n = 0; same && (n < params.size()); n++) {
+    same = ((uint32_t)params[n] == cr.u32());
+  }
+  if (!same) {
+    throw KException("SMPModel::resume: " + path
+      + " is not a checkpoint of this scenario with these parameters");
+  }
+
+  nextBargainID = cr.u64();
+
+  const unsigned int ns = cr.u32();
+  if (0 == ns) {
+    throw KException("SMPModel::resume: " + path + " holds no states");
+  }
+
+  // the initial state, read from the input, is rebuilt along with the rest
+  while (0 < history.size()) {
+    delete history.back();
+    history.pop_back();
+  }
+
+  KMatrix acc = KMatrix();
+  for (unsigned int t = 0; t < ns; t++) {
+    auto st = new SMPState(this); // its turn is history.size()
+    addState(st);
+
+    const KMatrix pos = cr.matrix();
+    const KMatrix idl = cr.matrix();
+    const KMatrix nra = cr.matrix();
+    const KMatrix nraProb = cr.matrix();
+    const bool sameAcc = (1 == cr.u32());
+    if (!sameAcc) {
+      acc = cr.matrix();
+    }
+    const bool shapeP = (numAct == pos.numR()) && (numDim == pos.numC())
+      && (numAct == idl.numR()) && (numDim == idl.numC());
+    if (!shapeP || (sameAcc && (0 == t))) {
+      throw KException("SMPModel::resume: " + path + " holds a malformed state");
+    }
+
+    for (unsigned int i = 0; i < numAct; i++) {
+      auto pi = new VctrPstn(numDim, 1);
+      auto ii = VctrPstn(numDim, 1);
+      for (unsigned int k = 0; k < numDim; k++) {
+        (*pi)(k, 0) = pos(i, k);
+        ii(k, 0) = idl(i, k);
+      }
+      st->pstns[i] = pi; // the constructor made room for them, as for doBCN
+      st->ideals.push_back(ii);
+    }
+    if (0 < acc.numC()) {
+      st->setAccomodate(acc);
+    }
+
+    const unsigned int nm = cr.u32();
+    for (unsigned int m = 0; m < nm; m++) {
+      const unsigned int k = cr.u32();
+      const uint64_t bid = cr.u64();
+      if (k >= numAct) {
+        throw KException("SMPModel::resume: " + path + " holds a malformed state");
+      }
+      st->setPosMoverBargain(k, bid);
+    }
+    st->pstnMoved = loadFlags(cr);
+    st->idealMoved = loadFlags(cr);
+    const bool flagsP = ((0 == st->pstnMoved.size()) || (numAct == st->pstnMoved.size()))
+      && ((0 == st->idealMoved.size()) || (numAct == st->idealMoved.size()));
+    if (!flagsP) {
+      throw KException("SMPModel::resume: " + path + " holds a malformed state");
+    }
+
+    // as SMPState::stepBCN sets up each new state
+    st->setUENdx();
+    st->setAUtil(-1, ReportingLevel::Silent);
+    if (!sameBits(nra, st->nra) || !sameBits(nraProb, st->nraProb)) {
+      throw KException("SMPModel::resume: state " + std::to_string(t) + " of " + path
+        + " does not come out the same from this input");
+    }
+    st->step = [st]() {
+      return st->stepBCN();
+    };
+  }
+  if (!cr.atEnd()) {
+    throw KException("SMPModel::resume: " + path + " holds more than expected");
+  }
+
+  rewindResults(ns - 1, runTables);
+  LOG(INFO) << "Resuming scenario" << scenId << "in turn" << (ns - 1) << "from" << path;
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
@@ -0,0 +1,223 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// --------------------------------------------
+//
+// Monte-Carlo ensembles of an SMP scenario. The summary is one table, with a
+// row for each quantity and the columns
+//
+//   Measure,Turn,Actor,Dim,N,Mean,SD,Min,Q05,Median,Q95,Max,Histogram
+//
+// where Measure is one of
+//
+//   Position       actor i's position on dimension k in turn t, over the N
+//                  replicates which reached turn t
+//   FinalPosition  the same in each replicate's final turn, with the counts
+//                  of a histogram over [0, 1], separated by spaces
+//   FinalProb      the probability of actor i's final position
+//   Turns          the final turn
+//
+// and a column which does not apply to the measure is empty. The quantiles
+// are P-squared estimates, so they are approximate once N exceeds five, and
+// depend on the order of the replicates; they are folded in order of
+// replicate, so the table is the same however many run at once.
+//
+// --------------------------------------------
+
+#include <fstream>
+
+#include "smp.h"
+
+namespace SMPLib {
+using std::string;
+using std::vector;
+
+using KBase::KMatrix;
+using KBase::KException;
+using KBase::VctrPstn;
+
+namespace {
+string cellCols(const KBase::RunningStats & st, double q05, double q50, double q95) {
+  return KBase::getFormattedString("%llu,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g",
+    (unsigned long long)st.count(), st.mean(), st.stdv(), st.min(), q05, q50, q95, st.max());
+}
+}
+
+void SMPEnsemble::Cell::add(double x) {
+  st.add(x);
+  q05.add(x);
+  q50.add(x);
+  q95.add(x);
+  return;
+}
+
+SMPEnsemble::SMPEnsemble(unsigned int r, uint64_t s) : replicates(r), seed(s) {
+  if (0 == replicates) {
+    throw KException("SMPEnsemble: there must be at least one replicate");
+  }
+}
+
+unsigned int SMPEnsemble::run(const string & inputDataFile, const vector<int> & modelParams,
+                              unsigned int maxPar) {
+  SMPSweep sw;
+  if (!modelParams.empty()) {
+    if (modelParams.size() != sw.paramValues.size()) {
+      throw KException("SMPEnsemble::run: expected " + std::to_string(sw.paramValues.size())
+        + " model parameters");
+    }
+    for (unsigned int p = 0; p < modelParams.size(); p++) {
+      sw.paramValues[p] = { modelParams[p] };
+    }
+  }
+  sw.paramValues[2] = { (int)KBase::StateTransMode::StochasticSTM };
+  sw.draws = replicates;
+  sw.seed = seed;
+  sw.maxPar = maxPar;
+  sw.runOptions = runOptions;
+
+  na = 0;
+  nd = 0;
+  turnPos.clear();
+  finalPos.clear();
+  finalHist.clear();
+  finalProb.clear();
+  turns = Cell();
+
+  held.clear();
+  nextFold = 0;
+
+  const unsigned int done = sw.run(inputDataFile, [this](const SMPSweep::Point & pt, const SMPModel * md) {
+    add(pt.run, md);
+  });
+  // those held back by a replicate which failed
+  for (const auto & h : held) {
+    fold(h.second);
+  }
+  held.clear();
+  return done;
+}
+
+void SMPEnsemble::add(unsigned int r, const SMPModel * md) {
+  Replicate rp;
+  rp.finalT = md->history.size() - 1;
+  rp.numAct = md->numAct;
+  rp.numDim = md->numDim;
+  auto st = ((SMPState*)(md->history[rp.finalT]));
+  if (!st->aUtilSet()) {
+    st->setAUtil(-1, KBase::ReportingLevel::Silent);
+  }
+  const auto pn = st->pDist(-1);
+  rp.prob = vector<double>(rp.numAct);
+  for (unsigned int i = 0; i < rp.numAct; i++) {
+    rp.prob[i] = st->posProb(i, std::get<1>(pn), std::get<0>(pn));
+  }
+  rp.pos.reserve((rp.finalT + 1) * rp.numAct * rp.numDim);
+  for (unsigned int t = 0; t <= rp.finalT; t++) {
+    auto s = md->history[t];
+    for (unsigned int i = 0; i < rp.numAct; i++) {
+      auto pi = ((const VctrPstn*)(s->pstns[i]));
+      for (unsigned int k = 0; k < rp.numDim; k++) {
+        rp.pos.push_back((*pi)(k, 0));
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(mtx);
+  held[r] = std::move(rp);
+  while ((!held.empty()) && (nextFold == held.begin()->first)) {
+    fold(held.begin()->second);
+    held.erase(held.begin());
+    nextFold++;
+  }
+  return;
+}
+
+void SMPEnsemble::fold(const Replicate & rp) {
+  if (0 == na) {
+    na = rp.numAct;
+    nd = rp.numDim;
+    finalPos = vector<Cell>(na * nd);
+    finalHist = vector<KBase::Histogram>(na * nd, KBase::Histogram(0.0, 1.0, histBins));
+    finalProb = vector<Cell>(na);
+  }
+  const unsigned int finalT = rp.finalT;
+  if (turnPos.size() <= finalT) {
+    turnPos.resize(finalT + 1, vector<Cell>(na * nd));
+  }
+  for (unsigned int t = 0; t <= finalT; t++) {
+    for (unsigned int ik = 0; ik < na * nd; ik++) {
+      turnPos[t][ik].add(rp.pos[t * na * nd + ik]);
+    }
+  }
+  for (unsigned int ik = 0; ik < na * nd; ik++) {
+    const double x = rp.pos[finalT * na * nd + ik];
+    finalPos[ik].add(x);
+    finalHist[ik].add(x);
+  }
+  for (unsigned int i = 0; i < na; i++) {
+    finalProb[i].add(rp.prob[i]);
+  }
+  turns.add(finalT);
+  return;
+}
+
+void SMPEnsemble::writeSummary(const string & fileName) const {
+  std::ofstream out(fileName);
+  if (!out.is_open()) {
+    throw KException("SMPEnsemble::writeSummary: could not open " + fileName);
+  }
+  auto cols = [](const Cell & c) {
+    return cellCols(c.st, c.q05.value(), c.q50.value(), c.q95.value());
+  };
+
+  out << "Measure,Turn,Actor,Dim,N,Mean,SD,Min,Q05,Median,Q95,Max,Histogram\n";
+  for (unsigned int t = 0; t < turnPos.size(); t++) {
+    for (unsigned int i = 0; i < na; i++) {
+      for (unsigned int k = 0; k < nd; k++) {
+        out << "Position," << t << "," << i << "," << k << "," << cols(turnPos[t][i * nd + k]) << ",\n";
+      }
+    }
+  }
+  for (unsigned int i = 0; i < na; i++) {
+    for (unsigned int k = 0; k < nd; k++) {
+      string h = "";
+      for (auto c : finalHist[i * nd + k].binCounts()) {
+        h += (h.empty() ? "" : " ") + std::to_string(c);
+      }
+      out << "FinalPosition,," << i << "," << k << "," << cols(finalPos[i * nd + k]) << "," << h << "\n";
+    }
+  }
+  for (unsigned int i = 0; i < na; i++) {
+    out << "FinalProb,," << i << ",," << cols(finalProb[i]) << ",\n";
+  }
+  out << "Turns,,,," << cols(turns) << ",\n";
+
+  if (!out.good()) {
+    throw KException("SMPEnsemble::writeSummary: could not write " + fileName);
+  }
+  return;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
@@ -0,0 +1,154 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// --------------------------------------------
+//
+// What-if branches of an SMP run. A fork at turn t keeps pointers to its
+// parent's states before t, which nothing changes once the run has moved on,
+// and copies only state t: the positions, ideals and accommodation from which
+// its own run starts. Everything else about that state (utilities,
+// probabilities, ...) is worked out again by stepBCN, under whatever the
+// caller changed in the fork's actors or parameters.
+//
+// --------------------------------------------
+
+#include "smp.h"
+
+namespace SMPLib {
+using std::string;
+using std::vector;
+
+using KBase::KException;
+using KBase::VctrPstn;
+
+SMPModel * SMPModel::fork(unsigned int t, string name, string desc) const {
+  if (t >= history.size()) {
+    throw KException("SMPModel::fork: turn " + std::to_string(t) + " is not in the history");
+  }
+  if (name.empty()) {
+    name = scenName + "-fork" + std::to_string(t);
+  }
+  if (desc.empty()) {
+    desc = "Fork of " + scenId + " at turn " + std::to_string(t);
+  }
+
+  auto fk = new SMPModel(desc, rngSeed, logPolicy.groups(), name);
+  fk->rng->setState(rng->getState());
+  fk->parentScenId = scenId;
+  fk->forkTurn = t;
+
+  fk->vpm = vpm;
+  fk->pcem = pcem;
+  fk->pceSolver = pceSolver;
+  fk->stm = stm;
+  fk->vrCltn = vrCltn;
+  fk->tpCommit = tpCommit;
+  fk->bigRAdj = bigRAdj;
+  fk->bigRRng = bigRRng;
+  fk->ivBrgn = ivBrgn;
+  fk->brgnMod = brgnMod;
+  fk->posTol = posTol;
+  fk->nextBargainID = nextBargainID.load(); // its movers into state t have this run's IDs
+
+  for (auto dn : dimName) {
+    fk->addDim(dn);
+  }
+  for (auto a : actrs) {
+    auto sa = ((const SMPActor*)a);
+    auto fa = new SMPActor(sa->name, sa->desc);
+    fa->sCap = sa->sCap;
+    fa->vSal = sa->vSal;
+    fa->vr = sa->vr;
+    fk->addActor(fa);
+  }
+
+  try {
+    fk->sqlTest();
+    fk->setLogPolicy(logPolicy);
+
+    // shared, not copied: Model::~Model leaves them to this model
+    for (unsigned int i = 0; i < t; i++) {
+      fk->history.push_back(history[i]);
+    }
+
+    auto s = ((const SMPState*)(history[t]));
+    auto st = new SMPState(fk); // its turn is t
+    fk->addState(st);
+    for (unsigned int i = 0; i < numAct; i++) {
+      auto pi = ((const VctrPstn*)(s->pstns[i]));
+      st->pstns[i] = new VctrPstn(*pi);
+    }
+    st->ideals = s->ideals;
+    st->setAccomodate(s->accomodate);
+    st->positionMovers = s->positionMovers;
+    st->step = [st]() {
+      return st->stepBCN();
+    };
+  }
+  catch (...) {
+    delete fk;
+    throw;
+  }
+
+  LOG(INFO) << "Forked scenario" << fk->scenId << "from" << scenId << "at turn" << t;
+  return fk;
+}
+
+string SMPModel::runFork(unsigned int t, const function<void(SMPModel *)> & edit, string name) {
+  if (nullptr == md0) {
+    lastExceptionMsg = "SMPModel::runFork: there is no model run to fork";
+    LOG(INFO) << lastExceptionMsg;
+    return "";
+  }
+
+  SMPModel * fk = nullptr;
+  string id = "";
+  try {
+    fk = md0->fork(t, name);
+    if (nullptr != edit) {
+      edit(fk);
+    }
+    displayModelParams(fk);
+    configExec(fk);
+    fk->releaseDB();
+    id = fk->getScenarioID();
+  }
+  catch (KException &ke) {
+    lastExceptionMsg = ke.msg;
+    LOG(INFO) << lastExceptionMsg;
+  }
+  catch (std::exception &std_ex) {
+    lastExceptionMsg = std_ex.what();
+    LOG(INFO) << lastExceptionMsg;
+  }
+  catch (...) {
+    lastExceptionMsg = "SMPModel::runFork: Unknown Exception Caught";
+    LOG(INFO) << lastExceptionMsg;
+  }
+  delete fk;
+  return id;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
@@ -145,7 +145,8 @@ KTable * SMPModel::createSQL(unsigned int n)  {
 
 void SMPModel::sqlTest() {
   QCoreApplication::addLibraryPath("./plugins");
-  initDBDriver(QString("smpDB"));
+  // one connection per model, so that a fork can run while its parent still exists
+  initDBDriver(QString::fromStdString("smpDB_" + scenId));
 
   if (0 == dbDriver.compare("QPSQL")) {
     if (!connectDB()) {
@@ -211,6 +212,8 @@ void SMPModel::sqlTest() {
     // create the table
     execQuery(thistable->tabSQL);
   }
+  setLogPolicy(logPolicy); // now that its tables are known
+
 
   return;
 }
@@ -258,102 +261,121 @@ void SMPModel::LogInfoTables()
     throw KException("SMPModel::LogInfoTables: st is null pointer");
   }
   auto accM = st->getAccomodate();
-
-  // Accomodation table to record affinities
-  query.prepare(QString::fromStdString(sqlAcc));
-  if ((accM.numR() != numAct) || (accM.numC() != numAct)) {
-    throw KException("SMPModel::LogInfoTables: accM matrix shape is not correct");
-  }
-  for (unsigned int Act_i = 0; Act_i < numAct; ++Act_i) {
-      for (unsigned int Act_j = 0; Act_j < numAct; ++Act_j) {
-          //bind the data
-          query.bindValue(":act_i", Act_i);
-          query.bindValue(":act_j", Act_j);
-          query.bindValue(":affinity", accM(Act_i, Act_j));
-          // record
-          if (!query.exec()) {
-            LOG(INFO) << query.lastError().text().toStdString();
-            throw KException("SMPModel::LogInfoTables: Failed to write Accommodation record");
-          }
-      }
-  }
-
-  // Dimension Description Table
-  query.prepare(QString::fromStdString(sqlD));
-  for (unsigned int k = 0; k < dimName.size(); k++)
-  {
-    // bind the data
-    query.bindValue(":dim_k", k);
-    query.bindValue(":desc", dimName[k].c_str());
-    // record
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("SMPModel::LogInfoTables: Failed to write DimensionDescription record");
+  const unsigned int finalT = history.size() - 1;
+  const KBase::LogPolicy::Rule & capRule = logRule("SpatialCapability");
+  const KBase::LogPolicy::Rule & salRule = logRule("SpatialSalience");
+
+  if (logRule("Accommodation").on) {
+    // Accomodation table to record affinities
+    query.prepare(QString::fromStdString(sqlAcc));
+    if ((accM.numR() != numAct) || (accM.numC() != numAct)) {
+      throw KException("SMPModel::LogInfoTables: accM matrix shape is not correct");
+    }
+    for (unsigned int Act_i = 0; Act_i < numAct; ++Act_i) {
+        for (unsigned int Act_j = 0; Act_j < numAct; ++Act_j) {
+            //bind the data
+            query.bindValue(":act_i", Act_i);
+            query.bindValue(":act_j", Act_j);
+            query.bindValue(":affinity", accM(Act_i, Act_j));
+            // record
+            if (!query.exec()) {
+              LOG(INFO) << query.lastError().text().toStdString();
+              throw KException("SMPModel::LogInfoTables: Failed to write Accommodation record");
+            }
+        }
     }
   }
 
-  // Spatial Capability
-  query.prepare(QString::fromStdString(sqlC));
-  // for each turn extract the information
-  for (unsigned int t = 0; t < history.size(); t++) {
-    auto st = history[t];
-    // get each actors capability value for each turn
-    auto cp = (const SMPState*)history[t];
-    auto caps = cp->actrCaps();
-    for (unsigned int i = 0; i < numAct; i++) {
-      // bind data
-      query.bindValue(":turn_t", t);
-      query.bindValue(":act_i", i);
-      query.bindValue(":cap", caps(0, i));
+  if (logRule("DimensionDescription").on) {
+    // Dimension Description Table
+    query.prepare(QString::fromStdString(sqlD));
+    for (unsigned int k = 0; k < dimName.size(); k++)
+    {
+      // bind the data
+      query.bindValue(":dim_k", k);
+      query.bindValue(":desc", dimName[k].c_str());
       // record
       if (!query.exec()) {
         LOG(INFO) << query.lastError().text().toStdString();
-        throw KException("SMPModel::LogInfoTables: Failed to write SpatialCapability record");
+        throw KException("SMPModel::LogInfoTables: Failed to write DimensionDescription record");
       }
     }
   }
 
-  // Spatial Salience
-  query.prepare(QString::fromStdString(sqlS));
-  // for each turn extract the information
-  for (unsigned int t = 0; t < history.size(); t++) {
-    // Get the individual turn
-    auto st = history[t];
-    // get the SMPState for turn
-    auto cp = (const SMPState*)history[t];
-    // Extract information for each actor and dimension
-    for (unsigned int i = 0; i < numAct; i++) {
-      for (unsigned int k = 0; k < numDim; k++) {
-        // Populate the actor
-        auto ai = ((const SMPActor*)actrs[i]);
-        // Get the Salience Value for each actor
-        //                double sal = ai->vSal(k, 0);
-        //bind the data
+  if (capRule.on) {
+    // Spatial Capability
+    query.prepare(QString::fromStdString(sqlC));
+    // for each turn extract the information
+    for (unsigned int t = forkTurn; t < history.size(); t++) {
+      if (!capRule.selected(t, finalT)) {
+        continue;
+      }
+      auto st = history[t];
+      // get each actors capability value for each turn
+      auto cp = (const SMPState*)history[t];
+      auto caps = cp->actrCaps();
+      for (unsigned int i = 0; i < numAct; i++) {
+        // bind data
         query.bindValue(":turn_t", t);
         query.bindValue(":act_i", i);
-        query.bindValue(":dim_k", k);
-        query.bindValue(":sal", ai->vSal(k, 0));
+        query.bindValue(":cap", caps(0, i));
         // record
         if (!query.exec()) {
           LOG(INFO) << query.lastError().text().toStdString();
-          throw KException("SMPModel::LogInfoTables: Failed to write SpatialSalience record");
+          throw KException("SMPModel::LogInfoTables: Failed to write SpatialCapability record");
         }
       }
     }
   }
 
-  query.prepare(QString::fromStdString(sqlSc));
-  //ScenarioDesc table
-  query.bindValue(":vr", static_cast<int>(vrCltn));
-  query.bindValue(":br", static_cast<int>(bigRAdj));
-  query.bindValue(":brr", static_cast<int>(bigRRng));
-  query.bindValue(":tpc", static_cast<int>(tpCommit));
-  query.bindValue(":ivb", static_cast<int>(ivBrgn));
-  query.bindValue(":bm", static_cast<int>(brgnMod));
-
-  if (!query.exec()) {
-    LOG(INFO) << query.lastError().text().toStdString();
-    throw KException("SMPModel::LogInfoTables: Failed to write ScenarioDesc record");   
+  if (salRule.on) {
+    // Spatial Salience
+    query.prepare(QString::fromStdString(sqlS));
+    // for each turn extract the information
+    for (unsigned int t = forkTurn; t < history.size(); t++) {
+      if (!salRule.selected(t, finalT)) {
+        continue;
+      }
+      // Get the individual turn
+      auto st = history[t];
+      // get the SMPState for turn
+      auto cp = (const SMPState*)history[t];
+      // Extract information for each actor and dimension
+      for (unsigned int i = 0; i < numAct; i++) {
+        for (unsigned int k = 0; k < numDim; k++) {
+          // Populate the actor
+          auto ai = ((const SMPActor*)actrs[i]);
+          // Get the Salience Value for each actor
+          //                double sal = ai->vSal(k, 0);
+          //bind the data
+          query.bindValue(":turn_t", t);
+          query.bindValue(":act_i", i);
+          query.bindValue(":dim_k", k);
+          query.bindValue(":sal", ai->vSal(k, 0));
+          // record
+          if (!query.exec()) {
+            LOG(INFO) << query.lastError().text().toStdString();
+            throw KException("SMPModel::LogInfoTables: Failed to write SpatialSalience record");
+          }
+        }
+      }
+    }
+  }
+
+  if (logRule("ScenarioDesc").on) {
+    query.prepare(QString::fromStdString(sqlSc));
+    //ScenarioDesc table
+    query.bindValue(":vr", static_cast<int>(vrCltn));
+    query.bindValue(":br", static_cast<int>(bigRAdj));
+    query.bindValue(":brr", static_cast<int>(bigRRng));
+    query.bindValue(":tpc", static_cast<int>(tpCommit));
+    query.bindValue(":ivb", static_cast<int>(ivBrgn));
+    query.bindValue(":bm", static_cast<int>(brgnMod));
+
+    if (!query.exec()) {
+      LOG(INFO) << query.lastError().text().toStdString();
+      throw KException("SMPModel::LogInfoTables: Failed to write ScenarioDesc record");   
+    }
   }
 
   // finish
@@ -365,8 +387,8 @@ void SMPModel::LogInfoTables()
 
 // --------------------------------------------
 void SMPState::updateBargnTable(const vector<vector<BargainSMP*>> & brgns,
-                                map<unsigned int, KBase::KMatrix>  actorBargains,
-                                map<unsigned int, unsigned int>   actorMaxBrgNdx) const {
+                                const vector<KBase::KMatrix> & actorBargains,
+                                const vector<unsigned int> & actorMaxBrgNdx) const {
 
   string sql = string("UPDATE Bargn SET Init_Prob = :init_prob, Init_Seld = :init_seld, "
     "Recd_Prob = :recd_prob, Recd_Seld = :recd_seld "
@@ -374,50 +396,46 @@ void SMPState::updateBargnTable(const vector<vector<BargainSMP*>> & brgns,
     "and (:turn_t = Turn_t) and (:bgnId = BargnId) "
     "and (:init_act_i = Init_Act_i) and (:recd_act_j = Recd_Act_j)");
 
-  QSqlQuery query = model->getQuery();
-
-  query.prepare(QString::fromStdString(sql));
+  KBase::SQLBatch b(sql, 8, "SMPState::updateBargnTable");
+  const KBase::LogPolicy::Rule & r = model->logRule("Bargn");
+  const uint64_t seed = model->getSeed();
 
-  auto updateBargn = [&query, this](int bargnID,
+  auto updateBargn = [&b, &r, seed, this](int bargnID,
     int initActor, double initProb, int isInitSelected,
     int recvActor, double recvProb, int isRecvSelected) {
+    // the same key as in Model::sqlBargainEntries, so that both pick the same rows
+    if (!r.sample(seed, turn, bargnID, (initActor << 16) | recvActor)) {
+      return;
+    }
 
-    query.bindValue(":init_prob", initProb);
+    b.add(initProb);
 
-    query.bindValue(":init_seld", isInitSelected);
+    b.add(isInitSelected);
 
     // For SQ cases, there would be no receiver
     if (initActor != recvActor) {
-      query.bindValue(":recd_prob", recvProb);
+      b.add(recvProb);
 
-      query.bindValue(":recd_seld", isRecvSelected);
+      b.add(isRecvSelected);
     }
     else {
       // Pass NULL values for SQ cases
-      query.bindValue(":recd_prob", QVariant::Double);
+      b.add(KBase::SQLValue());
 
-      query.bindValue(":recd_seld", QVariant::Int);
+      b.add(KBase::SQLValue());
     }
 
-    query.bindValue(":turn_t", turn);
+    b.add(turn);
 
-    query.bindValue(":bgnId", bargnID);
+    b.add(bargnID);
 
-    query.bindValue(":init_act_i", initActor);
+    b.add(initActor);
 
-    query.bindValue(":recd_act_j", recvActor);
-
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("SMPState::updateBargnTable: DB query failed");
-    }
+    b.add(recvActor);
 
     return;
   };
 
-  // start for the transaction
-  //model->beginDBTransaction();
-
   // Update the bargain table for the bargain values for init actor and recd actor
   // along with the info whether a bargain got selected or not in the respective actor's queue
   for (unsigned int i = 0; i < brgns.size(); i++) {
@@ -489,24 +507,13 @@ void SMPState::updateBargnTable(const vector<vector<BargainSMP*>> & brgns,
     }
   }
 
-  //model->commitDBTransaction();
+  model->sqlWriteTurn("Bargn", turn, std::move(b));
 
   return;
 }
 
 void SMPState::recordProbEduChlg() const {
-  size_t basePos = -1;
-  size_t digCount = 0;
-  size_t nextCommaPos = string::npos;
-
-  auto nextActor = [&basePos, &nextCommaPos](string &actors) {
-    basePos = nextCommaPos + 1;
-    nextCommaPos = actors.find_first_of(",", basePos);
-    size_t digCount = nextCommaPos - basePos;
-    return actors.substr(basePos, digCount);
-  };
-
-  QSqlQuery query = model->getQuery();
+  const unsigned int na = model->numAct;
   string qsql;
   qsql = string("INSERT INTO TPProbVictLoss "
     "(ScenarioId, Turn_t, Est_h, Init_i, ThrdP_k, Rcvr_j, Prob, Util_V, Util_L) "
@@ -514,119 +521,192 @@ void SMPState::recordProbEduChlg() const {
     "'") + model->getScenarioID() + "',"
     " :t, :h, :i, :thrdp_k, :j, :prob, :util_v, :util_l )";
 
-  query.prepare(QString::fromStdString(qsql));
+  unsigned int numEntries = 0;
+  for (const ChlgLog & cl : chlgLogs) {
+    numEntries += cl.entries.size();
+  }
+  // the entries were kept for any of the tables, so each picks its own rows again
+  const uint64_t seed = model->getSeed();
+  auto keeps = [this, seed](const KBase::LogPolicy::Rule * r, const ChlgEntry & e) {
+    return (nullptr != r) && r->estimator(e.h)
+      && r->sample(seed, turn, (e.h << 16) | e.k, (e.i << 16) | e.j);
+  };
 
-  //model->beginDBTransaction();
-  for (auto &tpv : tpvData) {
-    auto thij = tpv.first;
-    auto tpvArray = tpv.second;
+  KBase::SQLBatch tpBatch(qsql, 8, "SMPState::recordProbEduChlg");
+  tpBatch.vals.reserve(8 * na * numEntries);
+  for (const ChlgLog & cl : chlgLogs) {
+    for (const ChlgEntry & e : cl.entries) {
+      if (ChlgCache::noLog == e.tpvLog) { // its third parties are not recorded
+        continue;
+      }
+      const double * tpv = &(chlgLogs[e.tpvLog].tpv[e.tpvAt]);
+      for (unsigned int tpk = 0; tpk < na; tpk++) {  // third party voter, tpk
+        tpBatch.add(turn);
+        tpBatch.add(e.h);
+        tpBatch.add(e.i);
+        tpBatch.add(tpk);
+        tpBatch.add(e.j);
+        tpBatch.add(tpv[3 * tpk + 0]); // prob
+        tpBatch.add(tpv[3 * tpk + 1]); // util_v
+        tpBatch.add(tpv[3 * tpk + 2]); // util_l
+      }
+    }
+  }
+  model->sqlWrite(std::move(tpBatch));
 
-    basePos = -1;
-    digCount = 0;
-    nextCommaPos = string::npos;
+  qsql = string("INSERT INTO ProbVict "
+    "(ScenarioId, Turn_t, Est_h,Init_i,Rcvr_j,Prob) VALUES ('")
+    + model->getScenarioID() + "', :t, :h, :i, :j, :phij)";
 
-    auto t = std::stoi(nextActor(thij));
-    auto h = std::stoi(nextActor(thij));
-    auto i = std::stoi(nextActor(thij));
-    auto j = std::stoi(nextActor(thij));
+  KBase::SQLBatch pvBatch(qsql, 5, "SMPState::recordProbEduChlg");
+  pvBatch.vals.reserve(5 * numEntries);
+  for (const ChlgLog & cl : chlgLogs) {
+    for (const ChlgEntry & e : cl.entries) {
+      if (!keeps(chlgRules[1], e)) {
+        continue;
+      }
+      pvBatch.add(turn);
+      pvBatch.add(e.h);
+      pvBatch.add(e.i);
+      pvBatch.add(e.j);
+      pvBatch.add(e.phij);
+    }
+  }
+  model->sqlWrite(std::move(pvBatch));
 
-    query.bindValue(":t", t);
-    query.bindValue(":h", h);
-    query.bindValue(":i", i);
-    query.bindValue(":j", j);
+  qsql = string("INSERT INTO UtilChlg "
+    "(ScenarioId, Turn_t, Est_h,Aff_k,Init_i,Rcvr_j,Util_SQ,Util_Vict,Util_Cntst,Util_Chlg) VALUES ('")
+    + model->getScenarioID() + "', :t, :h, :k, :i, :j, :euSQ, :euVict, :euCntst, :euChlg)";
 
-    const unsigned int na = model->numAct;
+  KBase::SQLBatch ucBatch(qsql, 9, "SMPState::recordProbEduChlg");
+  ucBatch.vals.reserve(9 * numEntries);
+  for (const ChlgLog & cl : chlgLogs) {
+    for (const ChlgEntry & e : cl.entries) {
+      if (!keeps(chlgRules[0], e)) {
+        continue;
+      }
+      ucBatch.add(turn);
+      ucBatch.add(e.h);
+      ucBatch.add(e.k);
+      ucBatch.add(e.i);
+      ucBatch.add(e.j);
+      ucBatch.add(e.euSQ);
+      ucBatch.add(e.euVict);
+      ucBatch.add(e.euCntst);
+      ucBatch.add(e.euChlg);
+    }
+  }
+  model->sqlWrite(std::move(ucBatch));
 
-    for (int tpk = 0; tpk < na; tpk++) {  // third party voter, tpk
-      query.bindValue(":thrdp_k", tpk);
+  // everything has been copied into the batches now, so release the memory
+  chlgLogs = {};
 
-      // bind the data
-      query.bindValue(":prob", tpvArray(tpk, 0));
-      query.bindValue(":util_v", tpvArray(tpk, 1));
-      query.bindValue(":util_l", tpvArray(tpk, 2));
+  return;
+}
 
-      // actually record it
-      if (!query.exec()) {
-        LOG(INFO) << query.lastError().text().toStdString();
-        throw KException("SMPState::recordProbEduChlg: DB query failed.");
-      }
+void SMPModel::regenChlgTables(const string & scenarioID, const vector<unsigned int> & turns) {
+  // a model that records only the Challenge Tables, under the saved scenario's id
+  auto sm = std::unique_ptr<SMPModel>(new SMPModel("", KBase::dSeed, {false, false, true, false, false}));
+  sm->sqlTest();
+  sm->scenId = scenarioID;
+  QSqlQuery & qry = sm->query;
+
+  auto execQry = [&qry](const string & sql) {
+    if (!qry.exec(QString::fromStdString(sql))) {
+      LOG(INFO) << qry.lastError().text().toStdString();
+      throw KException("SMPModel::regenChlgTables: DB query failed");
     }
+  };
+  const string scen = " WHERE ScenarioId = '" + scenarioID + "'";
+
+  execQry("SELECT VotingRule, ThirdPartyCommit FROM ScenarioDesc" + scen);
+  if (!qry.next()) {
+    throw KException("SMPModel::regenChlgTables: Scenario not found in ScenarioDesc");
   }
+  sm->vrCltn = static_cast<VotingRule>(qry.value(0).toInt());
+  sm->tpCommit = static_cast<ThirdPartyCommit>(qry.value(1).toInt());
 
-  qsql = string("INSERT INTO ProbVict "
-    "(ScenarioId, Turn_t, Est_h,Init_i,Rcvr_j,Prob) VALUES ('")
-    + model->getScenarioID() + "', :t, :h, :i, :j, :phij)";
+  execQry("SELECT Name, \"Desc\" FROM ActorDescription" + scen + " ORDER BY Act_i");
+  while (qry.next()) {
+    sm->addActor(new SMPActor(qry.value(0).toString().toStdString(), qry.value(1).toString().toStdString()));
+  }
+  const unsigned int na = sm->numAct;
+  if (na < 2) {
+    throw KException("SMPModel::regenChlgTables: Scenario has fewer than two actors");
+  }
 
-  query.prepare(QString::fromStdString(qsql));
+  execQry("SELECT COUNT(*) FROM DimensionDescription" + scen);
+  const unsigned int nd = qry.next() ? qry.value(0).toUInt() : 0;
+  if (0 == nd) {
+    throw KException("SMPModel::regenChlgTables: Scenario has no dimensions");
+  }
 
-  for (auto &phijVal : phijData) {
-    auto thij = phijVal.first;
-    auto phij = phijVal.second;
+  auto checkNdx = [](unsigned int n, unsigned int lim) {
+    if (n >= lim) {
+      throw KException("SMPModel::regenChlgTables: Index out of range in recorded data");
+    }
+    return n;
+  };
 
-    basePos = -1;
-    digCount = 0;
-    nextCommaPos = string::npos;
+  // the identity matrix is the default, if none was recorded
+  auto accM = KBase::iMat(na);
+  execQry("SELECT Act_i, Act_j, Affinity FROM Accommodation" + scen);
+  while (qry.next()) {
+    accM(checkNdx(qry.value(0).toUInt(), na), checkNdx(qry.value(1).toUInt(), na)) = qry.value(2).toDouble();
+  }
 
-    auto t = std::stoi(nextActor(thij));
-    auto h = std::stoi(nextActor(thij));
-    auto i = std::stoi(nextActor(thij));
-    auto j = std::stoi(nextActor(thij));
+  // The last turn recorded is the final state, which never looked for challenges
+  vector<unsigned int> regenTurns = turns;
+  if (regenTurns.empty()) {
+    execQry("SELECT MAX(Turn_t) FROM PosUtil" + scen);
+    if (qry.next() && !qry.value(0).isNull()) {
+      const unsigned int lastT = qry.value(0).toUInt();
+      for (unsigned int t = 0; t < lastT; t++) {
+        regenTurns.push_back(t);
+      }
+    }
+  }
 
-    query.bindValue(":t", t);
-    query.bindValue(":h", h);
-    query.bindValue(":i", i);
-    query.bindValue(":j", j);
-    query.bindValue(":phij", phij);
+  for (auto t : regenTurns) {
+    const string turnT = scen + " AND Turn_t = " + std::to_string(t);
+    unsigned int n = 0;
 
-    // actually record it
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("SMPState::recordProbEduChlg: DB query failed.");
+    execQry("SELECT Act_i, Cap FROM SpatialCapability" + turnT);
+    for (n = 0; qry.next(); n++) {
+      auto ai = ((SMPActor*)(sm->actrs[checkNdx(qry.value(0).toUInt(), na)]));
+      ai->sCap = qry.value(1).toDouble();
+    }
+    if (n != na) {
+      throw KException("SMPModel::regenChlgTables: Incomplete SpatialCapability for turn " + std::to_string(t));
     }
-  }
 
-  qsql = string("INSERT INTO UtilChlg "
-    "(ScenarioId, Turn_t, Est_h,Aff_k,Init_i,Rcvr_j,Util_SQ,Util_Vict,Util_Cntst,Util_Chlg) VALUES ('")
-    + model->getScenarioID() + "', :t, :h, :k, :i, :j, :euSQ, :euVict, :euCntst, :euChlg)";
+    for (auto a : sm->actrs) {
+      ((SMPActor*)a)->vSal = KMatrix(nd, 1);
+    }
+    execQry("SELECT Act_i, Dim_k, Sal FROM SpatialSalience" + turnT);
+    for (n = 0; qry.next(); n++) {
+      auto ai = ((SMPActor*)(sm->actrs[checkNdx(qry.value(0).toUInt(), na)]));
+      ai->vSal(checkNdx(qry.value(1).toUInt(), nd), 0) = qry.value(2).toDouble();
+    }
+    if (n != na * nd) {
+      throw KException("SMPModel::regenChlgTables: Incomplete SpatialSalience for turn " + std::to_string(t));
+    }
 
-  query.prepare(QString::fromStdString(qsql));
-
-  for (auto &euVal : euData) {
-    auto thkij = euVal.first;
-    basePos = -1;
-    digCount = 0;
-    nextCommaPos = string::npos;
-
-    auto t = std::stoi(nextActor(thkij));
-    auto h = std::stoi(nextActor(thkij));
-    auto k = std::stoi(nextActor(thkij));
-    auto i = std::stoi(nextActor(thkij));
-    auto j = std::stoi(nextActor(thkij));
-
-    auto eu = euVal.second;
-    auto euSQ = eu[0];
-    auto euVict = eu[1];
-    auto euCntst = eu[2];
-    auto euChlg = eu[3];
-
-    query.bindValue(":t", t);
-    query.bindValue(":h", h);
-    query.bindValue(":k", k);
-    query.bindValue(":i", i);
-    query.bindValue(":j", j);
-    query.bindValue(":euSQ", euSQ);
-    query.bindValue(":euVict", euVict);
-    query.bindValue(":euCntst", euCntst);
-    query.bindValue(":euChlg", euChlg);
-
-    // actually record it
-    if (!query.exec()) {
-      LOG(INFO) << query.lastError().text().toStdString();
-      throw KException("SMPState::recordProbEduChlg: DB query failed.");
+    SMPState st(sm.get());
+    st.aUtil = vector<KMatrix>(na, KMatrix(na, na));
+    execQry("SELECT Est_h, Act_i, Pos_j, Util FROM PosUtil" + turnT);
+    for (n = 0; qry.next(); n++) {
+      const unsigned int h = checkNdx(qry.value(0).toUInt(), na);
+      st.aUtil[h](checkNdx(qry.value(1).toUInt(), na), checkNdx(qry.value(2).toUInt(), na)) = qry.value(3).toDouble();
     }
-  }
+    if (n != na * na * na) {
+      throw KException("SMPModel::regenChlgTables: Incomplete PosUtil for turn " + std::to_string(t));
+    }
+    st.setAccomodate(accM);
 
-  //model->commitDBTransaction();
+    LOG(INFO) << "Regenerating the Challenge Tables of scenario" << scenarioID << "turn" << t;
+    st.regenChlgs(t);
+  }
   return;
 }
 
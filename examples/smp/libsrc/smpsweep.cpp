@@ -0,0 +1,400 @@
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
+// The MIT License (MIT)
+//
+// Copyright (c) 2015 King Abdullah Petroleum Studies and Research Center
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom
+// the Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all copies or
+// substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+// BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+// DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+// --------------------------------------------
+//
+// Sensitivity sweeps of an SMP scenario. The input is read once; each run
+// then builds its own model from it, as initModel does, so runs share
+// nothing but the database, and by default record nothing there.
+//
+// Run r is draw (r % draws) of combination (r / draws) of the parameters,
+// the last parameter varying fastest. The draw alone fixes the run's seed
+// and its scaling of capabilities and saliences, from the stream (seed, draw)
+// of a StreamPRNG, so every combination sees the same draws: differences
+// between combinations come from the parameters, not from the luck of the
+// draw. A salience scaled up beyond what the actor has to spend is scaled
+// back down, so that each actor's saliences still sum to at most 1.
+//
+// --------------------------------------------
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+#include "smp.h"
+
+namespace SMPLib {
+using std::string;
+using std::vector;
+
+using KBase::KMatrix;
+using KBase::KException;
+using KBase::VctrPstn;
+using KBase::StreamPRNG;
+using KBase::lowerCase;
+using KBase::trimmed;
+using KBase::split;
+
+namespace {
+unsigned int number(const string & s, const string & clause) {
+  return KBase::number(s, "SMPSweep::apply", clause);
+}
+
+double spread(const string & s, const string & clause) {
+  size_t n = 0;
+  double x = -1.0;
+  try {
+    x = std::stod(s, &n);
+  }
+  catch (...) {
+    n = 0;
+  }
+  if ((n != s.size()) || !((0.0 <= x) && (x < 1.0))) {
+    throw KException("SMPSweep::apply: expected a spread in [0, 1), not '" + s + "', in " + clause);
+  }
+  return x;
+}
+
+// the names of each parameter's values, in the order of SMPSweep::paramNames
+const vector<const vector<string> *> valueNames = {
+  &KBase::VPModelNames, &KBase::PCEModelNames, &KBase::StateTransModeNames,
+  &KBase::VotingRuleNames, &KBase::BigRAdjustNames, &KBase::BigRRangeNames,
+  &KBase::ThirdPartyCommitNames, &InterVecBrgnNames, &SMPBargnModelNames };
+}
+
+const vector<string> SMPSweep::paramNames = {
+  "VictoryProbModel", "PCEModel", "StateTransitions", "VotingRule", "BigRAdjust",
+  "BigRRange", "ThirdPartyCommit", "InterVecBrgn", "BargnModel" };
+
+void SMPSweep::apply(const string & cs) {
+  for (const string & c : split(cs, ';')) {
+    if (c.empty()) {
+      continue;
+    }
+    const size_t eq = c.find('=');
+    if (string::npos == eq) {
+      throw KException("SMPSweep::apply: expected <name>=<value>, not " + c);
+    }
+    const string key = lowerCase(trimmed(c.substr(0, eq)));
+    const string val = trimmed(c.substr(eq + 1));
+
+    if ("cap" == key) {
+      capSpread = spread(val, c);
+      continue;
+    }
+    if ("sal" == key) {
+      salSpread = spread(val, c);
+      continue;
+    }
+    if ("draws" == key) {
+      draws = number(val, c);
+      if (0 == draws) {
+        throw KException("SMPSweep::apply: there must be at least one draw, in " + c);
+      }
+      continue;
+    }
+
+    unsigned int p = 0;
+    while ((p < paramNames.size()) && (lowerCase(paramNames[p]) != key)) {
+      p++;
+    }
+    if (p == paramNames.size()) {
+      throw KException("SMPSweep::apply: no parameter is called " + trimmed(c.substr(0, eq)));
+    }
+    const vector<string> & names = *(valueNames[p]);
+    vector<int> vs = {};
+    for (const string & v : split(val, ',')) {
+      unsigned int lo = 0;
+      unsigned int hi = 0;
+      if ("all" == lowerCase(v)) {
+        hi = names.size() - 1;
+      }
+      else if (string::npos != v.find_first_not_of("0123456789-")) {
+        lo = (unsigned int)KBase::enumFromName<int>(v, names);
+        hi = lo;
+      }
+      else {
+        const size_t dash = v.find('-');
+        lo = number(v.substr(0, dash), c);
+        hi = (string::npos == dash) ? lo : number(v.substr(dash + 1), c);
+      }
+      if ((hi < lo) || (names.size() <= hi)) {
+        throw KException("SMPSweep::apply: " + paramNames[p] + " has values 0 to "
+          + std::to_string(names.size() - 1) + ", not " + v);
+      }
+      for (unsigned int n = lo; n <= hi; n++) {
+        if (vs.end() == std::find(vs.begin(), vs.end(), (int)n)) {
+          vs.push_back(n);
+        }
+      }
+    }
+    paramValues[p] = vs;
+  }
+  if (0 == numRuns()) {
+    throw KException("SMPSweep::apply: too many runs");
+  }
+  return;
+}
+
+unsigned int SMPSweep::numRuns() const {
+  uint64_t n = draws;
+  for (const auto & vs : paramValues) {
+    n = n * std::max<uint64_t>(1, vs.size());
+    if (n > 0xFFFFFFFF) {
+      return 0;
+    }
+  }
+  return (unsigned int)n;
+}
+
+SMPSweep::Point SMPSweep::point(unsigned int r, const vector<int> & base,
+                                unsigned int na, unsigned int nd) const {
+  Point pt;
+  pt.run = r;
+  pt.draw = r % draws;
+
+  pt.params = base;
+  unsigned int c = r / draws;
+  for (unsigned int p = paramValues.size(); 0 < p; p--) {
+    const auto & vs = paramValues[p - 1];
+    if (!vs.empty()) {
+      pt.params[p - 1] = vs[c % vs.size()];
+      c = c / vs.size();
+    }
+  }
+
+  // capabilities are always drawn first, so they do not depend on salSpread
+  auto rng = StreamPRNG(seed, pt.draw);
+  pt.seed = rng.uniform();
+  pt.capScale = KMatrix(na, 1);
+  for (unsigned int i = 0; i < na; i++) {
+    pt.capScale(i, 0) = 1.0 + rng.uniform(-capSpread, capSpread);
+  }
+  pt.salScale = KMatrix(na, nd);
+  for (unsigned int i = 0; i < na; i++) {
+    for (unsigned int k = 0; k < nd; k++) {
+      pt.salScale(i, k) = 1.0 + rng.uniform(-salSpread, salSpread);
+    }
+  }
+  return pt;
+}
+
+unsigned int SMPSweep::run(const string & inputDataFile,
+                           const function<void(const Point &, const SMPModel *)> & onRun) const {
+  KBase::LogPolicy policy = logPolicy;
+  if (!fullLogs) {
+    policy.apply("-all");
+  }
+
+  size_t dotPos = inputDataFile.find_last_of(".");
+  const string fileExt = lowerCase((string::npos == dotPos) ? "" : inputDataFile.substr(dotPos + 1));
+  SMPModel * md = nullptr;
+  if ("csv" == fileExt) {
+    md = SMPModel::csvRead(inputDataFile, seed, policy.groups());
+  }
+  else if ("xml" == fileExt) {
+    md = SMPModel::xmlRead(inputDataFile, policy.groups());
+  }
+  else {
+    throw KException("SMPSweep::run: only xml or csv files are supported");
+  }
+  if (nullptr == md) {
+    throw KException("SMPSweep::run: could not read " + inputDataFile);
+  }
+
+  // all a run needs of the input
+  const unsigned int na = md->numAct;
+  const unsigned int nd = md->numDim;
+  vector<string> aNames = {};
+  vector<string> aDescs = {};
+  auto cap = KMatrix(na, 1);
+  auto pos = KMatrix(na, nd);
+  auto sal = KMatrix(na, nd);
+  auto s0 = ((SMPState*)(md->history[0]));
+  for (unsigned int i = 0; i < na; i++) {
+    auto ai = ((const SMPActor*)(md->actrs[i]));
+    auto pi = ((const VctrPstn*)(s0->pstns[i]));
+    aNames.push_back(ai->name);
+    aDescs.push_back(ai->desc);
+    cap(i, 0) = ai->sCap;
+    for (unsigned int k = 0; k < nd; k++) {
+      pos(i, k) = (*pi)(k, 0);
+      sal(i, k) = ai->vSal(k, 0);
+    }
+  }
+  const KMatrix accM = s0->getAccomodate();
+  const vector<string> dNames = md->dimName;
+  const string scenName = md->getScenarioName();
+  const vector<int> base = { (int)md->vpm, (int)md->pcem, (int)md->stm, (int)md->vrCltn,
+    (int)md->bigRAdj, (int)md->bigRRng, (int)md->tpCommit, (int)md->ivBrgn, (int)md->brgnMod };
+  md->releaseDB();
+  delete md;
+  md = nullptr;
+
+  const unsigned int n = numRuns();
+  LOG(INFO) << "Sweeping" << scenName << "in" << n << "runs";
+
+  std::atomic<unsigned int> done(0);
+  auto runner = [&](unsigned int r) {
+    const Point pt = point(r, base, na, nd);
+    auto c = KMatrix(na, 1);
+    auto s = KMatrix(na, nd);
+    for (unsigned int i = 0; i < na; i++) {
+      c(i, 0) = cap(i, 0) * pt.capScale(i, 0);
+      double si = 0.0;
+      for (unsigned int k = 0; k < nd; k++) {
+        s(i, k) = sal(i, k) * pt.salScale(i, k);
+        si = si + s(i, k);
+      }
+      for (unsigned int k = 0; (1.0 < si) && (k < nd); k++) {
+        s(i, k) = s(i, k) / si;
+      }
+    }
+
+    SMPModel * rm = nullptr;
+    try {
+      const string desc = "Sweep of " + scenName + ", run " + std::to_string(r);
+      rm = SMPModel::initModel(aNames, aDescs, dNames, c, pos, s, accM, pt.seed,
+        policy.groups(), desc.substr(0, Model::maxScenDescLen), scenName);
+      SMPModel::updateModelParameters(rm, pt.params);
+      rm->setLogPolicy(policy);
+      rm->pceSolver = runOptions.pceSolver;
+      SMPModel::configExec(rm);
+      if (nullptr != onRun) {
+        onRun(pt, rm);
+      }
+      done++;
+    }
+    catch (KException &ke) {
+      LOG(INFO) << "Sweep run" << r << "failed:" << ke.msg;
+    }
+    catch (std::exception &std_ex) {
+      LOG(INFO) << "Sweep run" << r << "failed:" << std_ex.what();
+    }
+    catch (...) {
+      LOG(INFO) << "Sweep run" << r << "failed";
+    }
+    if (nullptr != rm) {
+      rm->releaseDB();
+      delete rm;
+    }
+    return;
+  };
+
+  // Each run is a task in the shared pool, as are the steps within it: a run
+  // waiting for its steps helps with them, so nesting them does not deadlock.
+  if (0 < n) {
+    KBase::groupThreads(runner, 0, n - 1, maxPar);
+  }
+
+  LOG(INFO) << KBase::getFormattedString("%u of %u sweep runs succeeded", done.load(), n);
+  return done;
+}
+
+unsigned int SMPSweep::run(const string & inputDataFile, const string & resultsFile) const {
+  std::ofstream out(resultsFile);
+  if (!out.is_open()) {
+    throw KException("SMPSweep::run: could not open " + resultsFile);
+  }
+  std::mutex outMtx;
+  bool header = false;
+  std::map<unsigned int, string> held = {}; // lines of runs which finished early, by run
+  unsigned int nextRun = 0; // the run whose line is to be written next
+
+  auto writeRun = [&](const Point & pt, const SMPModel * rm) {
+    const unsigned int na = rm->numAct;
+    const unsigned int nd = rm->numDim;
+    const unsigned int finalT = rm->history.size() - 1;
+    auto st = ((SMPState*)(rm->history[finalT]));
+    if (!st->aUtilSet()) {
+      st->setAUtil(-1, KBase::ReportingLevel::Silent);
+    }
+    const auto pn = st->pDist(-1);
+    const KMatrix & pdt = std::get<0>(pn);
+    const KBase::VUI & unq = std::get<1>(pn);
+
+    string cols = "Run,Draw,Seed";
+    string line = KBase::getFormattedString("%u,%u,%llu", pt.run, pt.draw,
+      (unsigned long long)pt.seed);
+    for (unsigned int p = 0; p < paramNames.size(); p++) {
+      cols += "," + paramNames[p];
+      line += "," + std::to_string(pt.params[p]);
+    }
+    cols += ",Turns";
+    line += "," + std::to_string(finalT);
+    for (unsigned int i = 0; (0.0 < capSpread) && (i < na); i++) {
+      cols += KBase::getFormattedString(",Cap_%u", i);
+      line += KBase::getFormattedString(",%.6g", pt.capScale(i, 0));
+    }
+    for (unsigned int i = 0; (0.0 < salSpread) && (i < na); i++) {
+      for (unsigned int k = 0; k < nd; k++) {
+        cols += KBase::getFormattedString(",Sal_%u_%u", i, k);
+        line += KBase::getFormattedString(",%.6g", pt.salScale(i, k));
+      }
+    }
+    for (unsigned int i = 0; i < na; i++) {
+      auto pi = ((const VctrPstn*)(st->pstns[i]));
+      for (unsigned int k = 0; k < nd; k++) {
+        cols += KBase::getFormattedString(",Pos_%u_%u", i, k);
+        line += KBase::getFormattedString(",%.6g", (*pi)(k, 0));
+      }
+    }
+    for (unsigned int i = 0; i < na; i++) {
+      cols += KBase::getFormattedString(",Prob_%u", i);
+      line += KBase::getFormattedString(",%.6g", st->posProb(i, unq, pdt));
+    }
+    if (fullLogs) {
+      cols += ",ScenarioId";
+      line += "," + rm->getScenarioID();
+    }
+
+    // Runs finish in whatever order the threads take, so each line waits for
+    // those of the runs before it; a failed run holds back the rest to the end.
+    std::lock_guard<std::mutex> lk(outMtx);
+    if (!header) {
+      out << cols << "\n";
+      header = true;
+    }
+    held[pt.run] = line;
+    while ((!held.empty()) && (nextRun == held.begin()->first)) {
+      out << held.begin()->second << "\n";
+      held.erase(held.begin());
+      nextRun++;
+    }
+    out.flush(); // so that an interrupted batch keeps what it did
+  };
+
+  const unsigned int done = run(inputDataFile, writeRun);
+  for (const auto & h : held) {
+    out << h.second << "\n";
+  }
+  if (!out.good()) {
+    throw KException("SMPSweep::run: could not write " + resultsFile);
+  }
+  return done;
+}
+
+} // end of namespace
+
+// --------------------------------------------
+// Copyright KAPSARC. Open source MIT License.
+// --------------------------------------------
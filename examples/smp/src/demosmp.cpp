@@ -27,7 +27,15 @@
 
 #include "smp.h"
 #include "demosmp.h"
+#include "threadpool.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <functional>
+#include <new>
 #include <easylogging++.h>
 
 using KBase::PRNG;
@@ -38,6 +46,413 @@ using KBase::Position;
 using KBase::State;
 using KBase::VotingRule;
 using KBase::VPModel;
+using KBase::VUI;
+
+// -------------------------------------------------
+// Heap-allocation counting for --allocs. Replacing the global operator new
+// is the only portable way to see every allocation, including those inside
+// std::vector, but it taxes every allocation of every run, so it is compiled
+// in only when KTAB_COUNT_ALLOCS is defined (see CMakeLists.txt).
+#ifdef KTAB_COUNT_ALLOCS
+namespace DemoSMP {
+std::atomic<bool> countAllocs(false);
+std::atomic<uint64_t> allocCount(0);
+std::atomic<uint64_t> allocBytes(0);
+}; // end of namespace
+
+void * operator new(std::size_t n) {
+  if (DemoSMP::countAllocs.load(std::memory_order_relaxed)) {
+    DemoSMP::allocCount.fetch_add(1, std::memory_order_relaxed);
+    DemoSMP::allocBytes.fetch_add(n, std::memory_order_relaxed);
+  }
+  void * p = std::malloc((0 < n) ? n : 1);
+  if (nullptr == p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void * operator new[](std::size_t n) {
+  return operator new(n);
+}
+
+void operator delete(void * p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void * p) noexcept {
+  std::free(p);
+}
+#endif // KTAB_COUNT_ALLOCS
+
+// Run one random SMP with numA actors and no database logging,
+// reporting how many heap allocations the model run made.
+void DemoSMP::countSMPAllocs(unsigned int numA, uint64_t s) {
+  const std::vector<bool> noSQL = { false, false, false, false, false };
+#ifdef KTAB_COUNT_ALLOCS
+  allocCount = 0;
+  allocBytes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  countAllocs = true;
+  SMPLib::SMPModel::randomSMP(numA, 2, false, s, noSQL);
+  countAllocs = false;
+  double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  const uint64_t nAllocs = allocCount;
+  const uint64_t nBytes = allocBytes;
+  LOG(INFO) << KBase::getFormattedString(
+    "Random SMP with %u actors: %llu heap allocations, %.1f MB, %.2f seconds",
+    numA, (unsigned long long) nAllocs, nBytes / (1024.0 * 1024.0), dt);
+#else
+  auto t0 = std::chrono::steady_clock::now();
+  SMPLib::SMPModel::randomSMP(numA, 2, false, s, noSQL);
+  double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  LOG(INFO) << KBase::getFormattedString(
+    "Random SMP with %u actors: %.2f seconds (heap allocations are counted only in builds with KTAB_COUNT_ALLOCS)",
+    numA, dt);
+#endif
+  return;
+}
+
+// Time the Markov PCE solvers on numB random problems with n options each, in
+// which the options are nearly tied, as they are late in a run. Each solver
+// is compared with Damped, which is the iteration markovIncentivePCE has
+// always used. The warm-started Anderson solves a slightly perturbed copy of
+// each problem from the answer to the original, as happens from turn to turn.
+void DemoSMP::benchPCE(unsigned int n, uint64_t s) {
+  using KBase::PCESolver;
+  using KBase::PCEDiagnostics;
+  const unsigned int numB = 20;
+  const double tol = 1E-8;
+  auto rng = PRNG(s);
+
+  auto randomProblem = [n, &rng](double tie) {
+    auto a = KMatrix(n, 1);
+    for (unsigned int i = 0; i < n; i++) {
+      a(i, 0) = rng.uniform(-1.0, 1.0);
+    }
+    auto pv = KMatrix(n, n);
+    auto cp = KMatrix(n, n);
+    for (unsigned int j = 0; j < n; j++) {
+      double cs = 0.0;
+      for (unsigned int i = 0; i < n; i++) {
+        pv(i, j) = 0.5 + tie * (a(i, 0) - a(j, 0)) / 2;
+        cp(i, j) = rng.uniform(0.1, 1.0);
+        cs = cs + cp(i, j);
+      }
+      for (unsigned int i = 0; i < n; i++) {
+        cp(i, j) = cp(i, j) / cs;
+      }
+    }
+    return std::make_tuple(pv, cp);
+  };
+
+  struct Tally {
+    double secs = 0.0;
+    unsigned long long iters = 0;
+    double maxDiff = 0.0;
+    unsigned int fallBacks = 0;
+  };
+  const vector<string> names = { "Damped", "Direct", "Anderson", "Anderson (warm)" };
+  vector<Tally> tallies(names.size());
+
+  for (unsigned int b = 0; b < numB; b++) {
+    const auto prob = randomProblem(0.02);
+    const auto pv = std::get<0>(prob);
+    const auto cp = std::get<1>(prob);
+    auto pvNext = pv; // the next "turn": a small change to the victory probabilities
+    for (unsigned int i = 0; i < n; i++) {
+      for (unsigned int j = i + 1; j < n; j++) {
+        const double d = rng.uniform(-1E-3, 1E-3);
+        pvNext(i, j) = pvNext(i, j) + d;
+        pvNext(j, i) = pvNext(j, i) - d;
+      }
+    }
+
+    auto pRef = KMatrix();
+    auto pRefNext = Model::markovStationary(pvNext, cp, PCESolver::Damped, tol);
+    for (unsigned int k = 0; k < names.size(); k++) {
+      const PCESolver sv = (0 == k) ? PCESolver::Damped
+                           : ((1 == k) ? PCESolver::Direct : PCESolver::Anderson);
+      const bool warm = (3 == k);
+      auto d = PCEDiagnostics();
+      auto t0 = std::chrono::steady_clock::now();
+      auto p = warm ? Model::markovStationary(pvNext, cp, sv, tol, pRef, &d)
+               : Model::markovStationary(pv, cp, sv, tol, KMatrix(), &d);
+      tallies[k].secs += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      tallies[k].iters += d.iterations;
+      tallies[k].fallBacks += d.fellBack ? 1 : 0;
+      if (0 == k) {
+        pRef = p;
+      }
+      const double df = KBase::maxAbs(p - (warm ? pRefNext : pRef));
+      tallies[k].maxDiff = std::max(tallies[k].maxDiff, df);
+    }
+  }
+
+  LOG(INFO) << KBase::getFormattedString(
+    "Markov PCE solvers, %u problems with %u nearly tied options, tolerance %.0e:", numB, n, tol);
+  for (unsigned int k = 0; k < names.size(); k++) {
+    const auto & t = tallies[k];
+    LOG(INFO) << KBase::getFormattedString(
+      "  %-16s %8.2f ms/solve  %7.1f iterations/solve  max |p - pDamped| %.2e  %u fallbacks",
+      names[k].c_str(), 1000 * t.secs / numB, ((double)t.iters) / numB, t.maxDiff, t.fallBacks);
+  }
+  return;
+}
+
+// Time Model::coalitions for numA actors voting over as many options, with
+// each voting rule, by the general path (a callback to Model::vote for each
+// vote) and by the specialized kernel, and check they give the same bits.
+void DemoSMP::benchCoalitions(unsigned int numA, uint64_t s) {
+  auto rng = PRNG(s);
+  const auto w = KMatrix::uniform(&rng, 1, numA, 1.0, 100.0);
+  const auto u = KMatrix::uniform(&rng, numA, numA, 0.0, 1.0);
+  const unsigned int numVR = KBase::VotingRuleNames.size();
+  auto secs = [](std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  };
+
+  LOG(INFO) << KBase::getFormattedString("Coalitions of %u actors over %u options:", numA, numA);
+  for (unsigned int r = 0; r < numVR; r++) {
+    const auto vr = (VotingRule)r;
+    auto vfn = [vr, &w, &u](unsigned int k, unsigned int i, unsigned int j) {
+      return Model::vote(vr, w(0, k), u(k, i), u(k, j));
+    };
+    auto t0 = std::chrono::steady_clock::now();
+    const auto c0 = Model::coalitions(vfn, numA, numA);
+    const double dt0 = secs(t0);
+    t0 = std::chrono::steady_clock::now();
+    const auto c1 = Model::coalitions(vr, w, u);
+    const double dt1 = secs(t0);
+    unsigned int nDiff = 0;
+    for (unsigned int i = 0; i < numA; i++) {
+      for (unsigned int j = 0; j < numA; j++) {
+        nDiff += (c0(i, j) == c1(i, j)) ? 0 : 1;
+      }
+    }
+    LOG(INFO) << KBase::getFormattedString(
+      "  %-14s callback %8.2f ms  kernel %8.2f ms  (%.1fx)  %u elements differ",
+      KBase::VotingRuleNames[r].c_str(), 1000 * dt0, 1000 * dt1, dt0 / dt1, nDiff);
+  }
+  return;
+}
+
+// Time the search for unique positions among numA random positions in two
+// dimensions, about half of which repeat an earlier one to within a tenth of
+// the tolerance, by comparing every pair (ueIndices) and by the tolerance grid
+// (ueIndicesGrid), and check they give the same indices. Likewise for integer
+// positions, by comparing every pair and by hashing (ueIndicesByKey).
+void DemoSMP::benchUEIndices(unsigned int numA, uint64_t s) {
+  auto rng = PRNG(s);
+  const unsigned int nd = 2;
+  const double tol = 1E-3;
+  auto x = vector<double>(numA * nd);
+  auto keys = vector<int>(numA);
+  for (unsigned int i = 0; i < numA; i++) {
+    const bool repeat = (0 < i) && (rng.uniform(0.0, 1.0) < 0.5);
+    const unsigned int j = repeat ? ((unsigned int)(rng.uniform(0.0, 1.0) * i)) % i : i;
+    for (unsigned int k = 0; k < nd; k++) {
+      x[i * nd + k] = repeat ? x[j * nd + k] + rng.uniform(-tol / 10, tol / 10) : rng.uniform(0.0, 1.0);
+    }
+    keys[i] = repeat ? keys[j] : ((int)(rng.uniform(0.0, 1.0) * 1E6));
+  }
+  auto secs = [](std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  };
+  auto report = [numA](const char * what, double dt0, double dt1,
+                       const tuple<VUI, VUI> & ue0, const tuple<VUI, VUI> & ue1) {
+    const bool same = (std::get<0>(ue0) == std::get<0>(ue1)) && (std::get<1>(ue0) == std::get<1>(ue1));
+    LOG(INFO) << KBase::getFormattedString(
+      "  %-8s %u unique of %u  pairwise %8.2f ms  indexed %8.2f ms  (%.1fx)  %s",
+      what, (unsigned int)std::get<0>(ue0).size(), numA, 1000 * dt0, 1000 * dt1, dt0 / dt1,
+      same ? "same indices" : "DIFFERENT indices");
+  };
+
+  LOG(INFO) << KBase::getFormattedString("Unique positions among %u actors:", numA);
+  const auto ns = KBase::uiSeq(0, numA - 1);
+  auto xEqv = [&x, nd, tol](unsigned int i, unsigned int j) {
+    double d2 = 0.0;
+    for (unsigned int k = 0; k < nd; k++) {
+      const double d = x[i * nd + k] - x[j * nd + k];
+      d2 = d2 + d * d;
+    }
+    return (sqrt(d2) < tol);
+  };
+  auto t0 = std::chrono::steady_clock::now();
+  const auto ue0 = KBase::ueIndices<unsigned int>(ns, xEqv);
+  const double dt0 = secs(t0);
+  t0 = std::chrono::steady_clock::now();
+  const auto ue1 = KBase::ueIndicesGrid(x, nd, tol, xEqv);
+  report("spatial", dt0, secs(t0), ue0, ue1);
+
+  auto kEqv = [&keys](unsigned int i, unsigned int j) {
+    return (keys[i] == keys[j]);
+  };
+  t0 = std::chrono::steady_clock::now();
+  const auto ue2 = KBase::ueIndices<unsigned int>(ns, kEqv);
+  const double dt2 = secs(t0);
+  t0 = std::chrono::steady_clock::now();
+  const auto ue3 = KBase::ueIndicesByKey<int>(keys);
+  report("indexed", dt2, secs(t0), ue2, ue3);
+  return;
+}
+
+void DemoSMP::checkPgCopy(unsigned int numRows, uint64_t s) {
+  using KBase::PgCopyEncoder;
+  using KBase::SQLBatch;
+  using KBase::SQLValue;
+  const vector<string> schema = {
+    "create table if not exists Sample (ScenarioId TEXT, Turn_t INTEGER, Id BIGINT,"
+    " Code SMALLINT, Util FLOAT, Weight REAL, Note VARCHAR(32))"
+  };
+  const string sql = "INSERT INTO Sample (ScenarioId, Turn_t, Id, Code, Util, Weight, Note)"
+    " VALUES ('scen-1', :t, :id, :c, :u, :w, NULL)";
+  const vector<PgCopyEncoder::ColType> types = {
+    PgCopyEncoder::ColType::Text, PgCopyEncoder::ColType::Int4, PgCopyEncoder::ColType::Int8,
+    PgCopyEncoder::ColType::Int2, PgCopyEncoder::ColType::Float8, PgCopyEncoder::ColType::Float4,
+    PgCopyEncoder::ColType::Text
+  };
+
+  // Each row has a NULL and the literal text of the statement. The edges of
+  // each type come first, then random values; some of the placeholders are NULL.
+  auto rng = PRNG(s);
+  auto b = SQLBatch(sql, 5, "DemoSMP::checkPgCopy");
+  auto expected = vector<vector<string>>();
+  for (unsigned int r = 0; r < numRows; r++) {
+    int32_t t = (int32_t)(rng.uniform() % 1000);
+    int64_t id = (int64_t)rng.uniform();
+    int16_t c = (int16_t)(rng.uniform() % 65536);
+    double u = rng.uniform(-1E6, 1E6);
+    float w = (float)rng.uniform(0.0, 1.0);
+    if (0 == r) {
+      t = INT32_MIN; id = INT64_MIN; c = INT16_MIN; u = -0.0; w = 1E-30f;
+    }
+    else if (1 == r) {
+      t = INT32_MAX; id = INT64_MAX; c = INT16_MAX; u = 1.0 / 3.0; w = 3.4E38f;
+    }
+    const bool nullU = (0 == rng.uniform() % 7);
+    b.add(SQLValue(t));
+    b.add(SQLValue(id));
+    b.add(SQLValue(c));
+    b.add(nullU ? SQLValue() : SQLValue(u));
+    b.add(SQLValue((double)w));
+    expected.push_back({ "scen-1", std::to_string(t), std::to_string(id), std::to_string(c),
+                         nullU ? "NULL" : KBase::getFormattedString("%.17g", u),
+                         KBase::getFormattedString("%.9g", w), "NULL" });
+  }
+
+  auto enc = PgCopyEncoder(schema);
+  auto & p = enc.plan(b);
+  if (!p.copyable || (types != p.types)) {
+    LOG(INFO) << "COPY check: the statement was not planned as a COPY of the expected columns";
+    return;
+  }
+  enc.encode(p, b);
+  const string data = PgCopyEncoder::header + p.held + PgCopyEncoder::trailer;
+  const auto rows = PgCopyEncoder::decode(data, types);
+  unsigned int numBad = (rows.size() == expected.size()) ? 0 : 1;
+  for (unsigned int r = 0; (0 == numBad) && (r < rows.size()); r++) {
+    numBad = numBad + ((rows[r] == expected[r]) ? 0 : 1);
+  }
+  LOG(INFO) << KBase::getFormattedString("COPY check: %u rows, %u bytes, %u rows decoded differently",
+                                         numRows, (unsigned int)data.size(), numBad);
+
+  // a field whose length does not match its type must be caught
+  string bad = data;
+  const size_t lenAt = PgCopyEncoder::header.size() + 2 + 4 + 6 + 4 + 4 + 4 + 8; // Code's length
+  bad[lenAt + 3] = 4;
+  bool caught = false;
+  try {
+    PgCopyEncoder::decode(bad, types);
+  }
+  catch (KBase::KException & ke) {
+    caught = true;
+    LOG(INFO) << "COPY check: a wrong field length gives" << ke.msg;
+  }
+  if (!caught) {
+    LOG(INFO) << "COPY check: a wrong field length was NOT caught";
+  }
+  return;
+}
+
+void DemoSMP::checkResume(const KBase::LogPolicy & logPolicy, const string & input, uint64_t s,
+                          unsigned int every, const SMPLib::SMPRunOptions & opts) {
+  using SMPLib::SMPModel;
+  const string ckpt = input + "_resumeCheck.ckp";
+  auto readAll = [](const string & f) {
+    std::ifstream in(f, std::ios::binary);
+    return string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  };
+  std::remove(ckpt.c_str());
+
+  // the whole run, leaving its last checkpoint behind
+  auto o = opts;
+  o.checkpointFile = ckpt;
+  o.checkpointTurns = every;
+  o.resumeFile = "";
+  auto whole = SMPModel::runScenario(logPolicy, input, s, false, {}, o);
+  if (!whole.ok()) {
+    throw KBase::KException("DemoSMP::checkResume: " + whole.error);
+  }
+  if (readAll(ckpt).empty()) {
+    throw KBase::KException("DemoSMP::checkResume: the run was over before turn "
+                            + std::to_string(every) + ", so saved no checkpoint");
+  }
+
+  // the same run, from there
+  o.checkpointFile = "";
+  o.checkpointTurns = 0;
+  o.resumeFile = ckpt;
+  auto resumed = SMPModel::runScenario(logPolicy, input, s, false, {}, o);
+  if (!resumed.ok()) {
+    throw KBase::KException("DemoSMP::checkResume: " + resumed.error);
+  }
+
+  // A checkpoint of each finished run holds every state, the generator and
+  // what is yet to be written, so the two are the same if their bytes are.
+  whole.model()->saveCheckpoint(ckpt);
+  const string w = readAll(ckpt);
+  resumed.model()->saveCheckpoint(ckpt);
+  const string r = readAll(ckpt);
+  std::remove(ckpt.c_str());
+  LOG(INFO) << KBase::getFormattedString(
+    "Resume check: %u states uninterrupted, %u resumed; the runs end %s",
+    whole.iterationCount(), resumed.iterationCount(),
+    (w == r) ? "the same, bit for bit" : "DIFFERENTLY");
+  return;
+}
+
+void DemoSMP::checkEnsemble(const string & input, unsigned int replicates, uint64_t s,
+                            unsigned int maxPar, const SMPLib::SMPRunOptions & opts) {
+  const string one = input + "_ensembleCheck1.csv";
+  const string many = input + "_ensembleCheckN.csv";
+  auto readAll = [](const string & f) {
+    std::ifstream in(f, std::ios::binary);
+    return string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  };
+  if (0 == maxPar) {
+    maxPar = KBase::ThreadPool::defaultNumThreads();
+  }
+
+  SMPLib::SMPEnsemble e1(replicates, s);
+  e1.runOptions = opts;
+  const unsigned int n1 = e1.run(input, {}, 1);
+  e1.writeSummary(one);
+
+  SMPLib::SMPEnsemble eN(replicates, s);
+  eN.runOptions = opts;
+  const unsigned int nN = eN.run(input, {}, maxPar);
+  eN.writeSummary(many);
+
+  const string a = readAll(one);
+  const string b = readAll(many);
+  std::remove(one.c_str());
+  std::remove(many.c_str());
+  LOG(INFO) << KBase::getFormattedString(
+    "Ensemble check: %u of %u replicates one at a time, %u of %u with %u at once; the summaries are %s",
+    n1, replicates, nN, replicates, maxPar, (a == b) ? "the same, byte for byte" : "DIFFERENT");
+  return;
+}
 
 void ReplaceStringInPlace(std::string& subject, const std::string& search,
 	const std::string& replace) {
@@ -77,11 +492,43 @@ int main(int ac, char **av) {
   bool csvP = false;
   bool xmlP = false;
   bool logMin = false;
+  std::vector<string> logClauses = {};
   bool saveHist = false;
+  bool allocsP = false;
+  unsigned int allocsN = 100;
+  bool pceBenchP = false;
+  unsigned int pceBenchN = 100;
+  bool coalBenchP = false;
+  unsigned int coalBenchN = 200;
+  bool ueBenchP = false;
+  unsigned int ueBenchN = 2000;
+  bool stallBenchP = false;
+  unsigned int stallBenchN = 100;
+  bool copyCheckP = false;
+  unsigned int copyCheckN = 1000;
+  unsigned int resumeCheckN = 0;
+  unsigned int ensembleCheckN = 0;
   string inputCSV = "";
   string inputDBname = "";
   string inputXML = "";
   string connstr;
+  bool regenP = false;
+  string regenScenId = "";
+  std::vector<unsigned int> regenTurns = {};
+  struct ForkSpec {
+    unsigned int turn;
+    unsigned int actor;
+    double capFactor;
+  };
+  std::vector<ForkSpec> forks = {};
+  unsigned int concurrentRuns = 0; // 0: not given
+  bool sweepP = false;
+  bool sweepLogs = false;
+  string sweepOut = "";
+  SMPLib::SMPRunOptions runOpts;
+  SMPLib::SMPSweep sweep;
+  unsigned int ensembleN = 0;
+  string ensembleOut = "";
 
   auto showHelp = []() {
     printf("\n");
@@ -92,12 +539,75 @@ int main(int ac, char **av) {
     printf("--csv <f>        read a scenario from CSV\n");
     printf("--xml <f>        read a scenario from XML\n");
     printf("--logmin         log only scenario information + position histories\n");
+    printf("--log <clauses>  choose tables, turns, estimators and a sampling rate, after\n");
+    printf("                 --logmin if given; may be repeated. Each ';'-separated clause is\n");
+    printf("                 [-]<table|group|all>[:turns=0-2,5,8-][:first=<k>][:last=<k>]\n");
+    printf("                 [:est=<h>,<h>..][:rate=<p>], where the groups are Information,\n");
+    printf("                 Position, Challenge, Bargain and VectorPosition, e.g.\n");
+    printf("                 --log \"-all;Information;VectorPosition;PosUtil:est=0,3:last=2\"\n");
     printf("--savehist       export by-dim by-turn position histories (input+'_posLog.csv') and\n");
     printf("                 by-dim actor effective powers (input+'_effPower.csv')\n");
+    printf("--ckpt <f>       save a checkpoint of a CSV or XML run in f every --ckptevery turns,\n");
+    printf("                 and after any turn in which the process receives SIGUSR1\n");
+    printf("--ckptevery <n>  how often to save with --ckpt; default 0 (only on SIGUSR1)\n");
+    printf("--resume <f>     continue the run saved in checkpoint f, which must be of the same\n");
+    printf("                 input and model parameters, with the same --log options and database\n");
+    printf("--resumecheck <n>  run the CSV or XML scenario with a checkpoint every n turns, resume\n");
+    printf("                 it from the last one, and check that both runs end the same\n");
+    printf("--fork <t>:<i>:<f>  after a CSV or XML run, run a what-if branch of it from turn t,\n");
+    printf("                 with the capability of actor i multiplied by f; may be repeated.\n");
+    printf("                 Each is a new scenario which records only turns t and later\n");
+    printf("--runs <n>       make n runs of the CSV or XML scenario at once, each a scenario of\n");
+    printf("                 its own with its own database connection, and report the time taken;\n");
+    printf("                 with --sweep, make at most n runs at once (default: one per hardware thread)\n");
+    printf("--sweep <clauses>  sweep the CSV or XML scenario rather than run it once; may be\n");
+    printf("                 repeated. Each ';'-separated clause is one of\n");
+    printf("                   <parameter>=<values>  e.g. VotingRule=0-2,Cubic or PCEModel=all\n");
+    printf("                   cap=<s>, sal=<s>  scale capabilities or saliences by 1+U[-s,s]\n");
+    printf("                   draws=<n>         runs for each combination of parameters\n");
+    printf("                 where the parameters are %s\n", [] {
+      string ns = "";
+      for (auto & n : SMPLib::SMPSweep::paramNames) {
+        ns += (ns.empty() ? "" : ", ") + n;
+      }
+      return ns;
+    }().c_str());
+    printf("--sweepout <f>   write a line of results for each sweep run to f, in order of run;\n");
+    printf("                 default is the input file without its extension, +'_sweep.csv'\n");
+    printf("--sweeplogs      also record every sweep run in the database, under the --log options\n");
+    printf("--ensemble <r>   run r replicates of the CSV or XML scenario with stochastic state\n");
+    printf("                 transitions, at most --runs at once, keeping only running statistics\n");
+    printf("--ensembleout <f>  write the ensemble's summary table to f; default is the input\n");
+    printf("                 file without its extension, +'_ensemble.csv'\n");
+    printf("--ensemblecheck <r>  run r replicates of the CSV or XML scenario one at a time and\n");
+    printf("                 --runs at once, and check that the two summaries are the same\n");
+    printf("--allocs <n>     count heap allocations during a random SMP with n actors\n");
+    printf("                 and no database logging (e.g. n = 100); counting needs a\n");
+    printf("                 build configured with KTAB_COUNT_ALLOCS\n");
+    printf("--pceSolver <s>  how the Markov PCE models find their stationary distribution:\n");
+    printf("                 Damped (the default), Direct or Anderson\n");
+    printf("--pcebench <n>   time the PCE solvers on random problems with n options (e.g. n = 100)\n");
+    printf("--coalbench <n>  time and check the coalition kernels with n actors (e.g. n = 200)\n");
+    printf("--uebench <n>    time and check the unique-position search with n actors (e.g. n = 2000)\n");
+    printf("--stallbench <n> time the actor utilities of a turn in which no actor moved, with n actors,\n");
+    printf("                 against those of a first turn and of a turn in which one did (e.g. n = 100)\n");
+    printf("--copycheck <n>  encode n rows in PostgreSQL's binary COPY format, as PgCopySink\n");
+    printf("                 would send them, and check that they decode to the same values;\n");
+    printf("                 needs no --connstr\n");
+    printf("--implicitUtil <n>  compute actor utilities on demand, rather than storing them,\n");
+    printf("                 for scenarios with at least n actors (0 = always); default is %u\n",
+           SMPLib::SMPModel::implicitUtilActors);
+    printf("--regenChlg <id> <turns>  regenerate the Challenge Tables of scenario <id> in the\n");
+    printf("                 database, for the comma-separated turns (or 'all'), e.g. after --logmin\n");
+    printf("--threads <n>    size of the worker thread pool; default is the environment\n");
+    printf("                 variable KTAB_NUM_THREADS, else the hardware concurrency (%u)\n",
+           KBase::ThreadPool::defaultNumThreads());
     printf("--seed <n>       set a 64bit seed; default is %020llu; 0 means truly random\n", dSeed);
     printf("--connstr        a semicolon separated string for database server credentials:\n");
     printf("                 \"Driver=<QPSQL|QSQLITE>;Server=<IP>*;[Port=<port>]*;Database=<DB_name>;\n");
-    printf("                 Uid=<user_id>*;Pwd=<password>*\"*for QPSQL only\n");
+    printf("                 Uid=<user_id>*;Pwd=<password>*;[Format=<sql|columnar>]\"*for QPSQL only\n");
+    printf("                 Format=columnar writes the per-turn tables to columnar files under\n");
+    printf("                 <DB_name>.kcol/ instead, which SMPQ reads along with the database\n");
   };
 
   if (ac > 1) {
@@ -135,6 +645,291 @@ int main(int ac, char **av) {
       else if (strcmp(av[i], "--euSMP") == 0) {
         euSmpP = true;
       }
+      else if (strcmp(av[i], "--allocs") == 0) {
+        allocsP = true;
+        i++;
+        if (av[i] != NULL)
+        {
+                allocsN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--ckpt") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                runOpts.checkpointFile = av[i];
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--ckptevery") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                runOpts.checkpointTurns = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--resume") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                runOpts.resumeFile = av[i];
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--resumecheck") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                resumeCheckN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--ensemblecheck") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                ensembleCheckN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--fork") == 0) {
+        i++;
+        unsigned int t = 0;
+        unsigned int a = 0;
+        double f = 1.0;
+        if ((av[i] != NULL) && (3 == sscanf(av[i], "%u:%u:%lf", &t, &a, &f)))
+        {
+                forks.push_back({ t, a, f });
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--runs") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                concurrentRuns = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--sweep") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                try {
+                  sweep.apply(av[i]);
+                }
+                catch (KBase::KException & ke) {
+                  printf("%s\n", ke.msg.c_str());
+                  run = false;
+                  break;
+                }
+                sweepP = true;
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--sweepout") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                sweepOut = av[i];
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--sweeplogs") == 0) {
+        sweepLogs = true;
+      }
+      else if (strcmp(av[i], "--ensemble") == 0) {
+        i++;
+        if ((av[i] != NULL) && (0 < atoi(av[i])))
+        {
+                ensembleN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--ensembleout") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                ensembleOut = av[i];
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--pceSolver") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                runOpts.pceSolver = KBase::enumFromName<KBase::PCESolver>(av[i], KBase::PCESolverNames);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--pcebench") == 0) {
+        pceBenchP = true;
+        i++;
+        if (av[i] != NULL)
+        {
+                pceBenchN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--coalbench") == 0) {
+        coalBenchP = true;
+        i++;
+        if (av[i] != NULL)
+        {
+                coalBenchN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--uebench") == 0) {
+        ueBenchP = true;
+        i++;
+        if (av[i] != NULL)
+        {
+                ueBenchN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--stallbench") == 0) {
+        stallBenchP = true;
+        i++;
+        if (av[i] != NULL)
+        {
+                stallBenchN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--copycheck") == 0) {
+        copyCheckP = true;
+        i++;
+        if (av[i] != NULL)
+        {
+                copyCheckN = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--implicitUtil") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                SMPLib::SMPModel::implicitUtilActors = std::stoi(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--regenChlg") == 0) {
+        regenP = true;
+        if ((av[i + 1] != NULL) && (av[i + 2] != NULL))
+        {
+                regenScenId = av[i + 1];
+                string ts = av[i + 2];
+                i += 2;
+                if (ts != "all") {
+                  size_t pos = 0;
+                  while (pos < ts.size()) {
+                    size_t comma = ts.find(',', pos);
+                    if (string::npos == comma) {
+                      comma = ts.size();
+                    }
+                    regenTurns.push_back(std::stoi(ts.substr(pos, comma - pos)));
+                    pos = comma + 1;
+                  }
+                }
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
+      else if (strcmp(av[i], "--threads") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                KBase::ThreadPool::setGlobalThreads(std::stoi(av[i]));
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
       else if (strcmp(av[i], "--ra") == 0) {
         randAccP = true;
       }
@@ -144,6 +939,18 @@ int main(int ac, char **av) {
       else if (strcmp(av[i], "--logmin") == 0) {
         logMin = true;
       }
+      else if (strcmp(av[i], "--log") == 0) {
+        i++;
+        if (av[i] != NULL)
+        {
+                logClauses.push_back(av[i]);
+        }
+        else
+        {
+                run = false;
+                break;
+        }
+      }
       else if (strcmp(av[i], "--savehist") == 0) {
         saveHist = true;
       }
@@ -172,12 +979,28 @@ int main(int ac, char **av) {
   {
     sqlFlags = {true,false,false,false,true};
   }
+  KBase::LogPolicy logPolicy(sqlFlags);
+  try {
+    for (auto & c : logClauses) {
+      logPolicy.apply(c);
+    }
+  }
+  catch (KBase::KException & ke) {
+    printf("%s\n", ke.msg.c_str());
+    run = false;
+  }
 
   if (!run) {
     showHelp();
     return 0;
   }
 
+#ifdef SIGUSR1
+  if (!runOpts.checkpointFile.empty()) {
+    std::signal(SIGUSR1, KBase::Model::requestCheckpoint);
+  }
+#endif
+
   // Set logging configuration from a file
   //SMPLib::SMPModel::configLogger("./smpc-logger.conf");
   KBase::Model::configLogger("./smpc-logger.conf");
@@ -201,6 +1024,22 @@ int main(int ac, char **av) {
       seed = KBase::dSeed;
   }
 
+  // the COPY check needs no database, so it comes before logging in to one
+  if (copyCheckP) {
+    try {
+      DemoSMP::checkPgCopy(copyCheckN, seed);
+    }
+    catch (KBase::KException & ke) {
+      LOG(INFO) << "Exception caught in checkPgCopy:" << ke.msg;
+    }
+    const bool more = euSmpP || csvP || xmlP || allocsP || pceBenchP || coalBenchP
+                      || ueBenchP || stallBenchP || regenP;
+    if (connstr.empty() && (!more)) {
+      KBase::displayProgramEnd(sTime);
+      return 0;
+    }
+  }
+
   bool checkCredentials = SMPLib::SMPModel::loginCredentials(connstr);
   if (!checkCredentials) { // Some error with input credentials
     LOG(INFO) << KBase::Model::getLastError();
@@ -218,21 +1057,218 @@ int main(int ac, char **av) {
       LOG(INFO) << "Exception caught in randomSMP. Check previous messages for error";
     }
   }
-  if (csvP) {
-    string scenid = SMPLib::SMPModel::runModel(sqlFlags, inputCSV, seed, saveHist);
+  if (allocsP) {
+    try {
+      DemoSMP::countSMPAllocs(allocsN, seed);
+    }
+    catch (...) {
+      LOG(INFO) << "Exception caught in countSMPAllocs. Check previous messages for error";
+    }
+  }
+  if (pceBenchP) {
+    try {
+      DemoSMP::benchPCE(pceBenchN, seed);
+    }
+    catch (...) {
+      LOG(INFO) << "Exception caught in benchPCE. Check previous messages for error";
+    }
+  }
+  if (coalBenchP) {
+    try {
+      DemoSMP::benchCoalitions(coalBenchN, seed);
+    }
+    catch (...) {
+      LOG(INFO) << "Exception caught in benchCoalitions. Check previous messages for error";
+    }
+  }
+  if (ueBenchP) {
+    try {
+      DemoSMP::benchUEIndices(ueBenchN, seed);
+    }
+    catch (...) {
+      LOG(INFO) << "Exception caught in benchUEIndices. Check previous messages for error";
+    }
+  }
+  if (stallBenchP) {
+    try {
+      SMPLib::SMPModel::benchStalledTurn(stallBenchN, seed, { false, false, false, false, false });
+    }
+    catch (KBase::KException & ke) {
+      LOG(INFO) << "Exception caught in benchStalledTurn:" << ke.msg;
+    }
+  }
+  // each fork shares the turns before its own with the run just made
+  auto runForks = [&forks]() {
+    for (auto & fs : forks) {
+      auto edit = [fs](SMPLib::SMPModel * fk) {
+        if (fs.actor >= fk->numAct) {
+          throw KBase::KException("--fork: there is no actor " + std::to_string(fs.actor));
+        }
+        auto ai = ((SMPLib::SMPActor*)(fk->actrs[fs.actor]));
+        ai->sCap = fs.capFactor * ai->sCap;
+        return;
+      };
+      auto t0 = std::chrono::steady_clock::now();
+      string forkid = SMPLib::SMPModel::runFork(fs.turn, edit);
+      double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      if (forkid.empty()) {
+        LOG(INFO) << "Error: " << KBase::Model::getLastError();
+      }
+      else {
+        LOG(INFO) << KBase::getFormattedString(
+          "Fork %s from turn %u, actor %u capability x%.3f: %.2f seconds",
+          forkid.c_str(), fs.turn, fs.actor, fs.capFactor, dt);
+      }
+    }
+    return;
+  };
+
+  // several runs of the same input, at once, through the re-entrant interface
+  auto runConcurrently = [&logPolicy, &runOpts, seed, saveHist, concurrentRuns](const string & input) {
+    const std::vector<string> inputs(concurrentRuns, input);
+    auto t0 = std::chrono::steady_clock::now();
+    auto runs = SMPLib::SMPModel::runScenarios(logPolicy, inputs, seed, saveHist, {}, 0, runOpts);
+    double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    unsigned int nOK = 0;
+    for (auto & r : runs) {
+      if (r.ok()) {
+        nOK++;
+        LOG(INFO) << "Scenario" << r.scenarioID << "took" << r.iterationCount() << "states";
+      }
+      else {
+        LOG(INFO) << "Error: " << r.error;
+      }
+    }
+    LOG(INFO) << KBase::getFormattedString(
+      "%u of %u concurrent runs succeeded in %.2f seconds", nOK, concurrentRuns, dt);
+    return;
+  };
+
+  // many runs of the same input, varied as the --sweep clauses say
+  auto runSweep = [&](const string & input) {
+    const string out = sweepOut.empty() ? input.substr(0, input.find_last_of(".")) + "_sweep.csv" : sweepOut;
+    sweep.seed = (((uint64_t)-1) == seed) ? KBase::dSeed : seed;
+    sweep.maxPar = concurrentRuns;
+    sweep.fullLogs = sweepLogs;
+    sweep.logPolicy = logPolicy;
+    sweep.runOptions = runOpts;
+    auto t0 = std::chrono::steady_clock::now();
+    try {
+      const unsigned int nOK = sweep.run(input, out);
+      double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      LOG(INFO) << KBase::getFormattedString(
+        "%u of %u sweep runs succeeded in %.2f seconds; results in %s",
+        nOK, sweep.numRuns(), dt, out.c_str());
+    }
+    catch (KBase::KException &ke) {
+      LOG(INFO) << "Error: " << ke.msg;
+    }
+    return;
+  };
+
+  // replicates of the same input, summarized in order of replicate
+  auto runEnsemble = [&](const string & input) {
+    const string out = ensembleOut.empty() ? input.substr(0, input.find_last_of(".")) + "_ensemble.csv" : ensembleOut;
+    auto t0 = std::chrono::steady_clock::now();
+    try {
+      SMPLib::SMPEnsemble ens(ensembleN, (((uint64_t)-1) == seed) ? KBase::dSeed : seed);
+      ens.runOptions = runOpts;
+      const unsigned int nOK = ens.run(input, {}, concurrentRuns);
+      ens.writeSummary(out);
+      double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      LOG(INFO) << KBase::getFormattedString(
+        "%u of %u replicates succeeded in %.2f seconds; summary in %s",
+        nOK, ensembleN, dt, out.c_str());
+    }
+    catch (KBase::KException &ke) {
+      LOG(INFO) << "Error: " << ke.msg;
+    }
+    return;
+  };
+
+  // a run with checkpoints, and the same run resumed from the last of them
+  auto runResumeCheck = [&](const string & input) {
+    try {
+      DemoSMP::checkResume(logPolicy, input, seed, resumeCheckN, runOpts);
+    }
+    catch (KBase::KException &ke) {
+      LOG(INFO) << "Error: " << ke.msg;
+    }
+    return;
+  };
+
+  // the same replicates, one at a time and several at once
+  auto runEnsembleCheck = [&](const string & input) {
+    try {
+      DemoSMP::checkEnsemble(input, ensembleCheckN, (((uint64_t)-1) == seed) ? KBase::dSeed : seed,
+                             concurrentRuns, runOpts);
+    }
+    catch (KBase::KException &ke) {
+      LOG(INFO) << "Error: " << ke.msg;
+    }
+    return;
+  };
+
+  if (csvP && (0 < resumeCheckN)) {
+    runResumeCheck(inputCSV);
+  }
+  else if (csvP && (0 < ensembleCheckN)) {
+    runEnsembleCheck(inputCSV);
+  }
+  else if (csvP && (0 < ensembleN)) {
+    runEnsemble(inputCSV);
+  }
+  else if (csvP && sweepP) {
+    runSweep(inputCSV);
+  }
+  else if (csvP && (1 < concurrentRuns)) {
+    runConcurrently(inputCSV);
+  }
+  else if (csvP) {
+    string scenid = SMPLib::SMPModel::runModel(logPolicy, inputCSV, seed, saveHist, {}, runOpts);
     if (scenid.empty()) {
       LOG(INFO) << "Error: " << KBase::Model::getLastError();
     }
+    else {
+      runForks();
+    }
     SMPLib::SMPModel::destroyModel();
   }
-  if (xmlP) {
-    string scenid = SMPLib::SMPModel::runModel(sqlFlags, inputXML, seed, saveHist);
+  if (xmlP && (0 < resumeCheckN)) {
+    runResumeCheck(inputXML);
+  }
+  else if (xmlP && (0 < ensembleCheckN)) {
+    runEnsembleCheck(inputXML);
+  }
+  else if (xmlP && (0 < ensembleN)) {
+    runEnsemble(inputXML);
+  }
+  else if (xmlP && sweepP) {
+    runSweep(inputXML);
+  }
+  else if (xmlP && (1 < concurrentRuns)) {
+    runConcurrently(inputXML);
+  }
+  else if (xmlP) {
+    string scenid = SMPLib::SMPModel::runModel(logPolicy, inputXML, seed, saveHist, {}, runOpts);
     if (scenid.empty()) {
       LOG(INFO) << "Error: " << KBase::Model::getLastError();
     }
+    else {
+      runForks();
+    }
     SMPLib::SMPModel::destroyModel();
   }
 
+  if (regenP) {
+    try {
+      SMPLib::SMPModel::regenChlgTables(regenScenId, regenTurns);
+    }
+    catch (KBase::KException &ke) {
+      LOG(INFO) << "Error:" << ke.msg;
+    }
+  }
+
   KBase::displayProgramEnd(sTime);
   return 0;
 }
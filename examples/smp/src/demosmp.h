@@ -51,6 +51,32 @@ const string appVersion = "0.1";
 void demoActorUtils(uint64_t s, PRNG* rng);
 void demoEUSpatial(unsigned int numA, unsigned int sDim, bool accP, uint64_t s, PRNG* rng);
 
+// run a random SMP with numA actors, and report the number of heap allocations
+void countSMPAllocs(unsigned int numA, uint64_t s);
+
+// time the Markov PCE solvers on random problems with n options
+void benchPCE(unsigned int n, uint64_t s);
+
+// time and check the coalition kernels with numA actors
+void benchCoalitions(unsigned int numA, uint64_t s);
+
+// time and check the unique-position search with numA actors
+void benchUEIndices(unsigned int numA, uint64_t s);
+
+// encode numRows random rows as PgCopySink would, and check that they decode the same
+void checkPgCopy(unsigned int numRows, uint64_t s);
+
+// run the scenario in input with a checkpoint every `every` turns, resume it
+// from the last one, and check that the two runs end the same
+void checkResume(const KBase::LogPolicy & logPolicy, const string & input, uint64_t s,
+                 unsigned int every, const SMPLib::SMPRunOptions & opts);
+
+// run the given number of replicates of the scenario in input one at a time,
+// then at most maxPar at once (0: one per hardware thread), and check that
+// the two ensembles summarize the same
+void checkEnsemble(const string & input, unsigned int replicates, uint64_t s,
+                   unsigned int maxPar, const SMPLib::SMPRunOptions & opts);
+
 
 }; // end of namespace
 